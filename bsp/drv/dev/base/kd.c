@@ -50,6 +50,7 @@ static int kd_help(int, char **);
 static int kd_continue(int, char **);
 static int kd_reboot(int, char **);
 static int kd_mstat(int, char **);
+static int kd_kmem(int, char **);
 static int kd_thread(int, char **);
 static int kd_task(int, char **);
 static int kd_vm(int, char **);
@@ -73,6 +74,7 @@ static const struct cmd_entry cmd_table[] = {
 	{ "continue"	,kd_continue	,"Continue execution [c]" },
 	{ "reboot"	,kd_reboot	,"Reboot system" },
 	{ "mstat" 	,kd_mstat	,"Display memory usage" },
+	{ "kmem"	,kd_kmem	,"Display kernel object caches" },
 	{ "thread"	,kd_thread	,"Display thread information" },
 	{ "task"	,kd_task	,"Display task information" },
 	{ "vm"		,kd_vm		,"Dump all VM segments" },
@@ -207,6 +209,29 @@ kd_mstat(int argc, char **argv)
 	return 0;
 }
 
+static int
+kd_kmem(int argc, char **argv)
+{
+	struct kmeminfo ki;
+	int rc;
+
+	printf("Kernel object caches:\n");
+	printf(" name         size objs slabs  inuse   allocs    frees fails\n");
+	printf(" ------------ ---- ---- ----- ------ -------- -------- -----\n");
+
+	rc = 0;
+	ki.cookie = 0;
+	do {
+		rc = sysinfo(INFO_KMEM, &ki);
+		if (!rc) {
+			printf(" %12s %4d %4d %5d %6d %8ld %8ld %5ld\n",
+			       ki.name, (int)ki.size, ki.nobjs, ki.nslabs,
+			       ki.inuse, ki.nallocs, ki.nfrees, ki.nfails);
+		}
+	} while (rc == 0);
+	return 0;
+}
+
 static int
 kd_thread(int argc, char **argv)
 {
@@ -45,56 +45,96 @@
 static int debugflags = DBGBIT(INFO) | DBGBIT(TRACE);
 #endif
 
+/*
+ * Header of datagram buffer. It is kept in kernel memory, so
+ * that the net server can not change the links and state of
+ * the buffers owned by the driver.
+ */
 struct dbuf {
-#define DATAGRAM_HDR_MAGIC      0x9a0a
-	uint16_t        magic;
-	void            *data_start; /* address of the data buffer */
-	size_t          data_length; /* actual data length */
-	struct queue    link;
+	struct queue    link;       /* link in the dbuf pool */
+	struct dbuf     *hash_next; /* link in the hash table */
 	dbuf_state_t    state;
-	uint8_t         buf_pages;/* memory pages per datagram_buffer */
-	uint8_t         buf_align;/* alignment in buffer for performance */
+	void            *uaddr;     /* address in the net server */
+	char            *kaddr;     /* kernel address of the page */
+	size_t          data_length; /* actual data length */
 };
 
+/*
+ * Header at the top of the page, which is shared with struct
+ * dbuf_user of the net server. The kernel only reads and
+ * writes the data length here.
+ */
+struct dbuf_uhdr {
+	uint16_t        magic;
+	void            *data_start;
+	size_t          data_length;
+};
+
+#define dbuf_hash(uaddr) \
+	((int)(((vaddr_t)(uaddr) / PAGE_SIZE) & (DBUF_HASHSIZE - 1)))
+
 static int
 add_free_buf(struct net_driver *driver, dbuf_t buf)
 {
 	LOG_FUNCTION_NAME_ENTRY();
 	struct dbuf *dbuf = (struct dbuf *)buf;
-	ASSERT(dbuf->magic == DATAGRAM_HDR_MAGIC);
-	dbuf->state = DB_FREE;
 
+	sched_lock();
+	dbuf->state = DB_FREE;
 	enqueue(&driver->pool.free_list, &dbuf->link);
+	sched_unlock();
 	LOG_FUNCTION_NAME_EXIT(0);
 	return 0;
 }
 
 static int
-remove_free_buf(struct net_driver *driver, dbuf_t *buf)
+remove_free_buf(struct net_driver *driver, dbuf_t *buf, dbuf_state_t state)
 {
 	struct dbuf *dbuf;
 	queue_t q;
 
 	LOG_FUNCTION_NAME_ENTRY();
+	sched_lock();
 	q = dequeue(&driver->pool.free_list);
 	if (!q) {
+		sched_unlock();
 		LOG_FUNCTION_NAME_EXIT(ENOMEM);
 		return ENOMEM;
 	}
 	dbuf = queue_entry(q, struct dbuf, link);
+	dbuf->state = state;
+	sched_unlock();
 
 	*buf = (dbuf_t)dbuf;
 	LOG_FUNCTION_NAME_EXIT(0);
 	return 0;
 }
 
+static struct dbuf *
+dbuf_lookup(struct net_driver *driver, void *uaddr)
+{
+	struct dbuf *dbuf;
+
+	for (dbuf = driver->pool.hash[dbuf_hash(uaddr)]; dbuf != NULL;
+	     dbuf = dbuf->hash_next) {
+		if (dbuf->uaddr == uaddr)
+			return dbuf;
+	}
+	return NULL;
+}
+
 /* Interface to network coordinator */
 int
 netdrv_buf_pool_init(struct net_driver *driver)
 {
+	int i;
+
 	queue_init(&driver->pool.free_list);
 	queue_init(&driver->pool.tx_queue);
 	queue_init(&driver->pool.rx_queue);
+	for (i = 0; i < DBUF_HASHSIZE; i++)
+		driver->pool.hash[i] = NULL;
+	driver->pool.nr_bufs = 0;
 
 	return 0;
 }
@@ -108,7 +148,9 @@ netdrv_dq_rxbuf(struct net_driver *driver, dbuf_t *buf)
 
 	LOG_FUNCTION_NAME_ENTRY();
 	ASSERT(buf != NULL);
+	sched_lock();
 	n = dequeue(&driver->pool.rx_queue);
+	sched_unlock();
 	if (!n)
 		return ENOENT;
 	dbuf = queue_entry(n, struct dbuf, link);
@@ -128,7 +170,124 @@ netdrv_q_rxbuf(struct net_driver *driver, dbuf_t buf)
 int
 netdrv_dq_txbuf(struct net_driver *driver, dbuf_t *buf)
 {
-	return remove_free_buf(driver, buf);
+	return remove_free_buf(driver, buf, DB_USER);
+}
+
+/*
+ * Register a page of the net server as a datagram buffer.
+ *
+ * The page is held by the driver until the buffers are
+ * reclaimed, so that the device never accesses a page which
+ * the net server has freed.
+ */
+int
+dbuf_register(struct net_driver *driver, void *uaddr)
+{
+	struct dbuf *dbuf;
+	char *kaddr;
+	int h;
+
+	if ((vaddr_t)uaddr & PAGE_MASK)
+		return EINVAL;
+
+	sched_lock();
+	if (dbuf_lookup(driver, uaddr) != NULL) {
+		sched_unlock();
+		return EBUSY;
+	}
+	if (driver->pool.nr_bufs >= DBUF_MAX) {
+		sched_unlock();
+		return ENOMEM;
+	}
+	if ((kaddr = kmem_map(uaddr, PAGE_SIZE)) == NULL) {
+		sched_unlock();
+		return EFAULT;
+	}
+	if ((dbuf = kmem_alloc(sizeof(*dbuf))) == NULL) {
+		sched_unlock();
+		return ENOMEM;
+	}
+	page_share(kvtop(kaddr), PAGE_SIZE);
+
+	dbuf->state = DB_USER;
+	dbuf->uaddr = uaddr;
+	dbuf->kaddr = kaddr;
+	dbuf->data_length = 0;
+	h = dbuf_hash(uaddr);
+	dbuf->hash_next = driver->pool.hash[h];
+	driver->pool.hash[h] = dbuf;
+	driver->pool.nr_bufs++;
+	sched_unlock();
+	return 0;
+}
+
+/*
+ * Release all buffers of the driver. The device must be
+ * stopped before, so that it does not access the pages.
+ */
+void
+dbuf_reclaim(struct net_driver *driver)
+{
+	struct dbuf *dbuf, *next;
+	int i;
+
+	sched_lock();
+	for (i = 0; i < DBUF_HASHSIZE; i++) {
+		for (dbuf = driver->pool.hash[i]; dbuf != NULL;
+		     dbuf = next) {
+			next = dbuf->hash_next;
+			page_free(kvtop(dbuf->kaddr), PAGE_SIZE);
+			kmem_free(dbuf);
+		}
+	}
+	netdrv_buf_pool_init(driver);
+	sched_unlock();
+}
+
+/*
+ * Get the buffer registered for the address passed by the net
+ * server. The buffer must be owned by the net server.
+ */
+int
+dbuf_import(struct net_driver *driver, void *uaddr, dbuf_t *buf)
+{
+	struct dbuf *dbuf;
+	size_t len;
+
+	sched_lock();
+	if ((dbuf = dbuf_lookup(driver, uaddr)) == NULL) {
+		sched_unlock();
+		return EINVAL;
+	}
+	if (dbuf->state != DB_USER) {
+		sched_unlock();
+		return EBUSY;
+	}
+	len = ((struct dbuf_uhdr *)dbuf->kaddr)->data_length;
+	if (len > DBUF_DATA_SIZE) {
+		sched_unlock();
+		return EINVAL;
+	}
+	dbuf->data_length = len;
+	dbuf->state = DB_DRIVER;
+	sched_unlock();
+
+	*buf = (dbuf_t)dbuf;
+	return 0;
+}
+
+/*
+ * Pass the buffer to the net server, and return its address
+ * in the net server.
+ */
+void *
+dbuf_export(dbuf_t buf)
+{
+	struct dbuf *dbuf = (struct dbuf *)buf;
+
+	dbuf->state = DB_USER;
+	((struct dbuf_uhdr *)dbuf->kaddr)->data_length = dbuf->data_length;
+	return dbuf->uaddr;
 }
 /* end of exported API */
 
@@ -145,18 +304,23 @@ dbuf_release(struct net_driver *driver, dbuf_t buf)
 int
 dbuf_request(struct net_driver *driver, dbuf_t *buf)
 {
-	return remove_free_buf(driver, buf);
+	return remove_free_buf(driver, buf, DB_DRIVER);
 }
 
-/* add a received buffer to dbuf pool */
+/*
+ * add a received buffer to dbuf pool
+ * The driver calls netdrv_rx_done() after adding all the frames
+ * received by an interrupt.
+ */
 int
 dbuf_add(struct net_driver *driver, dbuf_t buf)
 {
 	struct dbuf *dbuf = (struct dbuf *)buf;
-	ASSERT(dbuf->magic == DATAGRAM_HDR_MAGIC);
-	dbuf->state = DB_READY;
 
+	sched_lock();
+	dbuf->state = DB_READY;
 	enqueue(&driver->pool.rx_queue, &dbuf->link);
+	sched_unlock();
 	return 0;
 }
 
@@ -164,23 +328,26 @@ paddr_t
 dbuf_get_paddr(dbuf_t buf)
 {
 	struct dbuf *dbuf = (struct dbuf *)buf;
-	ASSERT(dbuf->magic == DATAGRAM_HDR_MAGIC);
-	return kvtop(dbuf->data_start);
+	return kvtop(dbuf->kaddr + DBUF_DATA_OFFSET);
+}
+
+void *
+dbuf_get_data(dbuf_t buf)
+{
+	struct dbuf *dbuf = (struct dbuf *)buf;
+	return dbuf->kaddr + DBUF_DATA_OFFSET;
 }
 
 size_t
 dbuf_get_size(dbuf_t buf)
 {
-	struct dbuf *dbuf = (struct dbuf *)buf;
-	ASSERT(dbuf->magic == DATAGRAM_HDR_MAGIC);
-	return dbuf->buf_pages * PAGE_SIZE;
+	return DBUF_DATA_SIZE;
 }
 
 size_t
 dbuf_get_data_length(dbuf_t buf)
 {
 	struct dbuf *dbuf = (struct dbuf *)buf;
-	ASSERT(dbuf->magic == DATAGRAM_HDR_MAGIC);
 	return dbuf->data_length;
 }
 
@@ -188,7 +355,6 @@ void
 dbuf_set_data_length(dbuf_t buf, uint16_t length)
 {
 	struct dbuf *dbuf = (struct dbuf *)buf;
-	ASSERT(dbuf->magic == DATAGRAM_HDR_MAGIC);
 	dbuf->data_length = length;
 }
 /* end of DDI interface */
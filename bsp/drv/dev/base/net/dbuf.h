@@ -5,28 +5,41 @@ struct net_driver;
 #include <sys/queue.h>
 /*
  * For efficiency, all datagram reported from data-link layer is
- * memory mapped.
+ * memory mapped. A datagram buffer is a page of the net server,
+ * and the driver accesses it through its kernel address. The
+ * header of the buffer, which links it in the driver queues,
+ * is kept in the kernel.
  *
  * From the user point of view, following steps should be taken
  * to transfer and receive frames:
  *
  * - open /dev/netc, the net coordinator.
- * - query the network interface(s) via devctl(NC_QUERY_NETIF).
+ * - query the network interface(s) via ioctl(NETIO_QUERY_NR_IF).
  * - open the network interface(s), e.g. /dev/netX.
- * - request buffer for datagram_queue via ioctl(DQ_REQUEST_BUF).
- *   (you need to allocate two datagram_queues, one for tx, and the
- *   other for rx)
- * - initial each allocated buffer.
- * - for transmit, full data in buffer(s), then queue the buffer
- *   via ioctl(DQ_QUEUE_BUF).
- * - after transmission, net coordinator will change buffer state to
- *   free, then it can be recycled via ioctl(DQ_DEQUEUE_BUF).
- * - for receive, the operation is reversed.
+ * - register all buffers via ioctl(NETIO_REG_BATCH). The pages
+ *   are held by the driver until the interface is closed or the
+ *   net server exits. The buffers are identified by their
+ *   addresses, and unregistered addresses are rejected.
+ * - give free buffers to the pool via ioctl(NETIO_RX_QBATCH).
+ *   The driver loads them to its receive ring.
+ * - for receive, get the received buffers via
+ *   ioctl(NETIO_RX_DQBATCH). It sleeps until a frame arrives,
+ *   and returns all frames received by then.
+ * - for transmit, get free buffers via ioctl(NETIO_TX_DQBATCH),
+ *   fill data in the buffers, then queue them via
+ *   ioctl(NETIO_TX_QBATCH).
+ * - after transmission, the driver returns the buffer to the
+ *   free pool, and it is recycled for receive or transmit.
+ *
+ * The single buffer versions, NETIO_{RX,TX}_{Q,DQ}BUF, are also
+ * available.
  */
 
 typedef enum dbuf_state {
-	DB_FREE         = 0x0001,
-	DB_READY        = 0x0002,
+	DB_USER         = 0x0000,	/* owned by the net server */
+	DB_FREE         = 0x0001,	/* in the free pool */
+	DB_READY        = 0x0002,	/* received frame */
+	DB_DRIVER       = 0x0004,	/* owned by the driver */
 } dbuf_state_t;
 
 __BEGIN_DECLS
@@ -34,6 +47,10 @@ int netdrv_buf_pool_init(struct net_driver *);
 int netdrv_q_rxbuf(struct net_driver *, dbuf_t);
 int netdrv_dq_rxbuf(struct net_driver *, dbuf_t *);
 int netdrv_dq_txbuf(struct net_driver *, dbuf_t *);
+int dbuf_register(struct net_driver *, void *);
+void dbuf_reclaim(struct net_driver *);
+int dbuf_import(struct net_driver *, void *, dbuf_t *);
+void *dbuf_export(dbuf_t);
 __END_DECLS
 
 #endif /* _DBUF_H_ */
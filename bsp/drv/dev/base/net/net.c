@@ -53,12 +53,14 @@ static int net_close(device_t);
 static int net_ioctl(device_t, u_long, void *);
 static int net_devctl(device_t, u_long, void *);
 static int net_init(struct driver *);
+static void net_release(struct net_driver *);
 
 struct net_softc {
 	device_t		net_devs[MAX_NET_DEVS];
 	struct net_driver	*net_drvs[MAX_NET_DEVS];
 	int			nrdevs;
 	int			isopen;
+	task_t			owner;
 };
 static struct net_softc *net_softc;
 static struct list netdrv_list = LIST_INIT(netdrv_list);
@@ -153,6 +155,7 @@ static int net_open(device_t dev, int mode)
 			return EBUSY;
 		else {
 			nc->isopen = 1;
+			nc->owner = task_self();
 			return 0;
 		}
 	} else {
@@ -161,6 +164,7 @@ static int net_open(device_t dev, int mode)
 		if (drv->isopen)
 			return EBUSY;
 		drv->isopen = 1;
+		drv->owner = task_self();
 	}
 
 	return 0;
@@ -178,18 +182,68 @@ static int net_close(device_t dev)
 	} else {
 		struct net_driver *drv =
 			nc->net_drvs[id];
-		drv->isopen = 0;
+		if (drv->isopen)
+			net_release(drv);
 	}
 
 	return 0;
 }
 
+/*
+ * Stop the device and reclaim all buffers of the net server.
+ */
+static void
+net_release(struct net_driver *nd)
+{
+
+	nd->ops->stop(nd);
+	dbuf_reclaim(nd);
+	nd->isopen = 0;
+	nd->owner = 0;
+	sched_wakeup(&nd->rx_event);
+}
+
+/*
+ * Wait for received frames and pass up to max of them to the
+ * net server.
+ */
+static int
+net_rx_dqbatch(struct net_driver *nd, struct dbuf_batch *batch, int max)
+{
+	dbuf_t dbuf;
+	int rc;
+
+	batch->count = 0;
+	sched_lock();
+	while (netdrv_dq_rxbuf(nd, &dbuf)) {
+		rc = sched_sleep(&nd->rx_event);
+		if (rc == SLP_INTR) {
+			sched_unlock();
+			return EINTR;
+		}
+		if (!nd->isopen) {
+			/* the device was closed */
+			sched_unlock();
+			return EBADF;
+		}
+	}
+	do {
+		batch->bufs[batch->count++] = dbuf_export(dbuf);
+	} while (batch->count < max && netdrv_dq_rxbuf(nd, &dbuf) == 0);
+	sched_unlock();
+	return 0;
+}
+
 static int net_ioctl(device_t dev, u_long cmd, void *args)
 {
 	int id = get_id_from_device(dev);
 	struct net_softc *nc = net_softc;
 	struct net_driver *nd = nc->net_drvs[id];
+	struct dbuf_batch batch;
+	struct net_if_caps caps;
 	dbuf_t dbuf;
+	void *uaddr;
+	int i, error;
 
 	LOG_FUNCTION_NAME_ENTRY();
 	if (!task_capable(CAP_NETWORK))
@@ -200,7 +254,12 @@ static int net_ioctl(device_t dev, u_long cmd, void *args)
 		if (copyout(&nc->nrdevs, args, sizeof(nc->nrdevs)))
 			return EFAULT;
 		break;
-	case NETIO_GET_IF_CAPS:	
+	case NETIO_GET_IF_CAPS:
+		caps.type = nd->interface;
+		caps.mtu = nd->mtu;
+		memcpy(caps.hwaddr, nd->hwaddr, sizeof(caps.hwaddr));
+		if (copyout(&caps, args, sizeof(caps)))
+			return EFAULT;
 		break;
 	case NETIO_GET_STATUS:
 		break;
@@ -211,25 +270,108 @@ static int net_ioctl(device_t dev, u_long cmd, void *args)
 		nd->ops->stop(nd);
 		break;
 	case NETIO_TX_QBUF:
-		if (copyin(args, &dbuf, sizeof(dbuf_t)))
+		if (copyin(args, &uaddr, sizeof(uaddr)))
 			return EFAULT;
-		nd->ops->transmit(nd, dbuf);
-		break;
+		if ((error = dbuf_import(nd, uaddr, &dbuf)) != 0)
+			return error;
+		if ((error = nd->ops->transmit(nd, dbuf)) != 0)
+			dbuf_export(dbuf);
+		return error;
 	case NETIO_RX_QBUF:
-		if (copyin(args, &dbuf, sizeof(dbuf_t)))
+		if (copyin(args, &uaddr, sizeof(uaddr)))
 			return EFAULT;
+		if ((error = dbuf_import(nd, uaddr, &dbuf)) != 0)
+			return error;
 		netdrv_q_rxbuf(nd, dbuf);
+		if (nd->ops->rxfill)
+			nd->ops->rxfill(nd);
 		break;
 	case NETIO_TX_DQBUF:
 		if (netdrv_dq_txbuf(nd, &dbuf))
 			return ENOMEM;
-		if (copyout(&dbuf, args, sizeof(dbuf_t)))
+		uaddr = dbuf_export(dbuf);
+		if (copyout(&uaddr, args, sizeof(uaddr)))
 			return EFAULT;
 		break;
 	case NETIO_RX_DQBUF:
 		if (netdrv_dq_rxbuf(nd, &dbuf))
 			return ENOMEM;
-		if (copyout(&dbuf, args, sizeof(dbuf_t)))
+		uaddr = dbuf_export(dbuf);
+		if (copyout(&uaddr, args, sizeof(uaddr)))
+			return EFAULT;
+		break;
+	case NETIO_REG_BATCH:
+		if (nd->owner != task_self())
+			return EPERM;
+		if (copyin(args, &batch, sizeof(batch)))
+			return EFAULT;
+		if (batch.count < 0 || batch.count > NETIO_MAXBATCH)
+			return EINVAL;
+		for (i = 0; i < batch.count; i++) {
+			if ((error = dbuf_register(nd, batch.bufs[i])) != 0)
+				return error;
+		}
+		break;
+	case NETIO_RX_QBATCH:
+		if (copyin(args, &batch, sizeof(batch)))
+			return EFAULT;
+		if (batch.count < 0 || batch.count > NETIO_MAXBATCH)
+			return EINVAL;
+		for (i = 0; i < batch.count; i++) {
+			error = dbuf_import(nd, batch.bufs[i], &dbuf);
+			if (error)
+				return error;
+			netdrv_q_rxbuf(nd, dbuf);
+		}
+		if (nd->ops->rxfill)
+			nd->ops->rxfill(nd);
+		break;
+	case NETIO_TX_QBATCH:
+		/*
+		 * Transmit the buffers until the ring is full, and
+		 * return the number of buffers accepted.
+		 */
+		if (copyin(args, &batch, sizeof(batch)))
+			return EFAULT;
+		if (batch.count < 0 || batch.count > NETIO_MAXBATCH)
+			return EINVAL;
+		error = 0;
+		for (i = 0; i < batch.count; i++) {
+			error = dbuf_import(nd, batch.bufs[i], &dbuf);
+			if (error)
+				break;
+			if ((error = nd->ops->transmit(nd, dbuf)) != 0) {
+				dbuf_export(dbuf);
+				break;
+			}
+		}
+		batch.count = i;
+		if (copyout(&batch.count, args, sizeof(batch.count)))
+			return EFAULT;
+		if (i == 0)
+			return error;
+		break;
+	case NETIO_RX_DQBATCH:
+	case NETIO_TX_DQBATCH:
+		if (copyin(&((struct dbuf_batch *)args)->count, &batch.count,
+			   sizeof(batch.count)))
+			return EFAULT;
+		if (batch.count <= 0 || batch.count > NETIO_MAXBATCH)
+			return EINVAL;
+		if (cmd == NETIO_RX_DQBATCH) {
+			if ((error = net_rx_dqbatch(nd, &batch,
+						    batch.count)) != 0)
+				return error;
+		} else {
+			i = batch.count;
+			batch.count = 0;
+			while (batch.count < i &&
+			       netdrv_dq_txbuf(nd, &dbuf) == 0)
+				batch.bufs[batch.count++] = dbuf_export(dbuf);
+			if (batch.count == 0)
+				return ENOMEM;
+		}
+		if (copyout(&batch, args, sizeof(batch)))
 			return EFAULT;
 		break;
 	default:
@@ -241,6 +383,23 @@ static int net_ioctl(device_t dev, u_long cmd, void *args)
 
 static int net_devctl(device_t dev, u_long cmd, void *args)
 {
+	int id = get_id_from_device(dev);
+	struct net_softc *nc = net_softc;
+	struct net_driver *nd;
+
+	switch (cmd) {
+	case DEVCTL_TASK_EXIT:
+		/* release the device of the terminated net server */
+		if (id == 0xff) {
+			if (nc->isopen && nc->owner == (task_t)args)
+				nc->isopen = 0;
+			break;
+		}
+		nd = nc->net_drvs[id];
+		if (nd != NULL && nd->isopen && nd->owner == (task_t)args)
+			net_release(nd);
+		break;
+	}
 	return 0;
 }
 
@@ -258,6 +417,8 @@ netdrv_attach(struct netdrv_ops *ops, struct driver *driver,
 	nd->interface = type;
 	nd->driver = driver;
 	nd->ops = ops;
+	nd->mtu = 1500;
+	event_init(&nd->rx_event, "net rx");
 	list_init(&nd->link);
 	list_insert(&netdrv_list, &nd->link);
 	return 0;
@@ -271,3 +432,25 @@ netdrv_private(struct net_driver *driver)
 	dev = nc->net_devs[driver->id];
 	return device_private(dev);
 }
+
+/*
+ * Set the MAC address and MTU reported to the net server.
+ */
+void
+netdrv_set_caps(struct net_driver *driver, const uint8_t *hwaddr, int mtu)
+{
+
+	memcpy(driver->hwaddr, hwaddr, sizeof(driver->hwaddr));
+	driver->mtu = mtu;
+}
+
+/*
+ * Wake up the net server waiting for received frames. The driver
+ * calls this once after adding the frames of an interrupt.
+ */
+void
+netdrv_rx_done(struct net_driver *driver)
+{
+
+	sched_wakeup(&driver->rx_event);
+}
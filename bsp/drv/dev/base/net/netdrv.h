@@ -34,10 +34,17 @@
 #include <net.h>
 #include <sys/queue.h>
 
+#define DBUF_HASHSIZE	64	/* size of dbuf hash table */
+#define DBUF_MAX	256	/* max buffers per device */
+
+struct dbuf;
+
 struct dbuf_pool {
 	struct queue    free_list;
 	struct queue    rx_queue;
 	struct queue    tx_queue;
+	struct dbuf	*hash[DBUF_HASHSIZE]; /* registered buffers */
+	int		nr_bufs;
 };
 
 struct net_driver {
@@ -49,8 +56,12 @@ struct net_driver {
 
 	/* per-device dbuf pool */
 	struct dbuf_pool	pool;
+	struct event		rx_event;	/* frames received */
 
 	int		isopen;
+	task_t		owner;		/* task which opened device */
+	int		mtu;		/* max transfer unit */
+	uint8_t		hwaddr[6];	/* MAC address */
 };
 
 #endif
@@ -195,6 +195,18 @@ tty_start(struct tty *tp)
 		(*tp->t_oproc)(tp);
 }
 
+/*
+ * Wake up the readers of the input, and advance the input
+ * sequence for TIOCWAIT. The sequence is never negative.
+ */
+static void
+tty_inevent(struct tty *tp)
+{
+
+	tp->t_inseq = (tp->t_inseq + 1) & 0x7fffffff;
+	sched_wakeup(&tp->t_input);
+}
+
 /*
  * Flush tty read and/or write queues, notifying anyone waiting.
  */
@@ -209,7 +221,7 @@ tty_flush(struct tty *tp, int rw)
 			;
 		while (tty_getc(&tp->t_rawq) != -1)
 			;
-		sched_wakeup(&tp->t_input);
+		tty_inevent(tp);
 	}
 	if (rw & FWRITE) {
 		tp->t_state &= ~TS_TTSTOP;
@@ -368,10 +380,10 @@ tty_input(int c, struct tty *tp)
 	if (lflag & ICANON) {
 		if (c == '\n' || c == cc[VEOF] || c == cc[VEOL]) {
 			tty_catq(&tp->t_rawq, &tp->t_canq);
-			sched_wakeup(&tp->t_input);
+			tty_inevent(tp);
 		}
 	} else
-		sched_wakeup(&tp->t_input);
+		tty_inevent(tp);
 
 	if (lflag & ECHO)
 		tty_echo(c, tp);
@@ -529,7 +541,7 @@ tty_write(struct tty *tp, char *buf, size_t *nbyte)
 int
 tty_ioctl(struct tty *tp, u_long cmd, void *data)
 {
-	int flags;
+	int flags, seq, rc;
 	struct tty_queue *qp;
 
 	switch (cmd) {
@@ -600,6 +612,22 @@ tty_ioctl(struct tty *tp, u_long cmd, void *data)
 		if (copyout(&tp->t_outq.tq_count, data, sizeof(int)))
 			return EFAULT;
 		break;
+	case TIOCWAIT:		/* Prex */
+		/*
+		 * Block until the input sequence moves away from
+		 * the value passed in, and return the new one.
+		 * A negative value gets the sequence at once.
+		 */
+		if (copyin(data, &seq, sizeof(int)))
+			return EFAULT;
+		while (tp->t_inseq == seq) {
+			rc = sched_sleep(&tp->t_input);
+			if (rc == SLP_INTR)
+				return EINTR;
+		}
+		if (copyout(&tp->t_inseq, data, sizeof(int)))
+			return EFAULT;
+		break;
 	}
 	return 0;
 }
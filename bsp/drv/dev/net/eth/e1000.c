@@ -30,7 +30,7 @@
 
 /* e1000.c - device driver for Intel EEpro1000 NIC */
 
-#define	DBG
+/* #define DBG */
 #define MODULE_NAME	"e1000"
 
 #include <driver.h>
@@ -65,8 +65,11 @@ struct e1000_adaptor {
 	struct e1000_rx_desc *rx_desc;
 	dbuf_t		*rx_bufs;
 	dbuf_t		*tx_bufs;
-	int		rx_ptr;
-	int		tx_ptr;
+	int		rx_ptr;		/* next rx descriptor to harvest */
+	int		rx_tail;	/* next rx descriptor to fill */
+	int		tx_ptr;		/* next tx descriptor to release */
+	int		tx_tail;	/* next tx descriptor to use */
+	uint32_t	icr;		/* interrupt causes for IST */
 
 	struct e1000_hw	hw;
 };
@@ -74,6 +77,7 @@ struct e1000_adaptor {
 /* forward declaration */
 static int e1000_alloc_iodesc(struct e1000_adaptor *);
 static int e1000_isr(void *);
+static void e1000_ist(void *);
 static void e1000_fill_rx_buffer(struct e1000_adaptor *);
 
 /* driver layer operations */
@@ -85,6 +89,7 @@ static int e1000_net_init(struct net_driver *);
 static int e1000_net_start(struct net_driver *);
 static int e1000_net_stop(struct net_driver *);
 static int e1000_transmit(struct net_driver *, dbuf_t);
+static int e1000_rxfill(struct net_driver *);
 
 /* global definitions */
 static list_t pci_device_list; /* list of pci devices probed */
@@ -104,6 +109,7 @@ static struct netdrv_ops e1000_netdrv_ops = {
 	/* start */	e1000_net_start,
 	/* stop */	e1000_net_stop,
 	/* transmit */	e1000_transmit,
+	/* rxfill */	e1000_rxfill,
 };
 
 static int
@@ -170,6 +176,8 @@ e1000_net_init(struct net_driver *self)
 	struct pci_func *f;
 	struct e1000_adaptor *adaptor;
 	struct e1000_hw *hw;
+	uint32_t ral, rah;
+	uint8_t hwaddr[6];
 
 	f = to_pci_func(pci_device_list);
 	if (pci_func_configure(f) != 0) {
@@ -198,11 +206,23 @@ e1000_net_init(struct net_driver *self)
 	e1000_alloc_iodesc(adaptor);
 
 	adaptor->irq = irq_attach(hw->irqline, IPL_NET, 0,
-				  e1000_isr, IST_NONE, adaptor);
+				  e1000_isr, e1000_ist, adaptor);
 
-	/* add braodcast address to rx filter */
-	ew32_p(RA, 0xffffffff, 0);
-	ew32_p(RA, 0xffff | E1000_RAH_AV, 1);
+	/*
+	 * The MAC address is loaded from EEPROM to the first
+	 * receive address register at reset. Broadcast frames are
+	 * accepted by RCTL.BAM.
+	 */
+	ral = er32_p(RA, 0);
+	rah = er32_p(RA, 1);
+	hwaddr[0] = ral & 0xff;
+	hwaddr[1] = (ral >> 8) & 0xff;
+	hwaddr[2] = (ral >> 16) & 0xff;
+	hwaddr[3] = (ral >> 24) & 0xff;
+	hwaddr[4] = rah & 0xff;
+	hwaddr[5] = (rah >> 8) & 0xff;
+	ew32_p(RA, rah | E1000_RAH_AV, 1);
+	netdrv_set_caps(self, hwaddr, 1500);
 
 	return 0;
 }
@@ -212,67 +232,85 @@ e1000_link_changed(struct e1000_adaptor *adaptor)
 {
 }
 
-/* load as many rx buffers as possible */
+/*
+ * Load as many rx buffers as possible. One descriptor is always
+ * left empty so that a full ring is not taken as an empty one.
+ */
 static void
 e1000_fill_rx_buffer(struct e1000_adaptor *adaptor)
 {
 	struct e1000_hw *hw = &adaptor->hw;
-	int tail = er32(RDT);
-	int head = er32(RDH);
+	struct e1000_rx_desc *desc;
+	int tail, next;
 	dbuf_t dbuf;
-	struct e1000_rx_desc *desc = adaptor->rx_desc;
 
 	LOG_FUNCTION_NAME_ENTRY();
-
-	while (ENOMEM != dbuf_request(adaptor->driver, &dbuf))
-	{
-		desc[tail].buffer_addr =
-			cpu_to_le64(dbuf_get_paddr(dbuf));
-		desc[tail].length =
-			cpu_to_le16(dbuf_get_size(dbuf));
-		DPRINTF(RX, "set rx descriptor, buf=%08x, "
-			"len=%08x\n",
-			dbuf_get_paddr(dbuf),
-			dbuf_get_size(dbuf));
-		adaptor->rx_bufs[tail] = dbuf;
-		if (++tail >= adaptor->num_rx_queues)
-			tail = 0;
-		if (tail == head)
+	sched_lock();
+	tail = adaptor->rx_tail;
+	for (;;) {
+		next = (tail + 1) % adaptor->num_rx_queues;
+		if (next == adaptor->rx_ptr)
 			break;
+		if (dbuf_request(adaptor->driver, &dbuf))
+			break;
+		desc = &adaptor->rx_desc[tail];
+		desc->buffer_addr = cpu_to_le64(dbuf_get_paddr(dbuf));
+		desc->length = 0;
+		desc->status = 0;
+		desc->errors = 0;
+		adaptor->rx_bufs[tail] = dbuf;
+		tail = next;
 	}
-	ew32(RDT, tail);
+	if (tail != adaptor->rx_tail) {
+		adaptor->rx_tail = tail;
+		ew32(RDT, tail);
+	}
+	sched_unlock();
 	LOG_FUNCTION_NAME_EXIT_NORET();
 }
 
+/*
+ * Harvest all the frames received, and wake up the net server
+ * once for them.
+ */
 static int
 e1000_rx(struct e1000_adaptor *adaptor)
 {
-	struct e1000_hw *hw = &adaptor->hw;
 	struct e1000_rx_desc *desc;
 	dbuf_t rx_buf;
-	int head, rx_ptr;
-	LOG_FUNCTION_NAME_ENTRY();
+	int rx_ptr, nframes = 0;
 
-	head = er32(RDH);
+	LOG_FUNCTION_NAME_ENTRY();
+	sched_lock();
 	rx_ptr = adaptor->rx_ptr;
-
-	while (rx_ptr < head)
-	{
+	while (rx_ptr != adaptor->rx_tail) {
 		desc = &adaptor->rx_desc[rx_ptr];
-		DPRINTF(RX, "frame recevied, length=%08x\n",
-			le16_to_cpu(desc->length));
+		if (!(desc->status & E1000_RXD_STAT_DD))
+			break;
 		rx_buf = adaptor->rx_bufs[rx_ptr];
-		dbuf_set_data_length(rx_buf, le16_to_cpu(desc->length));
-		dbuf_add(adaptor->driver, rx_buf);
-
-		if (++rx_ptr >= adaptor->num_rx_queues)
-			rx_ptr = 0;
+		adaptor->rx_bufs[rx_ptr] = 0;
+		if ((desc->status & E1000_RXD_STAT_EOP) &&
+		    desc->errors == 0) {
+			DPRINTF(RX, "frame received, length=%d\n",
+				le16_to_cpu(desc->length));
+			dbuf_set_data_length(rx_buf,
+					     le16_to_cpu(desc->length));
+			dbuf_add(adaptor->driver, rx_buf);
+			nframes++;
+		} else {
+			/* drop frames spanning buffers or broken */
+			dbuf_release(adaptor->driver, rx_buf);
+		}
+		rx_ptr = (rx_ptr + 1) % adaptor->num_rx_queues;
 	}
-
 	adaptor->rx_ptr = rx_ptr;
+	sched_unlock();
 
 	/* reload rx_buffer */
 	e1000_fill_rx_buffer(adaptor);
+
+	if (nframes)
+		netdrv_rx_done(adaptor->driver);
 	LOG_FUNCTION_NAME_EXIT(0);
 	return 0;
 }
@@ -280,48 +318,74 @@ e1000_rx(struct e1000_adaptor *adaptor)
 static int
 e1000_release_tx_buffer(struct e1000_adaptor *adaptor)
 {
-	struct e1000_hw *hw = &adaptor->hw;
-	dbuf_t tx_buf;
-	int head, tx_ptr;
+	struct e1000_tx_desc *desc;
+	int tx_ptr;
 
 	LOG_FUNCTION_NAME_ENTRY();
-	head = er32(TDH);
-	while (tx_ptr < head)
-	{
-		tx_buf = adaptor->tx_bufs[tx_ptr];
-		dbuf_release(adaptor->driver, tx_buf);
-
-		if (++tx_ptr >= adaptor->num_rx_queues)
-			tx_ptr = 0;
+	sched_lock();
+	tx_ptr = adaptor->tx_ptr;
+	while (tx_ptr != adaptor->tx_tail) {
+		desc = &adaptor->tx_desc[tx_ptr];
+		if (!(desc->upper.fields.status & E1000_TXD_STAT_DD))
+			break;
+		dbuf_release(adaptor->driver, adaptor->tx_bufs[tx_ptr]);
+		adaptor->tx_bufs[tx_ptr] = 0;
+		tx_ptr = (tx_ptr + 1) % adaptor->num_tx_queues;
 	}
-
 	adaptor->tx_ptr = tx_ptr;
+	sched_unlock();
 	LOG_FUNCTION_NAME_EXIT(0);
 	return 0;
 }
 
+/*
+ * Interrupt service routine. It only saves the interrupt
+ * causes, and the rings are processed by IST.
+ */
 static int
 e1000_isr(void *args)
 {
 	struct e1000_adaptor *adaptor = args;
 	struct e1000_hw *hw = &adaptor->hw;
 	uint32_t cause;
-	LOG_FUNCTION_NAME_ENTRY();
 
 	/* Read the Interrupt Cause Read register. */
-	if ((cause = er32(ICR)))
-	{   
-		if (cause & E1000_ICR_LSC)
-			e1000_link_changed(adaptor);
+	if ((cause = er32(ICR)) == 0)
+		return INT_DONE;
+	adaptor->icr |= cause;
+	return INT_CONTINUE;
+}
 
-		if (cause & (E1000_ICR_RXO | E1000_ICR_RXT0))
-			e1000_rx(adaptor);
+/*
+ * Interrupt service thread.
+ */
+static void
+e1000_ist(void *args)
+{
+	struct e1000_adaptor *adaptor = args;
+	uint32_t cause;
+	int s;
 
-		if ((cause & E1000_ICR_TXQE) ||
-				(cause & E1000_ICR_TXDW))
-			e1000_release_tx_buffer(adaptor);
-	}
-	LOG_FUNCTION_NAME_EXIT(0);
+	s = splhigh();
+	cause = adaptor->icr;
+	adaptor->icr = 0;
+	splx(s);
+
+	if (cause & E1000_ICR_LSC)
+		e1000_link_changed(adaptor);
+
+	if (cause & (E1000_ICR_TXQE | E1000_ICR_TXDW))
+		e1000_release_tx_buffer(adaptor);
+
+	if (cause & (E1000_ICR_RXO | E1000_ICR_RXT0 | E1000_ICR_RXDMT0))
+		e1000_rx(adaptor);
+}
+
+static int
+e1000_rxfill(struct net_driver *self)
+{
+
+	e1000_fill_rx_buffer(netdrv_private(self));
 	return 0;
 }
 
@@ -340,26 +404,65 @@ e1000_net_start(struct net_driver *self)
 
 	/* start RX & TX engine */
 	rctl = er32(RCTL);
-	/* TODO: should depend on requested buffer size */
-	rctl |= E1000_RCTL_EN | E1000_RCTL_BSEX | E1000_RCTL_SZ_4096;
+	/* a dbuf holds DBUF_DATA_SIZE bytes of frame */
+	rctl &= ~(E1000_RCTL_BSEX | E1000_RCTL_SZ_4096);
+	rctl |= E1000_RCTL_EN | E1000_RCTL_BAM | E1000_RCTL_SZ_2048 |
+		E1000_RCTL_SECRC;
 	ew32(RCTL, rctl);
 	tctl = er32(TCTL);
-	tctl |= E1000_TCTL_EN | E1000_TCTL_PSP;
+	tctl &= ~(E1000_TCTL_CT | E1000_TCTL_COLD);
+	tctl |= E1000_TCTL_EN | E1000_TCTL_PSP |
+		(0x0f << E1000_CT_SHIFT) | (0x40 << E1000_COLD_SHIFT);
 	ew32(TCTL, tctl);
 
 	/* enable interrupt */
-	ims = E1000_ICR_LSC | E1000_ICR_RXO | E1000_ICR_RXT0 | 
-	      E1000_ICR_TXQE | E1000_ICR_TXDW;
+	ims = E1000_ICR_LSC | E1000_ICR_RXO | E1000_ICR_RXT0 |
+	      E1000_ICR_RXDMT0 | E1000_ICR_TXQE | E1000_ICR_TXDW;
 	ew32(IMS, ims);
 
 	LOG_FUNCTION_NAME_EXIT(0);
 	return 0;
 }
 
+/*
+ * Stop the device, and drop the buffers in the rings. The
+ * buffers are reclaimed by the net coordinator after this.
+ */
 static int
 e1000_net_stop(struct net_driver *self)
 {
+	struct e1000_adaptor *adaptor;
+	struct e1000_hw *hw;
+
 	LOG_FUNCTION_NAME_ENTRY();
+	adaptor = netdrv_private(self);
+	hw = &adaptor->hw;
+
+	sched_lock();
+	ew32(IMC, 0xffffffff);
+	ew32(RCTL, 0);
+	ew32(TCTL, E1000_TCTL_PSP);
+	er32(STATUS); /* wait for complete */
+
+	/* allow the pending DMA to complete */
+	delay_usec(10000);
+
+	memset(adaptor->rx_desc, 0,
+	       sizeof(struct e1000_rx_desc) * adaptor->num_rx_queues);
+	memset(adaptor->rx_bufs, 0, sizeof(dbuf_t) * adaptor->num_rx_queues);
+	memset(adaptor->tx_desc, 0,
+	       sizeof(struct e1000_tx_desc) * adaptor->num_tx_queues);
+	memset(adaptor->tx_bufs, 0, sizeof(dbuf_t) * adaptor->num_tx_queues);
+	ew32(RDH, 0);
+	ew32(RDT, 0);
+	ew32(TDH, 0);
+	ew32(TDT, 0);
+	adaptor->rx_ptr = 0;
+	adaptor->rx_tail = 0;
+	adaptor->tx_ptr = 0;
+	adaptor->tx_tail = 0;
+	sched_unlock();
+
 	LOG_FUNCTION_NAME_EXIT_NORET();
 	return 0;
 }
@@ -391,6 +494,7 @@ e1000_alloc_iodesc(struct e1000_adaptor *adaptor)
 	ew32(TDH, 0); /* tx descriptor head */
 	ew32(TDT, 0); /* tx descriptor tail */
 	adaptor->tx_ptr = 0;
+	adaptor->tx_tail = 0;
 
 	/* allocate rx descriptors */
 	desc_size = sizeof(struct e1000_rx_desc) *
@@ -410,6 +514,7 @@ e1000_alloc_iodesc(struct e1000_adaptor *adaptor)
 	ew32(RDH, 0); /* rx descriptor head */
 	ew32(RDT, 0); /* rx descriptor tail */
 	adaptor->rx_ptr = 0;
+	adaptor->rx_tail = 0;
 
 	return 0;
 }
@@ -425,37 +530,35 @@ e1000_transmit(struct net_driver *self, dbuf_t buf)
 {
 	struct e1000_adaptor *adaptor;
 	struct e1000_hw *hw;
-	adaptor = netdrv_private(self);
-	hw = &adaptor->hw;
-	uint32_t head, tail;
 	struct e1000_tx_desc *desc;
-	LOG_FUNCTION_NAME_ENTRY();
-
-	head = er32(TDH);
-	tail = er32(TDT);
+	int tail, next;
 
-	DPRINTF(TX, "%s(): head=%d, tail=%d\n",
-		__func__, head, tail);
+	LOG_FUNCTION_NAME_ENTRY();
+	adaptor = netdrv_private(self);
+	hw = &adaptor->hw;
 
-	if (tail == head)
+	sched_lock();
+	tail = adaptor->tx_tail;
+	next = (tail + 1) % adaptor->num_tx_queues;
+	if (next == adaptor->tx_ptr) {
+		sched_unlock();
 		return ENOMEM;
+	}
+	DPRINTF(TX, "%s(): tail=%d, len=%d\n", __func__, tail,
+		dbuf_get_data_length(buf));
 
 	desc = &adaptor->tx_desc[tail];
-
-	/* Mark this descriptor ready. */
-	desc->lower.data =
-		cpu_to_le32(E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS);
-	desc->lower.flags.length =
-		cpu_to_le16(dbuf_get_data_length(buf));
+	desc->buffer_addr = cpu_to_le64(dbuf_get_paddr(buf));
+	desc->lower.data = cpu_to_le32(E1000_TXD_CMD_EOP |
+		E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS |
+		dbuf_get_data_length(buf));
 	desc->upper.data = 0; /* status */
-
-	/* Mark end-of-packet if this is last descriptor */
-	if (tail == adaptor->num_tx_queues - 1)
-		desc->lower.data |= cpu_to_le32(E1000_TXD_CMD_EOP);
+	adaptor->tx_bufs[tail] = buf;
 
 	/* Advance the counter */
-	tail = (tail + 1) % adaptor->num_tx_queues;
-	ew32(TDT, tail);
+	adaptor->tx_tail = next;
+	ew32(TDT, next);
+	sched_unlock();
 	LOG_FUNCTION_NAME_EXIT(0);
 
 	return 0;
@@ -722,6 +722,8 @@ struct e1000_tx_desc {
 #define E1000_TCTL_RTLC   0x01000000    /* Re-transmit on late collision */
 #define E1000_TCTL_NRTU   0x02000000    /* No Re-transmit on underrun */
 #define E1000_TCTL_MULR   0x10000000    /* Multiple request support */
+#define E1000_CT_SHIFT    4             /* collision threshold shift */
+#define E1000_COLD_SHIFT  12            /* collision distance shift */
 
 /* Receive Descriptor */
 struct e1000_rx_desc {
@@ -125,6 +125,7 @@ void	*kmem_map(void *, size_t);
 paddr_t	 page_alloc(psize_t);
 void	 page_free(paddr_t, psize_t);
 void	 page_reserve(paddr_t, psize_t);
+void	 page_share(paddr_t, psize_t);
 
 irq_t	 irq_attach(int, int, int, int (*)(void *), void (*)(void *), void *);
 void	 irq_detach(irq_t);
@@ -145,6 +146,7 @@ void	 sched_wakeup(struct event *);
 void	 sched_dpc(struct dpc *, void (*)(void *), void *);
 #define	 sched_sleep(event)  sched_tsleep((event), 0)
 
+task_t	 task_self(void);
 int	 task_capable(cap_t);
 int	 exception_post(task_t, int);
 void	 machine_bootinfo(struct bootinfo **);
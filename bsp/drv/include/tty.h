@@ -69,6 +69,7 @@ struct tty {
 	pid_t		t_pgid;		/* foreground process group. */
 	task_t		t_sigtask;	/* task to dispatch the tty signal */
 	int		t_signo;	/* pending signal# */
+	int		t_inseq;	/* input event sequence */
 	struct dpc	t_dpc;		/* dpc for tty */
 };
 
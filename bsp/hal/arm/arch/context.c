@@ -181,6 +181,14 @@ context_restore(context_t ctx)
 	cur->cpsr = (cur->cpsr & ~PSR_MODE) | PSR_APP_MODE;
 }
 
+/*
+ * Release the resources of the context.
+ */
+void
+context_cleanup(context_t ctx)
+{
+}
+
 void
 context_dump(context_t ctx)
 {
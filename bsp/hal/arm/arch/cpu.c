@@ -41,3 +41,36 @@ cpu_init(void)
 {
 
 }
+
+/*
+ * Find the least significant bit set in the mask.
+ * Returns 1 + bit index, or 0 if no bit is set.
+ * ARMv4 has no clz instruction, so just use a binary search.
+ */
+int
+cpu_ffs(uint32_t mask)
+{
+	int bit = 1;
+
+	if (mask == 0)
+		return 0;
+	if ((mask & 0xffff) == 0) {
+		mask >>= 16;
+		bit += 16;
+	}
+	if ((mask & 0xff) == 0) {
+		mask >>= 8;
+		bit += 8;
+	}
+	if ((mask & 0xf) == 0) {
+		mask >>= 4;
+		bit += 4;
+	}
+	if ((mask & 0x3) == 0) {
+		mask >>= 2;
+		bit += 2;
+	}
+	if ((mask & 0x1) == 0)
+		bit += 1;
+	return bit;
+}
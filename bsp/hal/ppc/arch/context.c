@@ -188,6 +188,14 @@ context_restore(context_t ctx)
 	cur->srr1 |= MSR_DFLT;
 }
 
+/*
+ * Release the resources of the context.
+ */
+void
+context_cleanup(context_t ctx)
+{
+}
+
 void
 context_dump(context_t ctx)
 {
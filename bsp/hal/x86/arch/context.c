@@ -51,6 +51,15 @@
 #include <trap.h>
 #include <context.h>
 #include <locore.h>
+#include <cpufunc.h>
+
+#ifdef CONFIG_FPU
+#define MXCSR_DEFAULT	0x1f80		/* mask all SIMD exceptions */
+
+static context_t fpu_owner;	/* context which owns the FPU registers */
+static int fpu_present;		/* true if the FPU is available */
+static int fpu_fxsr;		/* true if fxsave/fxrstor is supported */
+#endif
 
 /*
  * Set user mode registers into the specific context.
@@ -139,11 +148,24 @@ context_set(context_t ctx, int type, register_t val)
  *
  * It is assumed all interrupts are disabled by caller.
  *
- * TODO: FPU context is not switched as of now.
+ * The FPU registers are not switched here. CR0.TS is set unless
+ * the next thread owns the FPU registers, and the registers are
+ * switched by fpu_trap() when the thread uses the FPU.
  */
 void
 context_switch(context_t prev, context_t next)
 {
+#ifdef CONFIG_FPU
+	uint32_t cr0;
+
+	if (next == fpu_owner)
+		clts();
+	else {
+		cr0 = get_cr0();
+		if ((cr0 & CR0_TS) == 0)
+			set_cr0(cr0 | CR0_TS);
+	}
+#endif
 	/* Set kernel stack pointer in TSS (esp0). */
 	tss_set((uint32_t)next->esp0);
 
@@ -199,6 +221,29 @@ context_restore(context_t ctx)
 	cur->eflags |= EFL_IF;
 }
 
+/*
+ * Release the resources of the context.
+ * This is called when the thread is terminated.
+ */
+void
+context_cleanup(context_t ctx)
+{
+#ifdef CONFIG_FPU
+	int s;
+
+	s = splhigh();
+	if (fpu_owner == ctx)
+		fpu_owner = NULL;
+	splx(s);
+
+	if (ctx->fpu_area != NULL) {
+		kmem_free(ctx->fpu_area);
+		ctx->fpu_area = NULL;
+		ctx->fregs = NULL;
+	}
+#endif
+}
+
 void
 context_dump(context_t ctx)
 {
@@ -207,3 +252,89 @@ context_dump(context_t ctx)
 	trap_dump(ctx->uregs);
 #endif
 }
+
+#ifdef CONFIG_FPU
+/*
+ * Handle the "device not available" trap.
+ *
+ * The FPU registers are switched lazily. A thread which has never
+ * used the FPU does not have the save area, and it pays nothing
+ * for the FPU at the context switch. When a thread executes the
+ * FPU instruction with CR0.TS set, the registers of the previous
+ * owner are saved to its context, and the registers of the current
+ * thread are loaded. The registers are initialized at first use.
+ *
+ * Returns 0 if the trap is handled.
+ */
+int
+fpu_trap(void)
+{
+	context_t ctx = &curthread->ctx;
+	int first = 0;
+	void *p;
+	int s;
+
+	if (!fpu_present)
+		return -1;
+
+	if (ctx->fregs == NULL) {
+		/* fxsave requires the 16-byte aligned area. */
+		if ((p = kmem_alloc(sizeof(union fpu_regs) + 15)) == NULL)
+			return -1;
+		ctx->fpu_area = p;
+		ctx->fregs = (union fpu_regs *)(((vaddr_t)p + 15) & ~15);
+		first = 1;
+	}
+
+	s = splhigh();
+	clts();
+	if (fpu_owner != ctx) {
+		if (fpu_owner != NULL) {
+			if (fpu_fxsr)
+				fxsave(fpu_owner->fregs);
+			else
+				fpu_save(fpu_owner->fregs);
+		}
+		if (first) {
+			fpu_reset();
+			if (fpu_fxsr)
+				ldmxcsr(MXCSR_DEFAULT);
+		} else {
+			if (fpu_fxsr)
+				fxrstor(ctx->fregs);
+			else
+				fpu_restore(ctx->fregs);
+		}
+		fpu_owner = ctx;
+	}
+	splx(s);
+	return 0;
+}
+
+/*
+ * Initialize the FPU.
+ *
+ * We assume the processor without cpuid instruction has the
+ * FPU. The fxsave/fxrstor and SSE are enabled if supported.
+ * CR0.TS is set to trap the first FPU instruction.
+ */
+void
+fpu_init(void)
+{
+	uint32_t features, cr0;
+
+	features = cpu_features();
+	if (features != 0 && (features & CPUID_FPU) == 0)
+		return;
+	fpu_present = 1;
+
+	if (features & CPUID_FXSR) {
+		fpu_fxsr = 1;
+		set_cr4(get_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+	}
+	cr0 = get_cr0();
+	cr0 &= ~CR0_EM;
+	cr0 |= CR0_MP | CR0_NE | CR0_TS;
+	set_cr0(cr0);
+}
+#endif /* CONFIG_FPU */
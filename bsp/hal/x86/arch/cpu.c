@@ -61,7 +61,7 @@ static const trapfn_t intr_table[] = {
 static const trapfn_t trap_table[] = {
 	trap_0, trap_1, trap_2, trap_3,	trap_4, trap_5, trap_6,
 	trap_7,	trap_8, trap_9, trap_10, trap_11, trap_12, trap_13,
-	trap_14, trap_15, trap_16, trap_17, trap_18
+	trap_14, trap_15, trap_16, trap_17, trap_18, trap_19
 };
 #define NTRAPS	(int)(sizeof(trap_table) / sizeof(void *))
 
@@ -150,8 +150,8 @@ gdt_init(void)
  * Setup the interrupt descriptor table and load it.
  *
  * IDT layout:
- *  0x00 - 0x12 ... S/W trap
- *  0x13 - 0x1f ... Intel reserved
+ *  0x00 - 0x13 ... S/W trap
+ *  0x14 - 0x1f ... Intel reserved
  *  0x20 - 0x3f ... H/W interrupt
  *  0x40        ... System call trap
  */
@@ -222,4 +222,7 @@ cpu_init(void)
 	gdt_init();
 	idt_init();
 	tss_init();
+#ifdef CONFIG_FPU
+	fpu_init();
+#endif
 }
@@ -50,6 +50,82 @@
  */
 static pgd_t boot_pgd = (pgd_t)BOOT_PGD;
 
+static int mmu_invlpg;		/* true if invlpg is available */
+static int mmu_pge;		/* true if global pages are enabled */
+static int mmu_pse;		/* true if 4M pages are enabled */
+
+/*
+ * Max number of pages to be invalidated one by one. The whole
+ * TLB is flushed for the larger range.
+ */
+#define INVLPG_MAX	32
+
+/*
+ * Flush all TLB entries including the global pages.
+ */
+static void
+flush_tlb_global(void)
+{
+	uint32_t cr4;
+
+	if (mmu_pge) {
+		cr4 = get_cr4();
+		set_cr4(cr4 & ~CR4_PGE);
+		set_cr4(cr4);
+	} else
+		flush_tlb();
+}
+
+/*
+ * Invalidate TLB entries for the specified range.
+ *
+ * The kernel pages are shared by all page directories. The user
+ * pages of the page directory which is not loaded in CR3 are not
+ * cached in TLB, since they are flushed when CR3 is loaded.
+ */
+static void
+mmu_flush(pgd_t pgd, vaddr_t va, size_t size)
+{
+	vaddr_t end;
+
+	if (va < KERNBASE && kvtop(pgd) != get_cr3())
+		return;
+
+	if (!mmu_invlpg || size > INVLPG_MAX * PAGE_SIZE) {
+		if (va < KERNBASE)
+			flush_tlb();
+		else
+			flush_tlb_global();
+		return;
+	}
+	for (end = va + size; va < end; va += PAGE_SIZE)
+		flush_tlb_page(va);
+}
+
+/*
+ * Split a 4M page into the page table which maps the same
+ * physical pages.
+ */
+static int
+mmu_split(uint32_t *pde, uint32_t pde_flag)
+{
+	uint32_t pte_flag;
+	paddr_t pg, pa;
+	pte_t pte;
+	int i;
+
+	if ((pg = page_alloc(PAGE_SIZE)) == 0)
+		return ENOMEM;
+	pte = (pte_t)ptokv(pg);
+	pa = (paddr_t)(*pde & PDE_LARGE_ADDRESS);
+	pte_flag = *pde & (PTE_PRESENT | PTE_WRITE | PTE_USER | PTE_WTHRU |
+			   PTE_NCACHE | PTE_GLOBAL);
+	for (i = 0; i < 1024; i++)
+		pte[i] = (uint32_t)(pa + i * PAGE_SIZE) | pte_flag;
+	*pde = (uint32_t)pg | pde_flag;
+	return 0;
+}
+
 /*
  * Map physical memory range into virtual address
  *
@@ -75,20 +151,28 @@ static pgd_t boot_pgd = (pgd_t)BOOT_PGD;
  * page entry in it. All page tables are released when mmu_delmap()
  * is called when task is terminated.
  *
- * TODO: TLB should be flushed for specific page by invalpg in
- * case of i486.
+ * If the processor supports 4M pages, the physically contiguous
+ * range which is aligned on 4M boundary is mapped by one page
+ * directory entry. The 4M page is split into a page table when
+ * a part of it is changed later. The kernel pages are mapped as
+ * global pages, and they are kept in TLB when CR3 is loaded.
  */
 int
 mmu_map(pgd_t pgd, paddr_t pa, vaddr_t va, size_t size, int type)
 {
 	uint32_t pte_flag = 0;
 	uint32_t pde_flag = 0;
+	uint32_t *pde;
+	vaddr_t start;
+	size_t len;
 	pte_t pte;
 	paddr_t pg;
 
 	pa = round_page(pa);
 	va = round_page(va);
 	size = trunc_page(size);
+	start = va;
+	len = size;
 
 	/*
 	 * Set page flag
@@ -117,11 +201,48 @@ mmu_map(pgd_t pgd, paddr_t pa, vaddr_t va, size_t size, int type)
 	default:
 		panic("mmu_map");
 	}
+	if (mmu_pge && (type == PG_SYSTEM || type == PG_IOMEM))
+		pte_flag |= PTE_GLOBAL;
+
 	/*
 	 * Map all pages
 	 */
 	while (size > 0) {
-		if (pte_present(pgd, va)) {
+		pde = &pgd[PAGE_DIR(va)];
+
+		/*
+		 * Map 4M page. The first 4M of physical memory
+		 * is not mapped by 4M page because it contains
+		 * the areas of the different memory types.
+		 */
+		if (mmu_pse && pte_flag != 0 && pa != 0 &&
+		    ((va | pa) & LARGE_PAGE_MASK) == 0 &&
+		    size >= LARGE_PAGE_SIZE) {
+			if ((*pde & (PDE_PRESENT | PDE_SIZE)) == PDE_PRESENT)
+				page_free((paddr_t)(*pde & PDE_ADDRESS),
+					  PAGE_SIZE);
+			*pde = (uint32_t)pa | pte_flag | PDE_SIZE;
+			pa += LARGE_PAGE_SIZE;
+			va += LARGE_PAGE_SIZE;
+			size -= LARGE_PAGE_SIZE;
+			continue;
+		}
+		if (*pde & PDE_SIZE) {
+			if (pte_flag == 0 && (va & LARGE_PAGE_MASK) == 0 &&
+			    size >= LARGE_PAGE_SIZE) {
+				/* Unmap whole 4M page */
+				*pde = 0;
+				pa += LARGE_PAGE_SIZE;
+				va += LARGE_PAGE_SIZE;
+				size -= LARGE_PAGE_SIZE;
+				continue;
+			}
+			if (mmu_split(pde, pde_flag)) {
+				DPRINTF(("Error: MMU mapping failed\n"));
+				return ENOMEM;
+			}
+		}
+		if (*pde & PDE_PRESENT) {
 			/* Page table already exists for the address */
 			pte = vtopte(pgd, va);
 		} else {
@@ -130,7 +251,7 @@ mmu_map(pgd_t pgd, paddr_t pa, vaddr_t va, size_t size, int type)
 				DPRINTF(("Error: MMU mapping failed\n"));
 				return ENOMEM;
 			}
-			pgd[PAGE_DIR(va)] = (uint32_t)pg | pde_flag;
+			*pde = (uint32_t)pg | pde_flag;
 			pte = (pte_t)ptokv(pg);
 			memset(pte, 0, PAGE_SIZE);
 		}
@@ -142,7 +263,7 @@ mmu_map(pgd_t pgd, paddr_t pa, vaddr_t va, size_t size, int type)
 		va += PAGE_SIZE;
 		size -= PAGE_SIZE;
 	}
-	flush_tlb();
+	mmu_flush(pgd, start, len);
 	return 0;
 }
 
@@ -169,7 +290,7 @@ mmu_newmap(void)
 
 	/* Copy kernel page tables */
 	i = PAGE_DIR(KERNBASE);
-	memcpy(&pgd[i], &boot_pgd[i], (size_t)(1024 - i));
+	memcpy(&pgd[i], &boot_pgd[i], (size_t)(1024 - i) * sizeof(uint32_t));
 	return pgd;
 }
 
@@ -187,7 +308,7 @@ mmu_terminate(pgd_t pgd)
 	/* Release all user page table */
 	for (i = 0; i < PAGE_DIR(KERNBASE); i++) {
 		pte = (pte_t)pgd[i];
-		if (pte != 0)
+		if (pte != 0 && !((uint32_t)pte & PDE_SIZE))
 			page_free((paddr_t)((paddr_t)pte & PTE_ADDRESS),
 				  PAGE_SIZE);
 	}
@@ -200,7 +321,7 @@ mmu_terminate(pgd_t pgd)
  *
  * This is called when context is switched.
  * Whole TLB are flushed automatically by loading
- * CR3 register.
+ * CR3 register, except the global kernel pages.
  */
 void
 mmu_switch(pgd_t pgd)
@@ -230,12 +351,18 @@ mmu_extract(pgd_t pgd, vaddr_t va, size_t size)
 	for (pg = start; pg <= end; pg += PAGE_SIZE) {
 		if (!pte_present(pgd, pg))
 			return 0;
+		if (pde_large(pgd, pg))
+			continue;
 		pte = vtopte(pgd, pg);
 		if (!page_present(pte, pg))
 			return 0;
 	}
 
 	/* Get physical address */
+	if (pde_large(pgd, va)) {
+		pa = (paddr_t)(pgd[PAGE_DIR(va)] & PDE_LARGE_ADDRESS);
+		return pa + (paddr_t)(va & LARGE_PAGE_MASK);
+	}
 	pte = vtopte(pgd, start);
 	pa = (paddr_t)ptetopg(pte, start);
 	return pa + (paddr_t)(va - start);
@@ -251,16 +378,33 @@ mmu_extract(pgd_t pgd, vaddr_t va, size_t size)
  * these kernel pages.
  * page_init() must be called before calling this routine.
  *
- * Note: This routine requires 4K bytes to map 4M bytes memory. So,
- * if the system has a lot of RAM, the "used memory" by kernel will
- * become large, too. For example, page table requires 512K bytes
- * for 512M bytes system RAM.
+ * Note: Without 4M pages, this routine requires 4K bytes to map
+ * 4M bytes memory. So, if the system has a lot of RAM, the "used
+ * memory" by kernel will become large, too. For example, page
+ * table requires 512K bytes for 512M bytes system RAM.
  */
 void
 mmu_init(struct mmumap *mmumap_table)
 {
 	struct mmumap *map;
 	int map_type = 0;
+	uint32_t features;
+
+	/*
+	 * We assume the processor which has the cpuid
+	 * instruction is i486 or later.
+	 */
+	features = cpu_features();
+	if (features != 0)
+		mmu_invlpg = 1;
+	if (features & CPUID_PSE) {
+		set_cr4(get_cr4() | CR4_PSE);
+		mmu_pse = 1;
+	}
+	if (features & CPUID_PGE) {
+		set_cr4(get_cr4() | CR4_PGE);
+		mmu_pge = 1;
+	}
 
 	for (map = mmumap_table; map->type != 0; map++) {
 		switch (map->type) {
@@ -278,4 +422,5 @@ mmu_init(struct mmumap *mmumap_table)
 			    (size_t)map->size, map_type))
 			panic("mmu_init");
 	}
+	flush_tlb_global();
 }
@@ -36,6 +36,7 @@
 #include <hal.h>
 #include <exception.h>
 #include <task.h>
+#include <vm.h>
 #include <cpu.h>
 #include <trap.h>
 #include <cpufunc.h>
@@ -65,7 +66,8 @@ static const char *const trap_name[] = {
 	"Reserved",		/* 15 */
 	"Coprocessor error",	/* 16 */
 	"Alignment check",	/* 17 */
-	"Cache flush denied"	/* 18 */
+	"Cache flush denied",	/* 18 */
+	"SIMD floating point"	/* 19 */
 };
 #define MAXTRAP (sizeof(trap_name) / sizeof(void *) - 1)
 #endif	/* DEBUG */
@@ -95,6 +97,7 @@ static const int exception_map[] = {
 	SIGFPE,		/* 16: Coprocessor error */
 	SIGILL,		/* 17: Alignment check */
 	SIGILL,		/* 18: Cache flush denied */
+	SIGFPE,		/* 19: SIMD floating point */
 };
 
 /*
@@ -106,11 +109,27 @@ trap_handler(struct cpu_regs *regs)
 {
 	u_long trap_no = regs->trap_no;
 
-	if (trap_no > 18)
+	if (trap_no > 19)
 		panic("Unknown trap");
 	else if (trap_no == 2)
 		panic("NMI");
 
+#ifdef CONFIG_FPU
+	/*
+	 * Switch the FPU registers to the current thread.
+	 */
+	if (trap_no == 7 && regs->cs != KERNEL_CS && fpu_trap() == 0)
+		return;
+#endif
+	/*
+	 * Page fault may be the write to the copy-on-write page,
+	 * or the first access to the page allocated on demand.
+	 * It is also raised by copyin()/copyout() in kernel mode
+	 * since CR0.WP is set.
+	 */
+	if (trap_no == 14 && vm_fault((vaddr_t)get_cr2()) == 0)
+		return;
+
 	/*
 	 * Check whether this trap is kernel page fault caused
 	 * by known routine to access user space like copyin().
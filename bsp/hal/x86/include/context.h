@@ -76,7 +76,7 @@ struct kern_regs {
 /*
  * FPU register for fsave/frstor
  */
-struct fpu_regs {
+struct fsave_regs {
 	uint32_t	ctrl_word;
 	uint32_t	stat_word;
 	uint32_t	tag_word;
@@ -87,6 +87,35 @@ struct fpu_regs {
 	uint32_t	st[20];
 };
 
+/*
+ * FPU/SSE register for fxsave/fxrstor
+ * This area must be aligned on a 16-byte boundary.
+ */
+struct fxsave_regs {
+	uint16_t	ctrl_word;
+	uint16_t	stat_word;
+	uint16_t	tag_word;
+	uint16_t	opcode;
+	uint32_t	ip_offset;
+	uint32_t	cs_sel;
+	uint32_t	op_offset;
+	uint32_t	op_sel;
+	uint32_t	mxcsr;
+	uint32_t	mxcsr_mask;
+	uint32_t	st[32];
+	uint32_t	xmm[32];
+	uint32_t	reserved[56];
+};
+
+/*
+ * Saved co-processor registers. The fsave format is used
+ * when the processor does not support fxsave.
+ */
+union fpu_regs {
+	struct fsave_regs  fsave;
+	struct fxsave_regs fxsave;
+};
+
 /*
  * Processor context
  */
@@ -95,7 +124,8 @@ struct context {
 	struct cpu_regs	*uregs;		/* user mode registers */
 	struct cpu_regs	*saved_regs;	/* saved user mode registers */
 #ifdef CONFIG_FPU
-	struct fpu_regs	*fregs;		/* co-processor registers */
+	union fpu_regs	*fregs;		/* co-processor registers */
+	void		*fpu_area;	/* allocated area for fregs */
 #endif
 	uint32_t	 esp0;		/* top of kernel stack */
 };
@@ -85,6 +85,24 @@
 #define CR0_MP		0x00000002	/* monitor coprocessor */
 #define CR0_PE		0x00000001	/* enable protected mode */
 
+/*
+ * CR4 register
+ */
+#define CR4_PSE		0x00000010	/* page size extensions */
+#define CR4_PGE		0x00000080	/* page global enable */
+#define CR4_OSFXSR	0x00000200	/* fxsave/fxrstor and SSE */
+#define CR4_OSXMMEXCPT	0x00000400	/* SIMD floating point exception */
+
+/*
+ * Processor features (cpuid 1, edx)
+ */
+#define CPUID_FPU	0x00000001	/* floating point unit */
+#define CPUID_PSE	0x00000008	/* page size extensions */
+#define CPUID_TSC	0x00000010	/* time stamp counter */
+#define CPUID_PGE	0x00002000	/* page global enable */
+#define CPUID_FXSR	0x01000000	/* fxsave/fxrstor */
+#define CPUID_SSE	0x02000000	/* SSE extensions */
+
 #ifndef __ASSEMBLY__
 
 #include <sys/types.h>
@@ -198,6 +216,10 @@ __BEGIN_DECLS
 void	 tss_set(uint32_t);
 uint32_t tss_get(void);
 void	 cpu_init(void);
+#ifdef CONFIG_FPU
+void	 fpu_init(void);
+int	 fpu_trap(void);
+#endif
 __END_DECLS
 
 #endif /* !__ASSEMBLY__ */
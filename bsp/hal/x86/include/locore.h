@@ -70,6 +70,7 @@ void	trap_15(void);
 void	trap_16(void);
 void	trap_17(void);
 void	trap_18(void);
+void	trap_19(void);
 void	syscall_entry(void);
 void	syscall_ret(void);
 void	cpu_switch(struct kern_regs *, struct kern_regs *);
@@ -35,6 +35,13 @@
 typedef uint32_t	*pgd_t;		/* page directory */
 typedef uint32_t	*pte_t;		/* page table entry */
 
+/*
+ * The page fault to the user page is passed to vm_fault(),
+ * so that the writable pages can be shared copy-on-write and
+ * the allocated pages can be filled on demand.
+ */
+#define MMU_FAULT
+
 /*
  * Page directory entry
  */
@@ -45,8 +52,10 @@ typedef uint32_t	*pte_t;		/* page table entry */
 #define PDE_NCACHE	0x00000010
 #define PDE_ACCESS	0x00000020
 #define PDE_SIZE	0x00000080
+#define PDE_GLOBAL	0x00000100
 #define PDE_AVAIL	0x00000e00
 #define PDE_ADDRESS	0xfffff000
+#define PDE_LARGE_ADDRESS 0xffc00000
 
 /*
  * Page table entry
@@ -58,9 +67,16 @@ typedef uint32_t	*pte_t;		/* page table entry */
 #define PTE_NCACHE	0x00000010
 #define PTE_ACCESS	0x00000020
 #define PTE_DIRTY	0x00000040
+#define PTE_GLOBAL	0x00000100
 #define PTE_AVAIL	0x00000e00
 #define PTE_ADDRESS	0xfffff000
 
+/*
+ * Large (4M) page mapped by one page directory entry
+ */
+#define LARGE_PAGE_SIZE	0x00400000
+#define LARGE_PAGE_MASK	(LARGE_PAGE_SIZE - 1)
+
 /*
  *  Virtual and physical address translation
  */
@@ -69,6 +85,8 @@ typedef uint32_t	*pte_t;		/* page table entry */
 
 #define pte_present(pgd, virt)  (pgd[PAGE_DIR(virt)] & PDE_PRESENT)
 
+#define pde_large(pgd, virt)    (pgd[PAGE_DIR(virt)] & PDE_SIZE)
+
 #define page_present(pte, virt) (pte[PAGE_TABLE(virt)] & PTE_PRESENT)
 
 #define vtopte(pgd, virt) \
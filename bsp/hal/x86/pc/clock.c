@@ -31,10 +31,20 @@
  * clock.c - clock driver for i8254.
  */
 
+/*
+ * With CONFIG_TICKLESS, the time stamp counter (TSC) is used as
+ * a clocksource, and the PIT can be switched to the one-shot
+ * mode while the system is idle. The TSC is calibrated with the
+ * PIT channel 2 at boot. The tick keeps running periodically if
+ * the processor has no TSC.
+ */
+
 #include <kernel.h>
 #include <timer.h>
 #include <irq.h>
+#include <hal.h>
 #include <sys/ipl.h>
+#include <cpu.h>
 #include <cpufunc.h>
 
 /* Interrupt vector for clock */
@@ -48,24 +58,224 @@
 
 /* I/O port for programmable interval timer */
 #define PIT_CH0		0x40
+#define PIT_CH2		0x42
 #define PIT_CTRL	0x43
 
+/* PIT commands for channel 0 */
+#define PIT_PERIODIC	0x34		/* mode 2: rate generator */
+#define PIT_ONESHOT	0x30		/* mode 0: interrupt on terminal count */
+
+#ifdef CONFIG_TICKLESS
+/* System control port for the gate and the output of channel 2 */
+#define SYS_CTRL	0x61
+#define SYS_GATE2	0x01
+#define SYS_SPEAKER	0x02
+#define SYS_OUT2	0x20
+
+#define CAL_TICKS	10		/* ticks to calibrate TSC */
+#define CAL_LOOPS	10000000	/* max loops to wait for PIT */
+
+/* Max ticks to stop, which must fit the 16-bit PIT counter */
+#define MAX_STOP	(0xffff / PIT_LATCH - 1)
+
+static int	tsc_ok;			/* true if TSC is usable */
+static u_long	tsc_per_tick;		/* TSC cycles per tick */
+static u_long	tsc_per_count;		/* TSC cycles per PIT count */
+static u_long	tsc_mult;		/* nsec = cycles * tsc_mult >> 24 */
+static u_long	tsc_last;		/* TSC at the last tick */
+static int	oneshot;		/* true in one-shot mode */
+#endif
+
+/*
+ * Program the PIT channel 0.
+ */
+static void
+pit_program(int mode, u_long count)
+{
+
+	outb_p(PIT_CTRL, (u_char)mode);
+	outb_p(PIT_CH0, (u_char)(count & 0xff));		/* LSB */
+	outb_p(PIT_CH0, (u_char)((count >> 8) & 0xff));	/* MSB */
+}
+
+#ifdef CONFIG_TICKLESS
+/*
+ * Program the PIT to interrupt once at the tick boundary which
+ * is the specified ticks after the last tick.
+ */
+static void
+pit_oneshot(u_long ticks)
+{
+	u_long remain, count;
+
+	remain = tsc_last + ticks * tsc_per_tick - cpu_cycles();
+	if ((long)remain <= 0)
+		count = 1;
+	else {
+		count = remain / tsc_per_count;
+		if (count == 0)
+			count = 1;
+		if (count > 0xffff)
+			count = 0xffff;
+	}
+	pit_program(PIT_ONESHOT, count);
+	oneshot = 1;
+}
+#endif
+
 /*
  * Clock interrupt service routine.
- * No H/W reprogram is required.
+ * No H/W reprogram is required in the periodic mode.
  */
 static int
 clock_isr(void *arg)
 {
 	int s;
+#ifdef CONFIG_TICKLESS
+	u_long now, ticks;
+#endif
 
 	s = splhigh();
+#ifdef CONFIG_TICKLESS
+	if (tsc_ok) {
+		now = cpu_cycles();
+		if (oneshot) {
+			/*
+			 * Count the ticks since the last one, rounding
+			 * for the latency of this interrupt.
+			 */
+			ticks = (now - tsc_last + tsc_per_tick / 2) /
+				tsc_per_tick;
+			if (ticks == 0) {
+				/* Stale interrupt of the previous setting */
+				splx(s);
+				return INT_DONE;
+			}
+			timer_catchup(ticks - 1);
+			pit_program(PIT_PERIODIC, PIT_LATCH);
+			oneshot = 0;
+		}
+		tsc_last = now;
+	}
+#endif
 	timer_handler();
 	splx(s);
 
 	return INT_DONE;
 }
 
+#ifdef CONFIG_TICKLESS
+/*
+ * Stop the periodic tick, and interrupt after the specified
+ * ticks. Called with interrupts disabled.
+ */
+int
+clock_stop(u_long ticks)
+{
+
+	if (!tsc_ok)
+		return -1;
+	if (ticks > MAX_STOP)
+		ticks = MAX_STOP;
+	pit_oneshot(ticks);
+	return 0;
+}
+
+/*
+ * Return the ticks passed since the clock was stopped, and
+ * interrupt at the next tick boundary to restart the periodic
+ * tick. Called with interrupts disabled.
+ */
+u_long
+clock_resume(void)
+{
+	u_long ticks;
+
+	if (!oneshot)
+		return 0;
+	ticks = (cpu_cycles() - tsc_last) / tsc_per_tick;
+	tsc_last += ticks * tsc_per_tick;
+	pit_oneshot(1);
+	return ticks;
+}
+
+/*
+ * Return nanoseconds since the last tick.
+ */
+u_long
+clock_nsec(void)
+{
+	u_long delta;
+
+	if (!tsc_ok)
+		return 0;
+	delta = cpu_cycles() - tsc_last;
+	if (delta >= tsc_per_tick)
+		delta = tsc_per_tick - 1;	/* tick is pending */
+	return (u_long)(((unsigned long long)delta * tsc_mult) >> 24);
+}
+
+/*
+ * Measure TSC cycles in CAL_TICKS ticks with the PIT channel 2.
+ * Returns 0 if the PIT does not respond.
+ */
+static u_long
+tsc_calibrate(void)
+{
+	u_long start, count = PIT_LATCH * CAL_TICKS;
+	int i;
+
+	outb(SYS_CTRL, (u_char)((inb(SYS_CTRL) & ~SYS_SPEAKER) | SYS_GATE2));
+	outb_p(PIT_CTRL, 0xb0);		/* channel 2, mode 0 */
+	outb_p(PIT_CH2, (u_char)(count & 0xff));
+	outb_p(PIT_CH2, (u_char)((count >> 8) & 0xff));
+
+	start = cpu_cycles();
+	for (i = 0; i < CAL_LOOPS; i++) {
+		if (inb(SYS_CTRL) & SYS_OUT2)
+			return cpu_cycles() - start;
+	}
+	return 0;
+}
+
+/*
+ * Setup TSC as the clocksource.
+ */
+static void
+tsc_init(void)
+{
+	u_long nsec, q, r;
+	int i;
+
+	if ((cpu_features() & CPUID_TSC) == 0)
+		return;
+	tsc_per_tick = tsc_calibrate() / CAL_TICKS;
+	tsc_per_count = tsc_per_tick / PIT_LATCH;
+	if (tsc_per_count == 0)
+		return;
+
+	/*
+	 * tsc_mult = (nsec per tick << 24) / tsc_per_tick, by the
+	 * long division in 32 bits.
+	 */
+	nsec = 1000000000UL / HZ;
+	q = nsec / tsc_per_tick;
+	r = nsec % tsc_per_tick;
+	for (i = 0; i < 24; i++) {
+		q <<= 1;
+		r <<= 1;
+		if (r >= tsc_per_tick) {
+			r -= tsc_per_tick;
+			q |= 1;
+		}
+	}
+	tsc_mult = q;
+	tsc_last = cpu_cycles();
+	tsc_ok = 1;
+	DPRINTF(("TSC: %d cycles/tick\n", tsc_per_tick));
+}
+#endif /* CONFIG_TICKLESS */
+
 /*
  * Initialize clock H/W chip.
  * Setup clock tick rate and install clock ISR.
@@ -75,9 +285,10 @@ clock_init(void)
 {
 	irq_t clock_irq;
 
-	outb_p(PIT_CTRL, 0x34);		/* Command to set generator mode */
-	outb_p(PIT_CH0, (u_char)(PIT_LATCH & 0xff));		/* LSB */
-	outb_p(PIT_CH0, (u_char)((PIT_LATCH >> 8) & 0xff));	/* MSB */
+#ifdef CONFIG_TICKLESS
+	tsc_init();
+#endif
+	pit_program(PIT_PERIODIC, PIT_LATCH);
 
 	clock_irq = irq_attach(CLOCK_IRQ, IPL_CLOCK, 0, &clock_isr,
 			       IST_NONE, NULL);
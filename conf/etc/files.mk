@@ -57,6 +57,7 @@ endif
 #FILES+= 	$(SRCDIR)/usr/test/fifo/fifo
 #FILES+= 	$(SRCDIR)/usr/test/fork/fork
 #FILES+= 	$(SRCDIR)/usr/test/forkbomb/forkbomb
+#FILES+= 	$(SRCDIR)/usr/test/lookup/lookup
 #FILES+= 	$(SRCDIR)/usr/test/memleak/memleak
 #FILES+= 	$(SRCDIR)/usr/test/mount/mount
 #FILES+= 	$(SRCDIR)/usr/test/object/object
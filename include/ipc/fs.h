@@ -35,6 +35,9 @@
 #include <sys/stat.h>
 #include <sys/fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/buf.h>
+#include <sys/poll.h>
+#include <sys/epoll.h>
 #include <ipc/ipc.h>
 
 #include <limits.h>
@@ -81,6 +84,11 @@
 #define FS_TRUNCATE	0x00000224
 #define FS_FTRUNCATE	0x00000225
 #define FS_FCHDIR	0x00000226
+#define FS_IOREGION	0x00000227
+#define FS_BIOSTAT	0x00000228
+#define FS_POLL		0x00000229
+#define FS_EPOLL_CTL	0x0000022A
+#define FS_EPOLL_WAIT	0x0000022B
 
 /*
  * Mount message
@@ -166,6 +174,45 @@ struct fcntl_msg {
 	struct flock lock;		/* file lock data */
 };
 
+/*
+ * Buffer cache statistics message
+ */
+struct bio_msg {
+	struct msg_header hdr;		/* message header */
+	struct bufstat stat;		/* statistics */
+};
+
+/*
+ * Poll message
+ *
+ * The server posts sem when the files may get ready. 0 for sem
+ * checks the files only, and 0 for nfds releases the set of sem.
+ */
+struct poll_msg {
+	struct msg_header hdr;		/* message header */
+	sem_t	sem;			/* semaphore to post */
+	int	nfds;			/* number of descriptors */
+	struct pollfd fds[OPEN_MAX];	/* descriptors and events */
+	int	nready;			/* number of ready descriptors */
+};
+
+/*
+ * Epoll message
+ *
+ * The epoll set is kept in the server for the pair of the task
+ * and sem. 0 for op of FS_EPOLL_CTL releases the set.
+ */
+struct epoll_msg {
+	struct msg_header hdr;		/* message header */
+	sem_t	sem;			/* semaphore to post */
+	int	op;			/* EPOLL_CTL_* */
+	int	fd;			/* file descriptor */
+	struct epoll_event event;	/* event for fd */
+	int	maxevents;		/* max number of events */
+	struct epoll_event events[OPEN_MAX]; /* ready events */
+	int	nready;			/* number of ready events */
+};
+
 
 /* Max size of fs message */
 #define MAX_FSMSG	sizeof(struct mount_msg)
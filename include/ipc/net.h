@@ -0,0 +1,112 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _IPC_NET_H
+#define _IPC_NET_H
+
+#include <sys/types.h>
+#include <sys/syslimits.h>
+#include <sys/posix.h>
+#include <sys/socket.h>
+#include <ipc/ipc.h>
+
+/*
+ * Messages for net object
+ */
+#define NET_SOCKET	0x00000600
+#define NET_BIND	0x00000601
+#define NET_LISTEN	0x00000602
+#define NET_ACCEPT	0x00000603
+#define NET_CONNECT	0x00000604
+#define NET_SHUTDOWN	0x00000605
+#define NET_CLOSE	0x00000606
+#define NET_SETSOCKOPT	0x00000607
+#define NET_GETSOCKOPT	0x00000608
+#define NET_GETSOCKNAME	0x00000609
+#define NET_GETPEERNAME	0x0000060A
+#define NET_SEND	0x0000060B
+#define NET_RECV	0x0000060C
+#define NET_BATCH	0x0000060D
+#define NET_IOCTL	0x0000060E
+#define NET_FCNTL	0x0000060F
+#define NET_EXIT	0x00000610
+
+#define SOCK_MAXADDRLEN	16		/* max length of socket address */
+#define SOCK_MAXOPTLEN	16		/* max length of socket option */
+
+/*
+ * Socket message
+ */
+struct sock_msg {
+	struct msg_header hdr;		/* message header */
+	int	sd;			/* socket descriptor */
+	int	data[3];		/* integer data */
+	socklen_t addrlen;		/* length of address */
+	char	addr[SOCK_MAXADDRLEN];	/* socket address */
+};
+
+/*
+ * Socket option message
+ */
+struct sockopt_msg {
+	struct msg_header hdr;		/* message header */
+	int	sd;			/* socket descriptor */
+	int	level;			/* option level */
+	int	name;			/* option name */
+	socklen_t optlen;		/* length of option */
+	char	optval[SOCK_MAXOPTLEN];	/* option value */
+};
+
+/*
+ * Socket I/O message
+ *
+ * The iovecs point to the buffers of the client, and the data
+ * is moved by the server directly.
+ */
+struct sockio_msg {
+	struct msg_header hdr;		/* message header */
+	int	sd;			/* socket descriptor */
+	int	flags;			/* MSG_* flags */
+	int	iovcnt;			/* number of iovecs */
+	struct iovec iov[IOV_MAX];	/* scatter/gather list */
+	socklen_t addrlen;		/* length of address */
+	char	addr[SOCK_MAXADDRLEN];	/* peer address */
+	size_t	size;			/* transferred size */
+};
+
+/*
+ * Socket batch message
+ */
+struct sockbatch_msg {
+	struct msg_header hdr;		/* message header */
+	int	nops;			/* number of operations */
+	struct sockop ops[SOP_MAX];	/* operations */
+};
+
+#endif /* !_IPC_NET_H */
@@ -0,0 +1,82 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _NETINET_IN_H_
+#define _NETINET_IN_H_
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+typedef uint32_t	in_addr_t;
+typedef uint16_t	in_port_t;
+
+/*
+ * Protocols
+ */
+#define IPPROTO_IP	0		/* dummy for IP */
+#define IPPROTO_ICMP	1		/* control message protocol */
+#define IPPROTO_TCP	6		/* tcp */
+#define IPPROTO_UDP	17		/* user datagram protocol */
+
+/*
+ * Internet address (in network byte order)
+ */
+struct in_addr {
+	in_addr_t	s_addr;
+};
+
+#define INADDR_ANY		((in_addr_t)0x00000000)
+#define INADDR_BROADCAST	((in_addr_t)0xffffffff)
+#define INADDR_NONE		((in_addr_t)0xffffffff)
+#define INADDR_LOOPBACK		((in_addr_t)0x7f000001)
+
+/*
+ * Socket address, internet style.
+ */
+struct sockaddr_in {
+	uint8_t		sin_len;
+	sa_family_t	sin_family;
+	in_port_t	sin_port;
+	struct in_addr	sin_addr;
+	char		sin_zero[8];
+};
+
+/*
+ * Options for use with [gs]etsockopt at the IP level.
+ */
+#define IP_TOS		1		/* int; IP type of service */
+#define IP_TTL		2		/* int; IP time to live */
+
+/*
+ * Options for use with [gs]etsockopt at the TCP level.
+ */
+#define TCP_NODELAY	0x01		/* don't delay send to coalesce */
+#define TCP_KEEPALIVE	0x02		/* idle time before keepalive */
+
+#endif /* !_NETINET_IN_H_ */
@@ -38,7 +38,8 @@
  * Buffer header
  */
 struct buf {
-	struct list	b_link;		/* link to block list */
+	struct list	b_link;		/* link to LRU list */
+	struct list	b_hash;		/* link to hash chain */
 	int		b_flags;	/* see defines below */
 	dev_t		b_dev;		/* device number */
 	int		b_blkno;	/* block # on device */
@@ -55,15 +56,30 @@ struct buf {
 #define	B_READ		0x00000008	/* read buffer. */
 #define	B_DONE		0x00000010	/* I/O completed. */
 
+/*
+ * Statistics of buffer cache.
+ */
+struct bufstat {
+	int		nbufs;		/* number of buffers */
+	int		maxbufs;	/* max number of buffers */
+	u_long		hits;		/* blocks found in cache */
+	u_long		misses;		/* blocks read into cache */
+	u_long		evicts;		/* cached blocks replaced */
+	u_long		rablks;		/* blocks read ahead */
+	u_long		clwrites;	/* clustered writes */
+};
+
 __BEGIN_DECLS
 struct buf *getblk(dev_t, int);
 int	bread(dev_t, int, struct buf **);
+int	breada(dev_t, int, int, struct buf **);
 int	bwrite(struct buf *);
 void	bdwrite(struct buf *);
 void	binval(dev_t);
 void	brelse(struct buf *);
 void	bflush(struct buf *);
 void	bio_sync(void);
+void	bio_stat(struct bufstat *);
 void	bio_init(void);
 __END_DECLS
 
@@ -74,6 +74,12 @@ typedef int (*devop_devctl_t) (device_t, u_long, void *);
 #define	no_ioctl	((devop_ioctl_t)enodev)
 #define	no_devctl	((devop_devctl_t)nullop)
 
+/*
+ * Device control code sent to all devices when a task is
+ * terminated. The argument is the task.
+ */
+#define DEVCTL_TASK_EXIT	(u_long)(('T' << 16) | 0)
+
 /*
  * Driver object
  */
@@ -0,0 +1,72 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SYS_EPOLL_H_
+#define _SYS_EPOLL_H_
+
+#include <sys/types.h>
+#include <sys/cdefs.h>
+#include <sys/poll.h>
+
+typedef union epoll_data {
+	void		*ptr;
+	int		fd;
+	uint32_t	u32;
+} epoll_data_t;
+
+/*
+ * Event of epoll. The events are level triggered.
+ */
+struct epoll_event {
+	uint32_t	events;		/* epoll events */
+	epoll_data_t	data;		/* user data */
+};
+
+#define EPOLLIN		POLLIN
+#define EPOLLPRI	POLLPRI
+#define EPOLLOUT	POLLOUT
+#define EPOLLERR	POLLERR
+#define EPOLLHUP	POLLHUP
+
+/*
+ * Commands for epoll_ctl()
+ */
+#define EPOLL_CTL_ADD	1		/* add a descriptor */
+#define EPOLL_CTL_DEL	2		/* remove a descriptor */
+#define EPOLL_CTL_MOD	3		/* change the events */
+
+#ifndef KERNEL
+__BEGIN_DECLS
+int	epoll_create(int);
+int	epoll_ctl(int, int, int, struct epoll_event *);
+int	epoll_wait(int, struct epoll_event *, int, int);
+__END_DECLS
+#endif
+
+#endif /* !_SYS_EPOLL_H_ */
@@ -87,4 +87,27 @@
 #define	EPROCLIM	39		/* Too many processes */
 #define	ENOSYS		40		/* Function not implemented */
 
+/* ipc/network software */
+#define	ENOTSOCK	41		/* Socket operation on non-socket */
+#define	EMSGSIZE	42		/* Message too long */
+#define	EPROTOTYPE	43		/* Protocol wrong type for socket */
+#define	ENOPROTOOPT	44		/* Protocol not available */
+#define	EPROTONOSUPPORT	45		/* Protocol not supported */
+#define	EOPNOTSUPP	46		/* Operation not supported */
+#define	EAFNOSUPPORT	47		/* Address family not supported */
+#define	EADDRINUSE	48		/* Address already in use */
+#define	EADDRNOTAVAIL	49		/* Can't assign requested address */
+#define	ENETDOWN	50		/* Network is down */
+#define	ENETUNREACH	51		/* Network is unreachable */
+#define	ECONNABORTED	52		/* Software caused connection abort */
+#define	ECONNRESET	53		/* Connection reset by peer */
+#define	ENOBUFS		54		/* No buffer space available */
+#define	EISCONN		55		/* Socket is already connected */
+#define	ENOTCONN	56		/* Socket is not connected */
+#define	ESHUTDOWN	57		/* Can't send after socket shutdown */
+#define	ECONNREFUSED	58		/* Connection refused */
+#define	EHOSTUNREACH	59		/* No route to host */
+#define	EALREADY	60		/* Operation already in progress */
+#define	EINPROGRESS	61		/* Operation now in progress */
+
 #endif /* !_SYS_ERRNO_H_ */
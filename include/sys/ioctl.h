@@ -125,10 +125,16 @@ struct __timeval {
 #define NETIO_RX_DQBUF		_IOR('D', 6, vaddr_t)
 #define NETIO_TX_QBUF		_IOR('D', 7, vaddr_t)
 #define NETIO_TX_DQBUF		_IOR('D', 8, vaddr_t)
+#define NETIO_RX_QBATCH		_IOW('D', 9, struct dbuf_batch)
+#define NETIO_RX_DQBATCH	_IOWR('D', 10, struct dbuf_batch)
+#define NETIO_TX_QBATCH		_IOWR('D', 11, struct dbuf_batch)
+#define NETIO_TX_DQBATCH	_IOWR('D', 12, struct dbuf_batch)
+#define NETIO_REG_BATCH		_IOW('D', 13, struct dbuf_batch)
 
 struct net_if_caps {
 	netif_type_t	type;
 	int		mtu;
+	uint8_t		hwaddr[6];	/* MAC address */
 };
 struct net_if_status {
 	int		nr_recv;
@@ -136,6 +142,12 @@ struct net_if_status {
 	int		nr_dropped;
 };
 
+/*
+ * Socket I/O control code
+ */
+#define FIONREAD		_IOR('f', 127, int)	/* get # bytes to read */
+#define FIONBIO			_IOW('f', 126, int)	/* set/clear non-blocking i/o */
+
 /*
  * User-space I/O control code
  */
@@ -69,6 +69,7 @@ struct mount {
 	struct vnode	*m_root;	/* root vnode */
 	struct vnode	*m_covered;	/* vnode covered on parent fs */
 	void		*m_data;	/* private data for fs */
+	time_t		m_mtime;	/* last modification in this fs */
 };
 typedef struct mount *mount_t;
 
@@ -6,6 +6,35 @@ typedef enum netif_type {
 	NETIF_ETHERNET  = 0x0001,
 } netif_type_t;
 
+/*
+ * A datagram buffer (dbuf) is one page of the net server, which
+ * is shared with the network driver. The page starts with the
+ * header, and the frame is stored at DBUF_DATA_OFFSET. The driver
+ * accesses the page through its kernel address, and the device
+ * reads and writes the frame there directly.
+ *
+ * The pages are registered with NETIO_REG_BATCH, and the driver
+ * holds them until the device is closed or the net server exits.
+ * The driver keeps its own header for each buffer, and only the
+ * data length is passed in the header of the page.
+ *
+ * The first DBUF_HDR_SIZE bytes belong to the header, and the
+ * area between the header and the frame is free for the owner.
+ */
+#define DBUF_HDR_SIZE		64	/* size of dbuf header */
+#define DBUF_DATA_OFFSET	128	/* offset of frame in dbuf */
+#define DBUF_DATA_SIZE		2048	/* max frame size in dbuf */
+
+#define NETIO_MAXBATCH		32	/* max buffers in a batch */
+
+/*
+ * Buffers for the batch I/O control codes.
+ */
+struct dbuf_batch {
+	int		count;		/* number of buffers */
+	struct dbuf_user *bufs[NETIO_MAXBATCH];
+};
+
 #ifndef KERNEL
 struct dbuf_user {
 #define DATAGRAM_HDR_MAGIC	0x9a0a
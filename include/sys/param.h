@@ -59,6 +59,8 @@
 #define	MAXTHREADS	128		/* max number of threads per task */
 #define	MAXOBJECTS	32		/* max number of objects per task */
 #define	MAXSYNCS	512		/* max number of synch objects per task */
+#define	MAXASYNC	16		/* max pending async messages per object */
+#define	MAXASYNCMSG	1024		/* max size of async message */
 #define MAXMEM		(4*1024*1024)	/* max core per task - first # is Mb */
 
 /* The following name length include a null-terminate character */
@@ -66,6 +68,7 @@
 #define MAXDEVNAME	12		/* max device name */
 #define MAXOBJNAME	16		/* max object name */
 #define MAXEVTNAME	12		/* max event name */
+#define MAXCACHENAME	12		/* max kmem cache name */
 
 #define HZ		CONFIG_HZ	/* ticks per second */
 #define MAXIRQS		32		/* max number of irq line */
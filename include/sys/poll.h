@@ -0,0 +1,61 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SYS_POLL_H_
+#define _SYS_POLL_H_
+
+#include <sys/cdefs.h>
+
+typedef unsigned int	nfds_t;
+
+/*
+ * Descriptor to poll
+ */
+struct pollfd {
+	int	fd;			/* file descriptor */
+	short	events;			/* events to look for */
+	short	revents;		/* events returned */
+};
+
+#define POLLIN		0x0001		/* data can be read */
+#define POLLPRI		0x0002		/* urgent data can be read */
+#define POLLOUT		0x0004		/* data can be written */
+#define POLLERR		0x0008		/* error (revents only) */
+#define POLLHUP		0x0010		/* hang up (revents only) */
+#define POLLNVAL	0x0020		/* invalid fd (revents only) */
+
+#define INFTIM		(-1)		/* no timeout */
+
+#ifndef KERNEL
+__BEGIN_DECLS
+int	poll(struct pollfd *, nfds_t, int);
+__END_DECLS
+#endif
+
+#endif /* !_SYS_POLL_H_ */
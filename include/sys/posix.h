@@ -32,12 +32,31 @@
 #ifndef KERNEL
 
 #include <sys/types.h>
+#include <sys/syslimits.h>
+
+/*
+ * Descriptor layout.  The file descriptors of the fs server come
+ * first, the socket descriptors of the net server and the epoll
+ * descriptors of the library follow them, so that read(), write()
+ * and close() can tell them apart.
+ */
+#define SOCKFD_BASE	OPEN_MAX
+#define NSOCKFD		32		/* max socket descriptors */
+#define EPOLLFD_BASE	(SOCKFD_BASE + NSOCKFD)
+#define NEPOLLFD	8		/* max epoll descriptors */
+
+#define ISSOCKFD(fd)	((fd) >= SOCKFD_BASE && (fd) < EPOLLFD_BASE)
+#define ISEPOLLFD(fd)	((fd) >= EPOLLFD_BASE && \
+			 (fd) < EPOLLFD_BASE + NEPOLLFD)
 
 extern object_t __proc_obj;
 extern object_t __fs_obj;
+extern object_t __net_obj;
 
 __BEGIN_DECLS
 int __posix_call(object_t, void *, size_t, int);
+int __sock_call(void *, size_t, int);
+int __epoll_close(int);
 __END_DECLS
 
 #endif	/* KERNEL */
@@ -79,6 +79,7 @@
 #define MUTEX_INITIALIZER	(mutex_t)0x4d496e69
 #define COND_INITIALIZER	(cond_t)0x43496e69
 
+struct timespec;
 
 __BEGIN_DECLS
 void	exception_return(void);
@@ -99,6 +100,7 @@ int	thread_create(task_t task, thread_t *tp);
 int	thread_terminate(thread_t t);
 int	thread_load(thread_t t, void (*entry)(void), void *stack);
 thread_t thread_self(void);
+int	thread_selfaddr(u_long **addr);
 void	thread_yield(void);
 int	thread_suspend(thread_t t);
 int	thread_resume(thread_t t);
@@ -112,6 +114,8 @@ int	vm_free(task_t task, void *addr);
 int	vm_attribute(task_t task, void *addr, int prot);
 int	vm_map(task_t target, void  *addr, size_t size, void **alloc);
 int	vm_map_phys(paddr_t addr, size_t size, void **alloc);
+int	vm_share(task_t target, void *addr, void *dest);
+int	vm_check(task_t target, void *addr, size_t size, void *local);
 
 int	object_create(const char *name, object_t *objp);
 int	object_destroy(object_t obj);
@@ -120,6 +124,10 @@ int	object_lookup(const char *name, object_t *objp);
 int	msg_send(object_t obj, void *msg, size_t size);
 int	msg_receive(object_t obj, void *msg, size_t size);
 int	msg_reply(object_t obj, void *msg, size_t size);
+int	msg_send_async(object_t obj, void *msg, size_t size);
+int	msg_poll(void **msgp, int wait);
+int	msg_receive_batch(object_t obj, void *buf, size_t size, int *countp);
+int	msg_reply_batch(object_t obj, void *buf, size_t size, int count);
 
 int	timer_sleep(u_long msec, u_long *remain);
 int	timer_alarm(u_long msec, u_long *remain);
@@ -155,6 +163,7 @@ int	sys_log(const char *msg);
 void	sys_panic(const char *msg);
 int	sys_info(int type, void *buf);
 int	sys_time(u_long *ticks);
+int	sys_uptime(struct timespec *ts);
 int	sys_debug(int cmd, void *data);
 
 void	panic(const char *fmt, ...);
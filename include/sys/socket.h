@@ -0,0 +1,200 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SYS_SOCKET_H_
+#define _SYS_SOCKET_H_
+
+#include <sys/types.h>
+#include <sys/cdefs.h>
+#include <sys/uio.h>
+#include <sys/poll.h>
+#include <sys/epoll.h>
+
+/*
+ * The values are shared with the lwIP stack of the net server.
+ */
+typedef uint32_t	socklen_t;
+typedef uint8_t		sa_family_t;
+
+/*
+ * Types
+ */
+#define SOCK_STREAM	1		/* stream socket */
+#define SOCK_DGRAM	2		/* datagram socket */
+#define SOCK_RAW	3		/* raw-protocol interface */
+
+/*
+ * Option flags per-socket.
+ */
+#define SO_DEBUG	0x0001		/* turn on debugging info recording */
+#define SO_ACCEPTCONN	0x0002		/* socket has had listen() */
+#define SO_REUSEADDR	0x0004		/* allow local address reuse */
+#define SO_KEEPALIVE	0x0008		/* keep connections alive */
+#define SO_DONTROUTE	0x0010		/* just use interface addresses */
+#define SO_BROADCAST	0x0020		/* permit sending of broadcast msgs */
+#define SO_LINGER	0x0080		/* linger on close if data present */
+
+/*
+ * Additional options, not kept in so_options.
+ */
+#define SO_SNDBUF	0x1001		/* send buffer size */
+#define SO_RCVBUF	0x1002		/* receive buffer size */
+#define SO_SNDTIMEO	0x1005		/* send timeout */
+#define SO_RCVTIMEO	0x1006		/* receive timeout */
+#define SO_ERROR	0x1007		/* get error status and clear */
+#define SO_TYPE		0x1008		/* get socket type */
+
+/*
+ * Level number for (get/set)sockopt() to apply to socket itself.
+ */
+#define SOL_SOCKET	0xfff		/* options for socket level */
+
+/*
+ * Address families.
+ */
+#define AF_UNSPEC	0		/* unspecified */
+#define AF_INET		2		/* internetwork: UDP, TCP, etc. */
+
+#define PF_UNSPEC	AF_UNSPEC
+#define PF_INET		AF_INET
+
+/*
+ * Structure used by kernel to store most addresses.
+ */
+struct sockaddr {
+	uint8_t		sa_len;		/* total length */
+	sa_family_t	sa_family;	/* address family */
+	char		sa_data[14];	/* actually longer; address value */
+};
+
+/*
+ * Message header for recvmsg and sendmsg calls.
+ */
+struct msghdr {
+	void		*msg_name;	/* optional address */
+	socklen_t	msg_namelen;	/* size of address */
+	struct iovec	*msg_iov;	/* scatter/gather array */
+	int		msg_iovlen;	/* # elements in msg_iov */
+	void		*msg_control;	/* ancillary data (not supported) */
+	socklen_t	msg_controllen;	/* ancillary data buffer len */
+	int		msg_flags;	/* flags on received message */
+};
+
+#define MSG_PEEK	0x01		/* peek at incoming message */
+#define MSG_WAITALL	0x02		/* wait for full request or error */
+#define MSG_OOB		0x04		/* process out-of-band data */
+#define MSG_DONTWAIT	0x08		/* this message should be nonblocking */
+#define MSG_MORE	0x10		/* sender will send more */
+
+/*
+ * howto arguments for shutdown(2)
+ */
+#define SHUT_RD		0		/* shut down the reading side */
+#define SHUT_WR		1		/* shut down the writing side */
+#define SHUT_RDWR	2		/* shut down both sides */
+
+/*
+ * Socket operation for sockbatch(). The operations are done in
+ * order by one request to the net server, and the result of each
+ * operation is stored in so_result and so_error.
+ *
+ *  SOP_SEND	send so_iov[so_count] to so_sd
+ *  SOP_RECV	receive to so_iov[so_count] from so_sd
+ *  SOP_ACCEPT	accept up to so_count connections on so_sd, and
+ *		store the new descriptors to so_fds
+ *  SOP_POLL	poll so_pfd[so_count] with so_timeout (msec)
+ *  SOP_EPCTL	do epoll_ctl() of the op so_flags for so_sd with the
+ *		events so_count and so_data
+ *  SOP_EPWAIT	get up to so_count ready events to so_ev
+ *
+ * Only the first data transfer of an operation may block, and
+ * MSG_DONTWAIT in so_flags makes it nonblocking too.
+ *
+ * If so_sem is not 0, SOP_POLL never blocks. Instead, the sockets
+ * are kept in the poll set for so_sem until any of them is ready
+ * or so_count is 0, and the server posts so_sem when they may get
+ * ready. The epoll set is also kept for so_sem, and it is released
+ * by SOP_EPCTL with 0 for so_flags.
+ */
+struct sockop {
+	int		so_op;		/* operation */
+	int		so_sd;		/* socket descriptor */
+	int		so_flags;	/* MSG_* flags */
+	int		so_count;	/* number of elements */
+	union {
+		struct iovec	*iov;
+		int		*fds;
+		struct pollfd	*pfd;
+		struct epoll_event *ev;
+		epoll_data_t	data;
+	} so_u;
+	int		so_timeout;	/* timeout for SOP_POLL */
+	sem_t		so_sem;		/* semaphore to post */
+	int		so_result;	/* bytes or count */
+	int		so_error;	/* error number */
+};
+#define so_iov		so_u.iov
+#define so_fds		so_u.fds
+#define so_pfd		so_u.pfd
+#define so_ev		so_u.ev
+#define so_data		so_u.data
+
+#define SOP_SEND	1
+#define SOP_RECV	2
+#define SOP_ACCEPT	3
+#define SOP_POLL	4
+#define SOP_EPCTL	5
+#define SOP_EPWAIT	6
+
+#define SOP_MAX		16		/* max operations in a batch */
+
+#ifndef KERNEL
+__BEGIN_DECLS
+int	accept(int, struct sockaddr *, socklen_t *);
+int	bind(int, const struct sockaddr *, socklen_t);
+int	connect(int, const struct sockaddr *, socklen_t);
+int	getpeername(int, struct sockaddr *, socklen_t *);
+int	getsockname(int, struct sockaddr *, socklen_t *);
+int	getsockopt(int, int, int, void *, socklen_t *);
+int	listen(int, int);
+ssize_t	recv(int, void *, size_t, int);
+ssize_t	recvfrom(int, void *, size_t, int, struct sockaddr *, socklen_t *);
+ssize_t	recvmsg(int, struct msghdr *, int);
+ssize_t	send(int, const void *, size_t, int);
+ssize_t	sendto(int, const void *, size_t, int, const struct sockaddr *,
+	       socklen_t);
+ssize_t	sendmsg(int, const struct msghdr *, int);
+int	setsockopt(int, int, int, const void *, socklen_t);
+int	shutdown(int, int);
+int	socket(int, int, int);
+int	sockbatch(struct sockop *, int);
+__END_DECLS
+#endif /* !KERNEL */
+
+#endif /* !_SYS_SOCKET_H_ */
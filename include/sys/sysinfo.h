@@ -54,6 +54,8 @@
 #define INFO_VM		6
 #define INFO_DEVICE	7
 #define INFO_IRQ	8
+#define INFO_OBJECT	9
+#define INFO_KMEM	10
 
 /*
  * Kernel information
@@ -70,10 +72,17 @@ struct kerninfo {
 /*
  * Memory information
  */
+#define NPAGEORDERS	12		/* number of page block orders */
+
 struct meminfo {
 	psize_t		total;		/* total memory size in bytes */
 	psize_t		free;		/* current free memory in bytes */
 	psize_t		bootdisk;	/* total size of boot disk */
+	int		maxorder;	/* largest free block order, or -1 */
+	u_int		nblocks[NPAGEORDERS]; /* free blocks per order */
+	u_long		cowfaults;	/* copy-on-write faults */
+	u_long		cowcopies;	/* pages copied on write */
+	u_long		zerofills;	/* pages filled on demand */
 };
 
 /*
@@ -127,6 +136,8 @@ struct vminfo {
 #define VF_EXEC		0x00000004
 #define VF_SHARED	0x00000008
 #define VF_MAPPED	0x00000010
+#define VF_COW		0x00000020
+#define VF_LAZY		0x00000040
 #define VF_FREE		0x00000080
 
 /*
@@ -146,6 +157,8 @@ struct timerinfo {
 	int		hz;		/* clock frequency */
 	u_long		cputicks;	/* total cpu ticks since boot */
 	u_long		idleticks;	/* total idle ticks */
+	u_long		ntimers;	/* number of active timers */
+	u_long		cascades;	/* timers moved to lower wheel */
 };
 
 /*
@@ -160,4 +173,32 @@ struct irqinfo {
 	thread_t	thread;		/* thread id of ist */
 };
 
+/*
+ * Kernel memory cache information
+ */
+struct kmeminfo {
+	u_long		cookie;		/* index cookie */
+	size_t		size;		/* object size */
+	int		nobjs;		/* objects per slab */
+	int		nslabs;		/* number of slabs */
+	int		inuse;		/* number of used objects */
+	u_long		nallocs;	/* total allocations */
+	u_long		nfrees;		/* total frees */
+	u_long		nfails;		/* failed allocations */
+	char		name[MAXCACHENAME]; /* cache name */
+};
+
+/*
+ * Object information
+ */
+struct objinfo {
+	int		nobjects;	/* number of objects */
+	int		nnamed;		/* number of named objects */
+	int		hashsize;	/* number of hash buckets */
+	u_int		resizes;	/* number of hash table resizes */
+	u_long		lookups;	/* number of object_lookup calls */
+	u_long		hits;		/* lookups which found object */
+	u_long		compares;	/* name compares in hash chains */
+};
+
 #endif /* !_SYS_SYSINFO_H */
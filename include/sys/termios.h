@@ -282,6 +282,7 @@ struct winsize {
 /* Prex unique */
 #define	TIOCSETSIGT	_IOW('t', 200, int)	/* set signal task */
 #define TIOCINQ		_IOR('t', 201, int)	/* input queue size */
+#define TIOCWAIT	_IOWR('t', 202, int)	/* wait for input event */
 
 /*
  * Defaults on "first" open.
@@ -0,0 +1,74 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SYS_TREE_H
+#define _SYS_TREE_H
+
+#include <sys/cdefs.h>
+
+/*
+ * Balanced binary tree (AVL tree).
+ *
+ * The tree does not compare the keys by itself. The caller
+ * finds the position of the new node, and links it with
+ * tree_insert(). If the node holds the data computed from its
+ * children, the update routine is called whenever the children
+ * of the node are changed.
+ */
+struct tnode {
+	struct tnode	*left;
+	struct tnode	*right;
+	struct tnode	*parent;
+	int		height;
+};
+typedef struct tnode *tnode_t;
+
+struct tree {
+	struct tnode	*root;
+	void		(*update)(struct tnode *);
+};
+typedef struct tree *tree_t;
+
+#define tree_root(tree)		((tree)->root)
+#define tree_left(node)		((node)->left)
+#define tree_right(node)	((node)->right)
+
+/* Get the struct for this entry */
+#define tree_entry(n, type, member) \
+    ((type *)((char *)(n) - (unsigned long)(&((type *)0)->member)))
+
+__BEGIN_DECLS
+void	tree_init(tree_t, void (*)(struct tnode *));
+void	tree_insert(tree_t, tnode_t, tnode_t *, tnode_t);
+void	tree_insert_after(tree_t, tnode_t, tnode_t);
+void	tree_remove(tree_t, tnode_t);
+void	tree_fixup(tree_t, tnode_t);
+__END_DECLS
+
+#endif /* !_SYS_TREE_H */
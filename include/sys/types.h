@@ -109,7 +109,7 @@ typedef	long		time_t;		/* time of day in seconds */
  * be enough for most uses.
  */
 #ifndef	FD_SETSIZE
-#define	FD_SETSIZE	16
+#define	FD_SETSIZE	64
 #endif
 
 typedef int32_t	fd_mask;
@@ -69,11 +69,15 @@ struct vnode {
 	int		v_flags;	/* vnode flag */
 	mode_t		v_mode;		/* file mode */
 	size_t		v_size;		/* file size */
+	time_t		v_mtime;	/* time of last modification */
 	mutex_t		v_lock;		/* lock for this vnode */
 	int		v_nrlocks;	/* lock count (for debug) */
 	int		v_blkno;	/* block number */
+	int		v_ranext;	/* next block of sequential read */
+	int		v_rawin;	/* read-ahead window in blocks */
 	char		*v_path;	/* pointer to path in fs */
 	void		*v_data;	/* private data for fs */
+	struct list	v_pollers;	/* poll entries for this vnode */
 };
 typedef struct vnode *vnode_t;
 
@@ -81,6 +85,10 @@ typedef struct vnode *vnode_t;
 #define VROOT		0x0001		/* root of its file system */
 #define VISTTY		0x0002		/* device is tty */
 #define VPROTDEV	0x0004		/* protected device */
+#define VTTYWATCH	0x0008		/* tty input is watched for poll */
+
+/* max read-ahead window in blocks */
+#define VRA_MAXWIN	16
 
 /*
  * Vnode attribute
@@ -119,6 +127,7 @@ struct vnops {
 	int (*vop_setattr)	(vnode_t, struct vattr *);
 	int (*vop_inactive)	(vnode_t);
 	int (*vop_truncate)	(vnode_t, off_t);
+	int (*vop_poll)		(vnode_t, file_t, int);
 };
 
 typedef	int (*vnop_open_t)	(vnode_t, int);
@@ -139,6 +148,7 @@ typedef	int (*vnop_getattr_t)	(vnode_t, struct vattr *);
 typedef	int (*vnop_setattr_t)	(vnode_t, struct vattr *);
 typedef	int (*vnop_inactive_t)	(vnode_t);
 typedef	int (*vnop_truncate_t)	(vnode_t, off_t);
+typedef	int (*vnop_poll_t)	(vnode_t, file_t, int);
 
 /*
  * vnode interface
@@ -162,15 +172,18 @@ typedef	int (*vnop_truncate_t)	(vnode_t, off_t);
 #define VOP_SETATTR(VP, VAP)	   ((VP)->v_op->vop_setattr)(VP, VAP)
 #define VOP_INACTIVE(VP)	   ((VP)->v_op->vop_inactive)(VP)
 #define VOP_TRUNCATE(VP, N)	   ((VP)->v_op->vop_truncate)(VP, N)
+#define VOP_POLL(VP, FP, E)	   ((VP)->v_op->vop_poll)(VP, FP, E)
 
 __BEGIN_DECLS
 int	 vop_nullop(void);
 int	 vop_einval(void);
+int	 vop_seltrue(vnode_t, file_t, int);
 vnode_t	 vn_lookup(struct mount *, char *);
 void	 vn_lock(vnode_t);
 void	 vn_unlock(vnode_t);
 int	 vn_stat(vnode_t, struct stat *);
 int	 vn_access(vnode_t, int);
+int	 vn_readahead(vnode_t, int, int);
 vnode_t	 vget(struct mount *, char *);
 void	 vput(vnode_t);
 void	 vgone(vnode_t);
@@ -178,6 +191,8 @@ void	 vref(vnode_t);
 void	 vrele(vnode_t);
 int	 vcount(vnode_t);
 void	 vflush(struct mount *);
+void	 vn_pollwakeup(vnode_t);
+void	 vn_touch(vnode_t);
 __END_DECLS
 
 #endif /* !_SYS_VNODE_H_ */
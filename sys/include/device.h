@@ -54,6 +54,7 @@ int	 device_read(device_t, void *, size_t *, int);
 int	 device_write(device_t, void *, size_t *, int);
 int	 device_ioctl(device_t, u_long, void *);
 int	 device_info(struct devinfo *);
+void	 device_cleanup(task_t);
 void	 device_init(void);
 __BEGIN_DECLS
 
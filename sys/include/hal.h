@@ -101,6 +101,7 @@ void	  context_set(context_t, int, register_t);
 void	  context_switch(context_t, context_t);
 void	  context_save(context_t);
 void	  context_restore(context_t);
+void	  context_cleanup(context_t);
 void	  context_dump(context_t);
 
 void	  mmu_init(struct mmumap *);
@@ -126,6 +127,8 @@ void	  interrupt_unmask(int, int);
 void	  interrupt_setup(int, int);
 void	  interrupt_init(void);
 
+int	  cpu_ffs(uint32_t);
+
 void	  machine_startup(void);
 void	  machine_idle(void);
 void	  machine_powerdown(int);
@@ -133,6 +136,11 @@ void	  machine_abort(void);
 void	  machine_bootinfo(struct bootinfo **);
 
 void	  clock_init(void);
+#ifdef CONFIG_TICKLESS
+int	  clock_stop(u_long);
+u_long	  clock_resume(void);
+u_long	  clock_nsec(void);
+#endif
 
 #ifdef DEBUG
 void	  diag_init(void);
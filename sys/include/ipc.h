@@ -34,28 +34,62 @@
 #include <types.h>
 #include <sys/list.h>
 #include <sys/queue.h>
+#include <sys/sysinfo.h>
 #include <ipc/ipc.h>
 
 struct object {
 	struct list	link;		/* linkage for all objects in system */
 	char		name[MAXOBJNAME]; /* object name */
+	struct list	hash_link;	/* linkage on name hash chain */
 	struct list	task_link;	/* linkage on object list in task */
 	task_t		owner;		/* creator of this object */
 	struct queue	sendq;		/* queue for sender threads */
 	struct queue	recvq;		/* queue for receiver threads */
+	struct queue	batchq;		/* queue for batch receiver threads */
+	struct queue	asyncq;		/* queue for asynchronous messages */
+	int		nasync;		/* number of messages in asyncq */
 };
 
+/*
+ * Asynchronous message.
+ *
+ * The message data is copied into the kernel buffer which
+ * follows this header. The sender thread keeps running and
+ * collects the reply later with msg_poll().
+ */
+struct amsg {
+	struct queue	link;		/* linkage on IPC queue */
+	struct list	sender_link;	/* linkage on sender's list */
+	thread_t	sender;		/* sender thread, NULL if gone */
+	object_t	obj;		/* target object */
+	int		state;		/* message state */
+	int		priority;	/* priority of sender */
+	int		error;		/* completion status */
+	void		*uaddr;		/* user address of message */
+	size_t		size;		/* size of message */
+};
+
+/* state for asynchronous message */
+#define AM_QUEUED	0	/* waiting in object's queue */
+#define AM_BUSY		1	/* received by server */
+#define AM_DONE		2	/* replied */
+
 __BEGIN_DECLS
 int	 object_create(const char *, object_t *);
 int	 object_lookup(const char *, object_t *);
 int	 object_destroy(object_t);
 int	 object_valid(object_t);
 void	 object_cleanup(task_t);
+void	 object_info(struct objinfo *);
 void	 object_init(void);
 
 int	 msg_send(object_t, void *, size_t);
 int	 msg_receive(object_t, void *, size_t);
 int	 msg_reply(object_t, void *, size_t);
+int	 msg_send_async(object_t, void *, size_t);
+int	 msg_poll(void **, int);
+int	 msg_receive_batch(object_t, void *, size_t, int *);
+int	 msg_reply_batch(object_t, void *, size_t, int);
 void	 msg_cancel(thread_t);
 void	 msg_abort(object_t);
 void	 msg_init(void);
@@ -32,11 +32,18 @@
 
 #include <types.h>
 #include <sys/cdefs.h>
+#include <sys/sysinfo.h>
+
+struct kmem_cache;
 
 __BEGIN_DECLS
 void	*kmem_alloc(size_t);
 void	 kmem_free(void *);
 void	*kmem_map(void *, size_t);
+struct kmem_cache *kmem_cache_create(const char *, size_t, void (*)(void *));
+void	*kmem_cache_alloc(struct kmem_cache *);
+void	 kmem_cache_free(struct kmem_cache *, void *);
+int	 kmem_info(struct kmeminfo *);
 void	 kmem_init(void);
 __END_DECLS
 
@@ -37,6 +37,8 @@
 __BEGIN_DECLS
 paddr_t	 page_alloc(psize_t);
 void	 page_free(paddr_t, psize_t);
+void	 page_share(paddr_t, psize_t);
+int	 page_shared(paddr_t);
 int	 page_reserve(paddr_t, psize_t);
 void	 page_info(struct meminfo *);
 void	 page_init(void);
@@ -46,7 +46,9 @@ struct sem {
 
 struct mutex {
 	struct list	task_link;	/* linkage on mutex list in task */
+	struct list	hash_link;	/* linkage on mutex hash table */
 	task_t		owner;		/* owner task */
+	mutex_t		*uaddr;		/* mutex variable in user space */
 	struct event	event;		/* event */
 	struct list	link;		/* linkage on locked mutex list */
 	thread_t	holder;		/* thread that holds the mutex */
@@ -69,6 +71,9 @@ struct cond {
 #define MUTEX_INITIALIZER	(mutex_t)0x4d496e69	/* 'MIni' */
 #define COND_INITIALIZER	(cond_t)0x43496e69	/* 'CIni' */
 
+/* lock word flag: holder must unlock the mutex with system call */
+#define MUTEX_CONTESTED		0x1
+
 __BEGIN_DECLS
 int	 sem_init(sem_t *, u_int);
 int	 sem_destroy(sem_t *);
@@ -86,6 +91,7 @@ int	 mutex_unlock(mutex_t *);
 void	 mutex_cancel(thread_t);
 void	 mutex_setpri(thread_t, int);
 void	 mutex_cleanup(task_t);
+void	 sync_init(void);
 
 int	 cond_init(cond_t *);
 int	 cond_destroy(cond_t *);
@@ -33,6 +33,8 @@
 #include <types.h>
 #include <sys/cdefs.h>
 
+struct timespec;
+
 __BEGIN_DECLS
 int	 sysinfo(int, void *);
 int	 sys_info(int, void *);
@@ -40,6 +42,7 @@ int	 sys_log(const char *);
 int	 sys_debug(int, void *);
 int	 sys_panic(const char *);
 int	 sys_time(u_long *);
+int	 sys_uptime(struct timespec *);
 int	 sys_nosys(void);
 __END_DECLS
 
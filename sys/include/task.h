@@ -51,6 +51,8 @@ struct task {
 	cap_t		capability;	/* security permission flag */
 	struct timer	alarm;		/* timer for alarm exception */
 	void		(*handler)(int); /* pointer to exception handler */
+	u_long		*selfaddr;	/* user address of thread id page */
+	u_long		*selfpage;	/* kernel address of thread id page */
 	struct list	threads;	/* list of threads */
 	struct list	objects;	/* IPC objects owned by this task */
 	struct list	mutexes;	/* mutexes owned by this task */
@@ -63,6 +63,7 @@ struct thread {
 	uint32_t 	excbits;	/* bitmap of pending exceptions */
 	struct list 	mutexes;	/* mutexes locked by this thread */
 	mutex_t 	mutex_waiting;	/* mutex pointer currently waiting */
+	u_long		lockid;		/* holder id in mutex lock word */
 	struct queue 	ipc_link;	/* linkage on IPC queue */
 	void		*msgaddr;	/* kernel address of IPC message */
 	size_t		msgsize;	/* size of IPC message */
@@ -70,6 +71,10 @@ struct thread {
 	thread_t	receiver;	/* thread that receives IPC message */
 	object_t 	sendobj;	/* IPC object sending to */
 	object_t 	recvobj;	/* IPC object receiving from */
+	struct list	amsgs;		/* asynchronous messages sent */
+	struct queue	amsg_done;	/* completed asynchronous messages */
+	struct queue	amsg_held;	/* asynchronous messages received */
+	struct event	amsg_event;	/* event for message completion */
 	void		*kstack;	/* base address of kernel stack */
 	struct context 	ctx;		/* machine specific context */
 };
@@ -105,6 +110,7 @@ int	 thread_terminate(thread_t);
 void	 thread_destroy(thread_t);
 int	 thread_load(thread_t, void (*)(void), void *);
 thread_t thread_self(void);
+int	 thread_selfaddr(u_long **);
 int	 thread_valid(thread_t);
 void	 thread_yield(void);
 int	 thread_suspend(thread_t);
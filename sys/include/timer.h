@@ -36,6 +36,8 @@
 #include <sys/sysinfo.h>
 #include <event.h>
 
+struct timespec;
+
 /*
  * Time-out element.
  */
@@ -81,6 +83,12 @@ void	 timer_cancel(thread_t);
 void	 timer_clock(void);
 void	 timer_handler(void);
 u_long	 timer_ticks(void);
+void	 timer_uptime(struct timespec *);
+#ifdef CONFIG_TICKLESS
+void	 timer_catchup(u_long);
+void	 timer_idle(void);
+void	 timer_resume(void);
+#endif
 void	 timer_info(struct timerinfo *);
 void	 timer_init(void);
 __END_DECLS
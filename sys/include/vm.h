@@ -32,6 +32,7 @@
 
 #include <types.h>
 #include <sys/cdefs.h>
+#include <sys/tree.h>
 #include <sys/sysinfo.h>
 #include <sys/bootinfo.h>
 
@@ -43,6 +44,8 @@ struct seg {
 	struct seg	*next;
 	struct seg	*sh_prev;	/* link for all shared segments */
 	struct seg	*sh_next;
+	struct tnode	node;		/* node of segment tree */
+	size_t		maxfree;	/* largest free segment in subtree */
 	vaddr_t		addr;		/* base address */
 	size_t		size;		/* size */
 	int		flags;		/* SEG_* flag */
@@ -55,7 +58,11 @@ struct seg {
 #define SEG_EXEC	0x00000004
 #define SEG_SHARED	0x00000008
 #define SEG_MAPPED	0x00000010
+#define SEG_COW		0x00000020
+#define SEG_LAZY	0x00000040
 #define SEG_FREE	0x00000080
+#define SEG_HOLD	0x00000100	/* holds reference of mapped pages */
+#define SEG_KERNEL	0x00000200	/* page written by kernel */
 
 /* Attribute for vm_attribute() */
 #define	PROT_NONE	0x0		/* pages cannot be accessed */
@@ -69,6 +76,7 @@ struct seg {
  */
 struct vm_map {
 	struct seg	head;		/* list head of segments */
+	struct tree	tree;		/* segment tree sorted by address */
 	int		refcnt;		/* reference count */
 	pgd_t		pgd;		/* page directory */
 	size_t		total;		/* total used size */
@@ -80,6 +88,8 @@ int	 vm_free(task_t, void *);
 int	 vm_attribute(task_t, void *, int);
 int	 vm_map(task_t, void *, size_t, void **);
 int	 vm_map_phys(paddr_t, size_t, void **);
+int	 vm_share(task_t, void *, void *);
+int	 vm_check(task_t, void *, size_t, void *);
 vm_map_t vm_dup(vm_map_t);
 vm_map_t vm_create(void);
 int	 vm_reference(vm_map_t);
@@ -87,7 +97,12 @@ void	 vm_terminate(vm_map_t);
 void	 vm_switch(vm_map_t);
 int	 vm_load(vm_map_t, struct module *, void **);
 paddr_t	 vm_translate(vaddr_t, size_t);
+int	 vm_kpage(vm_map_t, vaddr_t *, void **);
+void	*vm_kpage_dup(vm_map_t, vaddr_t);
+void	 vm_kpage_free(void *);
 int	 vm_info(struct vminfo *);
+int	 vm_fault(vaddr_t);
+void	 vm_stat(struct meminfo *);
 void	 vm_init(void);
 __END_DECLS
 
@@ -53,6 +53,17 @@
  * mapped to the receiver's memory by kernel. Since there is no page
  * out of memory in this system, we can copy the message data via physical
  * memory at anytime.
+ *
+ * Asynchronous transmission:
+ *
+ * msg_send_async() copies the message into a kernel buffer and returns
+ * immediately. Each object can hold up to MAXASYNC pending asynchronous
+ * messages. A server receives them with msg_receive() like other
+ * messages, or receives several of them at once with msg_receive_batch()
+ * and replies with msg_reply_batch(). The reply is stored in the kernel
+ * buffer, and the sender is notified through its completion event.
+ * msg_poll() copies the reply back to the original message buffer of
+ * the sender.
  */
 
 #include <kernel.h>
@@ -65,8 +76,11 @@
 #include <ipc.h>
 
 /* forward declarations */
+static thread_t	msg_top(queue_t);
 static thread_t	msg_dequeue(queue_t);
 static void	msg_enqueue(queue_t, thread_t);
+static struct amsg *amsg_top(queue_t);
+static void	amsg_complete(struct amsg *, int);
 
 static struct event ipc_event;		/* event for IPC operation */
 
@@ -188,6 +202,7 @@ int
 msg_receive(object_t obj, void *msg, size_t size)
 {
 	thread_t t;
+	struct amsg *m;
 	size_t len;
 	int rc, error = 0;
 
@@ -218,7 +233,7 @@ msg_receive(object_t obj, void *msg, size_t size)
 	/*
 	 * If no message exists, wait until message arrives.
 	 */
-	while (queue_empty(&obj->sendq)) {
+	while (queue_empty(&obj->sendq) && queue_empty(&obj->asyncq)) {
 		/*
 		 * Block until someone sends a message.
 		 */
@@ -254,6 +269,29 @@ msg_receive(object_t obj, void *msg, size_t size)
 		 */
 	}
 
+	/*
+	 * Take an asynchronous message if its sender has
+	 * higher priority than any synchronous sender.
+	 */
+	if (!queue_empty(&obj->asyncq)) {
+		m = amsg_top(&obj->asyncq);
+		if (queue_empty(&obj->sendq) ||
+		    m->priority < msg_top(&obj->sendq)->priority) {
+			len = MIN(size, m->size);
+			if (copyout(m + 1, msg, len)) {
+				curthread->recvobj = NULL;
+				sched_unlock();
+				return EFAULT;
+			}
+			queue_remove(&m->link);
+			obj->nasync--;
+			m->state = AM_BUSY;
+			enqueue(&curthread->amsg_held, &m->link);
+			sched_unlock();
+			return 0;
+		}
+	}
+
 	t = msg_dequeue(&obj->sendq);
 
 	/*
@@ -288,6 +326,7 @@ int
 msg_reply(object_t obj, void *msg, size_t size)
 {
 	thread_t t;
+	struct amsg *m;
 	size_t len;
 
 	if (!user_area(msg))
@@ -299,6 +338,24 @@ msg_reply(object_t obj, void *msg, size_t size)
 		sched_unlock();
 		return EINVAL;
 	}
+	/*
+	 * Reply to the asynchronous message.
+	 */
+	if (!queue_empty(&curthread->amsg_held)) {
+		m = queue_entry(queue_first(&curthread->amsg_held),
+				struct amsg, link);
+		len = MIN(size, m->size);
+		if (copyin(msg, m + 1, len)) {
+			sched_unlock();
+			return EFAULT;
+		}
+		queue_remove(&m->link);
+		amsg_complete(m, 0);
+		if (queue_empty(&curthread->amsg_held))
+			curthread->recvobj = NULL;
+		sched_unlock();
+		return 0;
+	}
 	/*
 	 * Check if sender still exists
 	 */
@@ -333,6 +390,273 @@ msg_reply(object_t obj, void *msg, size_t size)
 	return 0;
 }
 
+/*
+ * Send an asynchronous message.
+ *
+ * The message is copied into the kernel, and the current
+ * thread continues without waiting for the reply. The reply
+ * is collected by msg_poll() later. The message buffer must
+ * be kept by the caller until then.
+ */
+int
+msg_send_async(object_t obj, void *msg, size_t size)
+{
+	struct msg_header *hdr;
+	struct amsg *m;
+	queue_t head;
+	thread_t t;
+
+	if (!user_area(msg))
+		return EFAULT;
+
+	if (size < sizeof(struct msg_header) || size > MAXASYNCMSG)
+		return EINVAL;
+
+	sched_lock();
+
+	if (!object_valid(obj)) {
+		sched_unlock();
+		return EINVAL;
+	}
+	if (obj->nasync >= MAXASYNC) {
+		sched_unlock();
+		return EAGAIN;
+	}
+	if ((m = kmem_alloc(sizeof(*m) + size)) == NULL) {
+		sched_unlock();
+		return ENOMEM;
+	}
+	if (copyin(msg, m + 1, size)) {
+		kmem_free(m);
+		sched_unlock();
+		return EFAULT;
+	}
+	hdr = (struct msg_header *)(m + 1);
+	hdr->task = curtask;
+
+	m->sender = curthread;
+	m->obj = obj;
+	m->state = AM_QUEUED;
+	m->priority = curthread->priority;
+	m->error = 0;
+	m->uaddr = msg;
+	m->size = size;
+	list_insert(&curthread->amsgs, &m->sender_link);
+	enqueue(&obj->asyncq, &m->link);
+	obj->nasync++;
+
+	/*
+	 * Wake up a receiver. The batch receiver is
+	 * preferred since it can take all pending messages.
+	 */
+	head = queue_empty(&obj->batchq) ? &obj->recvq : &obj->batchq;
+	if (!queue_empty(head)) {
+		t = msg_dequeue(head);
+		sched_unsleep(t, 0);
+	}
+	sched_unlock();
+	return 0;
+}
+
+/*
+ * Get the reply of the asynchronous message.
+ *
+ * The reply is copied to the original message buffer, and
+ * its address is returned in msgp. If wait is 0, EAGAIN is
+ * returned when no reply has arrived yet. ENOENT is returned
+ * when there is no outstanding message. The return value is
+ * the completion status of the message.
+ */
+int
+msg_poll(void **msgp, int wait)
+{
+	struct amsg *m;
+	void *uaddr;
+	int rc, error;
+
+	sched_lock();
+
+	while (queue_empty(&curthread->amsg_done)) {
+		if (list_empty(&curthread->amsgs)) {
+			sched_unlock();
+			return ENOENT;
+		}
+		if (!wait) {
+			sched_unlock();
+			return EAGAIN;
+		}
+		rc = sched_sleep(&curthread->amsg_event);
+		if (rc == SLP_INTR) {
+			sched_unlock();
+			return EINTR;
+		}
+	}
+	m = queue_entry(dequeue(&curthread->amsg_done), struct amsg, link);
+	list_remove(&m->sender_link);
+
+	error = m->error;
+	uaddr = m->uaddr;
+	if (copyout(m + 1, uaddr, m->size) ||
+	    copyout(&uaddr, msgp, sizeof(uaddr)))
+		error = EFAULT;
+	kmem_free(m);
+
+	sched_unlock();
+	return error;
+}
+
+/*
+ * Receive multiple asynchronous messages at once.
+ *
+ * Up to *countp messages are copied to the buffer. Each
+ * message is placed in a slot of the specified size. The
+ * number of received messages is returned in *countp. This
+ * routine blocks until at least one asynchronous message
+ * arrives. Synchronous messages are not received here.
+ *
+ * If the buffer or the count can not be written, EFAULT is
+ * returned and all messages are left in the queue.
+ *
+ * All received messages must be replied by msg_reply_batch()
+ * or msg_reply() before the next receive.
+ */
+int
+msg_receive_batch(object_t obj, void *buf, size_t size, int *countp)
+{
+	struct amsg *m;
+	queue_t q;
+	char *slot;
+	size_t len;
+	int rc, count, n, error = 0;
+
+	if (!user_area(buf))
+		return EFAULT;
+
+	if (copyin(countp, &count, sizeof(count)))
+		return EFAULT;
+
+	if (count <= 0 || size < sizeof(struct msg_header))
+		return EINVAL;
+
+	sched_lock();
+
+	if (!object_valid(obj)) {
+		sched_unlock();
+		return EINVAL;
+	}
+	if (obj->owner != curtask) {
+		sched_unlock();
+		return EACCES;
+	}
+	if (curthread->recvobj) {
+		sched_unlock();
+		return EBUSY;
+	}
+	curthread->recvobj = obj;
+
+	while (queue_empty(&obj->asyncq)) {
+		msg_enqueue(&obj->batchq, curthread);
+		rc = sched_sleep(&ipc_event);
+		if (rc != 0) {
+			switch (rc) {
+			case SLP_INVAL:
+				error = EINVAL;	/* Object has been deleted */
+				break;
+			case SLP_INTR:
+				queue_remove(&curthread->ipc_link);
+				error = EINTR;	/* Got exception */
+				break;
+			default:
+				panic("msg_receive_batch");
+				break;
+			}
+			curthread->recvobj = NULL;
+			sched_unlock();
+			return error;
+		}
+	}
+
+	slot = buf;
+	for (n = 0; n < count && !queue_empty(&obj->asyncq); n++) {
+		m = amsg_top(&obj->asyncq);
+		len = MIN(size, m->size);
+		if (copyout(m + 1, slot, len)) {
+			error = EFAULT;
+			break;
+		}
+		queue_remove(&m->link);
+		obj->nasync--;
+		m->state = AM_BUSY;
+		enqueue(&curthread->amsg_held, &m->link);
+		slot += size;
+	}
+	if (error == 0 && copyout(&n, countp, sizeof(n)))
+		error = EFAULT;
+	if (error) {
+		/*
+		 * Put the messages back to the head of the queue
+		 * in the original order, so that none is lost.
+		 */
+		while (!queue_empty(&curthread->amsg_held)) {
+			q = queue_last(&curthread->amsg_held);
+			queue_remove(q);
+			queue_insert(&obj->asyncq, q);
+			m = queue_entry(q, struct amsg, link);
+			m->state = AM_QUEUED;
+			obj->nasync++;
+		}
+		curthread->recvobj = NULL;
+		sched_unlock();
+		return error;
+	}
+	sched_unlock();
+	return 0;
+}
+
+/*
+ * Reply to the messages received by msg_receive_batch().
+ *
+ * The replies are taken from the buffer in the same slot
+ * layout, and are matched to the received messages in order.
+ */
+int
+msg_reply_batch(object_t obj, void *buf, size_t size, int count)
+{
+	struct amsg *m;
+	char *slot;
+	size_t len;
+	int n;
+
+	if (!user_area(buf))
+		return EFAULT;
+
+	sched_lock();
+
+	if (!object_valid(obj) || obj != curthread->recvobj ||
+	    queue_empty(&curthread->amsg_held)) {
+		sched_unlock();
+		return EINVAL;
+	}
+	slot = buf;
+	for (n = 0; n < count && !queue_empty(&curthread->amsg_held); n++) {
+		m = queue_entry(queue_first(&curthread->amsg_held),
+				struct amsg, link);
+		len = MIN(size, m->size);
+		if (copyin(slot, m + 1, len)) {
+			sched_unlock();
+			return EFAULT;
+		}
+		queue_remove(&m->link);
+		amsg_complete(m, 0);
+		slot += size;
+	}
+	if (queue_empty(&curthread->amsg_held))
+		curthread->recvobj = NULL;
+
+	sched_unlock();
+	return 0;
+}
+
 /*
  * Cancel pending message operation of the specified thread.
  * This is called when the thread is terminated.
@@ -356,6 +680,9 @@ msg_reply(object_t obj, void *msg, size_t size)
 void
 msg_cancel(thread_t t)
 {
+	struct amsg *m;
+	queue_t q;
+	list_t n;
 
 	sched_lock();
 
@@ -369,9 +696,43 @@ msg_cancel(thread_t t)
 		if (t->sender != NULL) {
 			sched_unsleep(t->sender, SLP_BREAK);
 			t->sender->receiver = NULL;
+		} else if (!queue_empty(&t->amsg_held)) {
+			/*
+			 * Fail the asynchronous messages which
+			 * are being processed by this thread.
+			 */
+			while (!queue_empty(&t->amsg_held)) {
+				q = dequeue(&t->amsg_held);
+				m = queue_entry(q, struct amsg, link);
+				amsg_complete(m, EAGAIN);
+			}
 		} else
 			queue_remove(&t->ipc_link);
 	}
+	/*
+	 * Discard the asynchronous messages sent by this thread.
+	 * The message being processed by a server is released
+	 * when the server replies to it.
+	 */
+	while (!list_empty(&t->amsgs)) {
+		n = list_first(&t->amsgs);
+		m = list_entry(n, struct amsg, sender_link);
+		list_remove(n);
+		switch (m->state) {
+		case AM_QUEUED:
+			queue_remove(&m->link);
+			m->obj->nasync--;
+			kmem_free(m);
+			break;
+		case AM_BUSY:
+			m->sender = NULL;
+			break;
+		case AM_DONE:
+			queue_remove(&m->link);
+			kmem_free(m);
+			break;
+		}
+	}
 	sched_unlock();
 }
 
@@ -382,6 +743,7 @@ msg_cancel(thread_t t)
 void
 msg_abort(object_t obj)
 {
+	struct amsg *m;
 	queue_t q;
 	thread_t t;
 
@@ -403,15 +765,28 @@ msg_abort(object_t obj)
 		t = queue_entry(q, struct thread, ipc_link);
 		sched_unsleep(t, SLP_INVAL);
 	}
+	while (!queue_empty(&obj->batchq)) {
+		q = dequeue(&obj->batchq);
+		t = queue_entry(q, struct thread, ipc_link);
+		sched_unsleep(t, SLP_INVAL);
+	}
+	/*
+	 * Fail all pending asynchronous messages.
+	 */
+	while (!queue_empty(&obj->asyncq)) {
+		q = dequeue(&obj->asyncq);
+		m = queue_entry(q, struct amsg, link);
+		obj->nasync--;
+		amsg_complete(m, EINVAL);
+	}
 	sched_unlock();
 }
 
 /*
- * Dequeue thread from the IPC queue.
- * The most highest priority thread will be chosen.
+ * Return the highest priority thread in the IPC queue.
  */
 static thread_t
-msg_dequeue(queue_t head)
+msg_top(queue_t head)
 {
 	queue_t q;
 	thread_t t, top;
@@ -425,6 +800,19 @@ msg_dequeue(queue_t head)
 			top = t;
 		q = queue_next(q);
 	}
+	return top;
+}
+
+/*
+ * Dequeue thread from the IPC queue.
+ * The most highest priority thread will be chosen.
+ */
+static thread_t
+msg_dequeue(queue_t head)
+{
+	thread_t top;
+
+	top = msg_top(head);
 	queue_remove(&top->ipc_link);
 	return top;
 }
@@ -436,6 +824,47 @@ msg_enqueue(queue_t head, thread_t t)
 	enqueue(head, &t->ipc_link);
 }
 
+/*
+ * Return the asynchronous message which has the highest
+ * sender priority. The oldest one is chosen among the
+ * messages with same priority.
+ */
+static struct amsg *
+amsg_top(queue_t head)
+{
+	queue_t q;
+	struct amsg *m, *top;
+
+	q = queue_first(head);
+	top = queue_entry(q, struct amsg, link);
+
+	while (!queue_end(head, q)) {
+		m = queue_entry(q, struct amsg, link);
+		if (m->priority < top->priority)
+			top = m;
+		q = queue_next(q);
+	}
+	return top;
+}
+
+/*
+ * Complete the asynchronous message, and notify its sender.
+ * The message is just released if the sender has gone.
+ */
+static void
+amsg_complete(struct amsg *m, int error)
+{
+
+	if (m->sender == NULL) {
+		kmem_free(m);
+		return;
+	}
+	m->state = AM_DONE;
+	m->error = error;
+	enqueue(&m->sender->amsg_done, &m->link);
+	sched_wakeup(&m->sender->amsg_event);
+}
+
 void
 msg_init(void)
 {
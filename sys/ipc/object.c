@@ -54,6 +54,12 @@
  * The protected object can be created only by the task which has
  * CAP_PROTSERV capability. Since this capability is given to the known
  * system servers, the client task can always trust the object owner.
+ *
+ * The named objects are kept in a hash table keyed by the object
+ * name. When the table becomes crowded, a new table of twice the
+ * size is allocated, and the entries are moved to the new table a
+ * few buckets at a time by the subsequent object operations. So,
+ * no single operation pays for rehashing the whole table.
  */
 
 #include <kernel.h>
@@ -62,11 +68,107 @@
 #include <task.h>
 #include <ipc.h>
 
+#define HASH_MINSIZE	32	/* initial number of hash buckets */
+#define HASH_MAXSIZE	256	/* max number of hash buckets */
+#define HASH_LOAD	2	/* average chain length to grow table */
+#define REHASH_STEP	4	/* buckets moved by one operation */
+
+/*
+ * Hash table for object names.
+ */
+struct objhash {
+	struct list	*bucket;	/* array of hash chains */
+	u_int		size;		/* number of buckets (power of 2) */
+};
+
 /* forward declarations */
 static object_t	object_find(const char *);
 
 static struct list	object_list;	/* list of all objects */
 
+static struct list	hash_bucket[HASH_MINSIZE]; /* initial buckets */
+static struct objhash	hash_cur;	/* current hash table */
+static struct objhash	hash_old;	/* table being rehashed */
+static u_int		rehash_index;	/* next bucket to move in hash_old */
+static struct objinfo	objstat;	/* object statistics */
+static struct kmem_cache *object_cache;	/* cache for object structure */
+
+/*
+ * Compute the hash value of the object name.
+ */
+static u_int
+object_hash(const char *name)
+{
+	u_int h = 0;
+	int i;
+
+	for (i = 0; i < MAXOBJNAME && name[i] != '\0'; i++)
+		h = h * 31 + (u_char)name[i];
+	return h;
+}
+
+/*
+ * Move some buckets of the old table to the current table.
+ * The old table is released when all entries are moved.
+ */
+static void
+object_rehash(void)
+{
+	struct list *head;
+	object_t obj;
+	u_int i;
+
+	if (hash_old.bucket == NULL)
+		return;
+
+	for (i = 0; i < REHASH_STEP && rehash_index < hash_old.size; i++) {
+		head = &hash_old.bucket[rehash_index++];
+		while (!list_empty(head)) {
+			obj = list_entry(list_first(head), struct object,
+					 hash_link);
+			list_remove(&obj->hash_link);
+			list_insert(&hash_cur.bucket[object_hash(obj->name) &
+						    (hash_cur.size - 1)],
+				    &obj->hash_link);
+		}
+	}
+	if (rehash_index == hash_old.size) {
+		if (hash_old.bucket != hash_bucket)
+			kmem_free(hash_old.bucket);
+		hash_old.bucket = NULL;
+		hash_old.size = 0;
+	}
+}
+
+/*
+ * Start growing the hash table if it is crowded. The
+ * table is kept as it is when we can not allocate memory.
+ */
+static void
+object_grow(void)
+{
+	struct list *bucket;
+	u_int i, size;
+
+	if (hash_old.bucket != NULL ||
+	    objstat.nnamed < hash_cur.size * HASH_LOAD ||
+	    hash_cur.size >= HASH_MAXSIZE)
+		return;
+
+	size = hash_cur.size * 2;
+	if ((bucket = kmem_alloc(size * sizeof(struct list))) == NULL)
+		return;
+	for (i = 0; i < size; i++)
+		list_init(&bucket[i]);
+
+	hash_old = hash_cur;
+	hash_cur.bucket = bucket;
+	hash_cur.size = size;
+	rehash_index = 0;
+	objstat.hashsize = size;
+	objstat.resizes++;
+}
+
 /*
  * Create a new object.
  *
@@ -109,23 +211,29 @@ object_create(const char *name, object_t *objp)
 		sched_unlock();
 		return EFAULT;
 	}
-	if (object_find(str) != NULL) {
+	if (str[0] != '\0' && object_find(str) != NULL) {
 		sched_unlock();
 		return EEXIST;
 	}
-	if ((obj = kmem_alloc(sizeof(*obj))) == NULL) {
+	if ((obj = kmem_cache_alloc(object_cache)) == NULL) {
 		sched_unlock();
 		return ENOMEM;
 	}
-	if (name != NULL)
-		strlcpy(obj->name, str, MAXOBJNAME);
+	strlcpy(obj->name, str, MAXOBJNAME);
 
 	obj->owner = curtask;
-	queue_init(&obj->sendq);
-	queue_init(&obj->recvq);
 	list_insert(&curtask->objects, &obj->task_link);
 	curtask->nobjects++;
 	list_insert(&object_list, &obj->link);
+	if (obj->name[0] != '\0') {
+		object_rehash();
+		list_insert(&hash_cur.bucket[object_hash(obj->name) &
+					    (hash_cur.size - 1)],
+			    &obj->hash_link);
+		objstat.nnamed++;
+		object_grow();
+	}
+	objstat.nobjects++;
 	copyout(&obj, objp, sizeof(obj));
 
 	sched_unlock();
@@ -148,7 +256,11 @@ object_lookup(const char *name, object_t *objp)
 		return error;
 
 	sched_lock();
+	object_rehash();
 	obj = object_find(str);
+	objstat.lookups++;
+	if (obj != NULL)
+		objstat.hits++;
 	sched_unlock();
 
 	if (obj == NULL)
@@ -174,21 +286,45 @@ object_valid(object_t obj)
 	return 0;
 }
 
+/*
+ * Search the hash chain for the object name.
+ */
 static object_t
-object_find(const char *name)
+object_search(struct objhash *tab, const char *name, u_int h)
 {
 	object_t obj;
-	list_t n;
+	list_t head, n;
 
-	for (n = list_first(&object_list); n != &object_list;
-	     n = list_next(n)) {
-		obj = list_entry(n, struct object, link);
+	head = &tab->bucket[h & (tab->size - 1)];
+	for (n = list_first(head); n != head; n = list_next(n)) {
+		objstat.compares++;
+		obj = list_entry(n, struct object, hash_link);
 		if (!strncmp(obj->name, name, MAXOBJNAME))
 			return obj;
 	}
 	return 0;
 }
 
+/*
+ * Find the named object. The old table is also checked
+ * while the hash table is being resized.
+ */
+static object_t
+object_find(const char *name)
+{
+	object_t obj;
+	u_int h;
+
+	if (name[0] == '\0')
+		return 0;
+
+	h = object_hash(name);
+	obj = object_search(&hash_cur, name, h);
+	if (obj == NULL && hash_old.bucket != NULL)
+		obj = object_search(&hash_old, name, h);
+	return obj;
+}
+
 /*
  * Deallocate an object-- the internal version of object_destory.
  */
@@ -200,7 +336,13 @@ object_deallocate(object_t obj)
 	obj->owner->nobjects--;
 	list_remove(&obj->task_link);
 	list_remove(&obj->link);
-	kmem_free(obj);
+	if (obj->name[0] != '\0') {
+		list_remove(&obj->hash_link);
+		objstat.nnamed--;
+		object_rehash();
+	}
+	objstat.nobjects--;
+	kmem_cache_free(object_cache, obj);
 }
 
 /*
@@ -242,9 +384,48 @@ object_cleanup(task_t task)
 	}
 }
 
+/*
+ * Object constructor.
+ *
+ * All message queues are empty when the object is
+ * returned to the cache, since msg_abort() drains them.
+ */
+static void
+object_ctor(void *p)
+{
+	object_t obj = p;
+
+	queue_init(&obj->sendq);
+	queue_init(&obj->recvq);
+	queue_init(&obj->batchq);
+	queue_init(&obj->asyncq);
+	obj->nasync = 0;
+}
+
+/*
+ * Get object statistics.
+ */
+void
+object_info(struct objinfo *info)
+{
+
+	*info = objstat;
+}
+
 void
 object_init(void)
 {
+	int i;
 
 	list_init(&object_list);
+	object_cache = kmem_cache_create("object", sizeof(struct object),
+					 object_ctor);
+	if (object_cache == NULL)
+		panic("object_init");
+
+	for (i = 0; i < HASH_MINSIZE; i++)
+		list_init(&hash_bucket[i]);
+	hash_cur.bucket = hash_bucket;
+	hash_cur.size = HASH_MINSIZE;
+	objstat.hashsize = HASH_MINSIZE;
 }
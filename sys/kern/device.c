@@ -117,6 +117,8 @@ static const dkifn_t dkient[] = {
 	/* 37 */ DKIENT(sys_nosys),
 	/* 38 */ DKIENT(sys_nosys),
 #endif
+	/* 39 */ DKIENT(task_self),
+	/* 40 */ DKIENT(page_share),
 };
 
 /* list head of the devices */
@@ -550,6 +552,17 @@ device_info(struct devinfo *info)
 	return error;
 }
 
+/*
+ * Notify all devices that the task is terminated, so that the
+ * drivers release the resources held for the task.
+ */
+void
+device_cleanup(task_t task)
+{
+
+	device_broadcast(DEVCTL_TASK_EXIT, (void *)task, 1);
+}
+
 /*
  * Initialize device driver module.
  */
@@ -64,6 +64,7 @@
 #include <sched.h>
 #include <thread.h>
 #include <irq.h>
+#include <timer.h>
 #include <hal.h>
 
 /* forward declarations */
@@ -202,6 +203,11 @@ irq_handler(int vector)
 	/* Profile */
 	irq->count++;
 
+#ifdef CONFIG_TICKLESS
+	/* Restart the clock tick stopped by the idle thread. */
+	timer_resume();
+#endif
+
 	/*
 	 * Call ISR
 	 */
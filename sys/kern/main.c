@@ -90,6 +90,7 @@ main(void)
 	timer_init();
 	object_init();
 	msg_init();
+	sync_init();
 
 	/*
 	 * Enable interrupt and
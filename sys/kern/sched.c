@@ -89,7 +89,20 @@
 #include <sched.h>
 #include <hal.h>
 
+/*
+ * Run queue bitmap:
+ *
+ * Each bit of runq_bits[] is set if the run queue of the
+ * corresponding priority is not empty. runq_summary has one
+ * bit for each word of runq_bits[] which is not zero. So, the
+ * highest priority can be found with two find-first-set
+ * operations regardless of the number of populated queues.
+ */
+#define NRUNQWORDS	(NPRI / 32)
+
 static struct queue	runq[NPRI];	/* run queues */
+static uint32_t		runq_bits[NRUNQWORDS]; /* non-empty run queues */
+static uint32_t		runq_summary;	/* non-zero words in runq_bits */
 static struct queue	wakeq;		/* queue for waking threads */
 static struct queue	dpcq;		/* DPC queue */
 static struct event	dpc_event;	/* event for DPC */
@@ -101,12 +114,38 @@ static int		maxpri;		/* highest priority in runq */
 static int
 runq_getbest(void)
 {
-	int pri;
+	int i;
 
-	for (pri = 0; pri < MINPRI; pri++)
-		if (!queue_empty(&runq[pri]))
-			break;
-	return pri;
+	if (runq_summary == 0)
+		return MINPRI;
+	i = cpu_ffs(runq_summary) - 1;
+	return (i * 32) + cpu_ffs(runq_bits[i]) - 1;
+}
+
+/*
+ * Mark the run queue of the specified priority as populated.
+ */
+static void
+runq_setbit(int pri)
+{
+
+	runq_bits[pri / 32] |= 1U << (pri % 32);
+	runq_summary |= 1U << (pri / 32);
+}
+
+/*
+ * Clear the bit for the specified priority if its run
+ * queue becomes empty.
+ */
+static void
+runq_clrbit(int pri)
+{
+
+	if (queue_empty(&runq[pri])) {
+		runq_bits[pri / 32] &= ~(1U << (pri % 32));
+		if (runq_bits[pri / 32] == 0)
+			runq_summary &= ~(1U << (pri / 32));
+	}
 }
 
 /*
@@ -119,6 +158,7 @@ runq_enqueue(thread_t t)
 {
 
 	enqueue(&runq[t->priority], &t->sched_link);
+	runq_setbit(t->priority);
 	if (t->priority < maxpri) {
 		maxpri = t->priority;
 		curthread->resched = 1;
@@ -134,6 +174,7 @@ runq_insert(thread_t t)
 {
 
 	queue_insert(&runq[t->priority], &t->sched_link);
+	runq_setbit(t->priority);
 	if (t->priority < maxpri)
 		maxpri = t->priority;
 }
@@ -150,8 +191,10 @@ runq_dequeue(void)
 
 	q = dequeue(&runq[maxpri]);
 	t = queue_entry(q, struct thread, sched_link);
-	if (queue_empty(&runq[maxpri]))
+	if (queue_empty(&runq[maxpri])) {
+		runq_clrbit(maxpri);
 		maxpri = runq_getbest();
+	}
 
 	return t;
 }
@@ -164,6 +207,7 @@ runq_remove(thread_t t)
 {
 
 	queue_remove(&t->sched_link);
+	runq_clrbit(t->priority);
 	maxpri = runq_getbest();
 }
 
@@ -243,6 +287,8 @@ sched_swtch(void)
 	 */
 	if (prev->task != next->task)
 		vm_switch(next->task->map);
+	if (next->task->selfpage != NULL)
+		*next->task->selfpage = next->lockid;
 	context_switch(&prev->ctx, &next->ctx);
 }
 
@@ -718,6 +764,9 @@ sched_init(void)
 
 	for (i = 0; i < NPRI; i++)
 		queue_init(&runq[i]);
+	for (i = 0; i < NRUNQWORDS; i++)
+		runq_bits[i] = 0;
+	runq_summary = 0;
 
 	queue_init(&wakeq);
 	queue_init(&dpcq);
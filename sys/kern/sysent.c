@@ -141,6 +141,14 @@ static const struct sysent sysent[] = {
 	/* 58 */ SYSENT(1, sys_time),
 	/* 59 */ SYSENT(2, sys_debug),
 	/* 60 */ SYSENT(3, vm_map_phys),
+	/* 61 */ SYSENT(3, msg_send_async),
+	/* 62 */ SYSENT(2, msg_poll),
+	/* 63 */ SYSENT(4, msg_receive_batch),
+	/* 64 */ SYSENT(4, msg_reply_batch),
+	/* 65 */ SYSENT(1, thread_selfaddr),
+	/* 66 */ SYSENT(1, sys_uptime),
+	/* 67 */ SYSENT(3, vm_share),
+	/* 68 */ SYSENT(4, vm_check),
 };
 
 #define NSYSCALL	(int)(sizeof(sysent) / sizeof(sysent[0]))
@@ -38,10 +38,13 @@
 #include <vm.h>
 #include <irq.h>
 #include <page.h>
+#include <kmem.h>
 #include <device.h>
+#include <ipc.h>
 #include <system.h>
 #include <hal.h>
 #include <sys/dbgctl.h>
+#include <sys/time.h>
 
 static char	infobuf[MAXINFOSZ];	/* common information buffer */
 
@@ -65,6 +68,7 @@ sysinfo(int type, void *buf)
 		break;
 	case INFO_MEMORY:
 		page_info(buf);
+		vm_stat(buf);
 		break;
 	case INFO_TIMER:
 		timer_info(buf);
@@ -84,6 +88,12 @@ sysinfo(int type, void *buf)
 	case INFO_IRQ:
 		error = irq_info(buf);
 		break;
+	case INFO_OBJECT:
+		object_info(buf);
+		break;
+	case INFO_KMEM:
+		error = kmem_info(buf);
+		break;
 	default:
 		error = EINVAL;
 		break;
@@ -131,6 +141,12 @@ sys_info(int type, void *buf)
 	case INFO_IRQ:
 		bufsz = sizeof(struct irqinfo);
 		break;
+	case INFO_OBJECT:
+		bufsz = sizeof(struct objinfo);
+		break;
+	case INFO_KMEM:
+		bufsz = sizeof(struct kmeminfo);
+		break;
 	default:
 		sched_unlock();
 		return EINVAL;
@@ -235,6 +251,18 @@ sys_time(u_long *ticks)
 	return copyout(&t, ticks, sizeof(t));
 }
 
+/*
+ * Get the time since OS boot in the resolution of the clock.
+ */
+int
+sys_uptime(struct timespec *ts)
+{
+	struct timespec t;
+
+	timer_uptime(&t);
+	return copyout(&t, ts, sizeof(t));
+}
+
 /*
  * nonexistent system call.
  */
@@ -39,6 +39,7 @@
 #include <sync.h>
 #include <vm.h>
 #include <exception.h>
+#include <device.h>
 #include <task.h>
 #include <hal.h>
 #include <sys/bootinfo.h>
@@ -46,6 +47,7 @@
 struct task		kernel_task;	/* kernel task */
 static struct list	task_list;	/* list for all tasks */
 static int		ntasks;		/* number of tasks in system */
+static struct kmem_cache *task_cache;	/* cache for task structure */
 
 /**
  * task_create - create a new task.
@@ -101,7 +103,7 @@ task_create(task_t parent, int vm_option, task_t *childp)
 		}
 	}
 
-	if ((task = kmem_alloc(sizeof(*task))) == NULL) {
+	if ((task = kmem_cache_alloc(task_cache)) == NULL) {
 		sched_unlock();
 		return ENOMEM;
 	}
@@ -123,7 +125,7 @@ task_create(task_t parent, int vm_option, task_t *childp)
 		break;
 	}
 	if (map == NULL) {
-		kmem_free(task);
+		kmem_cache_free(task_cache, task);
 		sched_unlock();
 		return ENOMEM;
 	}
@@ -134,6 +136,15 @@ task_create(task_t parent, int vm_option, task_t *childp)
 	task->map = map;
 	task->handler = parent->handler;
 	task->capability = parent->capability;
+	if (vm_option != VM_NEW && parent->selfaddr != NULL) {
+		/*
+		 * The thread id page was copied by vm_dup(), or
+		 * it is shared with the parent.
+		 */
+		task->selfpage = vm_kpage_dup(map, (vaddr_t)parent->selfaddr);
+		if (task->selfpage != NULL)
+			task->selfaddr = parent->selfaddr;
+	}
 	task->parent = parent;
 	task->flags = TF_DEFAULT;
 	strlcpy(task->name, "*noname", MAXTASKNAME);
@@ -189,6 +200,7 @@ task_terminate(task_t task)
 	mutex_cleanup(task);
 	cond_cleanup(task);
 	sem_cleanup(task);
+	device_cleanup(task);
 
 	/*
 	 * Terminate each thread in the task.
@@ -202,9 +214,11 @@ task_terminate(task_t task)
 	if (task == curtask)
 		thread_destroy(curthread);
 
+	if (task->selfpage != NULL)
+		vm_kpage_free(task->selfpage);
 	vm_terminate(task->map);
 	task->map = NULL;
-	kmem_free(task);
+	kmem_cache_free(task_cache, task);
 	ntasks--;
 	sched_unlock();
 	return 0;
@@ -530,6 +544,10 @@ task_init(void)
 
 	list_init(&task_list);
 
+	task_cache = kmem_cache_create("task", sizeof(struct task), NULL);
+	if (task_cache == NULL)
+		panic("task_init");
+
 	/*
 	 * Create a kernel task as first task.
 	 */
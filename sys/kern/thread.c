@@ -38,6 +38,8 @@
 #include <ipc.h>
 #include <sched.h>
 #include <sync.h>
+#include <timer.h>
+#include <vm.h>
 #include <hal.h>
 
 /* forward declarations */
@@ -47,6 +49,9 @@ static void	thread_deallocate(thread_t);
 static struct thread	idle_thread;	/* idle thread */
 static thread_t		zombie;		/* zombie thread */
 static struct list	thread_list;	/* list of all threads */
+static struct kmem_cache *thread_cache; /* cache for thread structure */
+static struct kmem_cache *kstack_cache; /* cache for kernel stack */
+static u_long		next_lockid;	/* next id for mutex lock word */
 
 /* global variable */
 thread_t curthread = &idle_thread;	/* current thread */
@@ -204,6 +209,42 @@ thread_self(void)
 	return curthread;
 }
 
+/*
+ * Return the user address of the current thread id.
+ *
+ * The thread id page is allocated for the task at the first
+ * call. It is read-only in user mode, and the kernel stores the
+ * lock id of the running thread to it at every context switch,
+ * so that the library can identify the calling thread without
+ * system call. It is used by the user mode fast path of the
+ * mutex.
+ */
+int
+thread_selfaddr(u_long **addr)
+{
+	task_t self = curtask;
+	vaddr_t va;
+	void *kva;
+	int error;
+
+	sched_lock();
+	if (self->selfaddr == NULL) {
+		if ((error = vm_kpage(self->map, &va, &kva)) != 0) {
+			sched_unlock();
+			return error;
+		}
+		self->selfaddr = (u_long *)va;
+		self->selfpage = kva;
+		*self->selfpage = curthread->lockid;
+	}
+	if (copyout(&self->selfaddr, addr, sizeof(self->selfaddr))) {
+		sched_unlock();
+		return EFAULT;
+	}
+	sched_unlock();
+	return 0;
+}
+
 /*
  * Return true if specified thread is valid.
  */
@@ -399,7 +440,11 @@ thread_idle(void)
 {
 
 	for (;;) {
+#ifdef CONFIG_TICKLESS
+		timer_idle();
+#else
 		machine_idle();
+#endif
 		sched_yield();
 	}
 }
@@ -413,18 +458,34 @@ thread_allocate(task_t task)
 	struct thread *t;
 	void *stack;
 
-	if ((t = kmem_alloc(sizeof(*t))) == NULL)
+	if ((t = kmem_cache_alloc(thread_cache)) == NULL)
 		return NULL;
 
-	if ((stack = kmem_alloc(KSTACKSZ)) == NULL) {
-		kmem_free(t);
+	if ((stack = kmem_cache_alloc(kstack_cache)) == NULL) {
+		kmem_cache_free(thread_cache, t);
 		return NULL;
 	}
 	memset(t, 0, sizeof(*t));
 
 	t->kstack = stack;
 	t->task = task;
+
+	/*
+	 * The lock id is not reused soon even if the thread
+	 * structure is reused. It is an even number, and it is
+	 * never same with MUTEX_INITIALIZER.
+	 */
+	do
+		next_lockid += 2;
+	while (next_lockid == 0 ||
+	       next_lockid == ((u_long)MUTEX_INITIALIZER & ~MUTEX_CONTESTED));
+	t->lockid = next_lockid;
+
 	list_init(&t->mutexes);
+	list_init(&t->amsgs);
+	queue_init(&t->amsg_done);
+	queue_init(&t->amsg_held);
+	event_init(&t->amsg_event, "amsg");
 	list_insert(&thread_list, &t->link);
 	list_insert(&task->threads, &t->task_link);
 	task->nthreads++;
@@ -448,6 +509,7 @@ thread_deallocate(thread_t t)
 	list_remove(&t->link);
 	t->excbits = 0;
 	t->task->nthreads--;
+	context_cleanup(&t->ctx);
 
 	if (zombie != NULL) {
 		/*
@@ -455,9 +517,9 @@ thread_deallocate(thread_t t)
 		 * was killed in previous request.
 		 */
 		ASSERT(zombie != curthread);
-		kmem_free(zombie->kstack);
+		kmem_cache_free(kstack_cache, zombie->kstack);
 		zombie->kstack = NULL;
-		kmem_free(zombie);
+		kmem_cache_free(thread_cache, zombie);
 		zombie = NULL;
 	}
 	if (t == curthread) {
@@ -469,9 +531,9 @@ thread_deallocate(thread_t t)
 		return;
 	}
 
-	kmem_free(t->kstack);
+	kmem_cache_free(kstack_cache, t->kstack);
 	t->kstack = NULL;
-	kmem_free(t);
+	kmem_cache_free(thread_cache, t);
 }
 
 /*
@@ -580,6 +642,12 @@ thread_init(void)
 
 	list_init(&thread_list);
 
+	thread_cache = kmem_cache_create("thread", sizeof(struct thread),
+					 NULL);
+	kstack_cache = kmem_cache_create("kstack", KSTACKSZ, NULL);
+	if (thread_cache == NULL || kstack_cache == NULL)
+		panic("thread_init");
+
 	if ((stack = kmem_alloc(KSTACKSZ)) == NULL)
 		panic("thread_init");
 
@@ -592,6 +660,10 @@ thread_init(void)
 	idle_thread.state = TS_RUN;
 	idle_thread.locks = 1;
 	list_init(&idle_thread.mutexes);
+	list_init(&idle_thread.amsgs);
+	queue_init(&idle_thread.amsg_done);
+	queue_init(&idle_thread.amsg_held);
+	event_init(&idle_thread.amsg_event, "amsg");
 
 	list_insert(&thread_list, &idle_thread.link);
 	list_insert(&kernel_task.threads, &idle_thread.task_link);
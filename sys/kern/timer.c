@@ -31,6 +31,17 @@
  * timer.c - kernel timer services.
  */
 
+/*
+ * The active timers are kept in the hierarchical timing wheel.
+ * The first wheel has one slot for each tick, and each slot of
+ * the upper wheels covers the whole range of the lower wheel.
+ * A timer is put into the lowest wheel which can hold its
+ * expiration time, so that it can be inserted and removed in
+ * constant time. When the first wheel goes around, the timers
+ * in the next slot of the upper wheel are moved down to the
+ * lower wheels.
+ */
+
 #include <kernel.h>
 #include <task.h>
 #include <event.h>
@@ -39,16 +50,40 @@
 #include <kmem.h>
 #include <exception.h>
 #include <timer.h>
+#include <hal.h>
 #include <sys/signal.h>
+#include <sys/time.h>
 
 static volatile u_long	lbolt;		/* ticks elapsed since bootup */
 static volatile u_long	idle_ticks;	/* total ticks for idle */
 
+#define WHEEL0_BITS	8
+#define WHEEL_BITS	6
+#define WHEEL0_SIZE	(1 << WHEEL0_BITS)
+#define WHEEL_SIZE	(1 << WHEEL_BITS)
+#define WHEEL0_MASK	(WHEEL0_SIZE - 1)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define NR_WHEELS	4		/* number of upper wheels */
+#define MAX_TICKS	0xffffffffUL	/* max ticks to expire */
+
+/* Index of the slot for the upper wheel n */
+#define WHEEL_INDEX(t, n) \
+	(((t) >> (WHEEL0_BITS + (n) * WHEEL_BITS)) & WHEEL_MASK)
+
+static u_long		wheel_time;	/* next tick to process */
+static struct list	wheel0[WHEEL0_SIZE];	/* first wheel */
+static struct list	wheel[NR_WHEELS][WHEEL_SIZE];	/* upper wheels */
+static u_long		nr_active;	/* number of active timers */
+static u_long		nr_cascades;	/* timers moved to lower wheel */
+
 static struct event	timer_event;	/* event to wakeup a timer thread */
 static struct event	delay_event;	/* event for the thread delay */
-static struct list	timer_list;	/* list of active timers */
 static struct list	expire_list;	/* list of expired timers */
 
+#ifdef CONFIG_TICKLESS
+static int		clock_stopped;	/* true while the tick is stopped */
+#endif
+
 /*
  * Get remaining ticks to the expiration time.
  * Return 0 if timer has been expired.
@@ -62,32 +97,89 @@ time_remain(u_long expire)
 	return 0;
 }
 
+/*
+ * Put a timer into the slot for its expiration time.
+ */
+static void
+wheel_insert(struct timer *tmr)
+{
+	u_long expire, idx;
+	list_t slot;
+	int n;
+
+	expire = tmr->expire;
+	idx = expire - wheel_time;
+	if ((long)idx < 0) {
+		/*
+		 * Already expired. Process it at next tick.
+		 */
+		slot = &wheel0[wheel_time & WHEEL0_MASK];
+	} else if (idx < WHEEL0_SIZE) {
+		slot = &wheel0[expire & WHEEL0_MASK];
+	} else {
+		if (idx > MAX_TICKS) {
+			expire = wheel_time + MAX_TICKS;
+			tmr->expire = expire;
+			idx = MAX_TICKS;
+		}
+		for (n = 0; n < NR_WHEELS - 1; n++) {
+			if (idx < (1UL << (WHEEL0_BITS +
+					   (n + 1) * WHEEL_BITS)))
+				break;
+		}
+		slot = &wheel[n][WHEEL_INDEX(expire, n)];
+	}
+	list_insert(list_prev(slot), &tmr->link);
+}
+
+/*
+ * Move all timers in the slot of the upper wheel to the
+ * lower wheels. Returns the index of the slot.
+ */
+static int
+wheel_cascade(int n)
+{
+	struct timer *tmr;
+	list_t slot;
+	int idx;
+
+	idx = (int)WHEEL_INDEX(wheel_time, n);
+	slot = &wheel[n][idx];
+	while (!list_empty(slot)) {
+		tmr = timer_next(slot);
+		list_remove(&tmr->link);
+		wheel_insert(tmr);
+		nr_cascades++;
+	}
+	return idx;
+}
+
 /*
  * Activate a timer.
  */
 static void
 timer_add(struct timer *tmr, u_long ticks)
 {
-	list_t head, n;
-	struct timer *t;
 
 	if (ticks == 0)
 		ticks++;
 
 	tmr->expire = lbolt + ticks;
 	tmr->state = TM_ACTIVE;
+	wheel_insert(tmr);
+	nr_active++;
+}
 
-	/*
-	 * Insert a timer element into the timer list which
-	 * is sorted by expiration time.
-	 */
-	head = &timer_list;
-	for (n = list_first(head); n != head; n = list_next(n)) {
-		t = list_entry(n, struct timer, link);
-		if (time_before(tmr->expire, t->expire))
-			break;
-	}
-	list_insert(list_prev(n), &tmr->link);
+/*
+ * Deactivate a timer.
+ */
+static void
+timer_remove(struct timer *tmr)
+{
+
+	list_remove(&tmr->link);
+	tmr->state = TM_STOP;
+	nr_active--;
 }
 
 /*
@@ -101,10 +193,8 @@ timer_stop(struct timer *tmr)
 	ASSERT(tmr != NULL);
 
 	s = splhigh();
-	if (tmr->state == TM_ACTIVE) {
-		list_remove(&tmr->link);
-		tmr->state = TM_STOP;
-	}
+	if (tmr->state == TM_ACTIVE)
+		timer_remove(tmr);
 	splx(s);
 }
 
@@ -126,7 +216,7 @@ timer_callout(struct timer *tmr, u_long msec, void (*fn)(void *), void *arg)
 	s = splhigh();
 
 	if (tmr->state == TM_ACTIVE)
-		list_remove(&tmr->link);
+		timer_remove(tmr);
 
 	tmr->func = fn;
 	tmr->arg = arg;
@@ -272,7 +362,7 @@ timer_periodic(thread_t t, u_long start, u_long period)
 			 * This is to save the data area in the thread
 			 * structure.
 			 */
-			if ((tmr = kmem_alloc(sizeof(tmr))) == NULL) {
+			if ((tmr = kmem_alloc(sizeof(*tmr))) == NULL) {
 				sched_unlock();
 				return ENOMEM;
 			}
@@ -284,6 +374,8 @@ timer_periodic(thread_t t, u_long start, u_long period)
 		 * Program an interval timer.
 		 */
 		s = splhigh();
+		if (tmr->state == TM_ACTIVE)
+			timer_remove(tmr);
 		tmr->interval = mstohz(period);
 		if (tmr->interval == 0)
 			tmr->interval = 1;
@@ -361,8 +453,7 @@ timer_thread(void *dummy)
 			 * callout
 			 */
 			tmr = timer_next(&expire_list);
-			list_remove(&tmr->link);
-			tmr->state = TM_STOP;
+			timer_remove(tmr);
 			sched_lock();
 			spl0();
 			(*tmr->func)(tmr->arg);
@@ -390,7 +481,8 @@ timer_handler(void)
 {
 	struct timer *tmr;
 	u_long ticks;
-	int wakeup = 0;
+	list_t slot;
+	int n, wakeup = 0;
 
 	/*
 	 * Bump time in ticks.
@@ -400,28 +492,41 @@ timer_handler(void)
 	if (curthread->priority == PRI_IDLE)
 		idle_ticks++;
 
-	while (!list_empty(&timer_list)) {
+	while (time_before_eq(wheel_time, lbolt)) {
 		/*
-		 * Check timer expiration.
+		 * Move down the timers from the upper wheels
+		 * when the lower wheel goes around.
 		 */
-		tmr = timer_next(&timer_list);
-		if (time_before(lbolt, tmr->expire))
-			break;
-
-		list_remove(&tmr->link);
-		if (tmr->interval != 0) {
-			/*
-			 * Periodic timer - reprogram timer again.
-			 */
-			ticks = time_remain(tmr->expire + tmr->interval);
-			timer_add(tmr, ticks);
-			sched_wakeup(&tmr->event);
-		} else {
-			/*
-			 * One-shot timer
-			 */
-			list_insert(&expire_list, &tmr->link);
-			wakeup = 1;
+		if ((wheel_time & WHEEL0_MASK) == 0) {
+			for (n = 0; n < NR_WHEELS; n++) {
+				if (wheel_cascade(n) != 0)
+					break;
+			}
+		}
+		/*
+		 * All timers in this slot are expired.
+		 */
+		slot = &wheel0[wheel_time & WHEEL0_MASK];
+		wheel_time++;
+		while (!list_empty(slot)) {
+			tmr = timer_next(slot);
+			list_remove(&tmr->link);
+			if (tmr->interval != 0) {
+				/*
+				 * Periodic timer - reprogram timer again.
+				 */
+				nr_active--;
+				ticks = time_remain(tmr->expire +
+						    tmr->interval);
+				timer_add(tmr, ticks);
+				sched_wakeup(&tmr->event);
+			} else {
+				/*
+				 * One-shot timer
+				 */
+				list_insert(&expire_list, &tmr->link);
+				wakeup = 1;
+			}
 		}
 	}
 	if (wakeup)
@@ -430,6 +535,99 @@ timer_handler(void)
 	sched_tick();
 }
 
+#ifdef CONFIG_TICKLESS
+/*
+ * Account the ticks which passed without clock interrupts.
+ * The timers expired in them are processed by the next call
+ * of timer_handler().
+ */
+void
+timer_catchup(u_long ticks)
+{
+
+	lbolt += ticks;
+	if (curthread->priority == PRI_IDLE)
+		idle_ticks += ticks;
+}
+
+/*
+ * Return the ticks until the next tick which has something to
+ * do, up to the next time the first wheel goes around.
+ */
+static u_long
+timer_nextwork(void)
+{
+	u_long t;
+
+	for (t = wheel_time; ; t++) {
+		if ((t & WHEEL0_MASK) == 0 ||
+		    !list_empty(&wheel0[t & WHEEL0_MASK]))
+			break;
+	}
+	return t - lbolt;
+}
+
+/*
+ * Stop the clock tick while the system is idle.
+ *
+ * This is called by the idle thread instead of machine_idle().
+ * The clock is programmed to interrupt at the next timer
+ * expiration, and the tick is restarted by timer_resume() at
+ * the first interrupt.
+ */
+void
+timer_idle(void)
+{
+	u_long ticks;
+	int s;
+
+	s = splhigh();
+	ticks = timer_nextwork();
+	if (ticks > 1 && clock_stop(ticks) == 0)
+		clock_stopped = 1;
+	machine_idle();
+	splx(s);
+}
+
+/*
+ * Restart the clock tick if it is stopped. This is called at
+ * the entry of every interrupt.
+ */
+void
+timer_resume(void)
+{
+	int s;
+
+	s = splhigh();
+	if (clock_stopped) {
+		clock_stopped = 0;
+		timer_catchup(clock_resume());
+	}
+	splx(s);
+}
+#endif /* CONFIG_TICKLESS */
+
+/*
+ * Return the time since boot. The time in the current tick
+ * is added if the clock can tell it.
+ */
+void
+timer_uptime(struct timespec *ts)
+{
+	u_long ticks, nsec = 0;
+	int s;
+
+	s = splhigh();
+	ticks = lbolt;
+#ifdef CONFIG_TICKLESS
+	nsec = clock_nsec();
+#endif
+	splx(s);
+
+	ts->ts_sec = (time_t)(ticks / HZ);
+	ts->ts_nsec = (long)((ticks % HZ) * (1000000000UL / HZ) + nsec);
+}
+
 /*
  * Return ticks since boot.
  */
@@ -450,6 +648,8 @@ timer_info(struct timerinfo *info)
 	info->hz = HZ;
 	info->cputicks = lbolt;
 	info->idleticks = idle_ticks;
+	info->ntimers = nr_active;
+	info->cascades = nr_cascades;
 }
 
 /*
@@ -458,11 +658,18 @@ timer_info(struct timerinfo *info)
 void
 timer_init(void)
 {
+	int i, n;
 
 	event_init(&timer_event, "timer");
 	event_init(&delay_event, "delay");
-	list_init(&timer_list);
+	for (i = 0; i < WHEEL0_SIZE; i++)
+		list_init(&wheel0[i]);
+	for (n = 0; n < NR_WHEELS; n++) {
+		for (i = 0; i < WHEEL_SIZE; i++)
+			list_init(&wheel[n][i]);
+	}
 	list_init(&expire_list);
+	wheel_time = lbolt + 1;
 
 	if (kthread_create(&timer_thread, NULL, PRI_TIMER) == NULL)
 		panic("timer_init");
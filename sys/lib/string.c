@@ -86,6 +86,11 @@ strnlen(const char *str, size_t count)
 	return (size_t)(tmp - str);
 }
 
+#if !defined(__x86__)
+/*
+ * Copy by words while both addresses are aligned.
+ * The x86 HAL has its own memcpy() and memset().
+ */
 void *
 memcpy(void *dest, const void *src, size_t count)
 {
@@ -93,6 +98,13 @@ memcpy(void *dest, const void *src, size_t count)
 
 	ASSERT(count != 0);
 
+	if ((((u_long)tmp | (u_long)s) & (sizeof(long) - 1)) == 0) {
+		for (; count >= sizeof(long); count -= sizeof(long)) {
+			*(long *)tmp = *(long *)s;
+			tmp += sizeof(long);
+			s += sizeof(long);
+		}
+	}
 	while (count--)
 		*tmp++ = *s++;
 
@@ -103,11 +115,22 @@ void *
 memset(void *dest, int ch, size_t count)
 {
 	char *p = (char *)dest;
+	u_long fill;
 
 	ASSERT(count != 0);
 
+	if (((u_long)p & (sizeof(long) - 1)) == 0) {
+		fill = (u_char)ch;
+		fill |= fill << 8;
+		fill |= fill << 16;
+		for (; count >= sizeof(long); count -= sizeof(long)) {
+			*(u_long *)p = fill;
+			p += sizeof(long);
+		}
+	}
 	while (count--)
 		*p++ = (char)ch;
 
 	return dest;
 }
+#endif /* !__x86__ */
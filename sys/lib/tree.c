@@ -0,0 +1,226 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * tree.c - balanced binary tree library
+ */
+
+#include <kernel.h>
+#include <sys/tree.h>
+
+#define height(n)	((n) != NULL ? (n)->height : 0)
+
+/*
+ * Recompute the height and the data of the node.
+ */
+static void
+node_update(tree_t tree, tnode_t n)
+{
+	int l, r;
+
+	l = height(n->left);
+	r = height(n->right);
+	n->height = (l > r ? l : r) + 1;
+	if (tree->update != NULL)
+		tree->update(n);
+}
+
+/*
+ * Replace the child of the parent node.
+ */
+static void
+replace_child(tree_t tree, tnode_t parent, tnode_t old, tnode_t new)
+{
+
+	if (parent == NULL)
+		tree->root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+	if (new != NULL)
+		new->parent = parent;
+}
+
+static tnode_t
+rotate_left(tree_t tree, tnode_t x)
+{
+	tnode_t y = x->right;
+
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+	replace_child(tree, x->parent, x, y);
+	y->left = x;
+	x->parent = y;
+	node_update(tree, x);
+	node_update(tree, y);
+	return y;
+}
+
+static tnode_t
+rotate_right(tree_t tree, tnode_t x)
+{
+	tnode_t y = x->left;
+
+	x->left = y->right;
+	if (y->right != NULL)
+		y->right->parent = x;
+	replace_child(tree, x->parent, x, y);
+	y->right = x;
+	x->parent = y;
+	node_update(tree, x);
+	node_update(tree, y);
+	return y;
+}
+
+/*
+ * Rebalance the tree from the specified node to the root.
+ * The data of all nodes on the path are updated.
+ */
+static void
+rebalance(tree_t tree, tnode_t n)
+{
+	int balance;
+
+	while (n != NULL) {
+		node_update(tree, n);
+		balance = height(n->left) - height(n->right);
+		if (balance > 1) {
+			if (height(n->left->left) < height(n->left->right))
+				rotate_left(tree, n->left);
+			n = rotate_right(tree, n);
+		} else if (balance < -1) {
+			if (height(n->right->right) < height(n->right->left))
+				rotate_right(tree, n->right);
+			n = rotate_left(tree, n);
+		}
+		n = n->parent;
+	}
+}
+
+/*
+ * Initialize tree.
+ * The update routine can be NULL.
+ */
+void
+tree_init(tree_t tree, void (*update)(struct tnode *))
+{
+
+	tree->root = NULL;
+	tree->update = update;
+}
+
+/*
+ * Insert node at the specified position.
+ * The "link" argument points to the NULL child pointer of
+ * the "parent" node, or the root pointer of the tree.
+ */
+void
+tree_insert(tree_t tree, tnode_t parent, tnode_t *link, tnode_t node)
+{
+
+	node->left = node->right = NULL;
+	node->parent = parent;
+	node->height = 1;
+	*link = node;
+	rebalance(tree, node);
+}
+
+/*
+ * Insert node just after the specified node in order.
+ * If "prev" is NULL, the node is inserted to the empty tree.
+ */
+void
+tree_insert_after(tree_t tree, tnode_t prev, tnode_t node)
+{
+	tnode_t n;
+
+	if (prev == NULL) {
+		ASSERT(tree->root == NULL);
+		tree_insert(tree, NULL, &tree->root, node);
+	} else if (prev->right == NULL) {
+		tree_insert(tree, prev, &prev->right, node);
+	} else {
+		n = prev->right;
+		while (n->left != NULL)
+			n = n->left;
+		tree_insert(tree, n, &n->left, node);
+	}
+}
+
+/*
+ * Remove node from tree.
+ */
+void
+tree_remove(tree_t tree, tnode_t node)
+{
+	tnode_t child, next, start;
+
+	if (node->left != NULL && node->right != NULL) {
+		/*
+		 * Replace the node with its successor.
+		 */
+		next = node->right;
+		while (next->left != NULL)
+			next = next->left;
+		if (next->parent != node) {
+			start = next->parent;
+			start->left = next->right;
+			if (next->right != NULL)
+				next->right->parent = start;
+			next->right = node->right;
+			node->right->parent = next;
+		} else
+			start = next;
+		next->left = node->left;
+		node->left->parent = next;
+		replace_child(tree, node->parent, node, next);
+		rebalance(tree, start);
+	} else {
+		child = (node->left != NULL) ? node->left : node->right;
+		start = node->parent;
+		replace_child(tree, start, node, child);
+		rebalance(tree, start);
+	}
+}
+
+/*
+ * Update the data of the node and its ancestors.
+ * This must be called when the data of the node is changed.
+ */
+void
+tree_fixup(tree_t tree, tnode_t node)
+{
+
+	while (node != NULL) {
+		node_update(tree, node);
+		node = node->parent;
+	}
+}
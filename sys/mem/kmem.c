@@ -42,14 +42,28 @@
  *  2) All blocks divided in the same page are linked.
  *  3) All free blocks of the same size are linked.
  *
- * Currently, it can not handle the memory size exceeding one page.
- * Instead, a driver can use page_alloc() to allocate larger memory.
+ * The memory size exceeding one page is allocated directly from the
+ * page allocator. Such block has a large block header at the top of
+ * its first page to remember the allocated size.
  *
  * The kmem functions are used by not only the kernel core but also by
  * the buggy drivers. If such kernel code illegally writes data in
  * exceeding the allocated area, the system will crash easily. In
  * order to detect the memory over run, each free block has a magic
  * ID.
+ *
+ * Object cache:
+ *
+ * The kernel objects which are allocated and freed frequently, like
+ * threads or tasks, are managed by the object caches. A cache holds
+ * the objects of one size in slabs. A slab is one page which has a
+ * slab header and an array of the objects. The free objects in each
+ * slab are linked by the word placed after each object, so that the
+ * object keeps its contents while it is free. An optional constructor
+ * is called only when a new slab is created. So, the object must be
+ * returned to the cache in its constructed state. One empty slab is
+ * kept in each cache to avoid allocating and freeing a page
+ * repeatedly.
  */
 
 #include <kernel.h>
@@ -110,6 +124,64 @@ struct page_hdr {
 /* macro to get the index of free block list. */
 #define BLKNDX(b)	((u_int)((b)->size) >> 4)
 
+/*
+ * Large block header
+ *
+ * This header is placed at the top of the pages which are
+ * allocated for the large block. It must not be larger than
+ * the block header, and its magic must be at same offset.
+ */
+struct large_hdr {
+	u_short		 magic;		/* magic number */
+	u_short		 pad;
+	psize_t		 size;		/* size of allocated pages */
+};
+
+#define LARGE_MAGIC	0xfeed
+
+/*
+ * Slab header
+ *
+ * The slab header is placed at the top of each page which
+ * is used by the object cache.
+ */
+struct slab {
+	u_short		 magic;		/* magic number */
+	u_short		 inuse;		/* number of used objects */
+	struct list	 link;		/* linkage on slab list in cache */
+	struct kmem_cache *cache;	/* cache owning this slab */
+	char		 *free;		/* first free object */
+};
+
+/*
+ * Object cache
+ */
+struct kmem_cache {
+	struct list	 link;		/* linkage on cache list */
+	char		 name[MAXCACHENAME]; /* cache name */
+	size_t		 size;		/* object size */
+	size_t		 stride;	/* object size with free link */
+	int		 nobjs;		/* number of objects in slab */
+	void		 (*ctor)(void *); /* object constructor */
+	struct list	 partial;	/* slabs with free objects */
+	struct list	 full;		/* slabs without free objects */
+	struct list	 empty;		/* slabs without used objects */
+	int		 nempty;	/* number of empty slabs */
+	int		 nslabs;	/* number of slabs */
+	int		 inuse;		/* number of used objects */
+	u_long		 nallocs;	/* total allocations */
+	u_long		 nfrees;	/* total frees */
+	u_long		 nfails;	/* failed allocations */
+};
+
+#define SLAB_MAGIC	0xcafe
+#define SLAB_ALIGN	(sizeof(char *) * 2)
+#define SLAB_HDRSIZE	(((sizeof(struct slab) + SLAB_ALIGN - 1) / \
+			  SLAB_ALIGN) * SLAB_ALIGN)
+
+/* macro to point the free link of the object. */
+#define FREELINK(c, obj)	(*(char **)((obj) + (c)->size))
+
 /**
  * Array of the head block of free block list.
  *
@@ -137,6 +209,27 @@ struct page_hdr {
  */
 static struct list free_blocks[NR_BLOCK_LIST];
 
+static struct list cache_list;		/* list of all object caches */
+
+/*
+ * Allocate the memory larger than one page.
+ */
+static void *
+large_alloc(size_t size)
+{
+	struct large_hdr *hdr;
+	psize_t len;
+	paddr_t pa;
+
+	len = (psize_t)round_page(size + BLKHDR_SIZE);
+	if ((pa = page_alloc(len)) == 0)
+		return NULL;
+	hdr = ptokv(pa);
+	hdr->magic = LARGE_MAGIC;
+	hdr->size = len;
+	return (void *)((vaddr_t)hdr + BLKHDR_SIZE);
+}
+
 /*
  * Find the free block for the specified size.
  * Returns pointer to free block, or NULL on failure.
@@ -188,9 +281,12 @@ kmem_alloc(size_t size)
 	 * from the page already used. If it does not exist,
 	 * new page is allocated for free block.
 	 */
+	if (ALLOC_SIZE(size + BLKHDR_SIZE) > MAX_ALLOC_SIZE) {
+		p = large_alloc(size);
+		sched_unlock();
+		return p;
+	}
 	size = ALLOC_SIZE(size + BLKHDR_SIZE);
-	if (size > MAX_ALLOC_SIZE)
-		panic("kmem_alloc: too large allocation");
 
 	blk = block_find(size);
 	if (blk) {
@@ -278,6 +374,15 @@ kmem_free(void *ptr)
 
 	/* Get the block header */
 	blk = (struct block_hdr *)((vaddr_t)ptr - BLKHDR_SIZE);
+	if (blk->magic == LARGE_MAGIC) {
+		/*
+		 * Return the pages of the large block.
+		 */
+		blk->magic = 0;
+		page_free(kvtop(blk), ((struct large_hdr *)blk)->size);
+		sched_unlock();
+		return;
+	}
 	if (blk->magic != BLOCK_MAGIC)
 		panic("kmem_free: invalid address");
 
@@ -306,6 +411,202 @@ kmem_free(void *ptr)
 	sched_unlock();
 }
 
+/*
+ * Create an object cache.
+ *
+ * The objects of the specified size are allocated from the
+ * returned cache. If ctor is not NULL, it is called for each
+ * object when a new slab is created.
+ */
+struct kmem_cache *
+kmem_cache_create(const char *name, size_t size, void (*ctor)(void *))
+{
+	struct kmem_cache *cache;
+
+	ASSERT(size != 0);
+
+	if ((cache = kmem_alloc(sizeof(*cache))) == NULL)
+		return NULL;
+
+	strlcpy(cache->name, name, MAXCACHENAME);
+	cache->size = size;
+	cache->stride = ((size + sizeof(char *) + SLAB_ALIGN - 1) /
+			 SLAB_ALIGN) * SLAB_ALIGN;
+	cache->nobjs = (int)((PAGE_SIZE - SLAB_HDRSIZE) / cache->stride);
+	if (cache->nobjs == 0)
+		panic("kmem_cache_create: too large object");
+	cache->ctor = ctor;
+	list_init(&cache->partial);
+	list_init(&cache->full);
+	list_init(&cache->empty);
+	cache->nempty = 0;
+	cache->nslabs = 0;
+	cache->inuse = 0;
+	cache->nallocs = 0;
+	cache->nfrees = 0;
+	cache->nfails = 0;
+
+	sched_lock();
+	list_insert(&cache_list, &cache->link);
+	sched_unlock();
+	return cache;
+}
+
+/*
+ * Allocate a new slab for the cache, and construct
+ * all objects in it.
+ */
+static struct slab *
+slab_create(struct kmem_cache *cache)
+{
+	struct slab *slab;
+	paddr_t pa;
+	char *obj;
+	int i;
+
+	if ((pa = page_alloc(PAGE_SIZE)) == 0)
+		return NULL;
+
+	slab = ptokv(pa);
+	slab->magic = SLAB_MAGIC;
+	slab->inuse = 0;
+	slab->cache = cache;
+	slab->free = NULL;
+
+	obj = (char *)slab + SLAB_HDRSIZE + cache->stride * cache->nobjs;
+	for (i = 0; i < cache->nobjs; i++) {
+		obj -= cache->stride;
+		if (cache->ctor != NULL)
+			cache->ctor(obj);
+		FREELINK(cache, obj) = slab->free;
+		slab->free = obj;
+	}
+	cache->nslabs++;
+	return slab;
+}
+
+/*
+ * Allocate an object from the cache.
+ * Returns NULL on failure.
+ *
+ * => must not be called from interrupt context.
+ */
+void *
+kmem_cache_alloc(struct kmem_cache *cache)
+{
+	struct slab *slab;
+	char *obj;
+
+	sched_lock();
+
+	if (!list_empty(&cache->partial)) {
+		slab = list_entry(list_first(&cache->partial),
+				  struct slab, link);
+	} else if (!list_empty(&cache->empty)) {
+		slab = list_entry(list_first(&cache->empty),
+				  struct slab, link);
+		list_remove(&slab->link);
+		list_insert(&cache->partial, &slab->link);
+		cache->nempty--;
+	} else {
+		if ((slab = slab_create(cache)) == NULL) {
+			cache->nfails++;
+			sched_unlock();
+			return NULL;
+		}
+		list_insert(&cache->partial, &slab->link);
+	}
+
+	obj = slab->free;
+	slab->free = FREELINK(cache, obj);
+	slab->inuse++;
+	if (slab->free == NULL) {
+		list_remove(&slab->link);
+		list_insert(&cache->full, &slab->link);
+	}
+	cache->inuse++;
+	cache->nallocs++;
+
+	sched_unlock();
+	return obj;
+}
+
+/*
+ * Return an object to the cache.
+ *
+ * The object must be in its constructed state. The slab
+ * page is released when the cache has another empty slab.
+ */
+void
+kmem_cache_free(struct kmem_cache *cache, void *ptr)
+{
+	struct slab *slab;
+	char *obj = ptr;
+
+	ASSERT(ptr != NULL);
+
+	sched_lock();
+
+	slab = (struct slab *)PAGETOP(obj);
+	if (slab->magic != SLAB_MAGIC || slab->cache != cache)
+		panic("kmem_cache_free: invalid address");
+
+	if (slab->free == NULL) {
+		list_remove(&slab->link);
+		list_insert(&cache->partial, &slab->link);
+	}
+	FREELINK(cache, obj) = slab->free;
+	slab->free = obj;
+	cache->inuse--;
+	cache->nfrees++;
+
+	if (--slab->inuse == 0) {
+		list_remove(&slab->link);
+		if (cache->nempty > 0) {
+			slab->magic = 0;
+			page_free(kvtop(slab), PAGE_SIZE);
+			cache->nslabs--;
+		} else {
+			list_insert(&cache->empty, &slab->link);
+			cache->nempty++;
+		}
+	}
+	sched_unlock();
+}
+
+/*
+ * Get the statistics of the object cache.
+ */
+int
+kmem_info(struct kmeminfo *info)
+{
+	u_long target = info->cookie;
+	u_long i = 0;
+	struct kmem_cache *cache;
+	list_t n;
+
+	sched_lock();
+	for (n = list_first(&cache_list); n != &cache_list;
+	     n = list_next(n)) {
+		if (i++ == target) {
+			cache = list_entry(n, struct kmem_cache, link);
+			info->cookie = i;
+			info->size = cache->size;
+			info->nobjs = cache->nobjs;
+			info->nslabs = cache->nslabs;
+			info->inuse = cache->inuse;
+			info->nallocs = cache->nallocs;
+			info->nfrees = cache->nfrees;
+			info->nfails = cache->nfails;
+			strlcpy(info->name, cache->name, MAXCACHENAME);
+			sched_unlock();
+			return 0;
+		}
+	}
+	sched_unlock();
+	return ESRCH;
+}
+
 /*
  * Map specified virtual address to the kernel address
  * Returns kernel address on success, or NULL if no mapped memory.
@@ -328,4 +629,5 @@ kmem_init(void)
 
 	for (i = 0; i < NR_BLOCK_LIST; i++)
 		list_init(&free_blocks[i]);
+	list_init(&cache_list);
 }
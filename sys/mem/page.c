@@ -32,7 +32,27 @@
  */
 
 /*
- * Simple list-based page allocator:
+ * Buddy page allocator:
+ *
+ * Free memory is kept in blocks of 2^n pages. Each block order has
+ * its own free list, and a block is always aligned to its size
+ * relative to the base of the managed memory. When a block is freed,
+ * it is merged with its buddy (the neighbour block of the same order)
+ * as long as the buddy is free. A bitmap marks the first page of each
+ * free block, so that the state of the buddy can be checked without
+ * walking any list.
+ *
+ * The allocated size is not rounded to the power of 2. The unused
+ * tail of the block is returned to the free lists immediately, and
+ * the caller can free any page-aligned part of the allocated pages.
+ *
+ * A request larger than the largest block is served from a run of
+ * adjacent free blocks of the largest order.
+ *
+ * A page can be shared by more than one owner with page_share(). Each
+ * page has a reference count of the extra owners, and page_free() only
+ * drops one reference of the shared page. This is used by the VM for
+ * copy-on-write pages.
  *
  * When the remaining page is exhausted, what should we do ?
  * If the system can stop with panic() here, the error check of
@@ -49,6 +69,8 @@
 #include <sched.h>
 #include <hal.h>
 
+#define NR_ORDERS	NPAGEORDERS	/* number of block orders */
+
 /*
  * The page structure is put on the head of the first page of
  * each free block.
@@ -56,14 +78,157 @@
 struct page {
 	struct page	*next;
 	struct page	*prev;
-	vsize_t		size;		/* number of bytes of this block */
+	int		order;		/* order of this block */
 };
 
-static struct page	page_head;	/* first free block */
+static struct page	free_area[NR_ORDERS]; /* free lists for each order */
+static u_int		nr_free[NR_ORDERS]; /* number of free blocks */
+static u_char		*page_map;	/* bitmap of free block heads */
+static u_short		*page_refs;	/* extra references of each page */
+static u_long		nr_shared;	/* number of shared pages */
+static paddr_t		mem_base;	/* start of managed memory */
+static u_long		mem_pages;	/* number of managed pages */
 static psize_t		total_size;	/* size of memory in the system */
 static psize_t		used_size;	/* current used size */
 static psize_t		bootdisk_size;	/* size of the boot disk */
 
+/* macro to get the page index of the physical address. */
+#define PFN(pa)		((u_long)(((pa) - mem_base) / PAGE_SIZE))
+
+/* macro to get the size of the block. */
+#define BLKSIZE(order)	((psize_t)PAGE_SIZE << (order))
+
+#define map_set(n)	(page_map[(n) >> 3] |= (u_char)(1 << ((n) & 7)))
+#define map_clr(n)	(page_map[(n) >> 3] &= (u_char)~(1 << ((n) & 7)))
+#define map_test(n)	(page_map[(n) >> 3] & (1 << ((n) & 7)))
+
+/*
+ * Insert the block to the free list of the order.
+ */
+static void
+block_insert(paddr_t pa, int order)
+{
+	struct page *blk, *head;
+
+	blk = ptokv(pa);
+	head = &free_area[order];
+	blk->order = order;
+	blk->prev = head;
+	blk->next = head->next;
+	head->next->prev = blk;
+	head->next = blk;
+	map_set(PFN(pa));
+	nr_free[order]++;
+}
+
+/*
+ * Remove the block from its free list.
+ */
+static void
+block_remove(struct page *blk)
+{
+
+	blk->prev->next = blk->next;
+	blk->next->prev = blk->prev;
+	map_clr(PFN(kvtop(blk)));
+	nr_free[blk->order]--;
+}
+
+/*
+ * Return true if the block at pa is a free block of
+ * the specified order.
+ */
+static int
+block_isfree(paddr_t pa, int order)
+{
+	u_long n;
+
+	n = PFN(pa);
+	if (n + (1UL << order) > mem_pages || !map_test(n))
+		return 0;
+	return ((struct page *)ptokv(pa))->order == order;
+}
+
+/*
+ * Free one block, and merge it with its buddies.
+ */
+static void
+block_free(paddr_t pa, int order)
+{
+	paddr_t buddy;
+
+	while (order < NR_ORDERS - 1) {
+		buddy = mem_base + ((pa - mem_base) ^ BLKSIZE(order));
+		if (!block_isfree(buddy, order))
+			break;
+		block_remove(ptokv(buddy));
+		if (buddy < pa)
+			pa = buddy;
+		order++;
+	}
+	block_insert(pa, order);
+}
+
+/*
+ * Free the page aligned memory range. The range is divided
+ * into the largest aligned blocks.
+ */
+static void
+range_free(paddr_t pa, psize_t size)
+{
+	u_long n;
+	int order;
+
+	while (size > 0) {
+		n = PFN(pa);
+		for (order = NR_ORDERS - 1; order > 0; order--) {
+			if ((n & ((1UL << order) - 1)) == 0 &&
+			    BLKSIZE(order) <= size)
+				break;
+		}
+		block_free(pa, order);
+		pa += BLKSIZE(order);
+		size -= BLKSIZE(order);
+	}
+}
+
+/*
+ * Allocate the pages larger than the largest block. They are
+ * taken from the adjacent free blocks of the largest order.
+ */
+static paddr_t
+block_alloc_large(psize_t size)
+{
+	struct page *blk;
+	paddr_t pa;
+	u_long i, nblks;
+	int top = NR_ORDERS - 1;
+
+	nblks = (u_long)((size + BLKSIZE(top) - 1) / BLKSIZE(top));
+	for (blk = free_area[top].next; blk != &free_area[top];
+	     blk = blk->next) {
+		pa = kvtop(blk);
+		if (PFN(pa) + (nblks << top) > mem_pages)
+			continue;
+		for (i = 1; i < nblks; i++) {
+			if (!block_isfree(pa + i * BLKSIZE(top), top))
+				break;
+		}
+		if (i < nblks)
+			continue;
+
+		for (i = 0; i < nblks; i++)
+			block_remove(ptokv(pa + i * BLKSIZE(top)));
+		/*
+		 * Return the unused tail of the last block.
+		 */
+		if (size < nblks * BLKSIZE(top))
+			range_free(pa + size, nblks * BLKSIZE(top) - size);
+		return pa;
+	}
+	return 0;
+}
+
 /*
  * page_alloc - allocate continuous pages of the specified size.
  *
@@ -75,47 +240,63 @@ static psize_t		bootdisk_size;	/* size of the boot disk */
 paddr_t
 page_alloc(psize_t psize)
 {
-	struct page *blk, *tmp;
-	vsize_t size;
+	struct page *blk;
+	psize_t size;
+	paddr_t pa;
+	int order, i;
 
 	ASSERT(psize != 0);
 
 	sched_lock();
 
 	/*
-	 * Find the free block that has enough size.
+	 * Find the smallest free block that has enough size.
 	 */
-	size = round_page(psize);
-	blk = &page_head;
-	do {
-		blk = blk->next;
-		if (blk == &page_head) {
+	size = (psize_t)round_page(psize);
+	for (order = 0; order < NR_ORDERS; order++) {
+		if (BLKSIZE(order) >= size)
+			break;
+	}
+	if (order >= NR_ORDERS) {
+		if ((pa = block_alloc_large(size)) == 0) {
 			sched_unlock();
 			DPRINTF(("page_alloc: out of memory\n"));
-			return 0;	/* Not found. */
+			return 0;
 		}
-	} while (blk->size < size);
+		used_size += size;
+		sched_unlock();
+		return pa;
+	}
+	for (i = order; i < NR_ORDERS; i++) {
+		if (free_area[i].next != &free_area[i])
+			break;
+	}
+	if (i >= NR_ORDERS) {
+		sched_unlock();
+		DPRINTF(("page_alloc: out of memory\n"));
+		return 0;	/* Not found. */
+	}
+	blk = free_area[i].next;
+	block_remove(blk);
+	pa = kvtop(blk);
 
 	/*
-	 * If found block size is exactly same with requested,
-	 * just remove it from a free list. Otherwise, the
-	 * found block is divided into two and first half is
-	 * used for allocation.
+	 * Split the block until it fits the requested order.
+	 * The second half is returned to the free list.
 	 */
-	if (blk->size == size) {
-		blk->prev->next = blk->next;
-		blk->next->prev = blk->prev;
-	} else {
-		tmp = (struct page *)((vaddr_t)blk + size);
-		tmp->size = blk->size - size;
-		tmp->prev = blk->prev;
-		tmp->next = blk->next;
-		blk->prev->next = tmp;
-		blk->next->prev = tmp;
+	while (i > order) {
+		i--;
+		block_insert(pa + BLKSIZE(i), i);
 	}
-	used_size += (psize_t)size;
+	/*
+	 * Return the unused tail of the block.
+	 */
+	if (size < BLKSIZE(order))
+		range_free(pa + size, BLKSIZE(order) - size);
+
+	used_size += size;
 	sched_unlock();
-	return kvtop(blk);
+	return pa;
 }
 
 /*
@@ -128,116 +309,143 @@ page_alloc(psize_t psize)
 void
 page_free(paddr_t paddr, psize_t psize)
 {
-	struct page *blk, *prev;
-	vsize_t size;
+	paddr_t pa, start, end;
+	psize_t size;
+	u_long n;
 
 	ASSERT(psize != 0);
 
 	sched_lock();
 
-	size = round_page(psize);
-	blk = ptokv(paddr);
-
+	size = (psize_t)round_page(psize);
+	if (nr_shared == 0) {
+		range_free(paddr, size);
+		used_size -= size;
+		sched_unlock();
+		return;
+	}
 	/*
-	 * Find the target position in list.
+	 * Drop one reference of the shared pages, and free
+	 * the other pages.
 	 */
-	for (prev = &page_head; prev->next < blk; prev = prev->next) {
-		if (prev->next == &page_head)
-			break;
+	start = paddr;
+	end = paddr + size;
+	for (pa = paddr; pa < end; pa += PAGE_SIZE) {
+		n = PFN(pa);
+		if (page_refs[n] == 0)
+			continue;
+		if (--page_refs[n] == 0)
+			nr_shared--;
+		if (pa > start) {
+			range_free(start, pa - start);
+			used_size -= pa - start;
+		}
+		start = pa + PAGE_SIZE;
+	}
+	if (end > start) {
+		range_free(start, end - start);
+		used_size -= end - start;
 	}
+	sched_unlock();
+}
 
-	/*
-	 * Insert new block into list.
-	 */
-	blk->size = size;
-	blk->prev = prev;
-	blk->next = prev->next;
-	prev->next->prev = blk;
-	prev->next = blk;
+/*
+ * Add one reference to each page in the range. The
+ * pages are released when all owners free them.
+ */
+void
+page_share(paddr_t paddr, psize_t psize)
+{
+	paddr_t pa, end;
+	u_long n;
 
-	/*
-	 * If the adjoining block is free, it combines and
-	 * is made on block.
-	 */
-	if (blk->next != &page_head &&
-	    ((vaddr_t)blk + blk->size) == (vaddr_t)blk->next) {
-		blk->size += blk->next->size;
-		blk->next = blk->next->next;
-		blk->next->prev = blk;
-	}
-	if (blk->prev != &page_head &&
-	    (vaddr_t)blk->prev + blk->prev->size == (vaddr_t)blk) {
-		blk->prev->size += blk->size;
-		blk->prev->next = blk->next;
-		blk->next->prev = blk->prev;
+	sched_lock();
+	end = paddr + round_page(psize);
+	for (pa = trunc_page(paddr); pa < end; pa += PAGE_SIZE) {
+		n = PFN(pa);
+		if (page_refs[n]++ == 0)
+			nr_shared++;
 	}
-	used_size -= (psize_t)size;
 	sched_unlock();
 }
 
+/*
+ * Return true if the page has more than one owner.
+ */
+int
+page_shared(paddr_t pa)
+{
+
+	return page_refs[PFN(pa)] != 0;
+}
+
+/*
+ * Remove one page from the free block which contains it.
+ */
+static int
+page_take(paddr_t pa)
+{
+	paddr_t head;
+	u_long n;
+	int order;
+
+	n = PFN(pa);
+	for (order = 0; order < NR_ORDERS; order++) {
+		head = mem_base +
+			(paddr_t)(n & ~((1UL << order) - 1)) * PAGE_SIZE;
+		if (block_isfree(head, order))
+			break;
+	}
+	if (order >= NR_ORDERS)
+		return ENOMEM;
+
+	block_remove(ptokv(head));
+	while (order > 0) {
+		order--;
+		if (pa >= head + BLKSIZE(order)) {
+			block_insert(head, order);
+			head += BLKSIZE(order);
+		} else
+			block_insert(head + BLKSIZE(order), order);
+	}
+	return 0;
+}
+
 /*
  * The function to reserve pages in specific address.
  */
 int
 page_reserve(paddr_t paddr, psize_t psize)
 {
-	struct page *blk, *tmp;
-	vaddr_t start, end;
-	vsize_t size;
+	paddr_t start, end, pa;
 
 	if (psize == 0)
 		return 0;
 
-	start = trunc_page((vaddr_t)ptokv(paddr));
-	end = round_page((vaddr_t)ptokv(paddr + psize));
-	size = end - start;
+	start = trunc_page(paddr);
+	end = round_page(paddr + psize);
+	if (start < mem_base || PFN(end) > mem_pages)
+		return ENOMEM;
 
-	/*
-	 * Find the block which includes specified block.
-	 */
-	blk = page_head.next;
-	for (;;) {
-		if (blk == &page_head)
+	sched_lock();
+	for (pa = start; pa < end; pa += PAGE_SIZE) {
+		if (page_take(pa) != 0) {
+			/* Give back the pages reserved so far. */
+			if (pa > start)
+				range_free(start, pa - start);
+			sched_unlock();
 			return ENOMEM;
-
-		if ((vaddr_t)blk <= start
-		    && end <= (vaddr_t)blk + blk->size)
-			break;
-		blk = blk->next;
-	}
-	if ((vaddr_t)blk == start && blk->size == size) {
-		/*
-		 * Unlink the block from free list.
-		 */
-		blk->prev->next = blk->next;
-		blk->next->prev = blk->prev;
-	} else {
-		/*
-		 * Split this block.
-		 */
-		if ((vaddr_t)blk + blk->size != end) {
-			tmp = (struct page *)end;
-			tmp->size = (vaddr_t)blk + blk->size - end;
-			tmp->next = blk->next;
-			tmp->prev = blk;
-
-			blk->size -= tmp->size;
-			blk->next->prev = tmp;
-			blk->next = tmp;
 		}
-		if ((vaddr_t)blk == start) {
-			blk->prev->next = blk->next;
-			blk->next->prev = blk->prev;
-		} else
-			blk->size = start - (vaddr_t)blk;
 	}
-	used_size += (psize_t)size;
+	used_size += (psize_t)(end - start);
+	sched_unlock();
 	return 0;
 }
 
 void
 page_info(struct meminfo *info)
 {
+	int i;
 
 	info->total = total_size;
 	info->free = total_size - used_size;
@@ -249,6 +457,45 @@ page_info(struct meminfo *info)
 	 */
 	info->free -= bootdisk_size;
 #endif
+	info->maxorder = -1;
+	for (i = 0; i < NR_ORDERS; i++) {
+		info->nblocks[i] = nr_free[i];
+		if (nr_free[i] != 0)
+			info->maxorder = i;
+	}
+}
+
+/*
+ * Find the place for the page bitmap. It is taken from the
+ * end of a usable memory which does not overlap with other
+ * memory regions.
+ */
+static paddr_t
+page_mapaddr(struct bootinfo *bi, psize_t mapsize)
+{
+	struct physmem *ram, *r;
+	paddr_t pa;
+	int i, j;
+
+	for (i = bi->nr_rams - 1; i >= 0; i--) {
+		ram = &bi->ram[i];
+		if (ram->type != MT_USABLE || ram->size < mapsize)
+			continue;
+		pa = trunc_page(ram->base + ram->size - mapsize);
+		if (pa < ram->base)
+			continue;
+		for (j = 0; j < bi->nr_rams; j++) {
+			r = &bi->ram[j];
+			if (r->type != MT_USABLE &&
+			    r->base < pa + mapsize && pa < r->base + r->size)
+				break;
+		}
+		if (j == bi->nr_rams)
+			return pa;
+	}
+	panic("page_init: no memory for page map");
+	/* NOTREACHED */
+	return 0;
 }
 
 /*
@@ -261,21 +508,58 @@ page_init(void)
 {
 	struct physmem *ram;
 	struct bootinfo *bi;
+	paddr_t start, end, map;
+	psize_t mapsize, bitsize;
 	int i;
 
 	machine_bootinfo(&bi);
 
 	total_size = 0;
 	bootdisk_size = 0;
-	page_head.next = page_head.prev = &page_head;
+	for (i = 0; i < NR_ORDERS; i++)
+		free_area[i].next = free_area[i].prev = &free_area[i];
+
+	/*
+	 * Get the range of the usable memory, and allocate
+	 * the bitmap and the reference counts for it.
+	 */
+	mem_base = (paddr_t)~0;
+	end = 0;
+	for (i = 0; i < bi->nr_rams; i++) {
+		ram = &bi->ram[i];
+		if (ram->type == MT_USABLE) {
+			if (ram->base < mem_base)
+				mem_base = ram->base;
+			if (ram->base + ram->size > end)
+				end = ram->base + ram->size;
+		}
+	}
+	mem_base = trunc_page(mem_base);
+	mem_pages = (u_long)((round_page(end) - mem_base) / PAGE_SIZE);
+	bitsize = (psize_t)(((mem_pages + 7) / 8 + sizeof(u_short) - 1) &
+			    ~(sizeof(u_short) - 1));
+	mapsize = (psize_t)round_page(bitsize + mem_pages * sizeof(u_short));
+	map = page_mapaddr(bi, mapsize);
+	page_map = ptokv(map);
+	page_refs = (u_short *)(page_map + bitsize);
+	memset(page_map, 0, mapsize);
 
 	/*
-	 * First, create a free list from the boot information.
+	 * Create free lists from the boot information.
+	 * The pages used by the page map are excluded.
 	 */
 	for (i = 0; i < bi->nr_rams; i++) {
 		ram = &bi->ram[i];
 		if (ram->type == MT_USABLE) {
-			page_free(ram->base, ram->size);
+			start = round_page(ram->base);
+			end = trunc_page(ram->base + ram->size);
+			if (start <= map && map < end) {
+				if (map > start)
+					range_free(start, map - start);
+				start = map + mapsize;
+			}
+			if (end > start)
+				range_free(start, end - start);
 			total_size += ram->size;
 		}
 	}
@@ -297,6 +581,7 @@ page_init(void)
 			break;
 		}
 	}
+	total_size -= mapsize;
 	used_size = 0;
 	DPRINTF(("Memory size=%ld MB\n", total_size / 1024 / 1024));
 }
@@ -38,6 +38,17 @@
  * is copied to child task's. In this time, the read-only space
  * is shared with old map.
  *
+ * If the HAL passes the page fault to vm_fault(), the writable
+ * space is also shared copy-on-write. Both maps get read-only
+ * mappings of the same physical pages, and a page is copied when
+ * either task writes to it. In addition, vm_allocate() reserves
+ * only the virtual address space, and each page is allocated and
+ * zero-filled at its first access. Since the pages of such
+ * segments are not always continuous or existing, the page tables
+ * are used to find its physical pages. The segment is filled and
+ * made continuous again when it is mapped to another task or its
+ * attribute is changed.
+ *
  * Since this kernel does not do page out to the physical storage,
  * it is guaranteed that the allocated memory is always continuing
  * and existing. Thereby, a kernel and drivers can be constructed
@@ -54,23 +65,39 @@
 #include <vm.h>
 
 /* forward declarations */
-static void	   seg_init(struct seg *);
-static struct seg *seg_create(struct seg *, vaddr_t, size_t);
-static void	   seg_delete(struct seg *, struct seg *);
-static struct seg *seg_lookup(struct seg *, vaddr_t, size_t);
-static struct seg *seg_alloc(struct seg *, size_t);
-static void	   seg_free(struct seg *, struct seg *);
-static struct seg *seg_reserve(struct seg *, vaddr_t, size_t);
-static int	   do_allocate(vm_map_t, void **, size_t, int);
+static void	   seg_init(vm_map_t);
+static void	   seg_update(struct tnode *);
+static struct seg *seg_create(vm_map_t, struct seg *, vaddr_t, size_t);
+static void	   seg_delete(vm_map_t, struct seg *);
+static struct seg *seg_lookup(vm_map_t, vaddr_t, size_t);
+static struct seg *seg_alloc(vm_map_t, size_t);
+static void	   seg_free(vm_map_t, struct seg *);
+static struct seg *seg_reserve(vm_map_t, vaddr_t, size_t);
+static int	   do_allocate(vm_map_t, void **, size_t, int, int);
 static int	   do_free(vm_map_t, void *);
 static int	   do_attribute(vm_map_t, void *, int);
 static int	   do_map(vm_map_t, void *, size_t, void **);
 static int	   do_grant(vm_map_t, void *, size_t, void **);
+static int	   do_share(vm_map_t, void *, void *);
+static int	   do_check(vm_map_t, void *, size_t, void *);
 static int	   do_map_phys(paddr_t, size_t, void **);
 static vm_map_t	   do_dup(vm_map_t);
+static int	   cow_range(vm_map_t, vaddr_t, vaddr_t);
+static int	   cow_share(vm_map_t, struct seg *, vm_map_t);
+static int	   seg_fill(vm_map_t, vaddr_t, vaddr_t);
+static int	   seg_private(vm_map_t, struct seg *);
+static paddr_t	   seg_extract(vm_map_t, struct seg *, vaddr_t, vaddr_t);
+static void	   seg_release(vm_map_t, struct seg *);
 
 
 static struct vm_map	kernel_map;	/* vm mapping for kernel */
+static struct kmem_cache *seg_cache;	/* cache for segment */
+static u_long		cow_faults;	/* number of copy-on-write faults */
+static u_long		cow_copies;	/* number of pages copied on write */
+static u_long		zero_fills;	/* number of pages filled on demand */
+
+/* Segment whose pages are found by the page tables */
+#define SEG_PAGED	(SEG_COW | SEG_LAZY)
 
 /**
  * vm_allocate - allocate zero-filled memory for specified address
@@ -81,7 +108,8 @@ static struct vm_map	kernel_map;	/* vm mapping for kernel */
  *
  * The allocated area has writable, user-access attribute by
  * default.  The "addr" and "size" argument will be adjusted
- * to page boundary.
+ * to page boundary.  The physical pages are allocated on demand
+ * if the HAL supports it.
  */
 int
 vm_allocate(task_t task, void **addr, size_t size, int anywhere)
@@ -108,7 +136,7 @@ vm_allocate(task_t task, void **addr, size_t size, int anywhere)
 		return EACCES;
 	}
 
-	error = do_allocate(task->map, &uaddr, size, anywhere);
+	error = do_allocate(task->map, &uaddr, size, anywhere, 1);
 	if (!error) {
 		if (copyout(&uaddr, addr, sizeof(uaddr)))
 			error = EFAULT;
@@ -118,7 +146,7 @@ vm_allocate(task_t task, void **addr, size_t size, int anywhere)
 }
 
 static int
-do_allocate(vm_map_t map, void **addr, size_t size, int anywhere)
+do_allocate(vm_map_t map, void **addr, size_t size, int anywhere, int lazy)
 {
 	struct seg *seg;
 	vaddr_t start, end;
@@ -134,17 +162,29 @@ do_allocate(vm_map_t map, void **addr, size_t size, int anywhere)
 	 */
 	if (anywhere) {
 		size = round_page(size);
-		if ((seg = seg_alloc(&map->head, size)) == NULL)
+		if ((seg = seg_alloc(map, size)) == NULL)
 			return ENOMEM;
 	} else {
 		start = trunc_page((vaddr_t)*addr);
 		end = round_page(start + size);
 		size = (size_t)(end - start);
 
-		if ((seg = seg_reserve(&map->head, start, size)) == NULL)
+		if ((seg = seg_reserve(map, start, size)) == NULL)
 			return ENOMEM;
 	}
 	seg->flags = SEG_READ | SEG_WRITE;
+#ifdef MMU_FAULT
+	if (lazy) {
+		/*
+		 * Pages will be allocated by vm_fault().
+		 */
+		seg->flags |= SEG_LAZY;
+		seg->phys = 0;
+		*addr = (void *)seg->addr;
+		map->total += size;
+		return 0;
+	}
+#endif
 
 	/*
 	 * Allocate physical pages, and map them into virtual address
@@ -166,7 +206,7 @@ do_allocate(vm_map_t map, void **addr, size_t size, int anywhere)
  err2:
 	page_free(pa, size);
  err1:
-	seg_free(&map->head, seg);
+	seg_free(map, seg);
 	return ENOMEM;
 }
 
@@ -216,23 +256,22 @@ do_free(vm_map_t map, void *addr)
 	/*
 	 * Find the target segment.
 	 */
-	seg = seg_lookup(&map->head, va, 1);
+	seg = seg_lookup(map, va, 1);
 	if (seg == NULL || seg->addr != va || (seg->flags & SEG_FREE))
 		return EINVAL;
 
 	/*
-	 * Unmap pages of the segment.
+	 * Relinquish use of the page if it is not shared and mapped.
 	 */
-	mmu_map(map->pgd, seg->phys, seg->addr,	seg->size, PG_UNMAP);
+	seg_release(map, seg);
 
 	/*
-	 * Relinquish use of the page if it is not shared and mapped.
+	 * Unmap pages of the segment.
 	 */
-	if (!(seg->flags & SEG_SHARED) && !(seg->flags & SEG_MAPPED))
-		page_free(seg->phys, seg->size);
+	mmu_map(map->pgd, seg->phys, seg->addr,	seg->size, PG_UNMAP);
 
 	map->total -= seg->size;
-	seg_free(&map->head, seg);
+	seg_free(map, seg);
 
 	return 0;
 }
@@ -287,7 +326,7 @@ do_attribute(vm_map_t map, void *addr, int attr)
 	/*
 	 * Find the target segment.
 	 */
-	seg = seg_lookup(&map->head, va, 1);
+	seg = seg_lookup(map, va, 1);
 	if (seg == NULL || seg->addr != va || (seg->flags & SEG_FREE)) {
 		return EINVAL;	/* not allocated */
 	}
@@ -311,6 +350,11 @@ do_attribute(vm_map_t map, void *addr, int attr)
 	if (new_flags == 0)
 		return 0;	/* same attribute */
 
+	if (seg->flags & SEG_PAGED) {
+		if (seg_private(map, seg))
+			return ENOMEM;
+	}
+
 	map_type = (new_flags & SEG_WRITE) ? PG_WRITE : PG_READ;
 	if (attr & PROT_IO)
 		map_type = PG_IOMEM;
@@ -415,16 +459,18 @@ do_map(vm_map_t map, void *addr, size_t size, void **alloc)
 	/*
 	 * Find the segment that includes target address
 	 */
-	seg = seg_lookup(&map->head, start, size);
+	seg = seg_lookup(map, start, size);
 	if (seg == NULL || (seg->flags & SEG_FREE))
 		return EINVAL;	/* not allocated */
 	tgt = seg;
+	if ((pa = seg_extract(map, tgt, start, end)) == 0)
+		return ENOMEM;
 
 	/*
 	 * Find the free segment in current task
 	 */
 	curmap = curtask->map;
-	if ((seg = seg_alloc(&curmap->head, size)) == NULL)
+	if ((seg = seg_alloc(curmap, size)) == NULL)
 		return ENOMEM;
 	cur = seg;
 
@@ -436,15 +482,24 @@ do_map(vm_map_t map, void *addr, size_t size, void **alloc)
 	else
 		map_type = PG_READ;
 
-	pa = tgt->phys + (paddr_t)(start - tgt->addr);
 	if (mmu_map(curmap->pgd, pa, cur->addr, size, map_type)) {
-		seg_free(&curmap->head, cur);
+		seg_free(curmap, cur);
 		return ENOMEM;
 	}
 
-	cur->flags = tgt->flags | SEG_MAPPED;
+	cur->flags = (tgt->flags & ~(SEG_PAGED | SEG_KERNEL | SEG_HOLD)) |
+	    SEG_MAPPED;
 	cur->phys = pa;
 
+	/*
+	 * Hold the pages while they are mapped, so that they are
+	 * not reused even if the target task frees them.
+	 */
+	if (!(tgt->flags & SEG_MAPPED)) {
+		page_share(pa, size);
+		cur->flags |= SEG_HOLD;
+	}
+
 	tmp = (void *)(cur->addr + offset);
 	copyout(&tmp, alloc, sizeof(tmp));
 
@@ -452,6 +507,80 @@ do_map(vm_map_t map, void *addr, size_t size, void **alloc)
 	return 0;
 }
 
+/**
+ * vm_check - check the memory mapped by vm_map() is still valid.
+ *
+ * Returns 0 if the memory at "addr" in the target task is still
+ * backed by the same pages as "local" in the current task, or
+ * EFAULT if the target task has freed or remapped it. If the
+ * local memory is writable, the target memory must be writable.
+ * This is cheaper than mapping the memory again for the server
+ * which keeps the client buffer mapped.
+ */
+int
+vm_check(task_t target, void *addr, size_t size, void *local)
+{
+	int error;
+
+	sched_lock();
+	if (!task_valid(target)) {
+		sched_unlock();
+		return ESRCH;
+	}
+	if (target == curtask) {
+		sched_unlock();
+		return EINVAL;
+	}
+	if (!task_capable(CAP_EXTMEM)) {
+		sched_unlock();
+		return EPERM;
+	}
+	if (!user_area(addr) || !user_area(local)) {
+		sched_unlock();
+		return EFAULT;
+	}
+
+	error = do_check(target->map, addr, size, local);
+
+	sched_unlock();
+	return error;
+}
+
+static int
+do_check(vm_map_t map, void *addr, size_t size, void *local)
+{
+	struct seg *tgt, *cur;
+	vm_map_t curmap;
+	vaddr_t va, lva, end;
+	paddr_t pa;
+
+	if (size == 0)
+		return EINVAL;
+
+	va = trunc_page((vaddr_t)addr);
+	lva = trunc_page((vaddr_t)local);
+	if ((vaddr_t)addr - va != (vaddr_t)local - lva)
+		return EFAULT;
+	end = round_page((vaddr_t)addr + size);
+	size = (size_t)(end - va);
+
+	curmap = curtask->map;
+	tgt = seg_lookup(map, va, size);
+	cur = seg_lookup(curmap, lva, size);
+	if (tgt == NULL || (tgt->flags & SEG_FREE) ||
+	    cur == NULL || !(cur->flags & SEG_MAPPED))
+		return EFAULT;
+	if ((cur->flags & SEG_WRITE) && !(tgt->flags & SEG_WRITE))
+		return EFAULT;
+
+	for (; va < end; va += PAGE_SIZE, lva += PAGE_SIZE) {
+		pa = mmu_extract(curmap->pgd, lva, PAGE_SIZE);
+		if (pa == 0 || mmu_extract(map->pgd, va, PAGE_SIZE) != pa)
+			return EFAULT;
+	}
+	return 0;
+}
+
 /**
  * vm_map_phys - map physical memory to current task.
  *
@@ -501,7 +630,7 @@ do_map_phys(paddr_t addr, size_t size, void **alloc)
 	 * Find the free segment in current task
 	 */
 	curmap = curtask->map;
-	if ((seg = seg_alloc(&curmap->head, size)) == NULL)
+	if ((seg = seg_alloc(curmap, size)) == NULL)
 		return ENOMEM;
 	cur = seg;
 
@@ -510,7 +639,7 @@ do_map_phys(paddr_t addr, size_t size, void **alloc)
 	 */
 	map_type = PG_IOMEM;
 	if (mmu_map(curmap->pgd, addr, cur->addr, size, map_type)) {
-		seg_free(&curmap->head, cur);
+		seg_free(curmap, cur);
 		return ENOMEM;
 	}
 
@@ -588,15 +717,17 @@ do_grant(vm_map_t map, void *addr, size_t size, void **alloc)
 	 * Find the segment that includes target address
 	 */
 	curmap = curtask->map;
-	seg = seg_lookup(&curmap->head, start, size);
+	seg = seg_lookup(curmap, start, size);
 	if (seg == NULL || (seg->flags & SEG_FREE))
 		return EINVAL;	/* not allocated */
 	cur = seg;
+	if ((pa = seg_extract(curmap, cur, start, end)) == 0)
+		return ENOMEM;
 
 	/*
 	 * Find the free segment in target task
 	 */
-	if ((seg = seg_alloc(&map->head, size)) == NULL)
+	if ((seg = seg_alloc(map, size)) == NULL)
 		return ENOMEM;
 	tgt = seg;
 
@@ -608,9 +739,8 @@ do_grant(vm_map_t map, void *addr, size_t size, void **alloc)
 	else
 		map_type = PG_READ;
 
-	pa = cur->phys + (paddr_t)(start - cur->addr);
 	if (mmu_map(map->pgd, pa, tgt->addr, size, map_type)) {
-		seg_free(&map->head, tgt);
+		seg_free(map, tgt);
 		return ENOMEM;
 	}
 
@@ -624,6 +754,94 @@ do_grant(vm_map_t map, void *addr, size_t size, void **alloc)
 	return 0;
 }
 
+/**
+ * vm_share - share current task's read-only segment with another task.
+ *
+ * The whole segment at "addr" is mapped at "dest" in the target
+ * task, and it is linked to the list of the shared segments as
+ * vm_dup() does. So, the pages are released when the last task
+ * frees the segment. The current task can free its segment while
+ * the target task still uses it.
+ */
+int
+vm_share(task_t target, void *addr, void *dest)
+{
+	int error;
+
+	sched_lock();
+	if (!task_valid(target)) {
+		sched_unlock();
+		return ESRCH;
+	}
+	if (target == curtask) {
+		sched_unlock();
+		return EINVAL;
+	}
+	if (!task_capable(CAP_EXTMEM)) {
+		sched_unlock();
+		return EPERM;
+	}
+	if (!user_area(addr) || !user_area(dest)) {
+		sched_unlock();
+		return EFAULT;
+	}
+
+	error = do_share(target->map, addr, dest);
+
+	sched_unlock();
+	return error;
+}
+
+static int
+do_share(vm_map_t map, void *addr, void *dest)
+{
+	struct seg *seg, *cur, *tgt;
+	vm_map_t curmap;
+	vaddr_t va;
+
+	va = trunc_page((vaddr_t)addr);
+	if (va != (vaddr_t)addr || trunc_page((vaddr_t)dest) != (vaddr_t)dest)
+		return EINVAL;
+
+	/*
+	 * Find the segment in current task. It must be a
+	 * read-only segment which is owned by current task.
+	 */
+	curmap = curtask->map;
+	seg = seg_lookup(curmap, va, 1);
+	if (seg == NULL || seg->addr != va || (seg->flags & SEG_FREE))
+		return EINVAL;
+	cur = seg;
+	if (cur->flags & (SEG_WRITE | SEG_MAPPED | SEG_PAGED))
+		return EINVAL;
+	if (map->total + cur->size >= MAXMEM)
+		return ENOMEM;
+
+	/*
+	 * Reserve the segment in target task.
+	 */
+	if ((seg = seg_reserve(map, (vaddr_t)dest, cur->size)) == NULL)
+		return ENOMEM;
+	tgt = seg;
+
+	if (mmu_map(map->pgd, cur->phys, tgt->addr, cur->size, PG_READ)) {
+		seg_free(map, tgt);
+		return ENOMEM;
+	}
+	tgt->phys = cur->phys;
+	tgt->flags = cur->flags | SEG_SHARED;
+
+	/* Link to the shared list */
+	cur->flags |= SEG_SHARED;
+	tgt->sh_prev = cur;
+	tgt->sh_next = cur->sh_next;
+	cur->sh_next->sh_prev = tgt;
+	cur->sh_next = tgt;
+
+	map->total += cur->size;
+	return 0;
+}
+
 /*
  * Create new virtual memory space.
  * No memory is inherited.
@@ -647,7 +865,7 @@ vm_create(void)
 		kmem_free(map);
 		return NULL;
 	}
-	seg_init(&map->head);
+	seg_init(map);
 	return map;
 }
 
@@ -667,19 +885,16 @@ vm_terminate(vm_map_t map)
 	seg = &map->head;
 	do {
 		if (seg->flags != SEG_FREE) {
+			/* Free segment if it is not shared and mapped */
+			seg_release(map, seg);
+
 			/* Unmap segment */
 			mmu_map(map->pgd, seg->phys, seg->addr,
 				seg->size, PG_UNMAP);
-
-			/* Free segment if it is not shared and mapped */
-			if (!(seg->flags & SEG_SHARED) &&
-			    !(seg->flags & SEG_MAPPED)) {
-				page_free(seg->phys, seg->size);
-			}
 		}
 		tmp = seg;
 		seg = seg->next;
-		seg_delete(&map->head, tmp);
+		seg_delete(map, tmp);
 	} while (seg != &map->head);
 
 	if (map == curtask->map) {
@@ -704,7 +919,8 @@ vm_terminate(vm_map_t map)
  * All segments of original memory map are copied to new memory map.
  * If the segment is read-only, executable, or shared segment, it is
  * no need to copy. These segments are physically shared with the
- * original map.
+ * original map. The writable segments are shared copy-on-write if
+ * the HAL supports it.
  */
 vm_map_t
 vm_dup(vm_map_t org_map)
@@ -739,6 +955,8 @@ do_dup(vm_map_t org_map)
 	 */
 	*tmp = *src;
 	tmp->next = tmp->prev = tmp;
+	tree_init(&new_map->tree, seg_update);
+	tree_insert_after(&new_map->tree, NULL, &tmp->node);
 
 	if (src == src->next)	/* Blank memory ? */
 		return new_map;
@@ -751,7 +969,7 @@ do_dup(vm_map_t org_map)
 			dest = tmp;
 		} else {
 			/* Create new segment struct */
-			dest = kmem_alloc(sizeof(*dest));
+			dest = kmem_cache_alloc(seg_cache);
 			if (dest == NULL)
 				return NULL;
 
@@ -761,6 +979,8 @@ do_dup(vm_map_t org_map)
 			dest->next = tmp->next;
 			tmp->next->prev = dest;
 			tmp->next = dest;
+			tree_insert_after(&new_map->tree, &tmp->node,
+					  &dest->node);
 			tmp = dest;
 		}
 		if (src->flags == SEG_FREE) {
@@ -773,6 +993,17 @@ do_dup(vm_map_t org_map)
 			    !(src->flags & SEG_MAPPED)) {
 				dest->flags |= SEG_SHARED;
 			}
+#ifdef MMU_FAULT
+			if ((src->flags & SEG_WRITE) &&
+			    !(src->flags & (SEG_SHARED | SEG_MAPPED))) {
+				/* Share the writable segment. */
+				if (cow_share(org_map, src, new_map))
+					return NULL;
+				dest->flags |= SEG_COW;
+				src = src->next;
+				continue;
+			}
+#endif
 
 			if (!(dest->flags & SEG_SHARED)) {
 				/* Allocate new physical page. */
@@ -868,7 +1099,7 @@ vm_load(vm_map_t map, struct module *mod, void **stack)
 	/*
 	 * Create text segment
 	 */
-	error = do_allocate(map, &text, mod->textsz, 0);
+	error = do_allocate(map, &text, mod->textsz, 0, 0);
 	if (error)
 		return error;
 	memcpy(text, src, mod->textsz);
@@ -880,7 +1111,8 @@ vm_load(vm_map_t map, struct module *mod, void **stack)
 	 * Create data & BSS segment
 	 */
 	if (mod->datasz + mod->bsssz != 0) {
-		error = do_allocate(map, &data, mod->datasz + mod->bsssz, 0);
+		error = do_allocate(map, &data, mod->datasz + mod->bsssz,
+				    0, 0);
 		if (error)
 			return error;
 		if (mod->datasz > 0) {
@@ -892,7 +1124,7 @@ vm_load(vm_map_t map, struct module *mod, void **stack)
 	 * Create stack
 	 */
 	*stack = (void *)USRSTACK;
-	error = do_allocate(map, stack, DFLSTKSZ, 0);
+	error = do_allocate(map, stack, DFLSTKSZ, 0, 0);
 	if (error)
 		return error;
 
@@ -908,8 +1140,149 @@ vm_load(vm_map_t map, struct module *mod, void **stack)
 paddr_t
 vm_translate(vaddr_t addr, size_t size)
 {
+	vm_map_t map;
+	struct seg *seg;
+	paddr_t pa;
+
+	sched_lock();
+	map = curtask->map;
 
-	return mmu_extract(curtask->map->pgd, addr, size);
+	/*
+	 * The kernel may write to the returned address. So,
+	 * the pages must be filled and copied here.
+	 */
+	seg = seg_lookup(map, addr, size);
+	if (seg != NULL && (seg->flags & SEG_PAGED)) {
+		if (seg_fill(map, trunc_page(addr), round_page(addr + size)) ||
+		    cow_range(map, trunc_page(addr),
+			      round_page(addr + size))) {
+			sched_unlock();
+			return 0;
+		}
+	}
+	pa = mmu_extract(map->pgd, addr, size);
+	sched_unlock();
+	return pa;
+}
+
+/*
+ * Allocate a page which the kernel writes and the task reads.
+ *
+ * The page is mapped read-only at the returned user address,
+ * and the kernel address is returned in kva. The kernel holds
+ * its own reference to the page, so the kernel can write to it
+ * even after the task frees or remaps the user address. The
+ * reference is dropped by vm_kpage_free().
+ */
+int
+vm_kpage(vm_map_t map, vaddr_t *uva, void **kva)
+{
+	struct seg *seg;
+	paddr_t pa;
+
+	if ((pa = page_alloc(PAGE_SIZE)) == 0)
+		return ENOMEM;
+	memset(ptokv(pa), 0, PAGE_SIZE);
+
+	if ((seg = seg_alloc(map, PAGE_SIZE)) == NULL) {
+		page_free(pa, PAGE_SIZE);
+		return ENOMEM;
+	}
+	if (mmu_map(map->pgd, pa, seg->addr, PAGE_SIZE, PG_READ)) {
+		seg_free(map, seg);
+		page_free(pa, PAGE_SIZE);
+		return ENOMEM;
+	}
+	/* The segment has the second reference. */
+	page_share(pa, PAGE_SIZE);
+	seg->flags = SEG_READ | SEG_MAPPED | SEG_HOLD | SEG_KERNEL;
+	seg->phys = pa;
+	map->total += PAGE_SIZE;
+
+	*uva = seg->addr;
+	*kva = ptokv(pa);
+	return 0;
+}
+
+/*
+ * Take the kernel page at the user address in the new map
+ * created by task_create(). vm_dup() gives the copy of the page
+ * to the child, or the map is shared with the parent. Returns
+ * the kernel address, or NULL if the task has freed the page.
+ */
+void *
+vm_kpage_dup(vm_map_t map, vaddr_t uva)
+{
+	struct seg *seg;
+
+	seg = seg_lookup(map, uva, PAGE_SIZE);
+	if (seg == NULL || seg->addr != uva ||
+	    !(seg->flags & SEG_KERNEL))
+		return NULL;
+	page_share(seg->phys, PAGE_SIZE);
+	return ptokv(seg->phys);
+}
+
+/*
+ * Drop the kernel reference to the page.
+ */
+void
+vm_kpage_free(void *kva)
+{
+
+	page_free(kvtop(kva), PAGE_SIZE);
+}
+
+/*
+ * Handle the page fault to the user page.
+ *
+ * This is called by the HAL when the access to the user page
+ * is failed. The page is allocated if it is not filled yet,
+ * or copied if it is copy-on-write page. Returns 0 if the
+ * page is made accessible, or EFAULT if the fault is not
+ * resolved.
+ */
+int
+vm_fault(vaddr_t addr)
+{
+	vm_map_t map;
+	struct seg *seg;
+	vaddr_t va;
+	int error = EFAULT;
+
+	sched_lock();
+	map = curtask->map;
+	va = trunc_page(addr);
+	seg = seg_lookup(map, va, PAGE_SIZE);
+	if (seg == NULL || !(seg->flags & SEG_PAGED)) {
+		sched_unlock();
+		return EFAULT;
+	}
+	if (mmu_extract(map->pgd, va, PAGE_SIZE) == 0) {
+		if ((seg->flags & SEG_LAZY) && seg_fill(map, va,
+		    va + PAGE_SIZE) == 0)
+			error = 0;
+	} else if ((seg->flags & (SEG_COW | SEG_WRITE)) ==
+		   (SEG_COW | SEG_WRITE)) {
+		if (cow_range(map, va, va + PAGE_SIZE) == 0) {
+			cow_faults++;
+			error = 0;
+		}
+	}
+	sched_unlock();
+	return error;
+}
+
+/*
+ * Get copy-on-write statistics.
+ */
+void
+vm_stat(struct meminfo *info)
+{
+
+	info->cowfaults = cow_faults;
+	info->cowcopies = cow_copies;
+	info->zerofills = zero_fills;
 }
 
 int
@@ -958,17 +1331,204 @@ vm_init(void)
 	kernel_map.pgd = pgd;
 	mmu_switch(pgd);
 
-	seg_init(&kernel_map.head);
+	seg_cache = kmem_cache_create("seg", sizeof(struct seg), NULL);
+	if (seg_cache == NULL)
+		panic("vm_init");
+
+	seg_init(&kernel_map);
 	kernel_task.map = &kernel_map;
 }
 
 
+/*
+ * Make the pages in the range private and writable.
+ *
+ * The pages which are still shared with other maps are
+ * copied to a new continuous block. If all pages are private
+ * and continuous, they are just made writable.
+ */
+static int
+cow_range(vm_map_t map, vaddr_t start, vaddr_t end)
+{
+	paddr_t pa, base, new_pa;
+	vaddr_t va;
+	size_t size;
+	int copy = 0;
+
+	base = mmu_extract(map->pgd, start, PAGE_SIZE);
+	for (va = start; va < end; va += PAGE_SIZE) {
+		pa = mmu_extract(map->pgd, va, PAGE_SIZE);
+		if (pa == 0)
+			return EFAULT;
+		if (page_shared(pa) || pa != base + (paddr_t)(va - start))
+			copy = 1;
+	}
+	size = (size_t)(end - start);
+	if (!copy)
+		return mmu_map(map->pgd, base, start, size, PG_WRITE);
+
+	if ((new_pa = page_alloc(size)) == 0)
+		return ENOMEM;
+
+	/*
+	 * Copy pages, and drop the reference to the old pages.
+	 * The page tables exist for all pages, so mmu_map()
+	 * below does not fail.
+	 */
+	for (va = start; va < end; va += PAGE_SIZE) {
+		pa = mmu_extract(map->pgd, va, PAGE_SIZE);
+		memcpy(ptokv(new_pa + (paddr_t)(va - start)), ptokv(pa),
+		       PAGE_SIZE);
+		page_free(pa, PAGE_SIZE);
+	}
+	mmu_map(map->pgd, new_pa, start, size, PG_WRITE);
+	cow_copies += size / PAGE_SIZE;
+	return 0;
+}
+
+/*
+ * Share the writable segment with the new map copy-on-write.
+ * The pages are mapped read-only in both maps.
+ */
+static int
+cow_share(vm_map_t org_map, struct seg *seg, vm_map_t new_map)
+{
+	paddr_t pa;
+	vaddr_t va;
+
+	if (!(seg->flags & SEG_PAGED)) {
+		/*
+		 * First fork of this segment. All pages are
+		 * continuous at seg->phys.
+		 */
+		if (mmu_map(new_map->pgd, seg->phys, seg->addr, seg->size,
+			    PG_READ))
+			return ENOMEM;
+		mmu_map(org_map->pgd, seg->phys, seg->addr, seg->size,
+			PG_READ);
+		page_share(seg->phys, seg->size);
+		seg->flags |= SEG_COW;
+		return 0;
+	}
+	for (va = seg->addr; va < seg->addr + seg->size; va += PAGE_SIZE) {
+		pa = mmu_extract(org_map->pgd, va, PAGE_SIZE);
+		if (pa == 0)
+			continue;	/* not filled yet */
+		if (mmu_map(new_map->pgd, pa, va, PAGE_SIZE, PG_READ))
+			return ENOMEM;
+		mmu_map(org_map->pgd, pa, va, PAGE_SIZE, PG_READ);
+		page_share(pa, PAGE_SIZE);
+	}
+	seg->flags |= SEG_COW;
+	return 0;
+}
+
+/*
+ * Allocate zero-filled pages for the unfilled pages in the
+ * range. The pages are mapped one by one, so that the map
+ * is kept consistent even if it fails.
+ */
+static int
+seg_fill(vm_map_t map, vaddr_t start, vaddr_t end)
+{
+	paddr_t pa;
+	vaddr_t va;
+
+	for (va = start; va < end; va += PAGE_SIZE) {
+		if (mmu_extract(map->pgd, va, PAGE_SIZE) != 0)
+			continue;
+		if ((pa = page_alloc(PAGE_SIZE)) == 0)
+			return ENOMEM;
+		memset(ptokv(pa), 0, PAGE_SIZE);
+		if (mmu_map(map->pgd, pa, va, PAGE_SIZE, PG_WRITE)) {
+			page_free(pa, PAGE_SIZE);
+			return ENOMEM;
+		}
+		zero_fills++;
+	}
+	return 0;
+}
+
+/*
+ * Convert the copy-on-write or lazy segment to the normal
+ * segment which has private and continuous pages.
+ */
+static int
+seg_private(vm_map_t map, struct seg *seg)
+{
+	int error;
+
+	error = seg_fill(map, seg->addr, seg->addr + seg->size);
+	if (error)
+		return error;
+	error = cow_range(map, seg->addr, seg->addr + seg->size);
+	if (error)
+		return error;
+	seg->phys = mmu_extract(map->pgd, seg->addr, seg->size);
+	seg->flags &= ~SEG_PAGED;
+	return 0;
+}
+
+/*
+ * Return the physical address of the range in the segment.
+ *
+ * The pages of the lazy or copy-on-write segment are filled and
+ * copied only in the range, so that they become private and
+ * continuous. The rest of the segment is left as it is.
+ * Returns 0 if no memory.
+ */
+static paddr_t
+seg_extract(vm_map_t map, struct seg *seg, vaddr_t start, vaddr_t end)
+{
+
+	if (!(seg->flags & SEG_PAGED))
+		return seg->phys + (paddr_t)(start - seg->addr);
+	if (seg_fill(map, start, end) || cow_range(map, start, end))
+		return 0;
+	return mmu_extract(map->pgd, start, (size_t)(end - start));
+}
+
+/*
+ * Release the physical pages of the segment.
+ * The pages of shared or mapped segment are not released,
+ * but the reference held by vm_map() is dropped.
+ */
+static void
+seg_release(vm_map_t map, struct seg *seg)
+{
+	paddr_t pa;
+	vaddr_t va;
+
+	if (seg->flags & SEG_HOLD) {
+		page_free(seg->phys, seg->size);
+		return;
+	}
+	if (seg->flags & (SEG_SHARED | SEG_MAPPED))
+		return;
+
+	if (seg->flags & SEG_PAGED) {
+		for (va = seg->addr; va < seg->addr + seg->size;
+		     va += PAGE_SIZE) {
+			pa = mmu_extract(map->pgd, va, PAGE_SIZE);
+			if (pa != 0)
+				page_free(pa, PAGE_SIZE);
+		}
+	} else
+		page_free(seg->phys, seg->size);
+}
+
 /*
  * Initialize segment.
+ *
+ * The segments are linked in the list sorted by address, and
+ * they cover whole user space. The segment tree is also used
+ * to find the segment by address, or the first free segment
+ * which has enough size.
  */
 static void
-seg_init(struct seg *seg)
+seg_init(vm_map_t map)
 {
+	struct seg *seg = &map->head;
 
 	seg->next = seg->prev = seg;
 	seg->sh_next = seg->sh_prev = seg;
@@ -976,6 +1536,35 @@ seg_init(struct seg *seg)
 	seg->phys = 0;
 	seg->size = USERLIMIT - PAGE_SIZE;
 	seg->flags = SEG_FREE;
+
+	tree_init(&map->tree, seg_update);
+	tree_insert_after(&map->tree, NULL, &seg->node);
+}
+
+/*
+ * Compute the largest free segment in the subtree.
+ * This is called by the tree library.
+ */
+static void
+seg_update(struct tnode *n)
+{
+	struct seg *seg, *child;
+	size_t max = 0;
+
+	seg = tree_entry(n, struct seg, node);
+	if (seg->flags & SEG_FREE)
+		max = seg->size;
+	if (n->left != NULL) {
+		child = tree_entry(n->left, struct seg, node);
+		if (child->maxfree > max)
+			max = child->maxfree;
+	}
+	if (n->right != NULL) {
+		child = tree_entry(n->right, struct seg, node);
+		if (child->maxfree > max)
+			max = child->maxfree;
+	}
+	seg->maxfree = max;
 }
 
 /*
@@ -983,11 +1572,11 @@ seg_init(struct seg *seg)
  * Returns segment on success, or NULL on failure.
  */
 static struct seg *
-seg_create(struct seg *prev, vaddr_t addr, size_t size)
+seg_create(vm_map_t map, struct seg *prev, vaddr_t addr, size_t size)
 {
 	struct seg *seg;
 
-	if ((seg = kmem_alloc(sizeof(*seg))) == NULL)
+	if ((seg = kmem_cache_alloc(seg_cache)) == NULL)
 		return NULL;
 
 	seg->addr = addr;
@@ -1001,14 +1590,17 @@ seg_create(struct seg *prev, vaddr_t addr, size_t size)
 	prev->next->prev = seg;
 	prev->next = seg;
 
+	tree_insert_after(&map->tree, &prev->node, &seg->node);
 	return seg;
 }
 
 /*
  * Delete specified segment.
+ * This is used only when the whole map is deleted, so the
+ * segment is not removed from the tree.
  */
 static void
-seg_delete(struct seg *head, struct seg *seg)
+seg_delete(vm_map_t map, struct seg *seg)
 {
 
 	/*
@@ -1020,69 +1612,91 @@ seg_delete(struct seg *head, struct seg *seg)
 		if (seg->sh_prev == seg->sh_next)
 			seg->sh_prev->flags &= ~SEG_SHARED;
 	}
-	if (head != seg)
-		kmem_free(seg);
+	if (&map->head != seg)
+		kmem_cache_free(seg_cache, seg);
 }
 
 /*
  * Find the segment at the specified address.
  */
 static struct seg *
-seg_lookup(struct seg *head, vaddr_t addr, size_t size)
+seg_lookup(vm_map_t map, vaddr_t addr, size_t size)
 {
-	struct seg *seg;
+	struct tnode *n;
+	struct seg *seg, *found = NULL;
 
-	seg = head;
-	do {
-		if (seg->addr <= addr &&
-		    seg->addr + seg->size >= addr + size) {
-			return seg;
-		}
-		seg = seg->next;
-	} while (seg != head);
+	/*
+	 * Find the last segment which starts at or before
+	 * the address.
+	 */
+	n = tree_root(&map->tree);
+	while (n != NULL) {
+		seg = tree_entry(n, struct seg, node);
+		if (seg->addr <= addr) {
+			found = seg;
+			n = tree_right(n);
+		} else
+			n = tree_left(n);
+	}
+	if (found != NULL && found->addr + found->size >= addr + size)
+		return found;
 	return NULL;
 }
 
 /*
  * Allocate free segment for specified size.
+ * The free segment at the lowest address is used.
  */
 static struct seg *
-seg_alloc(struct seg *head, size_t size)
+seg_alloc(vm_map_t map, size_t size)
 {
-	struct seg *seg;
+	struct tnode *n;
+	struct seg *seg, *child;
 
-	seg = head;
-	do {
-		if ((seg->flags & SEG_FREE) && seg->size >= size) {
-			if (seg->size != size) {
-				/*
-				 * Split this segment and return its head.
-				 */
-				if (seg_create(seg,
-					       seg->addr + size,
-					       seg->size - size) == NULL)
-					return NULL;
+	n = tree_root(&map->tree);
+	seg = tree_entry(n, struct seg, node);
+	if (seg->maxfree < size)
+		return NULL;
+
+	for (;;) {
+		seg = tree_entry(n, struct seg, node);
+		if (tree_left(n) != NULL) {
+			child = tree_entry(tree_left(n), struct seg, node);
+			if (child->maxfree >= size) {
+				n = tree_left(n);
+				continue;
 			}
-			seg->size = size;
-			return seg;
 		}
-		seg = seg->next;
-	} while (seg != head);
-	return NULL;
+		if ((seg->flags & SEG_FREE) && seg->size >= size)
+			break;
+		n = tree_right(n);
+		ASSERT(n != NULL);
+	}
+
+	if (seg->size != size) {
+		/*
+		 * Split this segment and return its head.
+		 */
+		if (seg_create(map, seg, seg->addr + size,
+			       seg->size - size) == NULL)
+			return NULL;
+	}
+	seg->size = size;
+	seg->flags = 0;
+	tree_fixup(&map->tree, &seg->node);
+	return seg;
 }
 
 /*
  * Delete specified free segment.
  */
 static void
-seg_free(struct seg *head, struct seg *seg)
+seg_free(vm_map_t map, struct seg *seg)
 {
 	struct seg *prev, *next;
 
 	ASSERT(seg->flags != SEG_FREE);
 
-	seg->flags = SEG_FREE;
-
 	/*
 	 * If it is shared segment, unlink from shared list.
 	 */
@@ -1092,33 +1706,39 @@ seg_free(struct seg *head, struct seg *seg)
 		if (seg->sh_prev == seg->sh_next)
 			seg->sh_prev->flags &= ~SEG_SHARED;
 	}
+	seg->flags = SEG_FREE;
+
 	/*
 	 * If next segment is free, merge with it.
 	 */
 	next = seg->next;
-	if (next != head && (next->flags & SEG_FREE)) {
+	if (next != &map->head && (next->flags & SEG_FREE)) {
 		seg->next = next->next;
 		next->next->prev = seg;
 		seg->size += next->size;
-		kmem_free(next);
+		tree_remove(&map->tree, &next->node);
+		kmem_cache_free(seg_cache, next);
 	}
 	/*
 	 * If previous segment is free, merge with it.
 	 */
 	prev = seg->prev;
-	if (seg != head && (prev->flags & SEG_FREE)) {
+	if (seg != &map->head && (prev->flags & SEG_FREE)) {
 		prev->next = seg->next;
 		seg->next->prev = prev;
 		prev->size += seg->size;
-		kmem_free(seg);
+		tree_remove(&map->tree, &seg->node);
+		kmem_cache_free(seg_cache, seg);
+		seg = prev;
 	}
+	tree_fixup(&map->tree, &seg->node);
 }
 
 /*
  * Reserve the segment at the specified address/size.
  */
 static struct seg *
-seg_reserve(struct seg *head, vaddr_t addr, size_t size)
+seg_reserve(vm_map_t map, vaddr_t addr, size_t size)
 {
 	struct seg *seg, *prev, *next;
 	size_t diff;
@@ -1126,7 +1746,7 @@ seg_reserve(struct seg *head, vaddr_t addr, size_t size)
 	/*
 	 * Find the block which includes specified block.
 	 */
-	seg = seg_lookup(head, addr, size);
+	seg = seg_lookup(map, addr, size);
 	if (seg == NULL || !(seg->flags & SEG_FREE))
 		return NULL;
 
@@ -1137,25 +1757,29 @@ seg_reserve(struct seg *head, vaddr_t addr, size_t size)
 	if (seg->addr != addr) {
 		prev = seg;
 		diff = (size_t)(addr - seg->addr);
-		seg = seg_create(prev, addr, prev->size - diff);
+		seg = seg_create(map, prev, addr, prev->size - diff);
 		if (seg == NULL)
 			return NULL;
 		prev->size = diff;
+		tree_fixup(&map->tree, &prev->node);
 	}
 	/*
 	 * Check next segment to split segment.
 	 */
 	if (seg->size != size) {
-		next = seg_create(seg, seg->addr + size, seg->size - size);
+		next = seg_create(map, seg, seg->addr + size,
+				  seg->size - size);
 		if (next == NULL) {
 			if (prev) {
 				/* Undo previous seg_create() operation */
-				seg_free(head, seg);
+				seg->flags = 0;
+				seg_free(map, seg);
 			}
 			return NULL;
 		}
 		seg->size = size;
 	}
 	seg->flags = 0;
+	tree_fixup(&map->tree, &seg->node);
 	return seg;
 }
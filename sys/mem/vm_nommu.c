@@ -48,13 +48,13 @@
 #include <vm.h>
 
 /* forward declarations */
-static void	   seg_init(struct seg *);
-static struct seg *seg_create(struct seg *, vaddr_t, size_t);
-static void	   seg_delete(struct seg *, struct seg *);
-static struct seg *seg_lookup(struct seg *, vaddr_t, size_t);
-static struct seg *seg_alloc(struct seg *, size_t);
-static void	   seg_free(struct seg *, struct seg *);
-static struct seg *seg_reserve(struct seg *, vaddr_t, size_t);
+static void	   seg_init(vm_map_t);
+static struct seg *seg_create(vm_map_t, vaddr_t, size_t);
+static void	   seg_delete(vm_map_t, struct seg *);
+static struct seg *seg_lookup(vm_map_t, vaddr_t, size_t);
+static struct seg *seg_alloc(vm_map_t, size_t);
+static void	   seg_free(vm_map_t, struct seg *);
+static struct seg *seg_reserve(vm_map_t, vaddr_t, size_t);
 static int	   do_allocate(vm_map_t, void **, size_t, int);
 static int	   do_free(vm_map_t, void *);
 static int	   do_attribute(vm_map_t, void *, int);
@@ -62,6 +62,7 @@ static int	   do_map(vm_map_t, void *, size_t, void **);
 
 
 static struct vm_map	kernel_map;	/* vm mapping for kernel */
+static struct kmem_cache *seg_cache;	/* cache for segment */
 
 /**
  * vm_allocate - allocate zero-filled memory for specified address
@@ -124,7 +125,7 @@ do_allocate(vm_map_t map, void **addr, size_t size, int anywhere)
 	 */
 	if (anywhere) {
 		size = round_page(size);
-		if ((seg = seg_alloc(&map->head, size)) == NULL)
+		if ((seg = seg_alloc(map, size)) == NULL)
 			return ENOMEM;
 		start = seg->addr;
 	} else {
@@ -132,7 +133,7 @@ do_allocate(vm_map_t map, void **addr, size_t size, int anywhere)
 		end = round_page(start + size);
 		size = (size_t)(end - start);
 
-		if ((seg = seg_reserve(&map->head, start, size)) == NULL)
+		if ((seg = seg_reserve(map, start, size)) == NULL)
 			return ENOMEM;
 	}
 	seg->flags = SEG_READ | SEG_WRITE;
@@ -190,7 +191,7 @@ do_free(vm_map_t map, void *addr)
 	/*
 	 * Find the target segment.
 	 */
-	seg = seg_lookup(&map->head, va, 1);
+	seg = seg_lookup(map, va, 1);
 	if (seg == NULL || seg->addr != va || (seg->flags & SEG_FREE))
 		return EINVAL;	/* not allocated */
 
@@ -201,7 +202,7 @@ do_free(vm_map_t map, void *addr)
 		page_free(seg->phys, seg->size);
 
 	map->total -= seg->size;
-	seg_free(&map->head, seg);
+	seg_free(map, seg);
 
 	return 0;
 }
@@ -255,7 +256,7 @@ do_attribute(vm_map_t map, void *addr, int attr)
 	/*
 	 * Find the target segment.
 	 */
-	seg = seg_lookup(&map->head, va, 1);
+	seg = seg_lookup(map, va, 1);
 	if (seg == NULL || seg->addr != va || (seg->flags & SEG_FREE)) {
 		return EINVAL;	/* not allocated */
 	}
@@ -341,7 +342,7 @@ do_map(vm_map_t map, void *addr, size_t size, void **alloc)
 	/*
 	 * Find the segment that includes target address
 	 */
-	seg = seg_lookup(&map->head, start, size);
+	seg = seg_lookup(map, start, size);
 	if (seg == NULL || (seg->flags & SEG_FREE))
 		return EINVAL;	/* not allocated */
 	tgt = seg;
@@ -350,7 +351,7 @@ do_map(vm_map_t map, void *addr, size_t size, void **alloc)
 	 * Create new segment to map
 	 */
 	curmap = curtask->map;
-	if ((seg = seg_create(&curmap->head, start, size)) == NULL)
+	if ((seg = seg_create(curmap, start, size)) == NULL)
 		return ENOMEM;
 	seg->flags = tgt->flags | SEG_MAPPED;
 
@@ -360,6 +361,57 @@ do_map(vm_map_t map, void *addr, size_t size, void **alloc)
 	return 0;
 }
 
+/**
+ * vm_check - check the memory mapped by vm_map() is still valid.
+ *
+ * vm_map() returns the same address without MMU. So, the memory
+ * is valid while the target task keeps the segment.
+ */
+int
+vm_check(task_t target, void *addr, size_t size, void *local)
+{
+	struct seg *seg;
+	int error = 0;
+
+	sched_lock();
+	if (!task_valid(target)) {
+		sched_unlock();
+		return ESRCH;
+	}
+	if (target == curtask) {
+		sched_unlock();
+		return EINVAL;
+	}
+	if (!task_capable(CAP_EXTMEM)) {
+		sched_unlock();
+		return EPERM;
+	}
+	if (size == 0) {
+		sched_unlock();
+		return EINVAL;
+	}
+	seg = seg_lookup(target->map, trunc_page((vaddr_t)addr),
+			 (size_t)(round_page((vaddr_t)addr + size) -
+				  trunc_page((vaddr_t)addr)));
+	if (addr != local || seg == NULL || (seg->flags & SEG_FREE))
+		error = EFAULT;
+	sched_unlock();
+	return error;
+}
+
+/**
+ * vm_share - share current task's read-only segment with another task.
+ *
+ * The segment can not be placed at the specific address
+ * without MMU.
+ */
+int
+vm_share(task_t target, void *addr, void *dest)
+{
+
+	return ENOSYS;
+}
+
 /*
  * Create new virtual memory space.
  * No memory is inherited.
@@ -377,7 +429,7 @@ vm_create(void)
 	map->refcnt = 1;
 	map->total = 0;
 
-	seg_init(&map->head);
+	seg_init(map);
 	return map;
 }
 
@@ -405,7 +457,7 @@ vm_terminate(vm_map_t map)
 		}
 		tmp = seg;
 		seg = seg->next;
-		seg_delete(&map->head, tmp);
+		seg_delete(map, tmp);
 	} while (seg != &map->head);
 
 	kmem_free(map);
@@ -471,7 +523,7 @@ vm_load(vm_map_t map, struct module *mod, void **stack)
 	end = round_page(start + size);
 	size = (size_t)(end - start);
 
-	if ((seg = seg_create(&map->head, start, size)) == NULL)
+	if ((seg = seg_create(map, start, size)) == NULL)
 		return ENOMEM;
 
 	seg->flags = SEG_READ | SEG_WRITE;
@@ -496,6 +548,67 @@ vm_translate(vaddr_t addr, size_t size)
 	return (paddr_t)addr;
 }
 
+/*
+ * Allocate a page which the kernel writes and the task reads.
+ * The page can not be protected without MMU, but the kernel
+ * holds its own reference as the MMU version does.
+ */
+int
+vm_kpage(vm_map_t map, vaddr_t *uva, void **kva)
+{
+	struct seg *seg;
+
+	if ((seg = seg_alloc(map, PAGE_SIZE)) == NULL)
+		return ENOMEM;
+	memset((void *)seg->addr, 0, PAGE_SIZE);
+	page_share(seg->phys, PAGE_SIZE);
+	seg->flags = SEG_READ | SEG_KERNEL;
+	map->total += PAGE_SIZE;
+
+	*uva = seg->addr;
+	*kva = (void *)seg->addr;
+	return 0;
+}
+
+void *
+vm_kpage_dup(vm_map_t map, vaddr_t uva)
+{
+	struct seg *seg;
+
+	seg = seg_lookup(map, uva, PAGE_SIZE);
+	if (seg == NULL || seg->addr != uva ||
+	    !(seg->flags & SEG_KERNEL))
+		return NULL;
+	page_share(seg->phys, PAGE_SIZE);
+	return (void *)seg->addr;
+}
+
+void
+vm_kpage_free(void *kva)
+{
+
+	page_free((paddr_t)kva, PAGE_SIZE);
+}
+
+/*
+ * No copy-on-write without MMU.
+ */
+int
+vm_fault(vaddr_t addr)
+{
+
+	return EFAULT;
+}
+
+void
+vm_stat(struct meminfo *info)
+{
+
+	info->cowfaults = 0;
+	info->cowcopies = 0;
+	info->zerofills = 0;
+}
+
 int
 vm_info(struct vminfo *info)
 {
@@ -533,16 +646,25 @@ void
 vm_init(void)
 {
 
-	seg_init(&kernel_map.head);
+	seg_cache = kmem_cache_create("seg", sizeof(struct seg), NULL);
+	if (seg_cache == NULL)
+		panic("vm_init");
+
+	seg_init(&kernel_map);
 	kernel_task.map = &kernel_map;
 }
 
 /*
  * Initialize segment.
+ *
+ * The segments are linked in the list, and they are also
+ * sorted by address in the segment tree to find the segment
+ * by address.
  */
 static void
-seg_init(struct seg *seg)
+seg_init(vm_map_t map)
 {
+	struct seg *seg = &map->head;
 
 	seg->next = seg->prev = seg;
 	seg->sh_next = seg->sh_prev = seg;
@@ -550,18 +672,22 @@ seg_init(struct seg *seg)
 	seg->phys = 0;
 	seg->size = 0;
 	seg->flags = SEG_FREE;
+
+	tree_init(&map->tree, NULL);
+	tree_insert_after(&map->tree, NULL, &seg->node);
 }
 
 /*
- * Create new free segment after the specified segment.
+ * Create new free segment.
  * Returns segment on success, or NULL on failure.
  */
 static struct seg *
-seg_create(struct seg *prev, vaddr_t addr, size_t size)
+seg_create(vm_map_t map, vaddr_t addr, size_t size)
 {
-	struct seg *seg;
+	struct seg *seg, *prev = &map->head;
+	struct tnode *parent, **link;
 
-	if ((seg = kmem_alloc(sizeof(*seg))) == NULL)
+	if ((seg = kmem_cache_alloc(seg_cache)) == NULL)
 		return NULL;
 
 	seg->addr = addr;
@@ -575,14 +701,29 @@ seg_create(struct seg *prev, vaddr_t addr, size_t size)
 	prev->next->prev = seg;
 	prev->next = seg;
 
+	/*
+	 * Insert to the segment tree.
+	 */
+	parent = NULL;
+	link = &map->tree.root;
+	while (*link != NULL) {
+		parent = *link;
+		if (addr < tree_entry(parent, struct seg, node)->addr)
+			link = &parent->left;
+		else
+			link = &parent->right;
+	}
+	tree_insert(&map->tree, parent, link, &seg->node);
 	return seg;
 }
 
 /*
  * Delete specified segment.
+ * This is used only when the whole map is deleted, so the
+ * segment is not removed from the tree.
  */
 static void
-seg_delete(struct seg *head, struct seg *seg)
+seg_delete(vm_map_t map, struct seg *seg)
 {
 
 	/*
@@ -594,26 +735,34 @@ seg_delete(struct seg *head, struct seg *seg)
 		if (seg->sh_prev == seg->sh_next)
 			seg->sh_prev->flags &= ~SEG_SHARED;
 	}
-	if (head != seg)
-		kmem_free(seg);
+	if (&map->head != seg)
+		kmem_cache_free(seg_cache, seg);
 }
 
 /*
  * Find the segment at the specified address.
  */
 static struct seg *
-seg_lookup(struct seg *head, vaddr_t addr, size_t size)
+seg_lookup(vm_map_t map, vaddr_t addr, size_t size)
 {
-	struct seg *seg;
+	struct tnode *n;
+	struct seg *seg, *found = NULL;
 
-	seg = head;
-	do {
-		if (seg->addr <= addr &&
-		    seg->addr + seg->size >= addr + size) {
-			return seg;
-		}
-		seg = seg->next;
-	} while (seg != head);
+	/*
+	 * Find the last segment which starts at or before
+	 * the address.
+	 */
+	n = tree_root(&map->tree);
+	while (n != NULL) {
+		seg = tree_entry(n, struct seg, node);
+		if (seg->addr <= addr) {
+			found = seg;
+			n = tree_right(n);
+		} else
+			n = tree_left(n);
+	}
+	if (found != NULL && found->addr + found->size >= addr + size)
+		return found;
 	return NULL;
 }
 
@@ -621,7 +770,7 @@ seg_lookup(struct seg *head, vaddr_t addr, size_t size)
  * Allocate free segment for specified size.
  */
 static struct seg *
-seg_alloc(struct seg *head, size_t size)
+seg_alloc(vm_map_t map, size_t size)
 {
 	struct seg *seg;
 	paddr_t pa;
@@ -629,8 +778,8 @@ seg_alloc(struct seg *head, size_t size)
 	if ((pa = page_alloc(size)) == 0)
 		return NULL;
 
-	if ((seg = seg_create(head, (vaddr_t)pa, size)) == NULL) {
-     		page_free(pa, size);
+	if ((seg = seg_create(map, (vaddr_t)pa, size)) == NULL) {
+		page_free(pa, size);
 		return NULL;
 	}
 	return seg;
@@ -640,7 +789,7 @@ seg_alloc(struct seg *head, size_t size)
  * Delete specified free segment.
  */
 static void
-seg_free(struct seg *head, struct seg *seg)
+seg_free(vm_map_t map, struct seg *seg)
 {
 	ASSERT(seg->flags != SEG_FREE);
 
@@ -655,15 +804,16 @@ seg_free(struct seg *head, struct seg *seg)
 	}
 	seg->prev->next = seg->next;
 	seg->next->prev = seg->prev;
+	tree_remove(&map->tree, &seg->node);
 
-	kmem_free(seg);
+	kmem_cache_free(seg_cache, seg);
 }
 
 /*
  * Reserve the segment at the specified address/size.
  */
 static struct seg *
-seg_reserve(struct seg *head, vaddr_t addr, size_t size)
+seg_reserve(vm_map_t map, vaddr_t addr, size_t size)
 {
 	struct seg *seg;
 	paddr_t pa;
@@ -673,8 +823,8 @@ seg_reserve(struct seg *head, vaddr_t addr, size_t size)
 	if (page_reserve(pa, size) != 0)
 		return NULL;
 
-	if ((seg = seg_create(head, (vaddr_t)pa, size)) == NULL) {
-     		page_free(pa, size);
+	if ((seg = seg_create(map, (vaddr_t)pa, size)) == NULL) {
+		page_free(pa, size);
 		return NULL;
 	}
 	return seg;
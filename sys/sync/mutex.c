@@ -66,6 +66,25 @@
  *
  *   2. Even if thread is killed with mutex waiting, the related
  *      priority is not adjusted.
+ *
+ * <Lock word>
+ *   The state of the mutex is kept in the mutex variable in user
+ *   space, so that the library can lock and unlock the mutex with
+ *   an atomic instruction and no system call as long as nobody
+ *   waits for it.
+ *
+ *     MUTEX_INITIALIZER            unlocked
+ *     lockid                       locked in user space
+ *     lockid | MUTEX_CONTESTED     locked, kernel keeps the state
+ *
+ *   The lock id of the holder thread is used instead of the thread
+ *   pointer, since the pointer is soon reused for a new thread
+ *   when the holder is terminated.
+ *
+ *   A kernel mutex is bound to the user variable when the mutex is
+ *   contested or locked recursively. Once MUTEX_CONTESTED is set,
+ *   the holder must unlock it with the system call, and the kernel
+ *   passes the ownership to the next waiter directly.
  */
 
 #include <kernel.h>
@@ -77,21 +96,56 @@
 #include <sync.h>
 
 /* forward declarations */
-static int	mutex_valid(mutex_t);
-static int	mutex_copyin(mutex_t *, mutex_t *);
+static int	mutex_allocate(mutex_t *, mutex_t *);
+static void	mutex_deallocate(mutex_t);
+static mutex_t	mutex_lookup(mutex_t *);
+static int	mutex_copyin(mutex_t *, mutex_t, thread_t *);
+static int	mutex_store(mutex_t *, thread_t, u_long);
+static void	mutex_adopt(mutex_t, thread_t);
 static int	prio_inherit(thread_t);
 static void	prio_uninherit(thread_t);
 
+#define MUTEX_HASHSIZE	64		/* number of hash buckets */
+
+#define mutex_hash(task, ump) \
+	((((u_long)(task) >> 4) ^ ((u_long)(ump) >> 2)) & (MUTEX_HASHSIZE - 1))
+
+static struct kmem_cache *mutex_cache;	/* cache for mutex structure */
+static struct list mutex_table[MUTEX_HASHSIZE]; /* hash of bound mutexes */
+
 /*
  * Initialize a mutex.
  *
- * If an initialized mutex is reinitialized, undefined
- * behavior results. Technically, we can not detect such
- * error condition here because we can not touch the passed
- * object in kernel.
+ * The kernel mutex is not allocated here. It is bound to the
+ * mutex variable when a thread has to wait for it first.
  */
 int
 mutex_init(mutex_t *mp)
+{
+	mutex_t m;
+	int error;
+
+	sched_lock();
+	if ((error = mutex_store(mp, NULL, 0)) != 0) {
+		sched_unlock();
+		return error;
+	}
+	/*
+	 * Release the idle mutex left for the old variable
+	 * at the same address.
+	 */
+	m = mutex_lookup(mp);
+	if (m != NULL && m->holder == NULL && !event_waiting(&m->event))
+		mutex_deallocate(m);
+	sched_unlock();
+	return 0;
+}
+
+/*
+ * Allocate a kernel mutex for the mutex variable.
+ */
+static int
+mutex_allocate(mutex_t *mp, mutex_t *kmp)
 {
 	task_t self = curtask;
 	mutex_t m;
@@ -99,23 +153,20 @@ mutex_init(mutex_t *mp)
 	if (self->nsyncs >= MAXSYNCS)
 		return EAGAIN;
 
-	if ((m = kmem_alloc(sizeof(struct mutex))) == NULL)
+	if ((m = kmem_cache_alloc(mutex_cache)) == NULL)
 		return ENOMEM;
 
 	event_init(&m->event, "mutex");
 	m->owner = self;
+	m->uaddr = mp;
 	m->holder = NULL;
 	m->priority = MINPRI;
+	m->locks = 0;
 
-	if (copyout(&m, mp, sizeof(m))) {
-		kmem_free(m);
-		return EFAULT;
-	}
-
-	sched_lock();
 	list_insert(&self->mutexes, &m->task_link);
+	list_insert(&mutex_table[mutex_hash(self, mp)], &m->hash_link);
 	self->nsyncs++;
-	sched_unlock();
+	*kmp = m;
 	return 0;
 }
 
@@ -128,7 +179,8 @@ mutex_deallocate(mutex_t m)
 
 	m->owner->nsyncs--;
 	list_remove(&m->task_link);
-	kmem_free(m);
+	list_remove(&m->hash_link);
+	kmem_cache_free(mutex_cache, m);
 }
 
 /*
@@ -139,21 +191,31 @@ int
 mutex_destroy(mutex_t *mp)
 {
 	mutex_t m;
+	thread_t holder;
+	u_long val;
+	int error;
 
 	sched_lock();
-	if (copyin(mp, &m, sizeof(mp))) {
+	m = mutex_lookup(mp);
+	if ((error = mutex_copyin(mp, m, &holder)) != 0) {
 		sched_unlock();
-		return EFAULT;
+		return error;
 	}
-	if (!mutex_valid(m)) {
+	if (holder || (m && event_waiting(&m->event))) {
 		sched_unlock();
-		return EINVAL;
+		return EBUSY;
 	}
-	if (m->holder || event_waiting(&m->event)) {
+	/*
+	 * Invalidate the variable so that the later use
+	 * fails with EINVAL.
+	 */
+	val = 0;
+	if (copyout(&val, mp, sizeof(val))) {
 		sched_unlock();
-		return EBUSY;
+		return EFAULT;
 	}
-	mutex_deallocate(m);
+	if (m)
+		mutex_deallocate(m);
 	sched_unlock();
 	return 0;
 }
@@ -176,6 +238,9 @@ mutex_cleanup(task_t task)
 /*
  * Lock a mutex.
  *
+ * This is called by the library only when the mutex could
+ * not be locked in user space.
+ *
  * A current thread is blocked if the mutex has already been
  * locked. If current thread receives any exception while
  * waiting mutex, this routine returns with EINTR in order to
@@ -187,49 +252,68 @@ int
 mutex_lock(mutex_t *mp)
 {
 	mutex_t m;
+	thread_t holder;
 	int error, rc;
 
 	sched_lock();
-	if ((error = mutex_copyin(mp, &m)) != 0) {
+	m = mutex_lookup(mp);
+	if ((error = mutex_copyin(mp, m, &holder)) != 0) {
 		sched_unlock();
 		return error;
 	}
 
-	if (m->holder == curthread) {
+	if (holder == NULL) {
+		/*
+		 * The mutex is not locked. Leave it to user
+		 * space, so that it can be unlocked without
+		 * system call.
+		 */
+		error = mutex_store(mp, curthread, 0);
+		sched_unlock();
+		return error;
+	}
+
+	if (m == NULL && (error = mutex_allocate(mp, &m)) != 0) {
+		sched_unlock();
+		return error;
+	}
+	if (m->holder == NULL)
+		mutex_adopt(m, holder);
+
+	if (holder == curthread) {
 		/*
 		 * Recursive lock
 		 */
 		m->locks++;
 		ASSERT(m->locks != 0);
-	} else {
-		/*
-		 * Check whether a target mutex is locked.
-		 * If the mutex is not locked, this routine
-		 * returns immediately.
-		 */
-		if (m->holder == NULL)
-			m->priority = curthread->priority;
-		else {
-			/*
-			 * Wait for a mutex.
-			 */
-			curthread->mutex_waiting = m;
-			if ((error = prio_inherit(curthread)) != 0) {
-				curthread->mutex_waiting = NULL;
-				sched_unlock();
-				return error;
-			}
-			rc = sched_sleep(&m->event);
-			curthread->mutex_waiting = NULL;
-			if (rc == SLP_INTR) {
-				sched_unlock();
-				return EINTR;
-			}
-		}
-		m->locks = 1;
-		m->holder = curthread;
-		list_insert(&curthread->mutexes, &m->link);
+		error = mutex_store(mp, curthread, MUTEX_CONTESTED);
+		sched_unlock();
+		return error;
+	}
+
+	/*
+	 * Wait for a mutex. The holder will hand the
+	 * mutex over to us when it unlocks it.
+	 */
+	if ((error = mutex_store(mp, holder, MUTEX_CONTESTED)) != 0) {
+		sched_unlock();
+		return error;
 	}
+	curthread->mutex_waiting = m;
+	if ((error = prio_inherit(curthread)) != 0) {
+		curthread->mutex_waiting = NULL;
+		sched_unlock();
+		return error;
+	}
+	rc = sched_sleep(&m->event);
+	curthread->mutex_waiting = NULL;
+	if (rc == SLP_INTR) {
+		sched_unlock();
+		return EINTR;
+	}
+	m->locks = 1;
+	m->holder = curthread;
+	list_insert(&curthread->mutexes, &m->link);
 	sched_unlock();
 	return 0;
 }
@@ -241,25 +325,30 @@ int
 mutex_trylock(mutex_t *mp)
 {
 	mutex_t m;
+	thread_t holder;
 	int error;
 
 	sched_lock();
-	if ((error = mutex_copyin(mp, &m)) != 0) {
+	m = mutex_lookup(mp);
+	if ((error = mutex_copyin(mp, m, &holder)) != 0) {
 		sched_unlock();
 		return error;
 	}
 
-	if (m->holder == curthread) {
+	if (holder == NULL)
+		error = mutex_store(mp, curthread, 0);
+	else if (holder != curthread)
+		error = EBUSY;
+	else {
+		if (m == NULL && (error = mutex_allocate(mp, &m)) != 0) {
+			sched_unlock();
+			return error;
+		}
+		if (m->holder == NULL)
+			mutex_adopt(m, holder);
 		m->locks++;
 		ASSERT(m->locks != 0);
-	} else {
-		if (m->holder != NULL)
-			error = EBUSY;
-		else {
-			m->locks = 1;
-			m->holder = curthread;
-			list_insert(&curthread->mutexes, &m->link);
-		}
+		error = mutex_store(mp, curthread, MUTEX_CONTESTED);
 	}
 	sched_unlock();
 	return error;
@@ -273,18 +362,30 @@ int
 mutex_unlock(mutex_t *mp)
 {
 	mutex_t m;
+	thread_t holder;
 	int error;
 
 	sched_lock();
-	if ((error = mutex_copyin(mp, &m)) != 0) {
+	m = mutex_lookup(mp);
+	if ((error = mutex_copyin(mp, m, &holder)) != 0) {
 		sched_unlock();
 		return error;
 	}
 
-	if (m->holder != curthread || m->locks <= 0) {
+	if (holder != curthread) {
 		sched_unlock();
 		return EPERM;
 	}
+	if (m == NULL || m->holder == NULL) {
+		/*
+		 * Locked in user space.
+		 */
+		error = mutex_store(mp, NULL, 0);
+		sched_unlock();
+		return error;
+	}
+
+	ASSERT(m->locks > 0);
 	if (--m->locks == 0) {
 		list_remove(&m->link);
 		prio_uninherit(curthread);
@@ -297,9 +398,10 @@ mutex_unlock(mutex_t *mp)
 			m->holder->mutex_waiting = NULL;
 
 		m->priority = m->holder ? m->holder->priority : MINPRI;
+		error = mutex_store(mp, m->holder, MUTEX_CONTESTED);
 	}
 	sched_unlock();
-	return 0;
+	return error;
 }
 
 /*
@@ -311,6 +413,9 @@ mutex_unlock(mutex_t *mp)
  * terminated thread must be unlocked. Even if the terminated
  * thread is waiting some mutex, the inherited priority of other
  * mutex holder is not adjusted.
+ *
+ * The mutexes locked in user space are not tracked here. They
+ * are regarded as unlocked once the holder is gone.
  */
 void
 mutex_cancel(thread_t t)
@@ -342,6 +447,12 @@ mutex_cancel(thread_t t)
 			list_insert(&holder->mutexes, &m->link);
 		}
 		m->holder = holder;
+
+		/*
+		 * Update the lock word if we can see it.
+		 */
+		if (m->owner == curtask)
+			mutex_store(m->uaddr, holder, MUTEX_CONTESTED);
 	}
 }
 
@@ -358,52 +469,109 @@ mutex_setpri(thread_t t, int pri)
 }
 
 /*
- * Check if the specified mutex is valid.
+ * Initialize the synchronization objects.
  */
-static int
-mutex_valid(mutex_t m)
+void
+sync_init(void)
 {
-	mutex_t tmp;
+	int i;
+
+	for (i = 0; i < MUTEX_HASHSIZE; i++)
+		list_init(&mutex_table[i]);
+	mutex_cache = kmem_cache_create("mutex", sizeof(struct mutex), NULL);
+	if (mutex_cache == NULL)
+		panic("sync_init");
+}
+
+/*
+ * Find the kernel mutex bound to the mutex variable.
+ */
+static mutex_t
+mutex_lookup(mutex_t *ump)
+{
+	task_t self = curtask;
+	mutex_t m;
 	list_t head, n;
 
-	head = &curtask->mutexes;
+	head = &mutex_table[mutex_hash(self, ump)];
 	for (n = list_first(head); n != head; n = list_next(n)) {
-		tmp = list_entry(n, struct mutex, task_link);
-		if (tmp == m)
-			return 1;
+		m = list_entry(n, struct mutex, hash_link);
+		if (m->uaddr == ump && m->owner == self)
+			return m;
 	}
-	return 0;
+	return NULL;
 }
 
 /*
- * Copy mutex from user space.
- * If it is not initialized, create new mutex.
+ * Copy the lock word from user space, and return the
+ * thread that holds the mutex, or NULL if it is unlocked.
  */
 static int
-mutex_copyin(mutex_t *ump, mutex_t *kmp)
+mutex_copyin(mutex_t *ump, mutex_t m, thread_t *holderp)
 {
-	mutex_t m;
-	int error;
+	u_long val;
+	list_t head, n;
+	thread_t t;
 
-	if (copyin(ump, &m, sizeof(ump)))
+	if (copyin(ump, &val, sizeof(val)))
 		return EFAULT;
 
-	if (m == MUTEX_INITIALIZER) {
-		/*
-		 * Allocate new mutex, and retreive its id
-		 * from the user space.
-		 */
-		if ((error = mutex_init(ump)) != 0)
-			return error;
-		copyin(ump, &m, sizeof(ump));
-	} else {
-		if (!mutex_valid(m))
-			return EINVAL;
+	if (m != NULL && m->holder != NULL) {
+		*holderp = m->holder;
+		return 0;
+	}
+	*holderp = NULL;
+	if (val == (u_long)MUTEX_INITIALIZER)
+		return 0;
+	if (val == 0)
+		return EINVAL;
+
+	/*
+	 * A mutex left locked by a terminated thread, or the one
+	 * copied from the parent task is regarded as unlocked.
+	 */
+	head = &curtask->threads;
+	for (n = list_first(head); n != head; n = list_next(n)) {
+		t = list_entry(n, struct thread, task_link);
+		if (t->lockid == (val & ~MUTEX_CONTESTED)) {
+			*holderp = t;
+			break;
+		}
 	}
-	*kmp = m;
 	return 0;
 }
 
+/*
+ * Store the lock word to user space.
+ */
+static int
+mutex_store(mutex_t *ump, thread_t holder, u_long flags)
+{
+	u_long val;
+
+	if (holder == NULL)
+		val = (u_long)MUTEX_INITIALIZER;
+	else
+		val = holder->lockid | flags;
+
+	if (copyout(&val, ump, sizeof(val)))
+		return EFAULT;
+	return 0;
+}
+
+/*
+ * Take over the mutex locked in user space.
+ */
+static void
+mutex_adopt(mutex_t m, thread_t holder)
+{
+
+	m->locks = 1;
+	m->holder = holder;
+	m->priority = holder->priority;
+	list_insert(&holder->mutexes, &m->link);
+}
+
 /*
  * Inherit priority.
  *
@@ -43,6 +43,7 @@ int
 main(int argc, char *argv[])
 {
 	struct meminfo info;
+	int i;
 
 	sys_info(INFO_MEMORY, &info);
 
@@ -50,6 +51,19 @@ main(int argc, char *argv[])
 	printf("Mem: %10d %10d %10d %10d\n", (u_int)info.total,
 	       (u_int)(info.total - info.free), (u_int)info.free,
 	       (u_int)info.bootdisk);
+
+	/*
+	 * Show fragmentation of free memory.
+	 */
+	if (info.maxorder < 0)
+		printf("Largest free block: none\n");
+	else
+		printf("Largest free block: %d KB\n",
+		       (PAGE_SIZE << info.maxorder) / 1024);
+	printf("Free blocks:");
+	for (i = 0; i <= info.maxorder; i++)
+		printf(" %dK:%d", (PAGE_SIZE << i) / 1024, info.nblocks[i]);
+	printf("\n");
 	exit(0);
 	/* NOTREACHED */
 }
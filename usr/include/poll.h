@@ -0,0 +1 @@
+#include <sys/poll.h>
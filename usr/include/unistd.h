@@ -132,7 +132,7 @@ extern const char *const sys_siglist[];
 /* int	 rresvport(int *); */
 /* int	 ruserok(const char *, int, const char *, const char *); */
 /* char	*sbrk(int); */
-/* int	 select(int, fd_set *, fd_set *, fd_set *, struct timeval *); */
+int	 select(int, fd_set *, fd_set *, fd_set *, struct timeval *);
 int	 setegid(gid_t);
 int	 seteuid(uid_t);
 /* int	 setgroups(int, const gid_t *); */
@@ -158,6 +158,7 @@ int	 getsubopt(char **, char * const *, char **);
 
 void	 fslib_init(void);	/* used by Prex native task */
 void	 fslib_exit(void);	/* used by Prex native task */
+int	 ioregion(void *, size_t);	/* Prex extension */
 __END_DECLS
 
 /* configurable system strings */
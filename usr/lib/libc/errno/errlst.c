@@ -78,5 +78,28 @@ const char *const sys_errlist[] = {
 /* quotas & mush */
 	"Too many processes",			/* 39 - EPROCLIM */
 	"Function not implemented",		/* 40 - ENOSYS */
+
+/* ipc/network software */
+	"Socket operation on non-socket",	/* 41 - ENOTSOCK */
+	"Message too long",			/* 42 - EMSGSIZE */
+	"Protocol wrong type for socket",	/* 43 - EPROTOTYPE */
+	"Protocol not available",		/* 44 - ENOPROTOOPT */
+	"Protocol not supported",		/* 45 - EPROTONOSUPPORT */
+	"Operation not supported",		/* 46 - EOPNOTSUPP */
+	"Address family not supported",		/* 47 - EAFNOSUPPORT */
+	"Address already in use",		/* 48 - EADDRINUSE */
+	"Can't assign requested address",	/* 49 - EADDRNOTAVAIL */
+	"Network is down",			/* 50 - ENETDOWN */
+	"Network is unreachable",		/* 51 - ENETUNREACH */
+	"Software caused connection abort",	/* 52 - ECONNABORTED */
+	"Connection reset by peer",		/* 53 - ECONNRESET */
+	"No buffer space available",		/* 54 - ENOBUFS */
+	"Socket is already connected",		/* 55 - EISCONN */
+	"Socket is not connected",		/* 56 - ENOTCONN */
+	"Can't send after socket shutdown",	/* 57 - ESHUTDOWN */
+	"Connection refused",			/* 58 - ECONNREFUSED */
+	"No route to host",			/* 59 - EHOSTUNREACH */
+	"Operation already in progress",	/* 60 - EALREADY */
+	"Operation now in progress",		/* 61 - EINPROGRESS */
 };
 const int sys_nerr = sizeof(sys_errlist) / sizeof(sys_errlist[0]);
@@ -0,0 +1,102 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <arpa/inet.h>
+
+#include <ctype.h>
+#include <stddef.h>
+
+/*
+ * Convert the Internet host address from the dotted notation
+ * to binary data in network byte order. The forms a.b.c.d,
+ * a.b.c, a.b and a are accepted, and each part may be decimal,
+ * octal or hexadecimal as in C.
+ */
+int
+inet_aton(const char *cp, struct in_addr *addr)
+{
+	uint32_t parts[4], val;
+	int n, base, c;
+
+	for (n = 0; ; n++) {
+		if (!isdigit((unsigned char)*cp))
+			return 0;
+		val = 0;
+		base = 10;
+		if (*cp == '0') {
+			cp++;
+			if (*cp == 'x' || *cp == 'X') {
+				base = 16;
+				cp++;
+			} else
+				base = 8;
+		}
+		for (;;) {
+			c = (unsigned char)*cp;
+			if (isdigit(c) && c - '0' < base)
+				val = val * base + (c - '0');
+			else if (base == 16 && isxdigit(c))
+				val = val * 16 + (tolower(c) - 'a' + 10);
+			else
+				break;
+			cp++;
+		}
+		parts[n] = val;
+		if (*cp != '.')
+			break;
+		if (n == 3)
+			return 0;
+		cp++;
+	}
+	if (*cp != '\0' && !isspace((unsigned char)*cp))
+		return 0;
+
+	val = parts[n];
+	switch (n) {
+	case 1:		/* a.b -- 8.24 bits */
+		if (parts[0] > 0xff || val > 0xffffff)
+			return 0;
+		val |= parts[0] << 24;
+		break;
+	case 2:		/* a.b.c -- 8.8.16 bits */
+		if (parts[0] > 0xff || parts[1] > 0xff || val > 0xffff)
+			return 0;
+		val |= (parts[0] << 24) | (parts[1] << 16);
+		break;
+	case 3:		/* a.b.c.d -- 8.8.8.8 bits */
+		if (parts[0] > 0xff || parts[1] > 0xff ||
+		    parts[2] > 0xff || val > 0xff)
+			return 0;
+		val |= (parts[0] << 24) | (parts[1] << 16) | (parts[2] << 8);
+		break;
+	}
+	if (addr != NULL)
+		addr->s_addr = htonl(val);
+	return 1;
+}
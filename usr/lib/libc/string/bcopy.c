@@ -33,6 +33,15 @@
 #include <sys/cdefs.h>
 #include <string.h>
 
+/*
+ * sizeof(word) MUST BE A POWER OF TWO
+ * SO THAT wmask BELOW IS ALL ONES
+ */
+typedef	long word;		/* "word" used for optimal copy speed */
+
+#define	wsize	sizeof(word)
+#define	wmask	(wsize - 1)
+
 /*
  * Copy a block of memory, handling overlap.
  * This is the routine that actually implements
@@ -56,22 +65,64 @@ bcopy(src0, dst0, length)
 {
 	char *dst = dst0;
 	const char *src = src0;
+	size_t t;
 
 	if (length == 0 || dst == src)		/* nothing to do */
 		goto done;
 
-	if (((unsigned long)dst < (unsigned long)src) &&
-	    ((unsigned long)dst < (unsigned long)src + length)) {
-		/* Copy backwards. */
-		src += length;
-		dst += length;
-		while (length--) {
-			*--dst = *--src;
+	/*
+	 * Macros: loop-t-times; and loop-t-times, t>0
+	 */
+#define	TLOOP(s) if (t) TLOOP1(s)
+#define	TLOOP1(s) do { s; } while (--t)
+
+	if ((unsigned long)dst < (unsigned long)src) {
+		/*
+		 * Copy forward.
+		 */
+		t = (unsigned long)src;	/* only need low bits */
+		if ((t | (unsigned long)dst) & wmask) {
+			/*
+			 * Try to align operands.  This cannot be done
+			 * unless the low bits match.
+			 */
+			if ((t ^ (unsigned long)dst) & wmask || length < wsize)
+				t = length;
+			else
+				t = wsize - (t & wmask);
+			length -= t;
+			TLOOP1(*dst++ = *src++);
 		}
+		/*
+		 * Copy whole words, then mop up any trailing bytes.
+		 */
+		t = length / wsize;
+		TLOOP(*(word *)dst = *(const word *)src; src += wsize;
+		    dst += wsize);
+		t = length & wmask;
+		TLOOP(*dst++ = *src++);
 	} else {
-		while (length--) {
-			*dst++ = *src++;
+		/*
+		 * Copy backwards.  Otherwise essentially the same.
+		 * Alignment works as before, except that it takes
+		 * (t&wmask) bytes to align, not wsize-(t&wmask).
+		 */
+		src += length;
+		dst += length;
+		t = (unsigned long)src;
+		if ((t | (unsigned long)dst) & wmask) {
+			if ((t ^ (unsigned long)dst) & wmask || length <= wsize)
+				t = length;
+			else
+				t &= wmask;
+			length -= t;
+			TLOOP1(*--dst = *--src);
 		}
+		t = length / wsize;
+		TLOOP(src -= wsize; dst -= wsize;
+		    *(word *)dst = *(const word *)src);
+		t = length & wmask;
+		TLOOP(*--dst = *--src);
 	}
 done:
 #if defined(MEMCOPY) || defined(MEMMOVE)
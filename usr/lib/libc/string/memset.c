@@ -35,9 +35,13 @@
 #include <limits.h>
 #include <string.h>
 
+#define	wsize	sizeof(u_int)
+#define	wmask	(wsize - 1)
+
 #ifdef BZERO
 #define	RETURN	return
 #define	VAL	0
+#define	WIDEVAL	0
 
 void
 bzero(dst0, length)
@@ -46,6 +50,7 @@ bzero(dst0, length)
 #else
 #define	RETURN	return (dst0)
 #define	VAL	c0
+#define	WIDEVAL	c
 
 void *
 memset(dst0, c0, length)
@@ -54,10 +59,55 @@ memset(dst0, c0, length)
 	size_t length;
 #endif
 {
-	char *dst = dst0;
+	size_t t;
+#ifndef BZERO
+	u_int c;
+#endif
+	u_char *dst;
 
-	while (length--) {
-		*dst++ = (char)VAL;
+	dst = dst0;
+	/*
+	 * If not enough words, just fill bytes.  A length >= 2 words
+	 * guarantees that at least one of them is `complete' after
+	 * any necessary alignment.
+	 */
+	if (length < 3 * wsize) {
+		while (length != 0) {
+			*dst++ = VAL;
+			--length;
+		}
+		RETURN;
+	}
+
+#ifndef BZERO
+	if ((c = (u_char)c0) != 0) {	/* Fill the word. */
+		c = (c << 8) | c;	/* u_int is 16 bits. */
+#if UINT_MAX > 0xffff
+		c = (c << 16) | c;	/* u_int is 32 bits. */
+#endif
 	}
+#endif
+	/* Align destination by filling in bytes. */
+	if ((t = (u_long)dst & wmask) != 0) {
+		t = wsize - t;
+		length -= t;
+		do {
+			*dst++ = VAL;
+		} while (--t != 0);
+	}
+
+	/* Fill words.  Length was >= 2*words so we know t >= 1 here. */
+	t = length / wsize;
+	do {
+		*(u_int *)dst = WIDEVAL;
+		dst += wsize;
+	} while (--t != 0);
+
+	/* Mop up trailing bytes, if any. */
+	t = length & wmask;
+	if (t != 0)
+		do {
+			*dst++ = VAL;
+		} while (--t != 0);
 	RETURN;
 }
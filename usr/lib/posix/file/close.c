@@ -30,6 +30,7 @@
 #include <sys/prex.h>
 #include <sys/posix.h>
 #include <ipc/fs.h>
+#include <ipc/net.h>
 #include <ipc/ipc.h>
 
 int
@@ -37,6 +38,14 @@ close(int fd)
 {
 	struct msg m;
 
+	if (ISSOCKFD(fd)) {
+		m.hdr.code = NET_CLOSE;
+		m.data[0] = fd;
+		return __sock_call(&m, sizeof(m), 1);
+	}
+	if (ISEPOLLFD(fd))
+		return __epoll_close(fd);
+
 	m.hdr.code = FS_CLOSE;
 	m.data[0] = fd;
 	return __posix_call(__fs_obj, &m, sizeof(m), 1);
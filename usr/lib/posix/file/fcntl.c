@@ -30,11 +30,30 @@
 #include <sys/prex.h>
 #include <sys/posix.h>
 #include <ipc/fs.h>
+#include <ipc/net.h>
 #include <sys/fcntl.h>
 
 #include <stdarg.h>
 #include <string.h>
 
+/*
+ * Only F_GETFL and F_SETFL with O_NONBLOCK are supported for
+ * sockets.
+ */
+static int
+sock_fcntl(int fd, int cmd, long arg)
+{
+	struct msg m;
+
+	m.hdr.code = NET_FCNTL;
+	m.data[0] = fd;
+	m.data[1] = cmd;
+	m.data[2] = (int)arg;
+	if (__sock_call(&m, sizeof(m), 1) != 0)
+		return -1;
+	return m.data[2];
+}
+
 int
 fcntl(int fd, int cmd, ...)
 {
@@ -46,6 +65,9 @@ fcntl(int fd, int cmd, ...)
 	arg = va_arg(args, long);
 	va_end(args);
 
+	if (ISSOCKFD(fd))
+		return sock_fcntl(fd, cmd, arg);
+
 	m.hdr.code = FS_FCNTL;
 	m.fd = fd;
 	m.cmd = cmd;
@@ -30,12 +30,38 @@
 #include <sys/prex.h>
 #include <sys/posix.h>
 #include <ipc/fs.h>
+#include <ipc/net.h>
 #include <sys/ioctl.h>
 
 #include <errno.h>
 #include <stdarg.h>
 #include <string.h>
 
+/*
+ * The socket supports only the control codes with an integer
+ * parameter, like FIONBIO and FIONREAD.
+ */
+static int
+sock_ioctl(int fd, unsigned long cmd, char *argp)
+{
+	struct msg m;
+
+	if (IOCPARM_LEN(cmd) != sizeof(int) || argp == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	m.hdr.code = NET_IOCTL;
+	m.data[0] = fd;
+	m.data[1] = (int)cmd;
+	if (cmd & IOC_IN)
+		m.data[2] = *(int *)argp;
+	if (__sock_call(&m, sizeof(m), 1) != 0)
+		return -1;
+	if (cmd & IOC_OUT)
+		*(int *)argp = m.data[2];
+	return 0;
+}
+
 int
 ioctl(int fd, unsigned long cmd, ...)
 {
@@ -49,6 +75,9 @@ ioctl(int fd, unsigned long cmd, ...)
 	argp = va_arg(args, char *);
 	va_end(args);
 
+	if (ISSOCKFD(fd))
+		return sock_ioctl(fd, cmd, argp);
+
 	/*
 	 * Check the parameter size
 	 */
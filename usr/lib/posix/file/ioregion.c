@@ -0,0 +1,61 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/prex.h>
+#include <sys/posix.h>
+#include <ipc/fs.h>
+
+#include <stddef.h>
+#include <errno.h>
+
+/*
+ * Register the buffer as the I/O region shared with the file
+ * system server. The read/write requests for the buffer in
+ * the region do not have to map the buffer every time.
+ *
+ * The server keeps the pages of the region mapped until the
+ * region is released by the call with zero size, or the task
+ * forks, execs or exits. The buffer must not be freed or
+ * remapped while it is registered: the server checks the
+ * region on each request and drops it if the pages have been
+ * changed, and the request then fails with EFAULT unless the
+ * buffer can be mapped again. Call ioregion(NULL, 0) before
+ * freeing the buffer to release the pages at once.
+ */
+int
+ioregion(void *buf, size_t len)
+{
+	struct io_msg m;
+
+	m.hdr.code = FS_IOREGION;
+	m.fd = -1;
+	m.buf = buf;
+	m.size = len;
+	return __posix_call(__fs_obj, &m, sizeof(m), 0);
+}
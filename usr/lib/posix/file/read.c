@@ -30,6 +30,7 @@
 #include <sys/prex.h>
 #include <sys/posix.h>
 #include <ipc/fs.h>
+#include <ipc/net.h>
 
 #include <stddef.h>
 #include <errno.h>
@@ -39,6 +40,9 @@ read(int fd, void *buf, size_t len)
 {
 	struct io_msg m;
 
+	if (ISSOCKFD(fd))
+		return (int)recv(fd, buf, len, 0);
+
 	m.hdr.code = FS_READ;
 	m.fd = fd;
 	m.buf = buf;
@@ -30,6 +30,7 @@
 #include <sys/prex.h>
 #include <sys/posix.h>
 #include <ipc/fs.h>
+#include <ipc/net.h>
 
 #include <stddef.h>
 
@@ -38,6 +39,9 @@ write(int fd, void *buf, size_t len)
 {
 	struct io_msg m;
 
+	if (ISSOCKFD(fd))
+		return (int)send(fd, buf, len, 0);
+
 	m.hdr.code = FS_WRITE;
 	m.fd = fd;
 	m.buf = buf;
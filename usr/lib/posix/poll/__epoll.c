@@ -0,0 +1,88 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/prex.h>
+#include <sys/posix.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <ipc/fs.h>
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "local.h"
+
+struct epoll *__epoll_table[NEPOLLFD];
+
+/*
+ * Convert an epoll descriptor into its set.
+ */
+struct epoll *
+__epoll_get(int epfd)
+{
+
+	if (!ISEPOLLFD(epfd))
+		return NULL;
+	return __epoll_table[epfd - EPOLLFD_BASE];
+}
+
+/*
+ * Close an epoll descriptor. The sets in the servers are
+ * released before the semaphore is destroyed.
+ */
+int
+__epoll_close(int epfd)
+{
+	struct epoll *ep;
+	struct epoll_msg m;
+	struct sockop op;
+
+	if ((ep = __epoll_get(epfd)) == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	__epoll_table[epfd - EPOLLFD_BASE] = NULL;
+
+	if (ep->ep_fset) {
+		m.hdr.code = FS_EPOLL_CTL;
+		m.sem = ep->ep_sem;
+		m.op = 0;
+		__posix_call(__fs_obj, &m, sizeof(m), 1);
+	}
+	if (ep->ep_sset) {
+		op.so_op = SOP_EPCTL;
+		op.so_sem = ep->ep_sem;
+		op.so_flags = 0;
+		sockbatch(&op, 1);
+	}
+	sem_destroy(&ep->ep_sem);
+	free(ep);
+	return 0;
+}
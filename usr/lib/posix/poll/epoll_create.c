@@ -0,0 +1,71 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/prex.h>
+#include <sys/posix.h>
+#include <sys/epoll.h>
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include "local.h"
+
+int
+epoll_create(int size)
+{
+	struct epoll *ep;
+	int i, error;
+
+	if (size <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (i = 0; i < NEPOLLFD; i++) {
+		if (__epoll_table[i] == NULL)
+			break;
+	}
+	if (i == NEPOLLFD) {
+		errno = EMFILE;
+		return -1;
+	}
+	if ((ep = malloc(sizeof(struct epoll))) == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	if ((error = sem_init(&ep->ep_sem, 0)) != 0) {
+		free(ep);
+		errno = error;
+		return -1;
+	}
+	ep->ep_fset = 0;
+	ep->ep_sset = 0;
+	ep->ep_turn = 0;
+	__epoll_table[i] = ep;
+	return EPOLLFD_BASE + i;
+}
@@ -0,0 +1,106 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/prex.h>
+#include <sys/posix.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <ipc/fs.h>
+
+#include <stddef.h>
+#include <errno.h>
+
+#include "local.h"
+
+#define EPOLL_EVENTS	(EPOLLIN | EPOLLPRI | EPOLLOUT | EPOLLERR | EPOLLHUP)
+
+/*
+ * Change the interest set in the server of the descriptor.
+ */
+int
+epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+	struct epoll *ep;
+	struct epoll_msg m;
+	struct sockop sop;
+	struct epoll_event ev;
+
+	if ((ep = __epoll_get(epfd)) == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	if (fd < 0 || (fd >= OPEN_MAX && !ISSOCKFD(fd))) {
+		errno = (fd == epfd || ISEPOLLFD(fd)) ? EINVAL : EBADF;
+		return -1;
+	}
+	if (op != EPOLL_CTL_ADD && op != EPOLL_CTL_MOD &&
+	    op != EPOLL_CTL_DEL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (op != EPOLL_CTL_DEL && event == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	ev.events = 0;
+	ev.data.u32 = 0;
+	if (event != NULL) {
+		ev.events = event->events & EPOLL_EVENTS;
+		ev.data = event->data;
+	}
+
+	if (ISSOCKFD(fd)) {
+		sop.so_op = SOP_EPCTL;
+		sop.so_sem = ep->ep_sem;
+		sop.so_flags = op;
+		sop.so_sd = fd;
+		sop.so_count = (int)ev.events;
+		sop.so_data = ev.data;
+		if (sockbatch(&sop, 1) != 0)
+			return -1;
+		if (sop.so_error != 0) {
+			errno = sop.so_error;
+			return -1;
+		}
+		if (op == EPOLL_CTL_ADD)
+			ep->ep_sset = 1;
+		return 0;
+	}
+
+	m.hdr.code = FS_EPOLL_CTL;
+	m.sem = ep->ep_sem;
+	m.op = op;
+	m.fd = fd;
+	m.event = ev;
+	if (__posix_call(__fs_obj, &m, sizeof(m), 1) != 0)
+		return -1;
+	if (op == EPOLL_CTL_ADD)
+		ep->ep_fset = 1;
+	return 0;
+}
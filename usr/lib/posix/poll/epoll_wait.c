@@ -0,0 +1,146 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/prex.h>
+#include <sys/posix.h>
+#include <sys/param.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <ipc/fs.h>
+
+#include <string.h>
+#include <errno.h>
+
+#include "local.h"
+
+extern int _sem_wait(sem_t *, unsigned long);
+
+/*
+ * Get the ready events of the files from the fs server.
+ */
+static int
+epoll_files(struct epoll *ep, struct epoll_event *events, int maxevents)
+{
+	struct epoll_msg m;
+
+	if (!ep->ep_fset)
+		return 0;
+	m.hdr.code = FS_EPOLL_WAIT;
+	m.sem = ep->ep_sem;
+	m.maxevents = MIN(maxevents, OPEN_MAX);
+	if (__posix_call(__fs_obj, &m, sizeof(m), 1) != 0)
+		return -1;
+	memcpy(events, m.events, sizeof(struct epoll_event) * m.nready);
+	return m.nready;
+}
+
+/*
+ * Get the ready events of the sockets from the net server.
+ */
+static int
+epoll_socks(struct epoll *ep, struct epoll_event *events, int maxevents)
+{
+	struct sockop op;
+
+	if (!ep->ep_sset)
+		return 0;
+	op.so_op = SOP_EPWAIT;
+	op.so_sem = ep->ep_sem;
+	op.so_ev = events;
+	op.so_count = MIN(maxevents, NSOCKFD);
+	if (sockbatch(&op, 1) != 0)
+		return -1;
+	if (op.so_error != 0) {
+		errno = op.so_error;
+		return -1;
+	}
+	return op.so_result;
+}
+
+/*
+ * Collect the ready events from both servers. The server asked
+ * first is switched by each call, so that both are served even
+ * if there are more than maxevents.
+ */
+static int
+epoll_collect(struct epoll *ep, struct epoll_event *events, int maxevents)
+{
+	int i, n = 0, count;
+
+	for (i = 0; i < 2 && n < maxevents; i++) {
+		if ((ep->ep_turn + i) % 2 == 0)
+			count = epoll_files(ep, events + n, maxevents - n);
+		else
+			count = epoll_socks(ep, events + n, maxevents - n);
+		if (count < 0)
+			return -1;
+		n += count;
+	}
+	ep->ep_turn ^= 1;
+	return n;
+}
+
+/*
+ * Wait for the events of the set.
+ *
+ * The servers check only the members which may be ready, and
+ * post the semaphore of the set when any member may get ready.
+ */
+int
+epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+	   int timeout)
+{
+	struct epoll *ep;
+	u_long start;
+	int n, remain, error;
+
+	if ((ep = __epoll_get(epfd)) == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+	if (maxevents <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	sys_time(&start);
+	for (;;) {
+		if ((n = epoll_collect(ep, events, maxevents)) != 0)
+			return n;
+		if ((remain = __poll_remain(start, timeout)) == 0)
+			return 0;
+		error = _sem_wait(&ep->ep_sem,
+				  (remain < 0) ? 0 : (u_long)remain);
+		if (error == ETIMEDOUT)
+			return 0;
+		if (error != 0) {
+			errno = error;
+			return -1;
+		}
+	}
+}
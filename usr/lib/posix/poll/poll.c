@@ -0,0 +1,244 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/prex.h>
+#include <sys/posix.h>
+#include <sys/param.h>
+#include <sys/poll.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <ipc/fs.h>
+
+#include <errno.h>
+
+#include "local.h"
+
+extern int _sem_wait(sem_t *, unsigned long);
+
+/*
+ * The files are polled by the fs server, and the sockets by the
+ * net server. Neither server blocks for us. We pass a semaphore
+ * of our own, and both servers post it when any of the polled
+ * descriptors may get ready. Then we ask them again.
+ *
+ * The descriptors are checked once without the semaphore first,
+ * so that a ready descriptor costs only one request. A poll of
+ * the sockets only is passed to the net server, which can wait
+ * by itself.
+ */
+struct pollreq {
+	struct poll_msg	m;			/* request for files */
+	struct pollfd	sfds[NSOCKFD];		/* sockets */
+	int		nfile;			/* number of files */
+	int		nsock;			/* number of sockets */
+	int		fset;			/* set left in fs server */
+	int		sset;			/* set left in net server */
+};
+
+static u_long poll_hz;
+
+/*
+ * Return the remaining msec from start (ticks) until the timeout,
+ * or -1 if it never expires.
+ */
+int
+__poll_remain(u_long start, int timeout)
+{
+	struct timerinfo info;
+	u_long now, ticks, elapsed;
+
+	if (timeout < 0)
+		return -1;
+	if (poll_hz == 0) {
+		sys_info(INFO_TIMER, &info);
+		poll_hz = (u_long)info.hz;
+	}
+	sys_time(&now);
+	ticks = now - start;
+	elapsed = ticks / poll_hz * 1000 + ticks % poll_hz * 1000 / poll_hz;
+	if (elapsed >= (u_long)timeout)
+		return 0;
+	return timeout - (int)elapsed;
+}
+
+/*
+ * Poll the sockets in the net server.
+ */
+static int
+poll_socks(struct pollfd *sfds, int nsock, sem_t sem, int timeout)
+{
+	struct sockop op;
+
+	op.so_op = SOP_POLL;
+	op.so_count = nsock;
+	op.so_pfd = sfds;
+	op.so_timeout = timeout;
+	op.so_sem = sem;
+	if (sockbatch(&op, 1) != 0)
+		return -1;
+	if (op.so_error != 0) {
+		errno = op.so_error;
+		return -1;
+	}
+	return op.so_result;
+}
+
+/*
+ * Check the files and the sockets. If sem is not 0, they are
+ * registered to the servers, and the set of each server is kept
+ * until it finds a ready descriptor.
+ */
+static int
+poll_scan(struct pollreq *req, sem_t sem)
+{
+	int n = 0, ns;
+
+	if (req->nfile > 0) {
+		req->m.hdr.code = FS_POLL;
+		req->m.sem = sem;
+		req->m.nfds = req->nfile;
+		if (__posix_call(__fs_obj, &req->m, sizeof(req->m), 0) != 0)
+			return -1;
+		n = req->m.nready;
+		req->fset = (sem != 0 && n == 0);
+	}
+	if (req->nsock > 0) {
+		if ((ns = poll_socks(req->sfds, req->nsock, sem, 0)) < 0)
+			return -1;
+		req->sset = (sem != 0 && ns == 0);
+		n += ns;
+	}
+	return n;
+}
+
+/*
+ * Release the sets left in the servers.
+ */
+static void
+poll_release(struct pollreq *req, sem_t sem)
+{
+	struct poll_msg m;
+
+	if (req->fset) {
+		m.hdr.code = FS_POLL;
+		m.sem = sem;
+		m.nfds = 0;
+		__posix_call(__fs_obj, &m, sizeof(m), 0);
+		req->fset = 0;
+	}
+	if (req->sset) {
+		poll_socks(NULL, 0, sem, 0);
+		req->sset = 0;
+	}
+}
+
+/*
+ * Wait on the semaphore until any descriptor is ready.
+ */
+static int
+poll_wait(struct pollreq *req, int timeout)
+{
+	sem_t sem;
+	u_long start;
+	int n, remain, error;
+
+	if ((error = sem_init(&sem, 0)) != 0) {
+		errno = error;
+		return -1;
+	}
+	sys_time(&start);
+	for (;;) {
+		if ((n = poll_scan(req, sem)) != 0)
+			break;
+		if ((remain = __poll_remain(start, timeout)) == 0)
+			break;
+		error = _sem_wait(&sem, (remain < 0) ? 0 : (u_long)remain);
+		if (error == ETIMEDOUT)
+			break;
+		if (error != 0) {
+			errno = error;
+			n = -1;
+			break;
+		}
+	}
+	poll_release(req, sem);
+	sem_destroy(&sem);
+	return n;
+}
+
+int
+poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	struct pollreq req;
+	int fidx[OPEN_MAX], sidx[NSOCKFD];
+	int nbad = 0;
+	int i, fd, n;
+
+	if (nfds > OPEN_MAX + NSOCKFD) {
+		errno = EINVAL;
+		return -1;
+	}
+	req.nfile = req.nsock = 0;
+	req.fset = req.sset = 0;
+	for (i = 0; i < (int)nfds; i++) {
+		fds[i].revents = 0;
+		fd = fds[i].fd;
+		if (fd < 0)
+			continue;
+		if (fd < OPEN_MAX && req.nfile < OPEN_MAX) {
+			fidx[req.nfile] = i;
+			req.m.fds[req.nfile++] = fds[i];
+		} else if (ISSOCKFD(fd) && req.nsock < NSOCKFD) {
+			sidx[req.nsock] = i;
+			req.sfds[req.nsock++] = fds[i];
+		} else {
+			fds[i].revents = POLLNVAL;
+			nbad++;
+		}
+	}
+	/* Do not wait if there is an invalid descriptor. */
+	if (nbad > 0)
+		timeout = 0;
+
+	if (req.nfile == 0 && req.nsock > 0)
+		n = poll_socks(req.sfds, req.nsock, 0, timeout);
+	else {
+		n = poll_scan(&req, 0);
+		if (n == 0 && timeout != 0)
+			n = poll_wait(&req, timeout);
+	}
+	if (n < 0)
+		return -1;
+
+	for (i = 0; i < req.nfile; i++)
+		fds[fidx[i]].revents = req.m.fds[i].revents;
+	for (i = 0; i < req.nsock; i++)
+		fds[sidx[i]].revents = req.sfds[i].revents;
+	return n + nbad;
+}
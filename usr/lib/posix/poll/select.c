@@ -0,0 +1,118 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/poll.h>
+#include <sys/posix.h>
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+ * select() is done by poll().
+ */
+int
+select(int nfds, fd_set *rfds, fd_set *wfds, fd_set *efds,
+       struct timeval *tv)
+{
+	struct pollfd pfd[OPEN_MAX + NSOCKFD];
+	int fd, i, n, count, events, revents, timeout;
+
+	if (nfds < 0 || nfds > FD_SETSIZE) {
+		errno = EINVAL;
+		return -1;
+	}
+	n = 0;
+	for (fd = 0; fd < nfds; fd++) {
+		events = 0;
+		if (rfds != NULL && FD_ISSET(fd, rfds))
+			events |= POLLIN;
+		if (wfds != NULL && FD_ISSET(fd, wfds))
+			events |= POLLOUT;
+		if (efds != NULL && FD_ISSET(fd, efds))
+			events |= POLLPRI;
+		if (events == 0)
+			continue;
+		if (n >= OPEN_MAX + NSOCKFD) {
+			errno = EINVAL;
+			return -1;
+		}
+		pfd[n].fd = fd;
+		pfd[n].events = (short)events;
+		n++;
+	}
+
+	if (tv == NULL)
+		timeout = INFTIM;
+	else
+		timeout = (int)(tv->tv_sec * 1000 + tv->tv_usec / 1000);
+
+	if (poll(pfd, (nfds_t)n, timeout) < 0)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		if (pfd[i].revents & POLLNVAL) {
+			errno = EBADF;
+			return -1;
+		}
+	}
+	if (rfds != NULL)
+		FD_ZERO(rfds);
+	if (wfds != NULL)
+		FD_ZERO(wfds);
+	if (efds != NULL)
+		FD_ZERO(efds);
+
+	/*
+	 * A hang up or an error makes the descriptor ready, so
+	 * that the following read() or write() gets it.
+	 */
+	count = 0;
+	for (i = 0; i < n; i++) {
+		events = pfd[i].events;
+		revents = pfd[i].revents;
+		if (revents & (POLLHUP | POLLERR))
+			revents |= (events & (POLLIN | POLLOUT));
+		if (revents & events & POLLIN) {
+			FD_SET(pfd[i].fd, rfds);
+			count++;
+		}
+		if (revents & events & POLLOUT) {
+			FD_SET(pfd[i].fd, wfds);
+			count++;
+		}
+		if (revents & events & POLLPRI) {
+			FD_SET(pfd[i].fd, efds);
+			count++;
+		}
+	}
+	return count;
+}
@@ -36,6 +36,7 @@
 #ifndef _STANDALONE
 extern void __exception_exit(int *);
 extern void __file_exit(void);
+extern void __socket_exit(void);
 extern void __process_exit(int, int);
 #endif
 
@@ -46,6 +47,7 @@ _exit(int status)
 	int signo;
 
 	__exception_exit(&signo);
+	__socket_exit();
 	__file_exit();
 	__process_exit(status, signo);
 #endif
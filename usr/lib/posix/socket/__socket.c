@@ -0,0 +1,72 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/prex.h>
+#include <sys/posix.h>
+#include <ipc/ipc.h>
+#include <ipc/net.h>
+
+#include <errno.h>
+
+void __socket_exit(void);
+
+object_t __net_obj;
+
+/*
+ * Send a message to the net server.
+ *
+ * The server is looked up at the first call, since most tasks
+ * never use the network.
+ */
+int
+__sock_call(void *msg, size_t size, int restart)
+{
+
+	if (__net_obj == 0 && object_lookup("!net", &__net_obj) != 0) {
+		__net_obj = 0;
+		errno = ENETDOWN;
+		return -1;
+	}
+	return __posix_call(__net_obj, msg, size, restart);
+}
+
+/*
+ * Clean up
+ */
+void
+__socket_exit(void)
+{
+	struct msg m;
+
+	/* Let the net server close our sockets */
+	if (__net_obj != 0) {
+		m.hdr.code = NET_EXIT;
+		msg_send(__net_obj, &m, sizeof(m));
+	}
+}
@@ -0,0 +1,60 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/prex.h>
+#include <sys/posix.h>
+#include <ipc/net.h>
+
+#include <errno.h>
+#include <string.h>
+
+ssize_t
+sendmsg(int sd, const struct msghdr *msg, int flags)
+{
+	struct sockio_msg m;
+	socklen_t tolen;
+
+	tolen = (msg->msg_name == NULL) ? 0 : msg->msg_namelen;
+	if (tolen > SOCK_MAXADDRLEN ||
+	    msg->msg_iovlen < 0 || msg->msg_iovlen > IOV_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+	m.hdr.code = NET_SEND;
+	m.sd = sd;
+	m.flags = flags;
+	m.iovcnt = msg->msg_iovlen;
+	memcpy(m.iov, msg->msg_iov, sizeof(struct iovec) * m.iovcnt);
+	m.addrlen = tolen;
+	if (tolen > 0)
+		memcpy(m.addr, msg->msg_name, tolen);
+	if (__sock_call(&m, sizeof(m), 0) != 0)
+		return -1;
+	return (ssize_t)m.size;
+}
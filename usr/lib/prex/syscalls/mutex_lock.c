@@ -27,10 +27,86 @@
  * SUCH DAMAGE.
  */
 
+/*
+ * User mode fast path for mutex.
+ *
+ * The mutex variable holds the lock id of the thread that locks it.
+ * An uncontested mutex is locked and unlocked by exchanging the
+ * id with MUTEX_INITIALIZER in user space, and the system call
+ * is issued only when the exchange fails. Then, the kernel marks
+ * the variable as contested, and it handles the priority
+ * inheritance and the hand-off to the next waiter.
+ *
+ * The lock id of the running thread is kept up to date by the
+ * kernel at the context switch in the read-only page returned by
+ * thread_selfaddr(). The fast path is
+ * used only on the uniprocessor x86 system, where cmpxchg is
+ * atomic against the preemption. Otherwise, the mutex is always
+ * handled by the system call.
+ */
+
 #include <sys/prex.h>
 #include <errno.h>
 
 extern int _mutex_lock(mutex_t *mu);
+extern int _mutex_trylock(mutex_t *mu);
+extern int _mutex_unlock(mutex_t *mu);
+
+#if defined(__x86__)
+
+static volatile u_long *self_id;	/* id of the running thread */
+static int fastpath;			/* 1: enabled, -1: disabled */
+
+static __inline int
+mutex_cas(mutex_t *mu, mutex_t old, mutex_t new)
+{
+	mutex_t prev;
+
+	__asm__ __volatile__("cmpxchgl %2, %1"
+			     : "=a" (prev), "+m" (*mu)
+			     : "r" (new), "0" (old)
+			     : "memory");
+	return prev == old;
+}
+
+static int
+mutex_self(u_long *idp)
+{
+
+	if (fastpath == 0)
+		fastpath = thread_selfaddr((u_long **)&self_id) ? -1 : 1;
+	if (fastpath < 0)
+		return 0;
+	*idp = *self_id;
+	return 1;
+}
+
+static int
+mutex_fastlock(mutex_t *mu)
+{
+	u_long self;
+
+	if (!mutex_self(&self))
+		return 0;
+	return mutex_cas(mu, MUTEX_INITIALIZER, (mutex_t)self);
+}
+
+static int
+mutex_fastunlock(mutex_t *mu)
+{
+	u_long self;
+
+	if (!mutex_self(&self))
+		return 0;
+	return mutex_cas(mu, (mutex_t)self, MUTEX_INITIALIZER);
+}
+
+#else /* !__x86__ */
+
+#define mutex_fastlock(mu)	0
+#define mutex_fastunlock(mu)	0
+
+#endif /* !__x86__ */
 
 /*
  * mutex_lock() is not interrupted by signal
@@ -40,8 +116,28 @@ mutex_lock(mutex_t *mu)
 {
 	int error;
 
+	if (mutex_fastlock(mu))
+		return 0;
 	do
 		error = _mutex_lock(mu);
 	while (error == EINTR);
 	return error;
 }
+
+int
+mutex_trylock(mutex_t *mu)
+{
+
+	if (mutex_fastlock(mu))
+		return 0;
+	return _mutex_trylock(mu);
+}
+
+int
+mutex_unlock(mutex_t *mu)
+{
+
+	if (mutex_fastunlock(mu))
+		return 0;
+	return _mutex_unlock(mu);
+}
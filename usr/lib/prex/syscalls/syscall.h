@@ -95,5 +95,13 @@
 #define SYS_sys_time		58
 #define SYS_sys_debug		59
 #define SYS_vm_map_phys		60
+#define SYS_msg_send_async	61
+#define SYS_msg_poll		62
+#define SYS_msg_receive_batch	63
+#define SYS_msg_reply_batch	64
+#define SYS_thread_selfaddr	65
+#define SYS_sys_uptime		66
+#define SYS_vm_share		67
+#define SYS_vm_check		68
 
 #endif /* _SYSCALL_H */
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * swtch.c - benchmark for thread switching
+ */
+
+/*
+ * The benchmark measures the thread switch latency while the
+ * specified number of priority levels are populated in the run
+ * queue. A thread is switched back and forth between the main
+ * thread and a worker thread. Lower priority threads are used
+ * to fill the run queue, and they never get the CPU during the
+ * measurement.
+ */
+
+#include <sys/prex.h>
+#include <stdio.h>
+
+#define NR_LOOPS	100000	/* number of round trips */
+#define MAX_LEVELS	200	/* max number of filler threads */
+
+#define PRI_BENCH	50	/* priority for main and worker thread */
+#define PRI_FILLER	254	/* lowest priority of filler threads */
+
+static thread_t filler[MAX_LEVELS];
+static thread_t worker;
+static char stack[1024];
+static char filler_stack[16];
+
+static void
+null_thread(void)
+{
+	for (;;) ;
+}
+
+/*
+ * Worker thread just suspends itself. The main thread
+ * resumes this thread in each round trip.
+ */
+static void
+worker_thread(void)
+{
+	for (;;)
+		thread_suspend(thread_self());
+}
+
+/*
+ * Create filler threads which occupy 'levels' different
+ * priority levels below PRI_BENCH.
+ */
+static void
+fill_runq(task_t task, int levels)
+{
+	int i;
+
+	for (i = 0; i < levels; i++) {
+		if (thread_create(task, &filler[i]) != 0)
+			panic("thread_create is failed");
+		if (thread_load(filler[i], null_thread, filler_stack) != 0)
+			panic("thread_load is failed");
+		if (thread_setpri(filler[i], PRI_FILLER - i) != 0)
+			panic("thread_setpri is failed");
+		if (thread_resume(filler[i]) != 0)
+			panic("thread_resume is failed");
+	}
+}
+
+static void
+drain_runq(int levels)
+{
+	int i;
+
+	for (i = 0; i < levels; i++)
+		thread_terminate(filler[i]);
+}
+
+static void
+run_bench(task_t task, int levels, int hz)
+{
+	u_long start, end, nsec;
+	int i;
+
+	fill_runq(task, levels);
+
+	sys_time(&start);
+	for (i = 0; i < NR_LOOPS; i++) {
+		/*
+		 * Resume the worker. It preempts us and
+		 * suspends itself immediately.
+		 */
+		thread_resume(worker);
+	}
+	sys_time(&end);
+
+	drain_runq(levels);
+
+	/* Two thread switches per round trip */
+	nsec = (end - start) * (1000000 / hz) / (NR_LOOPS * 2 / 1000);
+	printf("%3d levels: %d msec for %d switches, %d.%03d usec/switch\n",
+	       levels, (int)((end - start) * 1000 / hz), NR_LOOPS * 2,
+	       (int)(nsec / 1000), (int)(nsec % 1000));
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct timerinfo info;
+	task_t task;
+
+	printf("Benchmark for thread switching\n");
+
+	sys_info(INFO_TIMER, &info);
+	if (info.hz == 0)
+		panic("can not get timer tick rate");
+
+	task = task_self();
+	thread_setpri(thread_self(), PRI_BENCH);
+
+	if (thread_create(task, &worker) != 0)
+		panic("thread_create is failed");
+	if (thread_load(worker, worker_thread, stack + sizeof(stack)) != 0)
+		panic("thread_load is failed");
+	if (thread_setpri(worker, PRI_BENCH) != 0)
+		panic("thread_setpri is failed");
+	if (thread_resume(worker) != 0)
+		panic("thread_resume is failed");
+
+	run_bench(task, 1, info.hz);
+	run_bench(task, 16, info.hz);
+	run_bench(task, MAX_LEVELS, info.hz);
+
+	thread_terminate(worker);
+	printf("Complete.\n");
+	return 0;
+}
@@ -33,25 +33,61 @@
 
 #include <sys/prex.h>
 #include <ipc/ipc.h>
+#include <ipc/fs.h>
 
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 static void
 usage(void)
 {
 
-	fprintf(stderr, "usage: debug [object]\n");
+	fprintf(stderr, "usage: debug [-b] [object]\n");
 	exit(1);
 }
 
+/*
+ * Show statistics of the buffer cache in the file system.
+ */
+static void
+show_bio(void)
+{
+	object_t obj;
+	struct bio_msg m;
+	struct bufstat *bs = &m.stat;
+	u_long total;
+
+	if (object_lookup("!fs", &obj) != 0) {
+		fprintf(stderr, "debug: can not find file system\n");
+		exit(1);
+	}
+	m.hdr.code = FS_BIOSTAT;
+	if (msg_send(obj, &m, sizeof(m)) != 0 || m.hdr.status != 0) {
+		fprintf(stderr, "debug: can not get buffer statistics\n");
+		exit(1);
+	}
+	total = bs->hits + bs->misses;
+	printf("buffers: %d/%d\n", bs->nbufs, bs->maxbufs);
+	printf("hits:    %lu (%lu%%)\n", bs->hits,
+	       total ? bs->hits * 100 / total : 0);
+	printf("misses:  %lu\n", bs->misses);
+	printf("evicts:  %lu\n", bs->evicts);
+	printf("rahead:  %lu\n", bs->rablks);
+	printf("clwrite: %lu\n", bs->clwrites);
+}
+
 int
 main(int argc, char *argv[])
 {
 	object_t obj;
 	struct msg m;
 
+	if (argc == 2 && !strcmp(argv[1], "-b")) {
+		show_bio();
+		exit(0);
+	}
 	if (argc != 2)
 		usage();
 
@@ -36,6 +36,8 @@
 #include <ipc/proc.h>
 #include <sys/elf.h>
 #include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 
 #include <string.h>
 #include <limits.h>
@@ -53,14 +55,92 @@ static char *sect_addr[32];	/* Array of section address */
 
 #ifdef CONFIG_MMU
 /*
- * Load executable ELF file
+ * Image cache
+ *
+ * The loadable segments of recently executed files are kept in
+ * the exec server. The read-only segments are shared with the new
+ * tasks by vm_share(), and only the writable segments are copied.
+ * An image is found by its path name, and it is used only while
+ * the inode number, size and modification time of the file are
+ * not changed.
+ */
+#define NR_IMAGES	8	/* number of cached images */
+#define NR_ISEGS	4	/* max loadable segments in image */
+
+struct iseg {
+	vaddr_t		addr;		/* page address in new task */
+	size_t		size;		/* page aligned size */
+	size_t		offset;		/* offset of data in page */
+	size_t		filesz;		/* size of file data */
+	int		shared;		/* true if read-only segment */
+	char		*data;		/* segment in exec server */
+};
+
+struct image {
+	char		*path;		/* path name, NULL if free */
+	ino_t		ino;		/* inode number */
+	off_t		size;		/* file size */
+	time_t		mtime;		/* modification time */
+	vaddr_t		entry;		/* entry address */
+	int		nsegs;		/* number of segments */
+	struct iseg	segs[NR_ISEGS];	/* loadable segments */
+	u_long		lastuse;	/* counter for LRU */
+};
+
+static struct image image_cache[NR_IMAGES];
+static u_long image_clock;
+
+/*
+ * Release the cached image. The shared segments are not freed
+ * until all tasks release them.
+ */
+static void
+image_free(struct image *img)
+{
+	int i;
+
+	for (i = 0; i < img->nsegs; i++) {
+		if (img->segs[i].data != NULL)
+			vm_free(task_self(), img->segs[i].data);
+	}
+	free(img->path);
+	memset(img, 0, sizeof(*img));
+}
+
+/*
+ * Find the valid image for the file.
+ */
+static struct image *
+image_lookup(char *path, struct stat *st)
+{
+	struct image *img;
+	int i;
+
+	for (i = 0; i < NR_IMAGES; i++) {
+		img = &image_cache[i];
+		if (img->path == NULL || strcmp(img->path, path))
+			continue;
+		if (img->ino == st->st_ino && img->size == st->st_size &&
+		    img->mtime == st->st_mtime) {
+			img->lastuse = ++image_clock;
+			return img;
+		}
+		/* The file has been changed. */
+		image_free(img);
+	}
+	return NULL;
+}
+
+/*
+ * Read all loadable segments of the file into the image.
  */
 static int
-load_exec(Elf32_Ehdr *ehdr, task_t task, int fd, vaddr_t *entry)
+image_read(struct image *img, Elf32_Ehdr *ehdr, int fd)
 {
 	Elf32_Phdr *phdr;
-	void *addr, *mapped;
-	size_t size = 0;
+	struct iseg *seg;
+	void *data;
+	size_t len;
 	int i;
 
 	phdr = (Elf32_Phdr *)((u_long)ehdr + ehdr->e_phoff);
@@ -68,41 +148,139 @@ load_exec(Elf32_Ehdr *ehdr, task_t task, int fd, vaddr_t *entry)
 		return ENOEXEC;
 
 	for (i = 0; i < (int)ehdr->e_phnum; i++, phdr++) {
-		if (phdr->p_type != PT_LOAD)
+		if (phdr->p_type != PT_LOAD || phdr->p_memsz == 0)
 			continue;
+		if (img->nsegs >= NR_ISEGS)
+			return ENOEXEC;
 
-		addr = (void *)phdr->p_vaddr;
-		size = phdr->p_memsz;
-		if (size == 0)
-			continue;
+		seg = &img->segs[img->nsegs++];
+		seg->addr = trunc_page(phdr->p_vaddr);
+		seg->offset = (size_t)(phdr->p_vaddr - seg->addr);
+		seg->size = round_page(phdr->p_vaddr + phdr->p_memsz) -
+			seg->addr;
+		seg->filesz = phdr->p_filesz;
+		seg->shared = !(phdr->p_flags & PF_W);
 
-		if (vm_allocate(task, &addr, size, 0) != 0)
+		/*
+		 * Keep whole read-only segment, but only the file
+		 * data of the writable segment.
+		 */
+		len = seg->shared ? seg->size : seg->offset + seg->filesz;
+		if (seg->filesz == 0 && !seg->shared)
+			continue;
+		if (vm_allocate(task_self(), &data, len, 1) != 0)
 			return ENOMEM;
+		seg->data = data;
 
-		if (vm_map(task, (void *)phdr->p_vaddr, size, &mapped) != 0)
-			return ENOEXEC;
-		if (phdr->p_filesz > 0) {
+		if (seg->filesz > 0) {
 			if (lseek(fd, (off_t)phdr->p_offset, SEEK_SET)
 			    == -(off_t)1)
-				goto err;
-			if (read(fd, mapped, phdr->p_filesz) < 0)
-				goto err;
+				return EIO;
+			if (read(fd, seg->data + seg->offset, seg->filesz)
+			    != (ssize_t)seg->filesz)
+				return EIO;
 		}
+		if (seg->shared) {
+			if (vm_attribute(task_self(), data, PROT_READ) != 0)
+				return ENOMEM;
+		}
+	}
+	img->entry = (vaddr_t)ehdr->e_entry;
+	return 0;
+}
 
-		vm_free(task_self(), mapped);
+/*
+ * Load the image into the task.
+ */
+static int
+image_exec(struct image *img, task_t task)
+{
+	struct iseg *seg;
+	void *addr, *mapped;
+	int i;
+
+	for (i = 0; i < img->nsegs; i++) {
+		seg = &img->segs[i];
+		addr = (void *)seg->addr;
 
-		/* Set read-only to text */
-		if (phdr->p_flags & PF_X) {
-			if (vm_attribute(task, addr, PROT_READ) != 0)
-				return ENOEXEC;
+		if (seg->shared) {
+			if (vm_share(task, seg->data, addr) != 0)
+				return ENOMEM;
+			continue;
 		}
+		if (vm_allocate(task, &addr, seg->size, 0) != 0)
+			return ENOMEM;
+		if (seg->filesz == 0)
+			continue;
+		if (vm_map(task, addr, seg->size, &mapped) != 0)
+			return ENOEXEC;
+		memcpy((char *)mapped + seg->offset, seg->data + seg->offset,
+		       seg->filesz);
+		vm_free(task_self(), mapped);
 	}
-	*entry = (vaddr_t)ehdr->e_entry;
 	return 0;
+}
 
- err:
-	vm_free(task_self(), mapped);
-	return EIO;
+/*
+ * Load executable ELF file
+ *
+ * The image is read into the cache if it is not found. The file
+ * which has been modified within this second is not cached,
+ * because its next modification may not change the time.
+ */
+static int
+load_exec(struct exec *exec)
+{
+	struct image *img, *tmp;
+	struct timespec now;
+	struct stat st;
+	int fd, i, error;
+
+	if (stat(exec->path, &st) == -1)
+		return ENOENT;
+
+	if ((img = image_lookup(exec->path, &st)) == NULL) {
+		if ((fd = open(exec->path, O_RDONLY)) == -1)
+			return ENOENT;
+		if (fstat(fd, &st) == -1) {
+			close(fd);
+			return EIO;
+		}
+
+		/* Use free or least recently used entry. */
+		img = &image_cache[0];
+		for (i = 1; i < NR_IMAGES && img->path != NULL; i++) {
+			tmp = &image_cache[i];
+			if (tmp->path == NULL || tmp->lastuse < img->lastuse)
+				img = tmp;
+		}
+		if (img->path != NULL)
+			image_free(img);
+
+		if ((img->path = strdup(exec->path)) == NULL) {
+			close(fd);
+			return ENOMEM;
+		}
+		img->ino = st.st_ino;
+		img->size = st.st_size;
+		img->mtime = st.st_mtime;
+		img->lastuse = ++image_clock;
+
+		error = image_read(img, (Elf32_Ehdr *)exec->header, fd);
+		close(fd);
+		if (error) {
+			image_free(img);
+			return error;
+		}
+	}
+
+	error = image_exec(img, exec->task);
+	exec->entry = img->entry;
+
+	sys_uptime(&now);
+	if (error || img->mtime >= (time_t)now.ts_sec)
+		image_free(img);
+	return error;
 }
 #else /* !CONFIG_MMU */
 
@@ -333,7 +511,10 @@ load_reloc(Elf32_Ehdr *ehdr, task_t task, int fd, vaddr_t *entry)
 int
 elf_load(struct exec *exec)
 {
-	int error, fd;
+	int error;
+#ifndef CONFIG_MMU
+	int fd;
+#endif
 
 	/*
 	 * Check permission.
@@ -343,17 +524,16 @@ elf_load(struct exec *exec)
 		return errno;
 	}
 
+#ifdef CONFIG_MMU
+	error = load_exec(exec);
+#else
 	if ((fd = open(exec->path, O_RDONLY)) == -1)
 		return ENOENT;
 
-#ifdef CONFIG_MMU
-	error = load_exec((Elf32_Ehdr *)exec->header, exec->task,
-			  fd, &exec->entry);
-#else
 	error = load_reloc((Elf32_Ehdr *)exec->header, exec->task,
 			  fd, &exec->entry);
-#endif
 	close(fd);
+#endif
 	return error;
 }
 
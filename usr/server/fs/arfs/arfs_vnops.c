@@ -79,6 +79,7 @@ static int arfs_lookup	(vnode_t, char *, vnode_t);
 #define arfs_setattr	((vnop_setattr_t)vop_nullop)
 #define arfs_inactive	((vnop_inactive_t)vop_nullop)
 #define arfs_truncate	((vnop_truncate_t)vop_nullop)
+#define arfs_poll	((vnop_poll_t)vop_seltrue)
 
 static char iobuf[BSIZE*2];
 
@@ -108,6 +109,7 @@ const struct vnops arfs_vnops = {
 	arfs_setattr,		/* setattr */
 	arfs_inactive,		/* inactive */
 	arfs_truncate,		/* truncate */
+	arfs_poll,		/* poll */
 };
 
 /*
@@ -206,7 +208,7 @@ static int
 arfs_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 {
 	off_t off, file_pos, buf_pos;
-	int blkno, error;
+	int blkno, endblk, lastblk, nra, error;
 	size_t nr_read, nr_copy;
 	mount_t mp;
 	struct buf *bp;
@@ -227,8 +229,19 @@ arfs_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 	if (vp->v_size - file_pos < size)
 		size = vp->v_size - file_pos;
 
-	/* Read and copy data */
+	/*
+	 * Read all blocks of this request at once, and the
+	 * following blocks too if the file is read sequentially.
+	 */
 	off = (off_t)vp->v_data;
+	blkno = (off + file_pos) / BSIZE;
+	endblk = (off + file_pos + size - 1) / BSIZE;
+	lastblk = (off + vp->v_size - 1) / BSIZE;
+	nra = vn_readahead(vp, blkno, endblk - blkno + 1);
+	if (endblk + nra > lastblk)
+		nra = lastblk - endblk;
+
+	/* Read and copy data */
 	nr_read = 0;
 	for (;;) {
 		DPRINTF(("arfs_read: file_pos=%d buf=%x size=%d\n",
@@ -236,7 +249,8 @@ arfs_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 
 		blkno = (off + file_pos) / BSIZE;
 		buf_pos = (off + file_pos) % BSIZE;
-		if ((error = bread(mp->m_dev, blkno, &bp)) != 0)
+		error = breada(mp->m_dev, blkno, endblk - blkno + nra, &bp);
+		if (error)
 			goto out;
 		nr_copy = BSIZE;
 		if (buf_pos > 0)
@@ -32,12 +32,15 @@
  */
 
 #include <sys/prex.h>
+#include <sys/param.h>
 #include <sys/device.h>
 #include <sys/stat.h>
 #include <sys/vnode.h>
 #include <sys/file.h>
 #include <sys/mount.h>
 #include <sys/syslog.h>
+#include <sys/poll.h>
+#include <sys/termios.h>
 
 #include <ctype.h>
 #include <unistd.h>
@@ -74,6 +77,7 @@ static int devfs_lookup	(vnode_t, char *, vnode_t);
 #define devfs_setattr	((vnop_setattr_t)vop_nullop)
 #define devfs_inactive	((vnop_inactive_t)vop_nullop)
 #define devfs_truncate	((vnop_truncate_t)vop_nullop)
+static int devfs_poll	(vnode_t, file_t, int);
 
 /*
  * vnode operations
@@ -97,6 +101,7 @@ struct vnops devfs_vnops = {
 	devfs_setattr,		/* setattr */
 	devfs_inactive,		/* inactive */
 	devfs_truncate,		/* truncate */
+	devfs_poll,		/* poll */
 };
 
 /*
@@ -189,6 +194,111 @@ devfs_ioctl(vnode_t vp, file_t fp, u_long cmd, void *arg)
 	return error;
 }
 
+/*
+ * A tty can not wake up its pollers by itself. When a tty is
+ * polled while it has no input, we start a watcher thread for
+ * the vnode. The watcher sleeps in the driver until the input
+ * of the tty changes, and calls vn_pollwakeup() for the vnode.
+ * It holds a reference of the vnode and is never stopped.
+ */
+#if CONFIG_FS_THREADS > 1
+static mutex_t watch_lock = MUTEX_INITIALIZER;
+#endif
+static vnode_t watch_vp;		/* vnode for new watcher */
+static sem_t watch_sem;			/* posted when watcher starts */
+
+static void
+devfs_watcher(void)
+{
+	vnode_t vp;
+	int seq, error;
+
+	vp = watch_vp;
+	sem_post(&watch_sem);
+
+	/*
+	 * Get the current sequence first, and let the pollers
+	 * check the input which came before it.
+	 */
+	seq = -1;
+	for (;;) {
+		error = device_ioctl((device_t)vp->v_data, TIOCWAIT, &seq);
+		if (error == EINTR)
+			continue;
+		if (error != 0)
+			break;
+		vn_pollwakeup(vp);
+	}
+	/*
+	 * The driver can not be watched. Keep VTTYWATCH so that
+	 * we do not try it again.
+	 */
+	DPRINTF(("devfs_watcher: %s error=%d\n", vp->v_path, error));
+	thread_terminate(thread_self());
+}
+
+/*
+ * Start a watcher thread for the tty vnode.
+ * Called with the vnode locked.
+ */
+static void
+devfs_watch(vnode_t vp)
+{
+	task_t self;
+	thread_t t;
+	void *stack, *sp;
+
+	mutex_lock(&watch_lock);
+	if (vp->v_flags & VTTYWATCH) {
+		mutex_unlock(&watch_lock);
+		return;
+	}
+	if (watch_sem == 0 && sem_init(&watch_sem, 0) != 0)
+		goto out;
+
+	self = task_self();
+	if (thread_create(self, &t) != 0)
+		goto out;
+	if (vm_allocate(self, &stack, DFLSTKSZ, 1) != 0) {
+		thread_terminate(t);
+		goto out;
+	}
+	sp = (void *)((u_long)stack + DFLSTKSZ - sizeof(u_long) * 3);
+	if (thread_load(t, devfs_watcher, sp) != 0) {
+		thread_terminate(t);
+		vm_free(self, stack);
+		goto out;
+	}
+	vref(vp);
+	vp->v_flags |= VTTYWATCH;
+	watch_vp = vp;
+	thread_resume(t);
+	sem_wait(&watch_sem, 0);
+ out:
+	mutex_unlock(&watch_lock);
+}
+
+/*
+ * A tty is readable when its input queue is not empty. The
+ * other devices are always ready.
+ */
+static int
+devfs_poll(vnode_t vp, file_t fp, int events)
+{
+	int count;
+
+	if (!(vp->v_flags & VISTTY))
+		return vop_seltrue(vp, fp, events);
+
+	if (device_ioctl((device_t)vp->v_data, TIOCINQ, &count) != 0)
+		return POLLERR;
+	if (count > 0)
+		return events & (POLLIN | POLLOUT);
+	if (events & POLLIN)
+		devfs_watch(vp);
+	return events & POLLOUT;
+}
+
 static int
 devfs_lookup(vnode_t dvp, char *name, vnode_t vp)
 {
@@ -65,6 +65,8 @@
 #define SEC_SIZE	512		/* sector size */
 #define SEC_INVAL	0xffffffff	/* invalid sector */
 
+#define FAT_RASIZE	(16 * 1024)	/* size of read-ahead buffer */
+
 /*
  * Pre-defined cluster number
  */
@@ -164,10 +166,17 @@ struct fatfsmount {
 	u_long	last_cluster;	/* last cluser */
 	u_long	fat_mask;	/* mask for cluster# */
 	u_long	free_scan;	/* start cluster# to free search */
+	u_long	fat_secs;	/* sectors per FAT */
+	u_long	free_count;	/* number of free clusters */
 	vnode_t	root_vnode;	/* vnode for root */
 	char	*io_buf;	/* local data buffer */
-	char	*fat_buf;	/* buffer for fat entry */
+	u_char	*fat_cache;	/* copy of the first FAT */
+	uint32_t *free_map;	/* bitmap of used clusters */
 	char	*dir_buf;	/* buffer for directory entry */
+	char	*ra_buf;	/* read-ahead buffer for file data */
+	u_long	ra_start;	/* first cluster# in ra_buf */
+	u_long	ra_count;	/* number of clusters in ra_buf */
+	u_long	ra_max;		/* max number of clusters in ra_buf */
 	dev_t	dev;		/* mounted device */
 #if CONFIG_FS_THREADS > 1
 	mutex_t lock;		/* file system lock */
@@ -180,6 +189,26 @@ struct fatfsmount {
 #define IS_EOFCL(fat, cl) \
 	(((cl) & EOF_MASK) == ((fat)->fat_mask & EOF_MASK))
 
+/*
+ * Run of the clusters which are contiguous on disk
+ */
+struct fat_extent {
+	u_long	index;		/* cluster index in file */
+	u_long	cluster;	/* first cluster# of run */
+	u_long	count;		/* number of clusters */
+};
+
+/*
+ * Cluster runs of the file, sorted by the index. They cover
+ * the FAT chain from its start, and are extended on demand.
+ */
+struct fat_extmap {
+	struct fat_extent *ext;	/* array of runs */
+	int	nexts;		/* number of runs */
+	int	size;		/* size of array */
+	int	eof;		/* true if mapped to end of chain */
+};
+
 /*
  * File/directory node
  */
@@ -187,6 +216,7 @@ struct fatfs_node {
 	struct fat_dirent dirent; /* copy of directory entry */
 	u_long	sector;		/* sector# for directory entry */
 	u_long	offset;		/* offset of directory entry in sector */
+	struct fat_extmap extmap; /* cluster runs of file */
 };
 
 extern struct vnops fatfs_vnops;
@@ -200,10 +230,15 @@ int	 fat_next_cluster(struct fatfsmount *fmp, u_long cl, u_long *next);
 int	 fat_set_cluster(struct fatfsmount *fmp, u_long cl, u_long next);
 int	 fat_alloc_cluster(struct fatfsmount *fmp, u_long scan_start, u_long *free);
 int	 fat_free_clusters(struct fatfsmount *fmp, u_long start);
-int	 fat_seek_cluster(struct fatfsmount *fmp, u_long start, u_long offset,
-			    u_long *cl);
-int	 fat_expand_file(struct fatfsmount *fmp, u_long cl, int size);
+int	 fat_seek_cluster(struct fatfsmount *fmp, struct fat_extmap *em,
+			  u_long start, u_long offset, u_long *cl);
+int	 fat_expand_file(struct fatfsmount *fmp, struct fat_extmap *em,
+			 u_long start, u_long size);
+int	 fat_shrink_file(struct fatfsmount *fmp, struct fat_extmap *em,
+			 u_long start, u_long size);
 int	 fat_expand_dir(struct fatfsmount *fmp, u_long cl, u_long *new_cl);
+int	 fat_load(struct fatfsmount *fmp);
+void	 fat_unload(struct fatfsmount *fmp);
 
 void	 fat_convert_name(char *org, char *name);
 void	 fat_restore_name(char *org, char *name);
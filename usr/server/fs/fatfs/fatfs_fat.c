@@ -38,84 +38,154 @@
 #include "fatfs.h"
 
 /*
- * Read the FAT entry for specified cluster.
+ * The whole first FAT is kept in memory while the file system is
+ * mounted, and the free clusters are tracked by a bitmap built at
+ * mount time. A modified FAT sector is written through the buffer
+ * cache with a delayed write.
  */
-static int
-read_fat_entry(struct fatfsmount *fmp, u_long cl)
+
+#define NBITS		32
+#define MAP_WORDS(n)	(((n) + NBITS - 1) / NBITS)
+#define MAP_BIT(cl)	((uint32_t)1 << ((cl) % NBITS))
+
+/* initial number of runs in the extent map */
+#define NEXTENTS	8
+
+/*
+ * Get the byte offset of the FAT entry in the FAT.
+ */
+static u_long
+fat_offset(struct fatfsmount *fmp, u_long cl)
 {
-	u_long sec;
-	char *buf = fmp->fat_buf;
-	int error, border = 0;
-	struct buf *bp;
 
-	/* Get the sector number in FAT entry. */
-	if (FAT16(fmp))
-		sec = (cl * 2) / SEC_SIZE;
-	else {
-		sec = (cl * 3 / 2) / SEC_SIZE;
-		/*
-		 * Check if the entry data is placed at the
-		 * end of sector. If so, we have to read one
-		 * more sector to get complete FAT12 entry.
-		 */
-		if ((cl * 3 / 2) % SEC_SIZE == SEC_SIZE - 1)
-			border = 1;
+	return FAT16(fmp) ? cl * 2 : cl * 3 / 2;
+}
+
+/*
+ * Get the FAT entry from the FAT cache.
+ */
+static u_long
+fat_get_entry(struct fatfsmount *fmp, u_long cl)
+{
+	u_char *p;
+	u_long val;
+
+	p = fmp->fat_cache + fat_offset(fmp, cl);
+	val = (u_long)p[0] | ((u_long)p[1] << 8);
+	if (FAT12(fmp)) {
+		if (cl & 1)
+			val >>= 4;
+		else
+			val &= 0xfff;
 	}
-	sec += fmp->fat_start;
+	return val;
+}
 
-	/* Read first sector. */
-	if ((error = bread(fmp->dev, sec, &bp)) != 0)
-		return error;
-	memcpy(buf, bp->b_data, SEC_SIZE);
-	brelse(bp);
+/*
+ * Write the FAT sector in the FAT cache to the device.
+ */
+static void
+fat_write_sector(struct fatfsmount *fmp, u_long sec)
+{
+	struct buf *bp;
 
-	if (!FAT12(fmp) || border == 0)
-		return 0;
+	/*
+	 * The write is delayed, so that the FAT sectors updated
+	 * while a file grows are written together when they are
+	 * flushed.
+	 */
+	bp = getblk(fmp->dev, (int)(fmp->fat_start + sec));
+	memcpy(bp->b_data, fmp->fat_cache + sec * SEC_SIZE, SEC_SIZE);
+	bdwrite(bp);
+}
 
-	/* Read second sector for the border entry of FAT12. */
-	if ((error = bread(fmp->dev, sec + 1, &bp)) != 0)
-		return error;
-	memcpy(buf + SEC_SIZE, bp->b_data, SEC_SIZE);
-	brelse(bp);
-	return 0;
+/*
+ * Set the FAT entry in the FAT cache, and write it.
+ */
+static void
+fat_set_entry(struct fatfsmount *fmp, u_long cl, u_long val)
+{
+	u_char *p;
+	u_long off;
+
+	off = fat_offset(fmp, cl);
+	p = fmp->fat_cache + off;
+	val &= fmp->fat_mask;
+	if (FAT16(fmp)) {
+		p[0] = (u_char)val;
+		p[1] = (u_char)(val >> 8);
+	} else if (cl & 1) {
+		p[0] = (u_char)((p[0] & 0x0f) | ((val << 4) & 0xf0));
+		p[1] = (u_char)(val >> 4);
+	} else {
+		p[0] = (u_char)val;
+		p[1] = (u_char)((p[1] & 0xf0) | ((val >> 8) & 0x0f));
+	}
+
+	/* The entry may cross the sector boundary. */
+	fat_write_sector(fmp, off / SEC_SIZE);
+	if ((off + 1) / SEC_SIZE != off / SEC_SIZE)
+		fat_write_sector(fmp, off / SEC_SIZE + 1);
 }
 
 /*
- * Write fat entry from buffer.
+ * Read the FAT into memory, and build the bitmap of the used
+ * clusters. This is called at mount time.
  */
-static int
-write_fat_entry(struct fatfsmount *fmp, u_long cl)
+int
+fat_load(struct fatfsmount *fmp)
 {
-	u_long sec;
-	char *buf = fmp->fat_buf;
-	int error, border = 0;
-	struct buf *bp;
+	size_t size;
+	u_long cl, nwords;
+	int error;
+
+	/* The entry of the last cluster must fit in the FAT. */
+	if (fat_offset(fmp, fmp->last_cluster - 1) + 1 >=
+	    fmp->fat_secs * SEC_SIZE)
+		return EINVAL;
+
+	size = fmp->fat_secs * SEC_SIZE;
+	if ((fmp->fat_cache = malloc(size)) == NULL)
+		return ENOMEM;
+	error = device_read(fmp->dev, fmp->fat_cache, &size, fmp->fat_start);
+	if (error || size != fmp->fat_secs * SEC_SIZE) {
+		free(fmp->fat_cache);
+		return EIO;
+	}
 
-	/* Get the sector number in FAT entry. */
-	if (FAT16(fmp))
-		sec = (cl * 2) / SEC_SIZE;
-	else {
-		sec = (cl * 3 / 2) / SEC_SIZE;
-		/* Check if border entry for FAT12 */
-		if ((cl * 3 / 2) % SEC_SIZE == SEC_SIZE - 1)
-			border = 1;
+	nwords = MAP_WORDS(fmp->last_cluster);
+	if ((fmp->free_map = malloc(nwords * sizeof(uint32_t))) == NULL) {
+		free(fmp->fat_cache);
+		return ENOMEM;
+	}
+	memset(fmp->free_map, 0, nwords * sizeof(uint32_t));
+
+	/* Cluster 0 and 1 are reserved. */
+	fmp->free_map[0] = MAP_BIT(0) | MAP_BIT(1);
+	fmp->free_count = 0;
+	for (cl = CL_FIRST; cl < fmp->last_cluster; cl++) {
+		if (fat_get_entry(fmp, cl) == CL_FREE)
+			fmp->free_count++;
+		else
+			fmp->free_map[cl / NBITS] |= MAP_BIT(cl);
 	}
-	sec += fmp->fat_start;
+	/* The bits after the last cluster are never free. */
+	for (; cl < nwords * NBITS; cl++)
+		fmp->free_map[cl / NBITS] |= MAP_BIT(cl);
 
-	/* Write first sector. */
-	bp = getblk(fmp->dev, sec);
-	memcpy(bp->b_data, buf, SEC_SIZE);
-	if ((error = bwrite(bp)) != 0)
-		return error;
+	DPRINTF(("fat_load: %d free clusters\n", (int)fmp->free_count));
+	return 0;
+}
 
-	if (!FAT12(fmp) || border == 0)
-		return 0;
+/*
+ * Release the FAT cache. This is called at unmount time.
+ */
+void
+fat_unload(struct fatfsmount *fmp)
+{
 
-	/* Write second sector for the border entry of FAT12. */
-	bp = getblk(fmp->dev, sec + 1);
-	memcpy(bp->b_data, buf + SEC_SIZE, SEC_SIZE);
-	error = bwrite(bp);
-	return error;
+	free(fmp->free_map);
+	free(fmp->fat_cache);
 }
 
 /*
@@ -127,32 +197,10 @@ write_fat_entry(struct fatfsmount *fmp, u_long cl)
 int
 fat_next_cluster(struct fatfsmount *fmp, u_long cl, u_long *next)
 {
-	u_int offset;
-	uint16_t val;
-	int error;
-
-	/* Read FAT entry */
-	error = read_fat_entry(fmp, cl);
-	if (error)
-		return error;
-
-	/* Get offset in buffer. */
-	if (FAT16(fmp))
-		offset = (cl * 2) % SEC_SIZE;
-	else
-		offset = (cl * 3 / 2) % SEC_SIZE;
 
-	/* Pick up cluster# */
-	val = *((uint16_t *)(fmp->fat_buf + offset));
-
-	/* Adjust data for FAT12 entry */
-	if (FAT12(fmp)) {
-		if (cl & 1)
-			val >>= 4;
-		else
-			val &= 0xfff;
-	}
-	*next = (u_long)val;
+	if (cl >= fmp->last_cluster)
+		return EIO;
+	*next = fat_get_entry(fmp, cl);
 	DPRINTF(("fat_next_cluster: %d => %d\n", cl, *next));
 	return 0;
 }
@@ -166,39 +214,23 @@ fat_next_cluster(struct fatfsmount *fmp, u_long cl, u_long *next)
 int
 fat_set_cluster(struct fatfsmount *fmp, u_long cl, u_long next)
 {
-	u_int offset;
-	char *buf = fmp->fat_buf;
-	int error;
-	uint16_t val, tmp;
+	uint32_t *word;
 
-	/* Read FAT entry */
-	error = read_fat_entry(fmp, cl);
-	if (error)
-		return error;
-
-	/* Get offset in buffer. */
-	if (FAT16(fmp))
-		offset = (cl * 2) % SEC_SIZE;
-	else
-		offset = (cl * 3 / 2) % SEC_SIZE;
+	if (cl < CL_FIRST || cl >= fmp->last_cluster)
+		return EIO;
 
-	/* Modify FAT entry for target cluster. */
-	val = (uint16_t)(next & fmp->fat_mask);
-	if (FAT12(fmp)) {
-		tmp = *((uint16_t *)(buf + offset));
-		if (cl & 1) {
-			val <<= 4;
-			val |= (tmp & 0xf);
-		} else {
-			tmp &= 0xf000;
-			val |= tmp;
-		}
+	word = &fmp->free_map[cl / NBITS];
+	if (next == CL_FREE) {
+		if (*word & MAP_BIT(cl))
+			fmp->free_count++;
+		*word &= ~MAP_BIT(cl);
+	} else {
+		if (!(*word & MAP_BIT(cl)))
+			fmp->free_count--;
+		*word |= MAP_BIT(cl);
 	}
-	*((uint16_t *)(buf + offset)) = val;
-
-	/* Write FAT entry */
-	error = write_fat_entry(fmp, cl);
-	return error;
+	fat_set_entry(fmp, cl, next);
+	return 0;
 }
 
 /*
@@ -207,30 +239,45 @@ fat_set_cluster(struct fatfsmount *fmp, u_long cl, u_long next)
  * @fmp: fat mount data
  * @scan_start: cluster# to scan first. If 0, use the previous used value.
  * @free: allocated cluster# to return
+ *
+ * The cluster is reserved in the bitmap, so that it is not
+ * allocated again until its FAT entry is set.
  */
 int
 fat_alloc_cluster(struct fatfsmount *fmp, u_long scan_start, u_long *free)
 {
-	u_long cl, next;
-	int error;
+	u_long cl, n;
+	uint32_t word;
 
 	if (scan_start == 0)
 		scan_start = fmp->free_scan;
 
 	DPRINTF(("fat_alloc_cluster: start=%d\n", scan_start));
 
+	if (fmp->free_count == 0)
+		return ENOSPC;		/* no space */
+
 	cl = scan_start + 1;
-	while (cl != scan_start) {
-		error = fat_next_cluster(fmp, cl, &next);
-		if (error)
-			return error;
-		if (next == CL_FREE) {	/* free ? */
+	for (n = 0; n < fmp->last_cluster + NBITS; ) {
+		if (cl >= fmp->last_cluster)
+			cl = CL_FIRST;
+		word = fmp->free_map[cl / NBITS];
+		if (word == 0xffffffff) {
+			/* Skip the word with no free cluster. */
+			n += NBITS - cl % NBITS;
+			cl += NBITS - cl % NBITS;
+			continue;
+		}
+		if (!(word & MAP_BIT(cl))) {
 			DPRINTF(("fat_alloc_cluster: free cluster=%d\n", cl));
+			fmp->free_map[cl / NBITS] |= MAP_BIT(cl);
+			fmp->free_count--;
+			fmp->free_scan = cl;
 			*free = cl;
 			return 0;
 		}
-		if (++cl >= fmp->last_cluster)
-			cl = CL_FIRST;
+		cl++;
+		n++;
 	}
 	return ENOSPC;		/* no space */
 }
@@ -259,83 +306,244 @@ fat_free_clusters(struct fatfsmount *fmp, u_long start)
 			return error;
 		cl = next;
 	}
-	/* Clear eof */
-	error = fat_set_cluster(fmp, cl, CL_FREE);
-	if (error)
-		return error;
 	return 0;
 }
 
+/*
+ * Append the cluster to the extent map.
+ */
+static int
+fat_map_append(struct fat_extmap *em, u_long index, u_long cl)
+{
+	struct fat_extent *ext;
+	int size;
+
+	if (em->nexts > 0) {
+		ext = &em->ext[em->nexts - 1];
+		if (ext->index + ext->count == index &&
+		    ext->cluster + ext->count == cl) {
+			ext->count++;
+			return 0;
+		}
+	}
+	if (em->nexts == em->size) {
+		size = em->size ? em->size * 2 : NEXTENTS;
+		ext = malloc(size * sizeof(struct fat_extent));
+		if (ext == NULL)
+			return ENOMEM;
+		if (em->nexts > 0)
+			memcpy(ext, em->ext,
+			       em->nexts * sizeof(struct fat_extent));
+		free(em->ext);
+		em->ext = ext;
+		em->size = size;
+	}
+	ext = &em->ext[em->nexts++];
+	ext->index = index;
+	ext->cluster = cl;
+	ext->count = 1;
+	return 0;
+}
+
+/*
+ * Extend the extent map until it covers the cluster index,
+ * or the end of the chain.
+ */
+static int
+fat_map_extend(struct fatfsmount *fmp, struct fat_extmap *em,
+	       u_long start, u_long index)
+{
+	struct fat_extent *ext;
+	u_long cl, next;
+	int error;
+
+	if (em->nexts == 0) {
+		if (start < CL_FIRST || start >= fmp->last_cluster)
+			return EIO;
+		em->eof = 0;
+		if ((error = fat_map_append(em, 0, start)) != 0)
+			return error;
+	}
+	while (!em->eof) {
+		ext = &em->ext[em->nexts - 1];
+		if (ext->index + ext->count > index)
+			break;
+		cl = ext->cluster + ext->count - 1;
+		next = fat_get_entry(fmp, cl);
+		if (IS_EOFCL(fmp, next)) {
+			em->eof = 1;
+			break;
+		}
+		if (next < CL_FIRST || next >= fmp->last_cluster)
+			return EIO;	/* broken chain */
+		error = fat_map_append(em, ext->index + ext->count, next);
+		if (error)
+			return error;
+	}
+	return 0;
+}
+
+/*
+ * Get the number of clusters in the extent map.
+ */
+static u_long
+fat_map_count(struct fat_extmap *em)
+{
+	struct fat_extent *ext;
+
+	if (em->nexts == 0)
+		return 0;
+	ext = &em->ext[em->nexts - 1];
+	return ext->index + ext->count;
+}
+
 /*
  * Get the cluster# for the specific file offset.
  *
  * @fmp: fat mount data
+ * @em: extent map of file
  * @start: start cluster# of file.
  * @offset: file offset
  * @cl: cluster# to return
  */
 int
-fat_seek_cluster(struct fatfsmount *fmp, u_long start, u_long offset,
-		 u_long *cl)
+fat_seek_cluster(struct fatfsmount *fmp, struct fat_extmap *em,
+		 u_long start, u_long offset, u_long *cl)
 {
-	int error, i;
-	u_long c, target;
+	struct fat_extent *ext;
+	u_long target;
+	int lo, hi, mid, error;
 
-	if (start > fmp->last_cluster)
+	target = offset / fmp->cluster_size;
+	if ((error = fat_map_extend(fmp, em, start, target)) != 0)
+		return error;
+	if (target >= fat_map_count(em))
 		return EIO;
 
-	c = start;
-	target = offset / fmp->cluster_size;
-	for (i = 0; i < target; i++) {
-		error = fat_next_cluster(fmp, c, &c);
-		if (error)
-			return error;
-		if (IS_EOFCL(fmp, c))
-			return EIO;
+	/* Binary search of the run. */
+	lo = 0;
+	hi = em->nexts - 1;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (em->ext[mid].index <= target)
+			lo = mid;
+		else
+			hi = mid - 1;
 	}
-	*cl = c;
+	ext = &em->ext[lo];
+	*cl = ext->cluster + (target - ext->index);
 	return 0;
 }
 
+/*
+ * Get the number of clusters for the file size.
+ * A file has one cluster at least.
+ */
+static u_long
+fat_size_to_count(struct fatfsmount *fmp, u_long size)
+{
+	u_long count;
+
+	count = (size + fmp->cluster_size - 1) / fmp->cluster_size;
+	return count ? count : 1;
+}
+
 /*
  * Expand file size.
  *
  * @fmp: fat mount data
- * @cl: cluster# of target file.
+ * @em: extent map of file
+ * @start: start cluster# of file.
  * @size: new size of file in bytes.
  */
 int
-fat_expand_file(struct fatfsmount *fmp, u_long cl, int size)
+fat_expand_file(struct fatfsmount *fmp, struct fat_extmap *em,
+		u_long start, u_long size)
 {
-	int i, cl_len, alloc, error;
-	u_long next;
+	struct fat_extent *ext;
+	u_long cl, next, count, need;
+	int error;
 
-	alloc = 0;
-	cl_len = size / fmp->cluster_size + 1;
+	if ((error = fat_map_extend(fmp, em, start, (u_long)-1)) != 0)
+		return error;
 
-	for (i = 0; i < cl_len; i++) {
-		error = fat_next_cluster(fmp, cl, &next);
-		if (error)
+	count = fat_map_count(em);
+	need = fat_size_to_count(fmp, size);
+	ext = &em->ext[em->nexts - 1];
+	cl = ext->cluster + ext->count - 1;
+	while (count < need) {
+		/*
+		 * Terminate the new cluster before linking it, so
+		 * that the chain is valid even if we fail.
+		 */
+		if ((error = fat_alloc_cluster(fmp, cl, &next)) != 0)
+			return error;
+		if ((error = fat_set_cluster(fmp, next, fmp->fat_eof)) != 0) {
+			/* Release the cluster reserved in the bitmap. */
+			fmp->free_map[next / NBITS] &= ~MAP_BIT(next);
+			fmp->free_count++;
 			return error;
-		if (alloc || next >= fmp->fat_eof) {
-			error = fat_alloc_cluster(fmp, cl, &next);
-			if (error)
-				return error;
-			alloc = 1;
 		}
-		if (alloc) {
-			error = fat_set_cluster(fmp, cl, next);
-			if (error)
-				return error;
+		if ((error = fat_set_cluster(fmp, cl, next)) != 0) {
+			fat_set_cluster(fmp, next, CL_FREE);
+			return error;
+		}
+		if ((error = fat_map_append(em, count, next)) != 0) {
+			/* Rebuild the map later. */
+			free(em->ext);
+			memset(em, 0, sizeof(struct fat_extmap));
 		}
 		cl = next;
+		count++;
 	}
-	if (alloc)
-		fat_set_cluster(fmp, cl, fmp->fat_eof);	/* add eof */
 	DPRINTF(("fat_expand_file: new size=%d\n", size));
 	return 0;
 }
 
+/*
+ * Shrink file size, and free the clusters after the new end.
+ *
+ * @fmp: fat mount data
+ * @em: extent map of file
+ * @start: start cluster# of file.
+ * @size: new size of file in bytes.
+ */
+int
+fat_shrink_file(struct fatfsmount *fmp, struct fat_extmap *em,
+		u_long start, u_long size)
+{
+	struct fat_extent *ext;
+	u_long cl, next, count;
+	int error;
+
+	count = fat_size_to_count(fmp, size);
+	error = fat_seek_cluster(fmp, em, start,
+				 (count - 1) * fmp->cluster_size, &cl);
+	if (error)
+		return error;
+
+	next = fat_get_entry(fmp, cl);
+	if (!IS_EOFCL(fmp, next)) {
+		if ((error = fat_set_cluster(fmp, cl, fmp->fat_eof)) != 0)
+			return error;
+		if ((error = fat_free_clusters(fmp, next)) != 0)
+			return error;
+	}
+
+	/* Drop the runs after the new end. */
+	while (em->nexts > 0) {
+		ext = &em->ext[em->nexts - 1];
+		if (ext->index < count) {
+			if (ext->index + ext->count > count)
+				ext->count = count - ext->index;
+			break;
+		}
+		em->nexts--;
+	}
+	em->eof = 1;
+	return 0;
+}
+
 /*
  * Expand directory size.
  *
@@ -101,6 +101,7 @@ fat_read_bpb(struct fatfsmount *fmp)
 	fmp->last_cluster = (bpb->total_sectors - fmp->data_start) /
 		bpb->sectors_per_cluster + CL_FIRST;
 	fmp->free_scan = CL_FIRST;
+	fmp->fat_secs = bpb->sectors_per_fat;
 
 	if (!strncmp((const char *)bpb->file_sys_id, "FAT12   ", 8)) {
 		fmp->fat_type = 12;
@@ -154,21 +155,32 @@ fatfs_mount(mount_t mp, char *dev, int flags, void *data)
 	if (fmp->io_buf == NULL)
 		goto err1;
 
-	fmp->fat_buf = malloc(SEC_SIZE * 2);
-	if (fmp->fat_buf == NULL)
+	if ((error = fat_load(fmp)) != 0)
 		goto err2;
 
+	error = ENOMEM;
 	fmp->dir_buf = malloc(SEC_SIZE);
 	if (fmp->dir_buf == NULL)
 		goto err3;
 
+	fmp->ra_max = FAT_RASIZE / fmp->cluster_size;
+	if (fmp->ra_max == 0)
+		fmp->ra_max = 1;
+	fmp->ra_buf = malloc(fmp->ra_max * fmp->cluster_size);
+	if (fmp->ra_buf == NULL)
+		goto err4;
+	fmp->ra_start = 0;
+	fmp->ra_count = 0;
+
 	mutex_init(&fmp->lock);
 	mp->m_data = fmp;
 	vp = mp->m_root;
 	vp->v_blkno = CL_ROOT;
 	return 0;
+ err4:
+	free(fmp->dir_buf);
  err3:
-	free(fmp->fat_buf);
+	fat_unload(fmp);
  err2:
 	free(fmp->io_buf);
  err1:
@@ -185,8 +197,9 @@ fatfs_unmount(mount_t mp)
 	struct fatfsmount *fmp;
 
 	fmp = mp->m_data;
+	free(fmp->ra_buf);
 	free(fmp->dir_buf);
-	free(fmp->fat_buf);
+	fat_unload(fmp);
 	free(fmp->io_buf);
 	mutex_destroy(&fmp->lock);
 	free(fmp);
@@ -204,6 +217,7 @@ fatfs_vget(mount_t mp, vnode_t vp)
 	np = malloc(sizeof(struct fatfs_node));
 	if (np == NULL)
 		return ENOMEM;
+	memset(np, 0, sizeof(struct fatfs_node));
 	vp->v_data = np;
 	return 0;
 }
@@ -57,7 +57,7 @@ static int fatfs_read	(vnode_t, file_t, void *, size_t, size_t *);
 static int fatfs_write	(vnode_t, file_t, void *, size_t, size_t *);
 #define fatfs_seek	((vnop_seek_t)vop_nullop)
 #define fatfs_ioctl	((vnop_ioctl_t)vop_einval)
-#define fatfs_fsync	((vnop_fsync_t)vop_nullop)
+static int fatfs_fsync	(vnode_t, file_t);
 static int fatfs_readdir(vnode_t, file_t, struct dirent *);
 static int fatfs_lookup	(vnode_t, char *, vnode_t);
 static int fatfs_create	(vnode_t, char *, mode_t);
@@ -69,6 +69,7 @@ static int fatfs_getattr(vnode_t, struct vattr *);
 static int fatfs_setattr(vnode_t, struct vattr *);
 static int fatfs_inactive(vnode_t);
 static int fatfs_truncate(vnode_t, off_t);
+#define fatfs_poll	((vnop_poll_t)vop_seltrue)
 
 /*
  * vnode operations
@@ -92,6 +93,7 @@ struct vnops fatfs_vnops = {
 	fatfs_setattr,		/* setattr */
 	fatfs_inactive,		/* inactive */
 	fatfs_truncate,		/* truncate */
+	fatfs_poll,		/* poll */
 };
 
 /*
@@ -109,17 +111,120 @@ fat_read_cluster(struct fatfsmount *fmp, u_long cluster)
 }
 
 /*
- * Write one cluster from buffer.
+ * Read contiguous clusters to the specified buffer.
  */
 static int
-fat_write_cluster(struct fatfsmount *fmp, u_long cluster)
+fat_read_direct(struct fatfsmount *fmp, u_long cluster, u_long count,
+		void *buf)
 {
 	u_long sec;
 	size_t size;
 
 	sec = cl_to_sec(fmp, cluster);
-	size = fmp->sec_per_cl * SEC_SIZE;
-	return device_write(fmp->dev, fmp->io_buf, &size, sec);
+	size = count * fmp->sec_per_cl * SEC_SIZE;
+	return device_read(fmp->dev, buf, &size, sec);
+}
+
+/*
+ * Discard the read-ahead data if it has the clusters
+ * to be written.
+ */
+static void
+fat_ra_inval(struct fatfsmount *fmp, u_long cluster, u_long count)
+{
+
+	if (cluster < fmp->ra_start + fmp->ra_count &&
+	    cluster + count > fmp->ra_start)
+		fmp->ra_count = 0;
+}
+
+/*
+ * Write contiguous clusters from the specified buffer.
+ */
+static int
+fat_write_direct(struct fatfsmount *fmp, u_long cluster, u_long count,
+		 void *buf)
+{
+	u_long sec;
+	size_t size;
+
+	fat_ra_inval(fmp, cluster, count);
+	sec = cl_to_sec(fmp, cluster);
+	size = count * fmp->sec_per_cl * SEC_SIZE;
+	return device_write(fmp->dev, buf, &size, sec);
+}
+
+/*
+ * Write one cluster from buffer.
+ */
+static int
+fat_write_cluster(struct fatfsmount *fmp, u_long cluster)
+{
+
+	return fat_write_direct(fmp, cluster, 1, fmp->io_buf);
+}
+
+/*
+ * Count the clusters in the chain which are contiguous on disk.
+ * @cl:    first cluster#
+ * @max:   max number of clusters to count
+ * @count: number of contiguous clusters to return
+ * @next:  cluster# following the counted clusters to return
+ */
+static int
+fat_contig_clusters(struct fatfsmount *fmp, u_long cl, u_long max,
+		    u_long *count, u_long *next)
+{
+	u_long n, tmp;
+	int error;
+
+	n = 1;
+	for (;;) {
+		if ((error = fat_next_cluster(fmp, cl, &tmp)) != 0)
+			return error;
+		if (n >= max || tmp != cl + 1)
+			break;
+		cl = tmp;
+		n++;
+	}
+	*count = n;
+	*next = tmp;
+	return 0;
+}
+
+/*
+ * Get the data of the cluster through the read-ahead buffer.
+ *
+ * If the cluster is not in the buffer, it is read with up to
+ * @nra following clusters of the chain which are contiguous
+ * on disk, by one device read.
+ */
+static int
+fat_read_ahead(struct fatfsmount *fmp, u_long cl, u_long nra, char **data)
+{
+	u_long count, next;
+	int error;
+
+	if (cl >= fmp->ra_start && cl < fmp->ra_start + fmp->ra_count) {
+		*data = fmp->ra_buf + (cl - fmp->ra_start) * fmp->cluster_size;
+		return 0;
+	}
+
+	count = 1;
+	if (nra > 0) {
+		if (nra >= fmp->ra_max)
+			nra = fmp->ra_max - 1;
+		error = fat_contig_clusters(fmp, cl, nra + 1, &count, &next);
+		if (error)
+			return error;
+	}
+	fmp->ra_count = 0;
+	if ((error = fat_read_direct(fmp, cl, count, fmp->ra_buf)) != 0)
+		return error;
+	fmp->ra_start = cl;
+	fmp->ra_count = count;
+	*data = fmp->ra_buf;
+	return 0;
 }
 
 /*
@@ -165,8 +270,10 @@ static int
 fatfs_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 {
 	struct fatfsmount *fmp;
-	int nr_read, nr_copy, buf_pos, error;
-	u_long cl, file_pos;
+	struct fatfs_node *np;
+	int nr_read, nr_copy, buf_pos, nra, error;
+	u_long cl, next, count, file_pos;
+	char *data;
 
 	DPRINTF(("fatfs_read: vp=%x\n", vp));
 
@@ -190,25 +297,51 @@ fatfs_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 		size = vp->v_size - file_pos;
 
 	/* Seek to the cluster for the file offset */
-	error = fat_seek_cluster(fmp, vp->v_blkno, file_pos, &cl);
+	np = vp->v_data;
+	error = fat_seek_cluster(fmp, &np->extmap, vp->v_blkno, file_pos, &cl);
 	if (error)
 		goto out;
 
 	/* Read and copy data */
 	nr_read = 0;
 	buf_pos = file_pos % fmp->cluster_size;
+	nra = vn_readahead(vp, (int)(file_pos / fmp->cluster_size),
+	    (int)((buf_pos + size + fmp->cluster_size - 1) /
+		  fmp->cluster_size));
 	do {
-		if (fat_read_cluster(fmp, cl)) {
-			error = EIO;
-			goto out;
-		}
+		next = CL_EOF;
+		if (buf_pos == 0 && size >= fmp->cluster_size) {
+			/*
+			 * Read the whole clusters directly into the
+			 * caller's buffer. The clusters which are
+			 * contiguous on disk are read at once.
+			 */
+			error = fat_contig_clusters(fmp, cl,
+			    size / fmp->cluster_size, &count, &next);
+			if (error)
+				goto out;
+			if (fat_read_direct(fmp, cl, count, buf)) {
+				error = EIO;
+				goto out;
+			}
+			nr_copy = count * fmp->cluster_size;
+		} else {
+			/*
+			 * Read the partial cluster through the
+			 * read-ahead buffer.
+			 */
+			if (fat_read_ahead(fmp, cl, nra, &data)) {
+				error = EIO;
+				goto out;
+			}
 
-		nr_copy = fmp->cluster_size;
-		if (buf_pos > 0)
-			nr_copy -= buf_pos;
-		if (buf_pos + size < fmp->cluster_size)
-			nr_copy = size;
-		memcpy(buf, fmp->io_buf + buf_pos, nr_copy);
+			nr_copy = fmp->cluster_size;
+			if (buf_pos > 0)
+				nr_copy -= buf_pos;
+			if (buf_pos + size < fmp->cluster_size)
+				nr_copy = size;
+			memcpy(buf, data + buf_pos, nr_copy);
+		}
 
 		file_pos += nr_copy;
 		nr_read += nr_copy;
@@ -216,9 +349,13 @@ fatfs_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 		if (size <= 0)
 			break;
 
-		error = fat_next_cluster(fmp, cl, &cl);
-		if (error)
-			goto out;
+		if (next != CL_EOF)
+			cl = next;
+		else {
+			error = fat_next_cluster(fmp, cl, &cl);
+			if (error)
+				goto out;
+		}
 
 		buf = (void *)((u_long)buf + nr_copy);
 		buf_pos = 0;
@@ -238,9 +375,9 @@ fatfs_write(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 	struct fatfsmount *fmp;
 	struct fatfs_node *np;
 	struct fat_dirent *de;
-	int nr_copy, nr_write, buf_pos, i, cl_size, error;
+	int nr_copy, nr_write, buf_pos, error;
 	u_long file_pos, end_pos;
-	u_long cl;
+	u_long cl, next, count;
 
 	DPRINTF(("fatfs_write: vp=%x\n", vp));
 
@@ -260,14 +397,13 @@ fatfs_write(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 	if (file_pos + size > end_pos) {
 		/* Expand the file size before writing to it */
 		end_pos = file_pos + size;
-		error = fat_expand_file(fmp, vp->v_blkno, end_pos);
-		if (error) {
-			error = EIO;
+		np = vp->v_data;
+		error = fat_expand_file(fmp, &np->extmap, vp->v_blkno,
+					end_pos);
+		if (error)
 			goto out;
-		}
 
 		/* Update directory entry */
-		np = vp->v_data;
 		de = &np->dirent;
 		de->size = end_pos;
 		error = fatfs_put_node(fmp, np);
@@ -277,32 +413,47 @@ fatfs_write(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 	}
 
 	/* Seek to the cluster for the file offset */
-	error = fat_seek_cluster(fmp, vp->v_blkno, file_pos, &cl);
+	np = vp->v_data;
+	error = fat_seek_cluster(fmp, &np->extmap, vp->v_blkno, file_pos, &cl);
 	if (error)
 		goto out;
 
 	buf_pos = file_pos % fmp->cluster_size;
-	cl_size = size / fmp->cluster_size + 1;
 	nr_write = 0;
-	i = 0;
 	do {
-		/* First and last cluster must be read before write */
-		if (i == 0 || i == cl_size) {
+		next = CL_EOF;
+		if (buf_pos == 0 && size >= fmp->cluster_size) {
+			/*
+			 * Write the whole clusters directly from the
+			 * caller's buffer. The clusters which are
+			 * contiguous on disk are written at once.
+			 */
+			error = fat_contig_clusters(fmp, cl,
+			    size / fmp->cluster_size, &count, &next);
+			if (error)
+				goto out;
+			if (fat_write_direct(fmp, cl, count, buf)) {
+				error = EIO;
+				goto out;
+			}
+			nr_copy = count * fmp->cluster_size;
+		} else {
+			/* Partial cluster must be read before write */
 			if (fat_read_cluster(fmp, cl)) {
 				error = EIO;
 				goto out;
 			}
-		}
-		nr_copy = fmp->cluster_size;
-		if (buf_pos > 0)
-			nr_copy -= buf_pos;
-		if (buf_pos + size < fmp->cluster_size)
-			nr_copy = size;
-		memcpy(fmp->io_buf + buf_pos, buf, nr_copy);
-
-		if (fat_write_cluster(fmp, cl)) {
-			error = EIO;
-			goto out;
+			nr_copy = fmp->cluster_size;
+			if (buf_pos > 0)
+				nr_copy -= buf_pos;
+			if (buf_pos + size < fmp->cluster_size)
+				nr_copy = size;
+			memcpy(fmp->io_buf + buf_pos, buf, nr_copy);
+
+			if (fat_write_cluster(fmp, cl)) {
+				error = EIO;
+				goto out;
+			}
 		}
 		file_pos += nr_copy;
 		nr_write += nr_copy;
@@ -310,13 +461,16 @@ fatfs_write(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 		if (size <= 0)
 			break;
 
-		error = fat_next_cluster(fmp, cl, &cl);
-		if (error)
-			goto out;
+		if (next != CL_EOF)
+			cl = next;
+		else {
+			error = fat_next_cluster(fmp, cl, &cl);
+			if (error)
+				goto out;
+		}
 
 		buf = (void *)((u_long)buf + nr_copy);
 		buf_pos = 0;
-		i++;
 	} while (!IS_EOFCL(fmp, cl));
 
 	fp->f_offset = file_pos;
@@ -335,6 +489,17 @@ fatfs_write(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 	return error;
 }
 
+/*
+ * Write the delayed FAT sectors to the device.
+ */
+static int
+fatfs_fsync(vnode_t vp, file_t fp)
+{
+
+	bio_sync();
+	return 0;
+}
+
 static int
 fatfs_readdir(vnode_t vp, file_t fp, struct dirent *dir)
 {
@@ -669,8 +834,11 @@ fatfs_setattr(vnode_t vp, struct vattr *vap)
 static int
 fatfs_inactive(vnode_t vp)
 {
+	struct fatfs_node *np;
 
-	free(vp->v_data);
+	np = vp->v_data;
+	free(np->extmap.ext);
+	free(np);
 	return 0;
 }
 
@@ -688,17 +856,19 @@ fatfs_truncate(vnode_t vp, off_t length)
 	np = vp->v_data;
 	de = &np->dirent;
 
-	if (length == 0) {
-		/* Remove clusters */
-		error = fat_free_clusters(fmp, de->cluster);
+	if (length < vp->v_size) {
+		/*
+		 * Free the clusters after the new end. The first
+		 * cluster is kept, since the directory entry still
+		 * points to it.
+		 */
+		error = fat_shrink_file(fmp, &np->extmap, vp->v_blkno, length);
 		if (error)
 			goto out;
 	} else if (length > vp->v_size) {
-		error = fat_expand_file(fmp, vp->v_blkno, length);
-		if (error) {
-			error = EIO;
+		error = fat_expand_file(fmp, &np->extmap, vp->v_blkno, length);
+		if (error)
 			goto out;
-		}
 	}
 
 	/* Update directory entry */
@@ -39,6 +39,7 @@
 #include <sys/syslog.h>
 #include <sys/dirent.h>
 #include <sys/list.h>
+#include <sys/poll.h>
 
 #include <ctype.h>
 #include <unistd.h>
@@ -89,6 +90,7 @@ static int fifo_remove	(vnode_t, vnode_t, char *);
 #define fifo_setattr	((vnop_setattr_t)vop_nullop)
 #define fifo_inactive	((vnop_inactive_t)vop_nullop)
 #define fifo_truncate	((vnop_truncate_t)vop_nullop)
+static int fifo_poll	(vnode_t, file_t, int);
 
 static void cleanup_fifo(vnode_t);
 static void wait_reader(vnode_t);
@@ -124,6 +126,7 @@ struct vnops fifofs_vnops = {
 	fifo_setattr,		/* setattr */
 	fifo_inactive,		/* inactive */
 	fifo_truncate,		/* truncate */
+	fifo_poll,		/* poll */
 };
 
 /*
@@ -313,6 +316,35 @@ fifo_ioctl(vnode_t vp, file_t fp, u_long cmd, void *arg)
 	return EINVAL;
 }
 
+/*
+ * Return the events which are ready now. The reader side gets
+ * POLLHUP when there is no data and no writer, and the writer
+ * side gets POLLERR when there is no reader.
+ */
+static int
+fifo_poll(vnode_t vp, file_t fp, int events)
+{
+	struct fifo_node *np = vp->v_data;
+	int revents = 0;
+
+	if (np == NULL)
+		return POLLERR;
+
+	if (fp->f_flags & FREAD) {
+		if (np->fn_size > 0)
+			revents |= (events & POLLIN);
+		else if (np->fn_writers == 0)
+			revents |= POLLHUP;
+	}
+	if (fp->f_flags & FWRITE) {
+		if (np->fn_readers == 0)
+			revents |= POLLERR;
+		else if (np->fn_size < PIPE_BUF)
+			revents |= (events & POLLOUT);
+	}
+	return revents;
+}
+
 static int
 fifo_lookup(vnode_t dvp, char *name, vnode_t vp)
 {
@@ -490,6 +522,7 @@ wakeup_writer(vnode_t vp)
 
 	DPRINTF(("wakeup_writer: %x\n", np));
 	cond_broadcast(&np->fn_rcond);
+	vn_pollwakeup(vp);
 }
 
 static void
@@ -512,4 +545,5 @@ wakeup_reader(vnode_t vp)
 
 	DPRINTF(("wakeup_reader: %x\n", np));
 	cond_broadcast(&np->fn_wcond);
+	vn_pollwakeup(vp);
 }
@@ -33,6 +33,7 @@
 #include <sys/cdefs.h>
 #include <sys/prex.h>
 #include <sys/types.h>
+#include <sys/list.h>
 
 /* #define DEBUG_RAMFS 1 */
 
@@ -55,18 +56,32 @@
 #define mutex_trylock(m)	do {} while (0)
 #endif
 
+/*
+ * File data is kept in pages indexed by a radix tree. Each tree
+ * node has RADIX_SIZE slots, and the leaf slots point to the
+ * pages. A page which has never been written is a hole, and is
+ * read as zero.
+ */
+#define RADIX_SHIFT	8
+#define RADIX_SIZE	(1 << RADIX_SHIFT)
+#define RADIX_MASK	(RADIX_SIZE - 1)
+
 /*
  * File/directory node for RAMFS
  */
 struct ramfs_node {
-	struct	ramfs_node *rn_next;   /* next node in the same directory */
-	struct	ramfs_node *rn_child;  /* first child node */
+	struct	list rn_link;	/* link in the parent directory */
+	struct	list rn_hash;	/* link in the name hash chain */
+	struct	list rn_child;	/* list head of child nodes */
+	struct	ramfs_node *rn_parent; /* parent directory */
 	int	 rn_type;	/* file or directory */
 	char	*rn_name;	/* name (null-terminated) */
 	size_t	 rn_namelen;	/* length of name not including terminator */
 	size_t	 rn_size;	/* file size */
-	char	*rn_buf;	/* buffer to the file data */
-	size_t	 rn_bufsize;	/* allocated buffer size */
+	void	*rn_pages;	/* root of the page tree */
+	int	 rn_height;	/* height of the page tree */
+	struct	ramfs_node *rn_dircur; /* readdir cursor */
+	off_t	 rn_diroff;	/* directory offset of the cursor */
 };
 
 __BEGIN_DECLS
@@ -65,6 +65,7 @@ static int ramfs_rmdir	(vnode_t, vnode_t, char *);
 #define ramfs_setattr	((vnop_setattr_t)vop_nullop)
 #define ramfs_inactive	((vnop_inactive_t)vop_nullop)
 static int ramfs_truncate(vnode_t, off_t);
+#define ramfs_poll	((vnop_poll_t)vop_seltrue)
 
 
 #if CONFIG_FS_THREADS > 1
@@ -93,8 +94,29 @@ struct vnops ramfs_vnops = {
 	ramfs_setattr,		/* setattr */
 	ramfs_inactive,		/* inactive */
 	ramfs_truncate,		/* truncate */
+	ramfs_poll,		/* poll */
 };
 
+#define RAMFS_BUCKETS	256		/* size of name hash table */
+
+/*
+ * Hash table of all nodes, keyed by the parent and the name.
+ */
+static struct list ramfs_table[RAMFS_BUCKETS];
+
+/*
+ * Get the hash value from the directory node and the name.
+ */
+static u_int
+ramfs_hash(struct ramfs_node *dnp, char *name, size_t len)
+{
+	u_int val = 0;
+
+	while (len-- > 0)
+		val = ((val << 5) + val) + *name++;
+	return (val ^ (u_int)dnp) & (RAMFS_BUCKETS - 1);
+}
+
 struct ramfs_node *
 ramfs_allocate_node(char *name, int type)
 {
@@ -113,37 +135,163 @@ ramfs_allocate_node(char *name, int type)
 	}
 	strlcpy(np->rn_name, name, np->rn_namelen + 1);
 	np->rn_type = type;
+	list_init(&np->rn_child);
 	return np;
 }
 
+/*
+ * Free the pages from the specified page index to the end of
+ * the subtree. Only the populated slots are visited. The tree
+ * node is freed when it becomes empty.
+ */
+static void
+ramfs_trim_pages(void **slot, int level, u_long base, u_long from)
+{
+	void **node;
+	u_long span;
+	int i, empty;
+
+	if (level == 0) {
+		if (base >= from) {
+			vm_free(task_self(), *slot);
+			*slot = NULL;
+		}
+		return;
+	}
+	node = *slot;
+	span = 1UL << (RADIX_SHIFT * (level - 1));
+	empty = 1;
+	for (i = 0; i < RADIX_SIZE; i++) {
+		if (node[i] == NULL)
+			continue;
+		if (base + (i + 1) * span > from)
+			ramfs_trim_pages(&node[i], level - 1,
+					 base + i * span, from);
+		if (node[i] != NULL)
+			empty = 0;
+	}
+	if (empty) {
+		free(node);
+		*slot = NULL;
+	}
+}
+
+/*
+ * Free the pages of the file from the specified page index.
+ */
+static void
+ramfs_free_pages(struct ramfs_node *np, u_long from)
+{
+
+	if (np->rn_pages != NULL)
+		ramfs_trim_pages(&np->rn_pages, np->rn_height, 0, from);
+	if (np->rn_pages == NULL)
+		np->rn_height = 0;
+}
+
+/*
+ * Get the page for the page index of the file.
+ * If alloc is false, NULL is returned for a hole.
+ */
+static int
+ramfs_get_page(struct ramfs_node *np, u_long index, int alloc, char **page)
+{
+	void **node, **slot;
+	int level;
+
+	*page = NULL;
+
+	/* Grow the tree until it covers the index. */
+	while (np->rn_height == 0 ||
+	       (index >> (RADIX_SHIFT * np->rn_height)) != 0) {
+		if (!alloc)
+			return 0;
+		if (np->rn_pages != NULL) {
+			node = malloc(RADIX_SIZE * sizeof(void *));
+			if (node == NULL)
+				return ENOMEM;
+			memset(node, 0, RADIX_SIZE * sizeof(void *));
+			node[0] = np->rn_pages;
+			np->rn_pages = node;
+		}
+		np->rn_height++;
+	}
+
+	slot = &np->rn_pages;
+	for (level = np->rn_height; level > 0; level--) {
+		if (*slot == NULL) {
+			if (!alloc)
+				return 0;
+			node = malloc(RADIX_SIZE * sizeof(void *));
+			if (node == NULL)
+				return ENOMEM;
+			memset(node, 0, RADIX_SIZE * sizeof(void *));
+			*slot = node;
+		}
+		node = *slot;
+		slot = &node[(index >> (RADIX_SHIFT * (level - 1))) &
+			     RADIX_MASK];
+	}
+	if (*slot == NULL && alloc) {
+		/* The new page is filled with zero by the kernel. */
+		if (vm_allocate(task_self(), slot, PAGE_SIZE, 1))
+			return ENOMEM;
+	}
+	*page = *slot;
+	return 0;
+}
+
 void
 ramfs_free_node(struct ramfs_node *np)
 {
 
+	ramfs_free_pages(np, 0);
 	free(np->rn_name);
 	free(np);
 }
 
+/*
+ * Link the node to the directory.
+ * Must be called with ramfs_lock held.
+ */
+static void
+ramfs_link_node(struct ramfs_node *dnp, struct ramfs_node *np)
+{
+
+	np->rn_parent = dnp;
+	list_insert(list_last(&dnp->rn_child), &np->rn_link);
+	list_insert(&ramfs_table[ramfs_hash(dnp, np->rn_name,
+					    np->rn_namelen)], &np->rn_hash);
+}
+
+/*
+ * Unlink the node from its directory.
+ * Must be called with ramfs_lock held.
+ */
+static void
+ramfs_unlink_node(struct ramfs_node *np)
+{
+	struct ramfs_node *dnp;
+
+	dnp = np->rn_parent;
+	if (dnp->rn_dircur == np)
+		dnp->rn_dircur = NULL;	/* invalidate readdir cursor */
+	list_remove(&np->rn_link);
+	list_remove(&np->rn_hash);
+	np->rn_parent = NULL;
+}
+
 static struct ramfs_node *
 ramfs_add_node(struct ramfs_node *dnp, char *name, int type)
 {
-	struct ramfs_node *np, *prev;
+	struct ramfs_node *np;
 
 	np = ramfs_allocate_node(name, type);
 	if (np == NULL)
 		return NULL;
 
 	mutex_lock(&ramfs_lock);
-
-	/* Link to the directory list */
-	if (dnp->rn_child == NULL) {
-		dnp->rn_child = np;
-	} else {
-		prev = dnp->rn_child;
-		while (prev->rn_next != NULL)
-			prev = prev->rn_next;
-		prev->rn_next = np;
-	}
+	ramfs_link_node(dnp, np);
 	mutex_unlock(&ramfs_lock);
 	return np;
 }
@@ -151,28 +299,13 @@ ramfs_add_node(struct ramfs_node *dnp, char *name, int type)
 static int
 ramfs_remove_node(struct ramfs_node *dnp, struct ramfs_node *np)
 {
-	struct ramfs_node *prev;
 
-	if (dnp->rn_child == NULL)
-		return EBUSY;
+	if (np->rn_parent != dnp)
+		return ENOENT;
 
 	mutex_lock(&ramfs_lock);
-
-	/* Unlink from the directory list */
-	if (dnp->rn_child == np) {
-		dnp->rn_child = np->rn_next;
-	} else {
-		for (prev = dnp->rn_child; prev->rn_next != np;
-		     prev = prev->rn_next) {
-			if (prev->rn_next == NULL) {
-				mutex_unlock(&ramfs_lock);
-				return ENOENT;
-			}
-		}
-		prev->rn_next = np->rn_next;
-	}
+	ramfs_unlink_node(np);
 	ramfs_free_node(np);
-
 	mutex_unlock(&ramfs_lock);
 	return 0;
 }
@@ -186,7 +319,7 @@ ramfs_rename_node(struct ramfs_node *np, char *name)
 	len = strlen(name);
 	if (len <= np->rn_namelen) {
 		/* Reuse current name buffer */
-		strlcpy(np->rn_name, name, sizeof(np->rn_name));
+		strlcpy(np->rn_name, name, np->rn_namelen + 1);
 	} else {
 		/* Expand name buffer */
 		tmp = malloc(len + 1);
@@ -204,6 +337,7 @@ static int
 ramfs_lookup(vnode_t dvp, char *name, vnode_t vp)
 {
 	struct ramfs_node *np, *dnp;
+	struct list *head, *n;
 	size_t len;
 	int found;
 
@@ -215,8 +349,10 @@ ramfs_lookup(vnode_t dvp, char *name, vnode_t vp)
 	len = strlen(name);
 	dnp = dvp->v_data;
 	found = 0;
-	for (np = dnp->rn_child; np != NULL; np = np->rn_next) {
-		if (np->rn_namelen == len &&
+	head = &ramfs_table[ramfs_hash(dnp, name, len)];
+	for (n = list_first(head); n != head; n = list_next(n)) {
+		np = list_entry(n, struct ramfs_node, rn_hash);
+		if (np->rn_parent == dnp && np->rn_namelen == len &&
 		    memcmp(name, np->rn_name, len) == 0) {
 			found = 1;
 			break;
@@ -263,49 +399,36 @@ ramfs_rmdir(vnode_t dvp, vnode_t vp, char *name)
 static int
 ramfs_remove(vnode_t dvp, vnode_t vp, char *name)
 {
-	struct ramfs_node *np;
-	int error;
 
 	DPRINTF(("remove %s in %s\n", name, dvp->v_path));
-	error = ramfs_remove_node(dvp->v_data, vp->v_data);
-	if (error)
-		return error;
-
-	np = vp->v_data;
-	if (np->rn_buf != NULL)
-		vm_free(task_self(), np->rn_buf);
-	return 0;
+	return ramfs_remove_node(dvp->v_data, vp->v_data);
 }
 
-/* Truncate file */
+/*
+ * Truncate file.
+ * Growing the file makes a hole. Shrinking it frees the pages
+ * after the new end, and clears the rest of the last page so
+ * that it is read as zero if the file grows again.
+ */
 static int
 ramfs_truncate(vnode_t vp, off_t length)
 {
 	struct ramfs_node *np;
-	void *new_buf;
-	size_t new_size;
-	task_t task;
+	char *page;
+	size_t off;
 
 	DPRINTF(("truncate %s length=%d\n", vp->v_path, length));
 	np = vp->v_data;
 
-	if (length == 0) {
-		if (np->rn_buf != NULL) {
-			vm_free(task_self(), np->rn_buf);
-			np->rn_buf = NULL;
-			np->rn_bufsize = 0;
-		}
-	} else if (length > np->rn_bufsize) {
-		task = task_self();
-		new_size = round_page(length);
-		if (vm_allocate(task, &new_buf, new_size, 1))
-			return EIO;
-		if (np->rn_size != 0) {
-			memcpy(new_buf, np->rn_buf, vp->v_size);
-			vm_free(task, np->rn_buf);
+	if ((size_t)length < np->rn_size) {
+		ramfs_free_pages(np, round_page(length) / PAGE_SIZE);
+		off = (size_t)length & PAGE_MASK;
+		if (off != 0) {
+			ramfs_get_page(np, (u_long)length / PAGE_SIZE, 0,
+				       &page);
+			if (page != NULL)
+				memset(page + off, 0, PAGE_SIZE - off);
 		}
-		np->rn_buf = new_buf;
-		np->rn_bufsize = new_size;
 	}
 	np->rn_size = length;
 	vp->v_size = length;
@@ -335,6 +458,8 @@ ramfs_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 {
 	struct ramfs_node *np;
 	off_t off;
+	size_t pos, len;
+	char *page;
 
 	*result = 0;
 	if (vp->v_type == VDIR)
@@ -350,7 +475,17 @@ ramfs_read(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 		size = vp->v_size - off;
 
 	np = vp->v_data;
-	memcpy(buf, np->rn_buf + off, size);
+	for (pos = 0; pos < size; pos += len) {
+		len = PAGE_SIZE - ((off + pos) & PAGE_MASK);
+		if (len > size - pos)
+			len = size - pos;
+		ramfs_get_page(np, (off + pos) / PAGE_SIZE, 0, &page);
+		if (page == NULL)
+			memset((char *)buf + pos, 0, len);	/* hole */
+		else
+			memcpy((char *)buf + pos,
+			       page + ((off + pos) & PAGE_MASK), len);
+	}
 
 	fp->f_offset += size;
 	*result = size;
@@ -361,10 +496,10 @@ static int
 ramfs_write(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 {
 	struct ramfs_node *np;
-	off_t file_pos, end_pos;
-	void *new_buf;
-	size_t new_size;
-	task_t task;
+	off_t file_pos;
+	size_t pos, len;
+	char *page;
+	int error;
 
 	*result = 0;
 	if (vp->v_type == VDIR)
@@ -373,37 +508,33 @@ ramfs_write(vnode_t vp, file_t fp, void *buf, size_t size, size_t *result)
 		return EINVAL;
 
 	np = vp->v_data;
-	/* Check if the file position exceeds the end of file. */
-	end_pos = vp->v_size;
-	file_pos = (fp->f_flags & O_APPEND) ? end_pos : fp->f_offset;
-	if (file_pos + size > (size_t)end_pos) {
-		/* Expand the file size before writing to it */
-		end_pos = file_pos + size;
-		if (end_pos > (off_t)np->rn_bufsize) {
-			task = task_self();
-			/*
-			 * We allocate the data buffer in page boundary.
-			 * So that we can reduce the memory allocation unless
-			 * the file size exceeds next page boundary.
-			 * This will prevent the memory fragmentation by
-			 * many malloc/free calls.
-			 */
-			new_size = round_page(end_pos);
-			if (vm_allocate(task, &new_buf, new_size, 1))
-				return EIO;
-			if (np->rn_size != 0) {
-				memcpy(new_buf, np->rn_buf, vp->v_size);
-				vm_free(task, np->rn_buf);
-			}
-			np->rn_buf = new_buf;
-			np->rn_bufsize = new_size;
-		}
-		np->rn_size = end_pos;
-		vp->v_size = end_pos;
+	file_pos = (fp->f_flags & O_APPEND) ? (off_t)vp->v_size : fp->f_offset;
+
+	/*
+	 * Only the pages written are allocated. The space between
+	 * the old end of file and the file position is left as a hole.
+	 */
+	error = 0;
+	for (pos = 0; pos < size; pos += len) {
+		len = PAGE_SIZE - ((file_pos + pos) & PAGE_MASK);
+		if (len > size - pos)
+			len = size - pos;
+		error = ramfs_get_page(np, (file_pos + pos) / PAGE_SIZE, 1,
+				       &page);
+		if (error)
+			break;
+		memcpy(page + ((file_pos + pos) & PAGE_MASK),
+		       (char *)buf + pos, len);
 	}
-	memcpy(np->rn_buf + file_pos, buf, size);
-	fp->f_offset += size;
-	*result = size;
+	if (pos == 0 && size != 0)
+		return error;
+
+	if (file_pos + pos > np->rn_size) {
+		np->rn_size = file_pos + pos;
+		vp->v_size = np->rn_size;
+	}
+	fp->f_offset = file_pos + pos;
+	*result = pos;
 	return 0;
 }
 
@@ -411,7 +542,7 @@ static int
 ramfs_rename(vnode_t dvp1, vnode_t vp1, char *name1,
 	     vnode_t dvp2, vnode_t vp2, char *name2)
 {
-	struct ramfs_node *np, *old_np;
+	struct ramfs_node *np;
 	int error;
 
 	if (vp2) {
@@ -420,39 +551,37 @@ ramfs_rename(vnode_t dvp1, vnode_t vp1, char *name1,
 		if (error)
 			return error;
 	}
-	/* Same directory ? */
-	if (dvp1 == dvp2) {
-		/* Change the name of existing file */
-		error = ramfs_rename_node(vp1->v_data, name2);
-		if (error)
-			return error;
-	} else {
-		/* Create new file or directory */
-		old_np = vp1->v_data;
-		np = ramfs_add_node(dvp2->v_data, name2, VREG);
-		if (np == NULL)
-			return ENOMEM;
 
-		if (vp1->v_type == VREG) {
-			/* Copy file data */
-			np->rn_buf = old_np->rn_buf;
-			np->rn_size = old_np->rn_size;
-			np->rn_bufsize = old_np->rn_bufsize;
-		}
-		/* Remove source file */
-		ramfs_remove_node(dvp1->v_data, vp1->v_data);
+	/*
+	 * Move the node to the new name. The file data and the
+	 * children of a directory stay with the node.
+	 */
+	np = vp1->v_data;
+	mutex_lock(&ramfs_lock);
+	ramfs_unlink_node(np);
+	error = ramfs_rename_node(np, name2);
+	if (error) {
+		ramfs_link_node(dvp1->v_data, np);
+		mutex_unlock(&ramfs_lock);
+		return error;
 	}
+	ramfs_link_node(dvp2->v_data, np);
+	mutex_unlock(&ramfs_lock);
 	return 0;
 }
 
 /*
  * @vp: vnode of the directory.
+ *
+ * The directory keeps the node and the offset returned last, so
+ * that reading the directory in order does not rescan the list.
  */
 static int
 ramfs_readdir(vnode_t vp, file_t fp, struct dirent *dir)
 {
 	struct ramfs_node *np, *dnp;
-	int i;
+	struct list *n;
+	off_t i;
 
 	mutex_lock(&ramfs_lock);
 
@@ -464,19 +593,27 @@ ramfs_readdir(vnode_t vp, file_t fp, struct dirent *dir)
 		strlcpy((char *)&dir->d_name, "..", sizeof(dir->d_name));
 	} else {
 		dnp = vp->v_data;
-		np = dnp->rn_child;
-		if (np == NULL) {
+		if (dnp->rn_dircur != NULL &&
+		    dnp->rn_diroff <= fp->f_offset) {
+			n = &dnp->rn_dircur->rn_link;
+			i = dnp->rn_diroff;
+		} else {
+			n = list_first(&dnp->rn_child);
+			i = 2;
+		}
+		for (; i != fp->f_offset; i++) {
+			if (n == &dnp->rn_child)
+				break;
+			n = list_next(n);
+		}
+		if (n == &dnp->rn_child) {
 			mutex_unlock(&ramfs_lock);
 			return ENOENT;
 		}
+		np = list_entry(n, struct ramfs_node, rn_link);
+		dnp->rn_dircur = np;
+		dnp->rn_diroff = fp->f_offset;
 
-		for (i = 0; i != (fp->f_offset - 2); i++) {
-			np = np->rn_next;
-			if (np == NULL) {
-				mutex_unlock(&ramfs_lock);
-				return ENOENT;
-			}
-		}
 		if (np->rn_type == VDIR)
 			dir->d_type = DT_DIR;
 		else
@@ -496,5 +633,9 @@ ramfs_readdir(vnode_t vp, file_t fp, struct dirent *dir)
 int
 ramfs_init(void)
 {
+	int i;
+
+	for (i = 0; i < RAMFS_BUCKETS; i++)
+		list_init(&ramfs_table[i]);
 	return 0;
 }
@@ -178,6 +178,7 @@ fs_close(struct task *t, struct msg *msg)
 
 	t->t_ofile[fd] = NULL;
 	t->t_nopens--;
+	poll_fdclose(t, fd);
 	return 0;
 }
 
@@ -210,23 +211,83 @@ fs_lseek(struct task *t, struct msg *msg)
 	return error;
 }
 
+static void	io_release(struct task *);
+
+/*
+ * Get the address of the client buffer in our space.
+ *
+ * If the buffer is in the I/O region registered by the
+ * client, the address is computed from its offset. The pages
+ * are checked against the current map of the client, and the
+ * region is released if the client has freed or remapped it.
+ * Otherwise, the buffer is mapped for this request.
+ */
+static int
+io_getbuf(struct task *t, struct io_msg *msg, void **buf)
+{
+	size_t offset;
+	char *map;
+
+	if (t->t_iomap != NULL && msg->buf >= t->t_iobuf) {
+		offset = (size_t)(msg->buf - t->t_iobuf);
+		if (offset < t->t_iosize &&
+		    msg->size <= t->t_iosize - offset) {
+			map = t->t_iomap + offset;
+			if (msg->size == 0 ||
+			    vm_check(msg->hdr.task, msg->buf, msg->size,
+				     map) == 0) {
+				*buf = map;
+				return 0;
+			}
+			DPRINTF(VFSDB_CORE, ("fs: stale I/O region\n"));
+			io_release(t);
+		}
+	}
+	if (vm_map(msg->hdr.task, msg->buf, msg->size, buf) != 0)
+		return EFAULT;
+	return 0;
+}
+
+static void
+io_putbuf(struct task *t, void *buf)
+{
+
+	if (t->t_iomap != NULL && (char *)buf >= t->t_iomap &&
+	    (char *)buf < t->t_iomap + t->t_iosize)
+		return;
+	vm_free(task_self(), buf);
+}
+
+/*
+ * Release the I/O region of the task.
+ */
+static void
+io_release(struct task *t)
+{
+
+	if (t->t_iomap != NULL)
+		vm_free(task_self(), t->t_iomap);
+	t->t_iobuf = NULL;
+	t->t_iomap = NULL;
+	t->t_iosize = 0;
+}
+
 static int
 fs_read(struct task *t, struct io_msg *msg)
 {
 	file_t fp;
 	void *buf;
-	size_t size, bytes;
+	size_t bytes;
 	int error;
 
 	if ((fp = task_getfp(t, msg->fd)) == NULL)
 		return EBADF;
-	size = msg->size;
-	if ((error = vm_map(msg->hdr.task, msg->buf, size, &buf)) != 0)
-		return EFAULT;
+	if ((error = io_getbuf(t, msg, &buf)) != 0)
+		return error;
 
-	error = sys_read(fp, buf, size, &bytes);
+	error = sys_read(fp, buf, msg->size, &bytes);
 	msg->size = bytes;
-	vm_free(task_self(), buf);
+	io_putbuf(t, buf);
 	return error;
 }
 
@@ -235,21 +296,47 @@ fs_write(struct task *t, struct io_msg *msg)
 {
 	file_t fp;
 	void *buf;
-	size_t size, bytes;
+	size_t bytes;
 	int error;
 
 	if ((fp = task_getfp(t, msg->fd)) == NULL)
 		return EBADF;
-	size = msg->size;
-	if ((error = vm_map(msg->hdr.task, msg->buf, size, &buf)) != 0)
-		return EFAULT;
+	if ((error = io_getbuf(t, msg, &buf)) != 0)
+		return error;
 
-	error = sys_write(fp, buf, size, &bytes);
+	error = sys_write(fp, buf, msg->size, &bytes);
 	msg->size = bytes;
-	vm_free(task_self(), buf);
+	io_putbuf(t, buf);
 	return error;
 }
 
+/*
+ * Register the I/O region of the client.
+ *
+ * The region is mapped to our space once, and the read/write
+ * requests for the buffer in it do not have to map it every
+ * time. The mapping holds the pages of the client, so each
+ * request checks them with vm_check() and the stale region is
+ * dropped. The region is released by the request with zero
+ * size, or when the task forks, execs or exits.
+ */
+static int
+fs_ioregion(struct task *t, struct io_msg *msg)
+{
+	void *map;
+
+	io_release(t);
+	if (msg->size == 0)
+		return 0;
+	if (vm_map(msg->hdr.task, msg->buf, msg->size, &map) != 0)
+		return EFAULT;
+
+	t->t_iobuf = msg->buf;
+	t->t_iomap = map;
+	t->t_iosize = msg->size;
+	return 0;
+}
+
 static int
 fs_ioctl(struct task *t, struct ioctl_msg *msg)
 {
@@ -325,6 +412,7 @@ fs_closedir(struct task *t, struct msg *msg)
 	if ((error = sys_closedir(fp)) != 0)
 		return error;
 	t->t_ofile[fd] = NULL;
+	poll_fdclose(t, fd);
 	return 0;
 }
 
@@ -557,6 +645,8 @@ fs_dup2(struct task *t, struct msg *msg)
 		error = sys_close(org);
 	}
 	t->t_ofile[new_fd] = fp;
+	if (org != NULL)
+		poll_fdclose(t, new_fd);
 
 	/* Increment file reference */
 	vref(fp->f_vnode);
@@ -649,6 +739,12 @@ fs_fork(struct task *t, struct msg *msg)
 	if ((error = task_alloc((task_t)msg->data[0], &newtask)) != 0)
 		return error;
 
+	/*
+	 * The pages of the I/O region are copied on write
+	 * after fork. So, it is not valid for the parent.
+	 */
+	io_release(t);
+
 	/*
 	 * Copy task related data
 	 */
@@ -697,6 +793,8 @@ fs_exec(struct task *t, struct msg *msg)
 
 	/* Update task id in the task. */
 	task_setid(target, new_id);
+	io_release(target);
+	poll_cleanup(target);
 
 	/* Close all directory descriptor */
 	for (fd = 0; fd < OPEN_MAX; fd++) {
@@ -725,6 +823,8 @@ fs_exit(struct task *t, struct msg *msg)
 
 	DPRINTF(VFSDB_CORE, ("fs_exit\n"));
 
+	poll_cleanup(t);
+
 	/*
 	 * Close all files opened by task.
 	 */
@@ -735,6 +835,7 @@ fs_exit(struct task *t, struct msg *msg)
 	}
 	if (t->t_cwdfp)
 		sys_close(t->t_cwdfp);
+	io_release(t);
 	task_free(t);
 	return 0;
 }
@@ -841,6 +942,58 @@ fs_ftruncate(struct task *t, struct msg *msg)
 	return sys_ftruncate(fp, msg->data[1]);
 }
 
+/*
+ * Get the events of the files. The client waits on its
+ * semaphore, and we never block here.
+ */
+static int
+fs_poll(struct task *t, struct poll_msg *msg)
+{
+
+	if (msg->nfds < 0 || msg->nfds > OPEN_MAX)
+		return EINVAL;
+
+	return sys_poll(t, msg->sem, msg->fds, msg->nfds, &msg->nready);
+}
+
+/*
+ * Change the epoll set of the task.
+ */
+static int
+fs_epoll_ctl(struct task *t, struct epoll_msg *msg)
+{
+
+	if (msg->sem == 0)
+		return EINVAL;
+
+	return sys_epoll_ctl(t, msg->sem, msg->op, msg->fd, &msg->event);
+}
+
+/*
+ * Get the ready events of the epoll set.
+ */
+static int
+fs_epoll_wait(struct task *t, struct epoll_msg *msg)
+{
+
+	if (msg->sem == 0 || msg->maxevents > OPEN_MAX)
+		return EINVAL;
+
+	return sys_epoll_wait(t, msg->sem, msg->events, msg->maxevents,
+			      &msg->nready);
+}
+
+/*
+ * Get statistics of the buffer cache.
+ */
+static int
+fs_biostat(struct task *t, struct bio_msg *msg)
+{
+
+	bio_stat(&msg->stat);
+	return 0;
+}
+
 /*
  * Prepare for boot
  */
@@ -921,6 +1074,7 @@ vfs_init(void)
 	task_init();
 	bio_init();
 	vnode_init();
+	dcache_init();
 
 	/*
 	 * Initialize each file system.
@@ -1012,6 +1166,11 @@ static const struct msg_map fsmsg_map[] = {
 	MSGMAP( FS_TRUNCATE,	fs_truncate ),
 	MSGMAP( FS_FTRUNCATE,	fs_ftruncate ),
 	MSGMAP( FS_FCHDIR,	fs_fchdir ),
+	MSGMAP( FS_IOREGION,	fs_ioregion ),
+	MSGMAP( FS_BIOSTAT,	fs_biostat ),
+	MSGMAP( FS_POLL,	fs_poll ),
+	MSGMAP( FS_EPOLL_CTL,	fs_epoll_ctl ),
+	MSGMAP( FS_EPOLL_WAIT,	fs_epoll_wait ),
 	MSGMAP( STD_BOOT,	fs_boot ),
 	MSGMAP( STD_SHUTDOWN,	fs_shutdown ),
 #ifdef DEBUG_VFS
@@ -36,6 +36,8 @@
 #include <sys/file.h>
 #include <sys/mount.h>
 #include <sys/dirent.h>
+#include <sys/poll.h>
+#include <sys/epoll.h>
 
 #include <assert.h>
 
@@ -86,6 +88,10 @@ struct task {
 	file_t	    t_ofile[NOFILE];	/* pointers to file structures of open files */
 	int	    t_nopens;		/* number of opening files */
 	mutex_t	    t_lock;		/* lock for this task */
+	char	    *t_iobuf;		/* client address of I/O region */
+	char	    *t_iomap;		/* mapped address of I/O region */
+	size_t	    t_iosize;		/* size of I/O region */
+	struct list t_pollsets;		/* poll sets of this task */
 };
 
 extern const struct vfssw vfssw[];
@@ -100,6 +106,15 @@ int	 sys_ioctl(file_t fp, u_long request, void *buf);
 int	 sys_fstat(file_t fp, struct stat *st);
 int	 sys_fsync(file_t fp);
 int	 sys_ftruncate(file_t fp, off_t length);
+int	 sys_poll(struct task *t, sem_t sem, struct pollfd *fds, int nfds,
+		  int *result);
+int	 sys_epoll_ctl(struct task *t, sem_t sem, int op, int fd,
+		       struct epoll_event *ev);
+int	 sys_epoll_wait(struct task *t, sem_t sem, struct epoll_event *events,
+			int maxevents, int *result);
+void	 vn_pollclose(file_t fp);
+void	 poll_fdclose(struct task *t, int fd);
+void	 poll_cleanup(struct task *t);
 
 int	 sys_opendir(char *path, file_t * file);
 int	 sys_closedir(file_t fp);
@@ -144,6 +159,12 @@ int	 namei(char *path, vnode_t *vpp);
 int	 lookup(char *path, vnode_t *vpp, char **name);
 void	 vnode_init(void);
 
+int	 dcache_lookup(mount_t mp, char *path, vnode_t *vpp);
+void	 dcache_enter(mount_t mp, char *path, vnode_t vp);
+void	 dcache_purge(char *path);
+void	 dcache_flush(mount_t mp);
+void	 dcache_init(void);
+
 int	 vfs_findroot(char *path, mount_t *mp, char **root);
 void	 vfs_busy(mount_t mp);
 void	 vfs_unbusy(mount_t mp);
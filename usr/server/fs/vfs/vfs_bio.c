@@ -27,6 +27,7 @@
  * SUCH DAMAGE.
  */
 
+
 /*
  * vfs_bio.c - buffered I/O operations
  */
@@ -36,6 +37,28 @@
  *	Bach: The Design of the UNIX Operating System (Prentice Hall, 1986)
  */
 
+/*
+ * The cached blocks are found by the hash table indexed with
+ * (dev, blkno), and the buffers which are not in use are kept in
+ * the LRU list. The cache starts with CONFIG_BUF_CACHE buffers,
+ * and grows up to the limit computed from the free memory.
+ *
+ * <Locking>
+ *   Each hash chain has its own lock, and the LRU list is protected
+ *   by lru_lock. B_BUSY is changed with lru_lock held, so that the
+ *   buffer can be taken from the LRU list without the lock of the
+ *   hash chain. A busy buffer is owned by the thread which holds
+ *   its b_lock.
+ *
+ * <Clustering>
+ *   When a block is read from the device, the following blocks can
+ *   be read ahead with the same device read. Likewise, when a
+ *   delayed write block is flushed, the adjacent dirty blocks are
+ *   written together. The data is transferred through cluster_buf,
+ *   since the buffers of the contiguous blocks are not contiguous
+ *   in memory.
+ */
+
 #include <sys/prex.h>
 #include <sys/list.h>
 #include <sys/param.h>
@@ -48,101 +71,277 @@
 
 #include "vfs.h"
 
-/* number of buffer cache */
+/* number of buffers allocated at start */
 #define NBUFS		CONFIG_BUF_CACHE
 
+/* number of hash chains (power of 2) */
+#define NBUCKETS	64
+
+/* percentage of the free memory used for the cache at most */
+#define BUF_MEMPCT	2
+
+/* max number of blocks in one device I/O */
+#define MAXCLUSTER	16
+
 /* macros to clear/set/test flags. */
 #define	SET(t, f)	(t) |= (f)
 #define	CLR(t, f)	(t) &= ~(f)
 #define	ISSET(t, f)	((t) & (f))
 
+#define BUCKET(dev, blkno) \
+	(&bio_hash[(((u_long)(dev) >> 4) + (u_long)(blkno)) & (NBUCKETS - 1)])
+
 /*
- * Global lock to access all buffer headers and lists.
+ * Hash chain of cached blocks.
  */
+struct bucket {
+	struct list	head;		/* buffers in this chain */
+	mutex_t		lock;		/* lock for this chain */
+};
+
 #if CONFIG_FS_THREADS > 1
-static mutex_t bio_lock = MUTEX_INITIALIZER;
-#define BIO_LOCK()	mutex_lock(&bio_lock)
-#define BIO_UNLOCK()	mutex_unlock(&bio_lock)
+#define HASH_LOCK(hp)	mutex_lock(&(hp)->lock)
+#define HASH_UNLOCK(hp)	mutex_unlock(&(hp)->lock)
+#define LRU_LOCK()	mutex_lock(&lru_lock)
+#define LRU_UNLOCK()	mutex_unlock(&lru_lock)
+#define LRU_WAIT()	cond_wait(&lru_cond, &lru_lock)
+#define LRU_WAKEUP()	cond_signal(&lru_cond)
+#define CLUSTER_LOCK()	mutex_lock(&cluster_lock)
+#define CLUSTER_UNLOCK() mutex_unlock(&cluster_lock)
 #else
-#define BIO_LOCK()
-#define BIO_UNLOCK()
+#define HASH_LOCK(hp)
+#define HASH_UNLOCK(hp)
+#define LRU_LOCK()
+#define LRU_UNLOCK()
+#define LRU_WAIT()	sys_panic("bio: no buffer")
+#define LRU_WAKEUP()
+#define CLUSTER_LOCK()
+#define CLUSTER_UNLOCK()
 #endif
 
+static struct bucket bio_hash[NBUCKETS];
 
-/* set of buffers */
-static char buffers[NBUFS][BSIZE];
+#if CONFIG_FS_THREADS > 1
+static mutex_t lru_lock = MUTEX_INITIALIZER;
+static cond_t lru_cond = COND_INITIALIZER;
+#endif
+static struct list lru_list = LIST_INIT(lru_list);
 
-static struct buf buf_table[NBUFS];
-static struct list free_list = LIST_INIT(free_list);
+#if CONFIG_FS_THREADS > 1
+static mutex_t cluster_lock = MUTEX_INITIALIZER;
+#endif
+static char cluster_buf[MAXCLUSTER * BSIZE];
 
-static sem_t free_sem;
+static int nbufs;			/* number of buffers */
+static int maxbufs;			/* max number of buffers */
+static u_long nr_hits;			/* blocks found in cache */
+static u_long nr_misses;		/* blocks not found in cache */
+static u_long nr_evicts;		/* valid blocks reused */
+static u_long nr_rablks;		/* blocks read ahead */
+static u_long nr_clwrites;		/* clustered writes */
 
+static int bio_write(struct buf *);
+static int bio_flush(struct buf *);
 
 /*
- * Insert buffer to the head of free list
+ * Allocate a new buffer if the cache can grow.
+ * Must be called with lru_lock held.
  */
-static void
-bio_insert_head(struct buf *bp)
+static struct buf *
+bio_alloc(void)
 {
+	struct buf *bp;
 
-	list_insert(&free_list, &bp->b_link);
-	sem_post(&free_sem);
+	if (nbufs >= maxbufs)
+		return NULL;
+	if ((bp = malloc(sizeof(struct buf) + BSIZE)) == NULL)
+		return NULL;
+
+	memset(bp, 0, sizeof(struct buf));
+	bp->b_flags = B_INVAL;
+	bp->b_data = (char *)(bp + 1);
+	bp->b_lock = MUTEX_INITIALIZER;
+	list_init(&bp->b_hash);
+	nbufs++;
+	return bp;
 }
 
 /*
- * Insert buffer to the tail of free list
+ * Determine if a block is in the cache.
+ * Must be called with the lock of the hash chain held.
  */
-static void
-bio_insert_tail(struct buf *bp)
+static struct buf *
+incore(struct bucket *hp, dev_t dev, int blkno)
 {
+	struct buf *bp;
+	list_t n;
 
-	list_insert(list_prev(&free_list), &bp->b_link);
-	sem_post(&free_sem);
+	for (n = list_first(&hp->head); n != &hp->head; n = list_next(n)) {
+		bp = list_entry(n, struct buf, b_hash);
+		if (bp->b_blkno == blkno && bp->b_dev == dev &&
+		    !ISSET(bp->b_flags, B_INVAL))
+			return bp;
+	}
+	return NULL;
 }
 
 /*
- * Remove buffer from free list
+ * Take the cached buffer from the LRU list.
+ *
+ * This is called with the lock of the hash chain held, and the
+ * lock is released here. If the buffer is busy, wait until it
+ * is released, and return NULL. The caller must look up the
+ * hash chain again in this case.
  */
-static void
-bio_remove(struct buf *bp)
+static struct buf *
+bio_grab(struct bucket *hp, struct buf *bp)
 {
 
-	sem_wait(&free_sem, 0);
-	ASSERT(!list_empty(&free_list));
+	LRU_LOCK();
+	if (ISSET(bp->b_flags, B_BUSY)) {
+		LRU_UNLOCK();
+		HASH_UNLOCK(hp);
+		/*
+		 * Wait buffer ready.
+		 */
+		mutex_lock(&bp->b_lock);
+		mutex_unlock(&bp->b_lock);
+		return NULL;
+	}
 	list_remove(&bp->b_link);
+	SET(bp->b_flags, B_BUSY);
+	LRU_UNLOCK();
+	HASH_UNLOCK(hp);
+
+	mutex_lock(&bp->b_lock);
+	return bp;
 }
 
 /*
- * Remove buffer from the head of free list
+ * Take the cached block which has the specified flags, without
+ * waiting. Return NULL if the block is not cached, or it is busy.
  */
 static struct buf *
-bio_remove_head(void)
+bio_trygrab(dev_t dev, int blkno, int flags)
 {
+	struct bucket *hp;
 	struct buf *bp;
 
-	sem_wait(&free_sem, 0);
-	ASSERT(!list_empty(&free_list));
-	bp = list_entry(list_first(&free_list), struct buf, b_link);
-	list_remove(&bp->b_link);
+	hp = BUCKET(dev, blkno);
+	HASH_LOCK(hp);
+	bp = incore(hp, dev, blkno);
+	if (bp != NULL) {
+		LRU_LOCK();
+		if (ISSET(bp->b_flags, B_BUSY) ||
+		    (bp->b_flags & flags) != flags)
+			bp = NULL;
+		else {
+			list_remove(&bp->b_link);
+			SET(bp->b_flags, B_BUSY);
+		}
+		LRU_UNLOCK();
+	}
+	HASH_UNLOCK(hp);
+
+	if (bp != NULL)
+		mutex_lock(&bp->b_lock);
 	return bp;
 }
 
 /*
- * Determine if a block is in the cache.
+ * Get a free buffer.
+ *
+ * An unused buffer is taken first. Then, a new buffer is
+ * allocated while the cache can grow. Otherwise, the least
+ * recently used buffer is taken. It is written if it has a
+ * delayed write data.
+ *
+ * If @wait is 0, NULL is returned instead of waiting for a
+ * buffer or writing a dirty one.
  */
 static struct buf *
-incore(dev_t dev, int blkno)
+bio_getfree(int wait)
 {
 	struct buf *bp;
-	int i;
 
-	for (i = 0; i < NBUFS; i++) {
-		bp = &buf_table[i];
-		if (bp->b_blkno == blkno && bp->b_dev == dev &&
-		    !ISSET(bp->b_flags, B_INVAL))
+	LRU_LOCK();
+	for (;;) {
+		if (!list_empty(&lru_list)) {
+			bp = list_entry(list_first(&lru_list),
+					struct buf, b_link);
+			if (ISSET(bp->b_flags, B_INVAL))
+				break;
+		}
+		if ((bp = bio_alloc()) != NULL) {
+			SET(bp->b_flags, B_BUSY);
+			LRU_UNLOCK();
+			mutex_lock(&bp->b_lock);
 			return bp;
+		}
+		if (!list_empty(&lru_list)) {
+			bp = list_entry(list_first(&lru_list),
+					struct buf, b_link);
+			if (!wait && ISSET(bp->b_flags, B_DELWRI))
+				bp = NULL;
+			break;
+		}
+		if (!wait) {
+			bp = NULL;
+			break;
+		}
+		LRU_WAIT();
 	}
-	return NULL;
+	if (bp == NULL) {
+		LRU_UNLOCK();
+		return NULL;
+	}
+	list_remove(&bp->b_link);
+	SET(bp->b_flags, B_BUSY);
+	LRU_UNLOCK();
+
+	mutex_lock(&bp->b_lock);
+	if (ISSET(bp->b_flags, B_DELWRI))
+		bio_flush(bp);
+
+	/*
+	 * Remove it from the hash chain of the old block.
+	 */
+	if (!list_empty(&bp->b_hash)) {
+		if (!ISSET(bp->b_flags, B_INVAL))
+			nr_evicts++;
+		HASH_LOCK(BUCKET(bp->b_dev, bp->b_blkno));
+		list_remove(&bp->b_hash);
+		list_init(&bp->b_hash);
+		HASH_UNLOCK(BUCKET(bp->b_dev, bp->b_blkno));
+	}
+	return bp;
+}
+
+/*
+ * Assign the free buffer to the block.
+ *
+ * If other thread has cached the block while we are getting
+ * the buffer, the buffer is released and NULL is returned.
+ */
+static struct buf *
+bio_assign(struct buf *bp, dev_t dev, int blkno)
+{
+	struct bucket *hp;
+
+	hp = BUCKET(dev, blkno);
+	HASH_LOCK(hp);
+	if (incore(hp, dev, blkno) != NULL) {
+		HASH_UNLOCK(hp);
+		bp->b_flags = B_INVAL | B_BUSY;
+		brelse(bp);
+		return NULL;
+	}
+	bp->b_flags = B_BUSY;
+	bp->b_dev = dev;
+	bp->b_blkno = blkno;
+	list_insert(&hp->head, &bp->b_hash);
+	HASH_UNLOCK(hp);
+	return bp;
 }
 
 /*
@@ -156,39 +355,27 @@ incore(dev_t dev, int blkno)
 struct buf *
 getblk(dev_t dev, int blkno)
 {
+	struct bucket *hp;
 	struct buf *bp;
 
 	DPRINTF(VFSDB_BIO, ("getblk: dev=%x blkno=%d\n", dev, blkno));
+	hp = BUCKET(dev, blkno);
  start:
-	BIO_LOCK();
-	bp = incore(dev, blkno);
+	HASH_LOCK(hp);
+	bp = incore(hp, dev, blkno);
 	if (bp != NULL) {
 		/* Block found in cache. */
-		if (ISSET(bp->b_flags, B_BUSY)) {
-			/*
-			 * Wait buffer ready.
-			 */
-			BIO_UNLOCK();
-			mutex_lock(&bp->b_lock);
-			mutex_unlock(&bp->b_lock);
-			/* Scan again if it's busy */
-			goto start;
-		}
-		bio_remove(bp);
-		SET(bp->b_flags, B_BUSY);
-	} else {
-		bp = bio_remove_head();
-		if (ISSET(bp->b_flags, B_DELWRI)) {
-			BIO_UNLOCK();
-			bwrite(bp);
+		if ((bp = bio_grab(hp, bp)) == NULL)
 			goto start;
-		}
-		bp->b_flags = B_BUSY;
-		bp->b_dev = dev;
-		bp->b_blkno = blkno;
+		nr_hits++;
+		DPRINTF(VFSDB_BIO, ("getblk: done bp=%x\n", bp));
+		return bp;
 	}
-	mutex_lock(&bp->b_lock);
-	BIO_UNLOCK();
+	HASH_UNLOCK(hp);
+
+	if ((bp = bio_assign(bio_getfree(1), dev, blkno)) == NULL)
+		goto start;
+	nr_misses++;
 	DPRINTF(VFSDB_BIO, ("getblk: done bp=%x\n", bp));
 	return bp;
 }
@@ -203,51 +390,215 @@ brelse(struct buf *bp)
 	DPRINTF(VFSDB_BIO, ("brelse: bp=%x dev=%x blkno=%d\n",
 				bp, bp->b_dev, bp->b_blkno));
 
-	BIO_LOCK();
+	LRU_LOCK();
 	CLR(bp->b_flags, B_BUSY);
-	mutex_unlock(&bp->b_lock);
 	if (ISSET(bp->b_flags, B_INVAL))
-		bio_insert_head(bp);
+		list_insert(&lru_list, &bp->b_link);
 	else
-		bio_insert_tail(bp);
-	BIO_UNLOCK();
+		list_insert(list_prev(&lru_list), &bp->b_link);
+	LRU_WAKEUP();
+	LRU_UNLOCK();
+	mutex_unlock(&bp->b_lock);
 }
 
 /*
- * Block read with cache.
+ * Get a buffer for the block to read ahead.
+ *
+ * Return NULL if the block is already cached, or no buffer is
+ * available without waiting.
+ */
+static struct buf *
+bio_getra(dev_t dev, int blkno)
+{
+	struct bucket *hp;
+	struct buf *bp;
+
+	hp = BUCKET(dev, blkno);
+	HASH_LOCK(hp);
+	bp = incore(hp, dev, blkno);
+	HASH_UNLOCK(hp);
+	if (bp != NULL)
+		return NULL;
+
+	if ((bp = bio_getfree(0)) == NULL)
+		return NULL;
+	return bio_assign(bp, dev, blkno);
+}
+
+/*
+ * Block read with read-ahead.
  * @dev:   device id to read from.
  * @blkno: block number.
+ * @nra:   number of blocks to read ahead.
  * @buf:   buffer pointer to be returned.
  *
- * An actual read operation is done only when the cached
- * buffer is dirty.
+ * When the block is not cached, the following blocks which are
+ * not cached either are read with the same device read, and
+ * left in the cache. The read-ahead stops at the first cached
+ * block, or when no buffer is available without waiting.
  */
 int
-bread(dev_t dev, int blkno, struct buf **bpp)
+breada(dev_t dev, int blkno, int nra, struct buf **bpp)
 {
-	struct buf *bp;
+	struct buf *bp, *rabp[MAXCLUSTER];
 	size_t size;
-	int error;
+	int i, n, error;
 
-	DPRINTF(VFSDB_BIO, ("bread: dev=%x blkno=%d\n", dev, blkno));
+	DPRINTF(VFSDB_BIO, ("breada: dev=%x blkno=%d nra=%d\n",
+			    dev, blkno, nra));
 	bp = getblk(dev, blkno);
 
-	if (!ISSET(bp->b_flags, (B_DONE | B_DELWRI))) {
-		size = BSIZE;
-		error = device_read((device_t)dev, bp->b_data, &size, blkno);
-		if (error) {
-			DPRINTF(VFSDB_BIO, ("bread: i/o error\n"));
-			brelse(bp);
-			return error;
+	if (ISSET(bp->b_flags, (B_DONE | B_DELWRI)))
+		goto done;
+
+	rabp[0] = bp;
+	for (n = 1; n <= nra && n < MAXCLUSTER; n++) {
+		if ((rabp[n] = bio_getra(dev, blkno + n)) == NULL)
+			break;
+	}
+	if (n > 1) {
+		CLUSTER_LOCK();
+		size = (size_t)(n * BSIZE);
+		error = device_read((device_t)dev, cluster_buf, &size, blkno);
+		if (!error && size == (size_t)(n * BSIZE)) {
+			for (i = 0; i < n; i++)
+				memcpy(rabp[i]->b_data, cluster_buf + i * BSIZE,
+				       BSIZE);
+		}
+		CLUSTER_UNLOCK();
+
+		/*
+		 * If the cluster can not be read, e.g. it runs off
+		 * the end of the device, read the block alone.
+		 */
+		for (i = 1; i < n; i++) {
+			if (!error && size == (size_t)(n * BSIZE)) {
+				SET(rabp[i]->b_flags, (B_READ | B_DONE));
+				nr_rablks++;
+			} else
+				SET(rabp[i]->b_flags, B_INVAL);
+			brelse(rabp[i]);
 		}
+		if (!error && size == (size_t)(n * BSIZE))
+			goto done;
+	}
+
+	size = BSIZE;
+	error = device_read((device_t)dev, bp->b_data, &size, blkno);
+	if (error) {
+		DPRINTF(VFSDB_BIO, ("breada: i/o error\n"));
+		SET(bp->b_flags, B_INVAL);
+		brelse(bp);
+		return error;
 	}
+ done:
 	CLR(bp->b_flags, B_INVAL);
 	SET(bp->b_flags, (B_READ | B_DONE));
-	DPRINTF(VFSDB_BIO, ("bread: done bp=%x\n\n", bp));
+	DPRINTF(VFSDB_BIO, ("breada: done bp=%x\n\n", bp));
 	*bpp = bp;
 	return 0;
 }
 
+/*
+ * Block read with cache.
+ * @dev:   device id to read from.
+ * @blkno: block number.
+ * @buf:   buffer pointer to be returned.
+ *
+ * An actual read operation is done only when the cached
+ * buffer is dirty.
+ */
+int
+bread(dev_t dev, int blkno, struct buf **bpp)
+{
+
+	return breada(dev, blkno, 0, bpp);
+}
+
+/*
+ * Write the buffer to the device.
+ */
+static int
+bio_write(struct buf *bp)
+{
+	size_t size;
+	int error;
+
+	CLR(bp->b_flags, (B_READ | B_DONE | B_DELWRI));
+
+	size = BSIZE;
+	error = device_write((device_t)bp->b_dev, bp->b_data, &size,
+			   bp->b_blkno);
+	if (error)
+		return error;
+	SET(bp->b_flags, B_DONE);
+	return 0;
+}
+
+/*
+ * Write the delayed write buffer with the adjacent ones.
+ *
+ * The dirty blocks which are contiguous to the given block and
+ * are not in use are gathered, and they are written with one
+ * device write. The given buffer is kept busy, and the other
+ * buffers are released.
+ */
+static int
+bio_flush(struct buf *bp)
+{
+	struct buf *clbp[MAXCLUSTER], *tmp;
+	size_t size;
+	int i, n, blkno, error;
+
+	/* Gather the blocks before this one, in reverse order. */
+	n = 0;
+	for (blkno = bp->b_blkno - 1; blkno >= 0 && n < MAXCLUSTER / 2;
+	     blkno--) {
+		tmp = bio_trygrab(bp->b_dev, blkno, B_DELWRI);
+		if (tmp == NULL)
+			break;
+		clbp[n++] = tmp;
+	}
+	for (i = 0; i < n / 2; i++) {
+		tmp = clbp[i];
+		clbp[i] = clbp[n - 1 - i];
+		clbp[n - 1 - i] = tmp;
+	}
+	clbp[n++] = bp;
+
+	/* Gather the blocks after this one. */
+	for (blkno = bp->b_blkno + 1; n < MAXCLUSTER; blkno++) {
+		tmp = bio_trygrab(bp->b_dev, blkno, B_DELWRI);
+		if (tmp == NULL)
+			break;
+		clbp[n++] = tmp;
+	}
+
+	if (n == 1)
+		return bio_write(bp);
+
+	DPRINTF(VFSDB_BIO, ("bio_flush: dev=%x blkno=%d count=%d\n",
+			    bp->b_dev, clbp[0]->b_blkno, n));
+	CLUSTER_LOCK();
+	for (i = 0; i < n; i++) {
+		memcpy(cluster_buf + i * BSIZE, clbp[i]->b_data, BSIZE);
+		CLR(clbp[i]->b_flags, (B_READ | B_DONE | B_DELWRI));
+	}
+	size = (size_t)(n * BSIZE);
+	error = device_write((device_t)bp->b_dev, cluster_buf, &size,
+			     clbp[0]->b_blkno);
+	CLUSTER_UNLOCK();
+	nr_clwrites++;
+
+	for (i = 0; i < n; i++) {
+		if (!error)
+			SET(clbp[i]->b_flags, B_DONE);
+		if (clbp[i] != bp)
+			brelse(clbp[i]);
+	}
+	return error;
+}
+
 /*
  * Block write with cache.
  * @buf:   buffer to write.
@@ -258,25 +609,14 @@ bread(dev_t dev, int blkno, struct buf **bpp)
 int
 bwrite(struct buf *bp)
 {
-	size_t size;
 	int error;
 
 	ASSERT(ISSET(bp->b_flags, B_BUSY));
 	DPRINTF(VFSDB_BIO, ("bwrite: dev=%x blkno=%d\n", bp->b_dev,
 			    bp->b_blkno));
 
-	BIO_LOCK();
-	CLR(bp->b_flags, (B_READ | B_DONE | B_DELWRI));
-	BIO_UNLOCK();
-
-	size = BSIZE;
-	error = device_write((device_t)bp->b_dev, bp->b_data, &size,
-			   bp->b_blkno);
-	if (error)
+	if ((error = bio_write(bp)) != 0)
 		return error;
-	BIO_LOCK();
-	SET(bp->b_flags, B_DONE);
-	BIO_UNLOCK();
 	brelse(bp);
 	return 0;
 }
@@ -292,10 +632,8 @@ void
 bdwrite(struct buf *bp)
 {
 
-	BIO_LOCK();
 	SET(bp->b_flags, B_DELWRI);
 	CLR(bp->b_flags, B_DONE);
-	BIO_UNLOCK();
 	brelse(bp);
 }
 
@@ -306,10 +644,8 @@ void
 bflush(struct buf *bp)
 {
 
-	BIO_LOCK();
 	if (ISSET(bp->b_flags, B_DELWRI))
 		bwrite(bp);
-	BIO_UNLOCK();
 }
 
 /*
@@ -319,47 +655,82 @@ bflush(struct buf *bp)
 void
 binval(dev_t dev)
 {
+	struct bucket *hp;
 	struct buf *bp;
+	list_t n;
 	int i;
 
-	BIO_LOCK();
-	for (i = 0; i < NBUFS; i++) {
-		bp = &buf_table[i];
-		if (bp->b_dev == dev) {
+	for (i = 0; i < NBUCKETS; i++) {
+		hp = &bio_hash[i];
+ start:
+		HASH_LOCK(hp);
+		for (n = list_first(&hp->head); n != &hp->head;
+		     n = list_next(n)) {
+			bp = list_entry(n, struct buf, b_hash);
+			if (bp->b_dev != dev)
+				continue;
+			if ((bp = bio_grab(hp, bp)) == NULL)
+				goto start;
 			if (ISSET(bp->b_flags, B_DELWRI))
-				bwrite(bp);
-			else if (ISSET(bp->b_flags, B_BUSY))
-				brelse(bp);
-			bp->b_flags = B_INVAL;
+				bio_flush(bp);
+
+			HASH_LOCK(hp);
+			list_remove(&bp->b_hash);
+			list_init(&bp->b_hash);
+			HASH_UNLOCK(hp);
+			bp->b_flags = B_INVAL | B_BUSY;
+			brelse(bp);
+			goto start;
 		}
+		HASH_UNLOCK(hp);
 	}
-	BIO_UNLOCK();
 }
 
 /*
- * Invalidate all buffers.
- * This is called when unmount.
+ * Write all delayed write buffers.
  */
 void
 bio_sync(void)
 {
+	struct bucket *hp;
 	struct buf *bp;
+	list_t n;
 	int i;
 
+	for (i = 0; i < NBUCKETS; i++) {
+		hp = &bio_hash[i];
  start:
-	BIO_LOCK();
-	for (i = 0; i < NBUFS; i++) {
-		bp = &buf_table[i];
-		if (ISSET(bp->b_flags, B_BUSY)) {
-			BIO_UNLOCK();
-			mutex_lock(&bp->b_lock);
-			mutex_unlock(&bp->b_lock);
+		HASH_LOCK(hp);
+		for (n = list_first(&hp->head); n != &hp->head;
+		     n = list_next(n)) {
+			bp = list_entry(n, struct buf, b_hash);
+			if (!ISSET(bp->b_flags, B_DELWRI | B_BUSY))
+				continue;
+			if ((bp = bio_grab(hp, bp)) == NULL)
+				goto start;
+			if (ISSET(bp->b_flags, B_DELWRI))
+				bio_flush(bp);
+			brelse(bp);
 			goto start;
 		}
-		if (ISSET(bp->b_flags, B_DELWRI))
-			bwrite(bp);
+		HASH_UNLOCK(hp);
 	}
-	BIO_UNLOCK();
+}
+
+/*
+ * Get statistics of the buffer cache.
+ */
+void
+bio_stat(struct bufstat *bs)
+{
+
+	bs->nbufs = nbufs;
+	bs->maxbufs = maxbufs;
+	bs->hits = nr_hits;
+	bs->misses = nr_misses;
+	bs->evicts = nr_evicts;
+	bs->rablks = nr_rablks;
+	bs->clwrites = nr_clwrites;
 }
 
 /*
@@ -368,18 +739,29 @@ bio_sync(void)
 void
 bio_init(void)
 {
+	struct meminfo mi;
 	struct buf *bp;
 	int i;
 
+	for (i = 0; i < NBUCKETS; i++) {
+		list_init(&bio_hash[i].head);
+		bio_hash[i].lock = MUTEX_INITIALIZER;
+	}
+
+	/*
+	 * Determine the limit of the cache size.
+	 */
+	maxbufs = NBUFS;
+	if (sys_info(INFO_MEMORY, &mi) == 0 &&
+	    (int)(mi.free / 100 * BUF_MEMPCT / BSIZE) > maxbufs)
+		maxbufs = (int)(mi.free / 100 * BUF_MEMPCT / BSIZE);
+
 	for (i = 0; i < NBUFS; i++) {
-		bp = &buf_table[i];
-		bp->b_flags = B_INVAL;
-		bp->b_data = buffers[i];
-		mutex_init(&bp->b_lock);
-		list_insert(&free_list, &bp->b_link);
+		if ((bp = bio_alloc()) == NULL)
+			break;
+		list_insert(&lru_list, &bp->b_link);
 	}
-	sem_init(&free_sem, NBUFS);
 
-	DPRINTF(VFSDB_BIO, ("bio: Buffer cache size %dK bytes\n",
-			    BSIZE * NBUFS / 1024));
+	DPRINTF(VFSDB_BIO, ("bio: Buffer cache size %dK-%dK bytes\n",
+			    BSIZE * nbufs / 1024, BSIZE * maxbufs / 1024));
 }
@@ -0,0 +1,304 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * vfs_cache.c - name cache for path lookup
+ */
+
+/*
+ * The name cache remembers the result of the recent lookups,
+ * keyed by the mount point and the path name in the file system.
+ *
+ * A positive entry holds a reference to the vnode, so that the
+ * vnode stays in the vnode table and namei() can find it without
+ * asking the file system. A negative entry records that the path
+ * does not exist.
+ *
+ * The entries are invalidated when a name is created, removed or
+ * renamed, and when the file system is unmounted. Since some file
+ * systems (e.g. fatfs) ignore the case of names, the invalidation
+ * compares the path names without case.
+ */
+
+#include <sys/prex.h>
+#include <sys/list.h>
+#include <sys/vnode.h>
+#include <sys/mount.h>
+
+#include <limits.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "vfs.h"
+
+#define DCACHE_BUCKETS	32		/* size of hash table */
+#define DCACHE_SIZE	128		/* max number of entries */
+
+/*
+ * Name cache entry
+ */
+struct dcache {
+	struct list	d_link;		/* link for hash list */
+	struct list	d_lru;		/* link for LRU list */
+	mount_t		d_mount;	/* mount point */
+	vnode_t		d_vnode;	/* vnode, or NULL if not exist */
+	char		d_path[1];	/* path name in file system */
+};
+
+static struct list dcache_table[DCACHE_BUCKETS];
+static struct list dcache_lru = LIST_INIT(dcache_lru);
+static int dcache_count;
+
+#if CONFIG_FS_THREADS > 1
+static mutex_t dcache_lock = MUTEX_INITIALIZER;
+#define DCACHE_LOCK()	mutex_lock(&dcache_lock)
+#define DCACHE_UNLOCK()	mutex_unlock(&dcache_lock)
+#else
+#define DCACHE_LOCK()
+#define DCACHE_UNLOCK()
+#endif
+
+/*
+ * Get the hash value from the mount point and path name.
+ */
+static u_int
+dcache_hash(mount_t mp, char *path)
+{
+	u_int val = 0;
+
+	while (*path)
+		val = ((val << 5) + val) + *path++;
+	return (val ^ (u_int)mp) & (DCACHE_BUCKETS - 1);
+}
+
+/*
+ * Find the entry for the path.
+ * Must be called with dcache_lock held.
+ */
+static struct dcache *
+dcache_find(mount_t mp, char *path)
+{
+	list_t head, n;
+	struct dcache *dp;
+
+	head = &dcache_table[dcache_hash(mp, path)];
+	for (n = list_first(head); n != head; n = list_next(n)) {
+		dp = list_entry(n, struct dcache, d_link);
+		if (dp->d_mount == mp && !strncmp(dp->d_path, path, PATH_MAX))
+			return dp;
+	}
+	return NULL;
+}
+
+/*
+ * Release the entry removed from the cache.
+ * This must be called without dcache_lock, since vrele() may
+ * deallocate the vnode.
+ */
+static void
+dcache_free(struct dcache *dp)
+{
+
+	if (dp->d_vnode != NULL)
+		vrele(dp->d_vnode);
+	free(dp);
+}
+
+/*
+ * Check if the path is the specified one, or under it.
+ */
+static int
+dcache_match(char *path, char *prefix)
+{
+	size_t len;
+
+	len = strlen(prefix);
+	if (strncasecmp(path, prefix, len))
+		return 0;
+	return (path[len] == '\0' || path[len] == '/' ||
+		prefix[len - 1] == '/');
+}
+
+/*
+ * Remove the entries of the mount point. If @path is not NULL,
+ * only the entries for the path and under it are removed.
+ */
+static void
+dcache_remove(mount_t mp, char *path)
+{
+	struct list purged;
+	list_t head, n, next;
+	struct dcache *dp;
+	int i;
+
+	list_init(&purged);
+	DCACHE_LOCK();
+	for (i = 0; i < DCACHE_BUCKETS; i++) {
+		head = &dcache_table[i];
+		for (n = list_first(head); n != head; n = next) {
+			next = list_next(n);
+			dp = list_entry(n, struct dcache, d_link);
+			if (dp->d_mount != mp ||
+			    (path != NULL && !dcache_match(dp->d_path, path)))
+				continue;
+			list_remove(&dp->d_link);
+			list_remove(&dp->d_lru);
+			list_insert(&purged, &dp->d_lru);
+			dcache_count--;
+		}
+	}
+	DCACHE_UNLOCK();
+
+	while (!list_empty(&purged)) {
+		n = list_first(&purged);
+		list_remove(n);
+		dcache_free(list_entry(n, struct dcache, d_lru));
+	}
+}
+
+/*
+ * Look up the name cache.
+ *
+ * Returns 1 if the path is cached. In this case, @vpp is set
+ * to the locked vnode, or NULL if the path does not exist.
+ * Returns 0 if the path is not cached.
+ */
+int
+dcache_lookup(mount_t mp, char *path, vnode_t *vpp)
+{
+	struct dcache *dp;
+	vnode_t vp;
+
+	DCACHE_LOCK();
+	if ((dp = dcache_find(mp, path)) == NULL) {
+		DCACHE_UNLOCK();
+		return 0;
+	}
+	list_remove(&dp->d_lru);
+	list_insert(list_prev(&dcache_lru), &dp->d_lru);
+	vp = dp->d_vnode;
+	if (vp != NULL)
+		vref(vp);
+	DCACHE_UNLOCK();
+
+	DPRINTF(VFSDB_VNODE, ("dcache_lookup: %s %s\n", path,
+			      vp ? "found" : "negative"));
+	if (vp != NULL)
+		vn_lock(vp);
+	*vpp = vp;
+	return 1;
+}
+
+/*
+ * Add the result of the lookup to the cache.
+ * @vp is the vnode found, or NULL if the path does not exist.
+ * The least recently used entry is replaced if the cache is full.
+ */
+void
+dcache_enter(mount_t mp, char *path, vnode_t vp)
+{
+	struct dcache *dp, *old;
+	size_t len;
+
+	len = strlen(path) + 1;
+	if ((dp = malloc(sizeof(struct dcache) + len)) == NULL)
+		return;
+	dp->d_mount = mp;
+	dp->d_vnode = vp;
+	strlcpy(dp->d_path, path, len);
+	if (vp != NULL)
+		vref(vp);
+
+	old = NULL;
+	DCACHE_LOCK();
+	if (dcache_find(mp, path) != NULL) {
+		/* Other thread has added it. */
+		DCACHE_UNLOCK();
+		dcache_free(dp);
+		return;
+	}
+	if (dcache_count >= DCACHE_SIZE) {
+		old = list_entry(list_first(&dcache_lru), struct dcache, d_lru);
+		list_remove(&old->d_link);
+		list_remove(&old->d_lru);
+		dcache_count--;
+	}
+	list_insert(&dcache_table[dcache_hash(mp, path)], &dp->d_link);
+	list_insert(list_prev(&dcache_lru), &dp->d_lru);
+	dcache_count++;
+	DCACHE_UNLOCK();
+
+	if (old != NULL)
+		dcache_free(old);
+}
+
+/*
+ * Invalidate the entries for the full path name and the
+ * names under it. This is called when the name is created,
+ * removed or renamed.
+ */
+void
+dcache_purge(char *path)
+{
+	mount_t mp;
+	char *p;
+	char node[PATH_MAX];
+	size_t len;
+
+	if (vfs_findroot(path, &mp, &p))
+		return;
+	strlcpy(node, "/", sizeof(node));
+	strlcat(node, p, sizeof(node));
+	len = strlen(node);
+	while (len > 1 && node[len - 1] == '/')
+		node[--len] = '\0';
+	dcache_remove(mp, node);
+}
+
+/*
+ * Invalidate all entries of the mount point for unmount.
+ */
+void
+dcache_flush(mount_t mp)
+{
+
+	dcache_remove(mp, NULL);
+}
+
+void
+dcache_init(void)
+{
+	int i;
+
+	for (i = 0; i < DCACHE_BUCKETS; i++)
+		list_init(&dcache_table[i]);
+	dcache_count = 0;
+}
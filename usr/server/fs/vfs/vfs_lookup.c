@@ -67,6 +67,13 @@ namei(char *path, vnode_t *vpp)
 		return ENOTDIR;
 	strlcpy(node, "/", sizeof(node));
 	strlcat(node, p, sizeof(node));
+	if (dcache_lookup(mp, node, &vp)) {
+		/* Found in the name cache. */
+		if (vp == NULL)
+			return ENOENT;
+		*vpp = vp;
+		return 0;
+	}
 	vp = vn_lookup(mp, node);
 	if (vp) {
 		/* vnode is already active. */
@@ -101,10 +108,19 @@ namei(char *path, vnode_t *vpp)
 		/*
 		 * Get a vnode for the target.
 		 */
+		if (dvp->v_type != VDIR) {
+			vput(dvp);
+			return ENOTDIR;
+		}
 		strlcat(node, "/", sizeof(node));
 		strlcat(node, name, sizeof(node));
-		vp = vn_lookup(mp, node);
-		if (vp == NULL) {
+		if (dcache_lookup(mp, node, &vp)) {
+			if (vp == NULL) {
+				/* Cached as not exist */
+				vput(dvp);
+				return ENOENT;
+			}
+		} else if ((vp = vn_lookup(mp, node)) == NULL) {
 			vp = vget(mp, node);
 			if (vp == NULL) {
 				vput(dvp);
@@ -112,12 +128,15 @@ namei(char *path, vnode_t *vpp)
 			}
 			/* Find a vnode in this directory. */
 			error = VOP_LOOKUP(dvp, name, vp);
-			if (error || (*p == '/' && vp->v_type != VDIR)) {
+			if (error) {
 				/* Not found */
+				if (error == ENOENT)
+					dcache_enter(mp, node, NULL);
 				vput(vp);
 				vput(dvp);
 				return error;
 			}
+			dcache_enter(mp, node, vp);
 		}
 		vput(dvp);
 		dvp = vp;
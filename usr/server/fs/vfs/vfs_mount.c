@@ -40,6 +40,7 @@
 #include <sys/dirent.h>
 #include <sys/list.h>
 #include <sys/buf.h>
+#include <sys/time.h>
 
 #include <limits.h>
 #include <unistd.h>
@@ -93,6 +94,7 @@ sys_mount(char *dev, char *dir, char *fsname, int flags, void *data)
 	list_t head, n;
 	device_t device;
 	vnode_t vp, vp_covered;
+	struct timespec ts;
 	int error;
 
 #ifdef DEBUG
@@ -140,6 +142,10 @@ sys_mount(char *dev, char *dir, char *fsname, int flags, void *data)
 	mp->m_dev = (dev_t)device;
 	strlcpy(mp->m_path, dir, sizeof(mp->m_path));
 
+	/* The files may be changed while it is not mounted. */
+	sys_uptime(&ts);
+	mp->m_mtime = (time_t)ts.ts_sec;
+
 	/*
 	 * Get vnode to be covered in the upper file system.
 	 */
@@ -237,6 +243,7 @@ sys_umount(char *path)
 		error = EINVAL;
 		goto out;
 	}
+	dcache_flush(mp);
 	if ((error = VFS_UNMOUNT(mp)) != 0)
 		goto out;
 	list_remove(&mp->m_link);
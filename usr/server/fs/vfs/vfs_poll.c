@@ -0,0 +1,567 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * vfs_poll.c - wait for the events of files
+ */
+
+#include <sys/prex.h>
+#include <sys/list.h>
+#include <sys/vnode.h>
+#include <sys/file.h>
+#include <sys/poll.h>
+#include <sys/epoll.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vfs.h"
+
+/*
+ * The fs server never sleeps for a poller. A client passes a
+ * semaphore of its own, and we keep a poll set for the pair of
+ * the task and the semaphore. Each entry of the set is linked
+ * to the vnode of the polled file, and the file systems call
+ * vn_pollwakeup() for the vnode when its state may change.
+ * Then we post the semaphore of each set which polls the vnode.
+ * The client waits on the semaphore and asks us again.
+ *
+ * The net server posts the same semaphore for the sockets, so
+ * a client can wait for both files and sockets at once.
+ *
+ * A poll set is rebuilt by every FS_POLL request, and it is
+ * released as soon as any file is ready. An epoll set is built
+ * by FS_EPOLL_CTL, and it keeps the entries which may be ready
+ * on its ready list, so that FS_EPOLL_WAIT checks only them.
+ */
+struct pollset {
+	struct list	ps_link;	/* link to poll sets of task */
+	sem_t		ps_sem;		/* semaphore of client */
+	int		ps_epoll;	/* true if epoll set */
+	int		ps_posted;	/* true if posted since last scan */
+	struct list	ps_entries;	/* all entries */
+	struct list	ps_ready;	/* entries which may be ready */
+};
+
+struct pollent {
+	struct list	pe_link;	/* link to entries of set */
+	struct list	pe_vlink;	/* link to pollers of vnode */
+	struct list	pe_rlink;	/* link to ready list */
+	struct pollset	*pe_set;	/* poll set */
+	vnode_t		pe_vp;		/* vnode, or NULL if closed */
+	file_t		pe_fp;		/* file */
+	int		pe_fd;		/* file descriptor */
+	int		pe_events;	/* requested events */
+	epoll_data_t	pe_data;	/* user data for epoll */
+	int		pe_onready;	/* true if on ready list */
+	int		pe_pending;	/* true if woken while checked */
+};
+
+/*
+ * poll_lock protects the vnode lists, the ready lists and the
+ * posted flags. The other fields are changed only with the task
+ * locked. The vnode lock must be taken before poll_lock.
+ *
+ * It is needed even with one fs thread, since the tty watchers
+ * of devfs call vn_pollwakeup() from their own threads.
+ */
+#if CONFIG_FS_THREADS == 1
+#undef mutex_lock
+#undef mutex_unlock
+#endif
+static mutex_t poll_lock = MUTEX_INITIALIZER;
+
+/*
+ * Post the semaphore of the set, once until the next scan.
+ * Called with poll_lock held.
+ */
+static void
+poll_post(struct pollset *ps)
+{
+
+	if (!ps->ps_posted) {
+		ps->ps_posted = 1;
+		sem_post(&ps->ps_sem);
+	}
+}
+
+/*
+ * Notify an event of the entry to its set.
+ * Called with poll_lock held.
+ */
+static void
+poll_notify(struct pollent *pe)
+{
+	struct pollset *ps = pe->pe_set;
+
+	if (ps->ps_epoll) {
+		pe->pe_pending = 1;
+		if (!pe->pe_onready) {
+			list_insert(list_last(&ps->ps_ready), &pe->pe_rlink);
+			pe->pe_onready = 1;
+		}
+	}
+	poll_post(ps);
+}
+
+/*
+ * Wake up the pollers of the vnode.
+ */
+void
+vn_pollwakeup(vnode_t vp)
+{
+	struct pollent *pe;
+	list_t n;
+
+	mutex_lock(&poll_lock);
+	for (n = list_first(&vp->v_pollers); n != &vp->v_pollers;
+	     n = list_next(n)) {
+		pe = list_entry(n, struct pollent, pe_vlink);
+		poll_notify(pe);
+	}
+	mutex_unlock(&poll_lock);
+}
+
+/*
+ * Unlink the entries of the file from its vnode. This is called
+ * with the vnode locked before the last reference of the file
+ * is dropped.
+ */
+void
+vn_pollclose(file_t fp)
+{
+	vnode_t vp = fp->f_vnode;
+	struct pollent *pe;
+	list_t n, next;
+
+	mutex_lock(&poll_lock);
+	for (n = list_first(&vp->v_pollers); n != &vp->v_pollers;
+	     n = next) {
+		next = list_next(n);
+		pe = list_entry(n, struct pollent, pe_vlink);
+		if (pe->pe_fp == fp) {
+			list_remove(&pe->pe_vlink);
+			pe->pe_vp = NULL;
+		}
+	}
+	mutex_unlock(&poll_lock);
+}
+
+/*
+ * Add an entry for the file to the set.
+ */
+static struct pollent *
+pollent_alloc(struct pollset *ps, int fd, file_t fp, int events)
+{
+	struct pollent *pe;
+
+	if ((pe = malloc(sizeof(struct pollent))) == NULL)
+		return NULL;
+	memset(pe, 0, sizeof(struct pollent));
+	pe->pe_set = ps;
+	pe->pe_vp = fp->f_vnode;
+	pe->pe_fp = fp;
+	pe->pe_fd = fd;
+	pe->pe_events = events;
+
+	mutex_lock(&poll_lock);
+	list_insert(&pe->pe_vp->v_pollers, &pe->pe_vlink);
+	list_insert(list_last(&ps->ps_entries), &pe->pe_link);
+	mutex_unlock(&poll_lock);
+	return pe;
+}
+
+static void
+pollent_free(struct pollent *pe)
+{
+
+	mutex_lock(&poll_lock);
+	if (pe->pe_vp != NULL)
+		list_remove(&pe->pe_vlink);
+	if (pe->pe_onready)
+		list_remove(&pe->pe_rlink);
+	list_remove(&pe->pe_link);
+	mutex_unlock(&poll_lock);
+	free(pe);
+}
+
+/*
+ * Find the set of the task for the semaphore.
+ */
+static struct pollset *
+pollset_lookup(struct task *t, sem_t sem, int epoll)
+{
+	struct pollset *ps;
+	list_t n;
+
+	for (n = list_first(&t->t_pollsets); n != &t->t_pollsets;
+	     n = list_next(n)) {
+		ps = list_entry(n, struct pollset, ps_link);
+		if (ps->ps_sem == sem && ps->ps_epoll == epoll)
+			return ps;
+	}
+	return NULL;
+}
+
+static struct pollset *
+pollset_alloc(struct task *t, sem_t sem, int epoll)
+{
+	struct pollset *ps;
+
+	if ((ps = malloc(sizeof(struct pollset))) == NULL)
+		return NULL;
+	memset(ps, 0, sizeof(struct pollset));
+	ps->ps_sem = sem;
+	ps->ps_epoll = epoll;
+	list_init(&ps->ps_entries);
+	list_init(&ps->ps_ready);
+	list_insert(&t->t_pollsets, &ps->ps_link);
+	return ps;
+}
+
+static void
+pollset_clear(struct pollset *ps)
+{
+	struct pollent *pe;
+
+	while (!list_empty(&ps->ps_entries)) {
+		pe = list_entry(list_first(&ps->ps_entries),
+				struct pollent, pe_link);
+		pollent_free(pe);
+	}
+}
+
+static void
+pollset_free(struct pollset *ps)
+{
+
+	pollset_clear(ps);
+	list_remove(&ps->ps_link);
+	free(ps);
+}
+
+/*
+ * Start a new scan of the set. The events after this point
+ * post the semaphore again.
+ */
+static void
+pollset_rescan(struct pollset *ps)
+{
+
+	mutex_lock(&poll_lock);
+	ps->ps_posted = 0;
+	mutex_unlock(&poll_lock);
+}
+
+/*
+ * Release all poll sets of the task.
+ */
+void
+poll_cleanup(struct task *t)
+{
+	struct pollset *ps;
+
+	while (!list_empty(&t->t_pollsets)) {
+		ps = list_entry(list_first(&t->t_pollsets),
+				struct pollset, ps_link);
+		pollset_free(ps);
+	}
+}
+
+/*
+ * The file descriptor of the task has been closed. The epoll
+ * sets forget it, and the poll sets are woken to report it.
+ */
+void
+poll_fdclose(struct task *t, int fd)
+{
+	struct pollset *ps;
+	struct pollent *pe;
+	list_t n, m, next;
+
+	for (n = list_first(&t->t_pollsets); n != &t->t_pollsets;
+	     n = list_next(n)) {
+		ps = list_entry(n, struct pollset, ps_link);
+		for (m = list_first(&ps->ps_entries); m != &ps->ps_entries;
+		     m = next) {
+			next = list_next(m);
+			pe = list_entry(m, struct pollent, pe_link);
+			if (pe->pe_fd != fd)
+				continue;
+			if (ps->ps_epoll)
+				pollent_free(pe);
+			else {
+				mutex_lock(&poll_lock);
+				poll_post(ps);
+				mutex_unlock(&poll_lock);
+			}
+		}
+	}
+}
+
+/*
+ * Get the current events of the file, or POLLNVAL if the
+ * descriptor does not refer the file anymore.
+ */
+static int
+poll_check(struct task *t, int fd, file_t fp, int events)
+{
+	vnode_t vp;
+	int revents;
+
+	if (fp == NULL || task_getfp(t, fd) != fp)
+		return POLLNVAL;
+
+	vp = fp->f_vnode;
+	vn_lock(vp);
+	revents = VOP_POLL(vp, fp, events);
+	vn_unlock(vp);
+	return revents;
+}
+
+/*
+ * Get the events of the files, and return the number of files
+ * which have any event.
+ *
+ * If sem is not 0, the files are registered to the poll set for
+ * sem before they are checked, so that any later event posts sem.
+ * The set is released when any file is ready, or nfds is 0.
+ */
+int
+sys_poll(struct task *t, sem_t sem, struct pollfd *fds, int nfds,
+	 int *result)
+{
+	struct pollset *ps = NULL;
+	file_t fp;
+	int i, revents, n = 0;
+
+	if (sem != 0) {
+		ps = pollset_lookup(t, sem, 0);
+		if (nfds == 0) {
+			if (ps != NULL)
+				pollset_free(ps);
+			*result = 0;
+			return 0;
+		}
+		if (ps == NULL) {
+			if ((ps = pollset_alloc(t, sem, 0)) == NULL)
+				return ENOMEM;
+		}
+		pollset_clear(ps);
+		pollset_rescan(ps);
+		for (i = 0; i < nfds; i++) {
+			fp = task_getfp(t, fds[i].fd);
+			if (fp == NULL)
+				continue;
+			if (pollent_alloc(ps, fds[i].fd, fp,
+					  fds[i].events) == NULL) {
+				pollset_free(ps);
+				return ENOMEM;
+			}
+		}
+	}
+
+	for (i = 0; i < nfds; i++) {
+		fds[i].revents = 0;
+		if (fds[i].fd < 0)
+			continue;
+		fp = task_getfp(t, fds[i].fd);
+		revents = poll_check(t, fds[i].fd, fp, fds[i].events);
+		fds[i].revents = (short)revents;
+		if (revents != 0)
+			n++;
+	}
+	if (n > 0 && ps != NULL)
+		pollset_free(ps);
+
+	*result = n;
+	return 0;
+}
+
+/*
+ * Find the entry of the epoll set for the descriptor. An entry
+ * whose file was replaced is dropped here.
+ */
+static struct pollent *
+epoll_lookup(struct task *t, struct pollset *ps, int fd)
+{
+	struct pollent *pe;
+	list_t n;
+
+	for (n = list_first(&ps->ps_entries); n != &ps->ps_entries;
+	     n = list_next(n)) {
+		pe = list_entry(n, struct pollent, pe_link);
+		if (pe->pe_fd != fd)
+			continue;
+		if (task_getfp(t, fd) != pe->pe_fp) {
+			pollent_free(pe);
+			return NULL;
+		}
+		return pe;
+	}
+	return NULL;
+}
+
+/*
+ * Change the interest list of the epoll set for sem. The set
+ * is released if op is 0.
+ */
+int
+sys_epoll_ctl(struct task *t, sem_t sem, int op, int fd,
+	      struct epoll_event *ev)
+{
+	struct pollset *ps;
+	struct pollent *pe;
+	file_t fp;
+	int events;
+
+	ps = pollset_lookup(t, sem, 1);
+	if (op == 0) {
+		if (ps != NULL)
+			pollset_free(ps);
+		return 0;
+	}
+	if ((fp = task_getfp(t, fd)) == NULL)
+		return EBADF;
+
+	pe = NULL;
+	if (ps != NULL)
+		pe = epoll_lookup(t, ps, fd);
+
+	events = (int)ev->events | POLLERR | POLLHUP;
+	switch (op) {
+	case EPOLL_CTL_ADD:
+		if (pe != NULL)
+			return EEXIST;
+		if (ps == NULL) {
+			if ((ps = pollset_alloc(t, sem, 1)) == NULL)
+				return ENOMEM;
+		}
+		if ((pe = pollent_alloc(ps, fd, fp, events)) == NULL)
+			return ENOMEM;
+		break;
+	case EPOLL_CTL_MOD:
+		if (pe == NULL)
+			return ENOENT;
+		pe->pe_events = events;
+		break;
+	case EPOLL_CTL_DEL:
+		if (pe == NULL)
+			return ENOENT;
+		pollent_free(pe);
+		return 0;
+	default:
+		return EINVAL;
+	}
+	pe->pe_data = ev->data;
+
+	/* Let the next wait check the new events. */
+	mutex_lock(&poll_lock);
+	poll_notify(pe);
+	mutex_unlock(&poll_lock);
+	return 0;
+}
+
+/*
+ * Collect the ready events of the epoll set for sem.
+ *
+ * Only the entries on the ready list are checked. An entry stays
+ * there while it is ready, since the events are level triggered,
+ * and it is taken off when it is not ready anymore.
+ */
+int
+sys_epoll_wait(struct task *t, sem_t sem, struct epoll_event *events,
+	       int maxevents, int *result)
+{
+	struct pollset *ps;
+	struct pollent *pe;
+	list_t n, next;
+	int revents, valid, nready = 0;
+
+	*result = 0;
+	if (maxevents <= 0)
+		return EINVAL;
+	if ((ps = pollset_lookup(t, sem, 1)) == NULL)
+		return 0;
+
+	pollset_rescan(ps);
+
+	mutex_lock(&poll_lock);
+	n = list_first(&ps->ps_ready);
+	mutex_unlock(&poll_lock);
+
+	while (n != &ps->ps_ready) {
+		pe = list_entry(n, struct pollent, pe_rlink);
+
+		mutex_lock(&poll_lock);
+		pe->pe_pending = 0;
+		valid = (pe->pe_vp != NULL);
+		mutex_unlock(&poll_lock);
+
+		revents = POLLNVAL;
+		if (valid)
+			revents = poll_check(t, pe->pe_fd, pe->pe_fp,
+					     pe->pe_events);
+
+		mutex_lock(&poll_lock);
+		next = list_next(n);
+		if (revents == 0 && !pe->pe_pending) {
+			list_remove(&pe->pe_rlink);
+			pe->pe_onready = 0;
+		}
+		mutex_unlock(&poll_lock);
+
+		if (revents & POLLNVAL) {
+			/* The file has been closed. */
+			pollent_free(pe);
+		} else if (revents != 0) {
+			events[nready].events = (uint32_t)revents;
+			events[nready].data = pe->pe_data;
+			if (++nready == maxevents) {
+				/*
+				 * Start the next wait from the entry
+				 * we could not check.
+				 */
+				mutex_lock(&poll_lock);
+				next = list_next(n);
+				if (next != &ps->ps_ready) {
+					list_remove(&ps->ps_ready);
+					list_insert(list_prev(next),
+						    &ps->ps_ready);
+				}
+				mutex_unlock(&poll_lock);
+				break;
+			}
+		}
+		n = next;
+	}
+	*result = nready;
+	return 0;
+}
@@ -81,8 +81,10 @@ sys_open(char *path, int flags, mode_t mode, file_t *pfp)
 			vput(dvp);
 			if (error)
 				return error;
+			dcache_purge(path);
 			if ((error = namei(path, &vp)) != 0)
 				return error;
+			vn_touch(vp);
 			flags &= ~O_TRUNC;
 		} else if (error) {
 			return error;
@@ -122,6 +124,7 @@ sys_open(char *path, int flags, mode_t mode, file_t *pfp)
 			vput(vp);
 			return error;
 		}
+		vn_touch(vp);
 	}
 	/* Setup file structure */
 	if (!(fp = malloc(sizeof(struct file)))) {
@@ -166,6 +169,7 @@ sys_close(file_t fp)
 		vn_unlock(vp);
 		return error;
 	}
+	vn_pollclose(fp);
 	vput(vp);
 	free(fp);
 	return 0;
@@ -211,6 +215,8 @@ sys_write(file_t fp, void *buf, size_t size, size_t *count)
 	vp = fp->f_vnode;
 	vn_lock(vp);
 	error = VOP_WRITE(vp, fp, buf, size, count);
+	if (!error)
+		vn_touch(vp);
 	vn_unlock(vp);
 	return error;
 }
@@ -483,6 +489,9 @@ sys_mkdir(char *path, mode_t mode)
 	mode |= S_IFDIR;
 
 	error = VOP_MKDIR(dvp, name, mode);
+	if (!error)
+		vn_touch(dvp);
+	dcache_purge(path);
  out:
 	vput(dvp);
 	return error;
@@ -507,6 +516,7 @@ sys_rmdir(char *path)
 		error = ENOTDIR;
 		goto out;
 	}
+	dcache_purge(path);
 	if (vp->v_flags & VROOT || vcount(vp) >= 2) {
 		error = EBUSY;
 		goto out;
@@ -515,6 +525,8 @@ sys_rmdir(char *path)
 		goto out;
 
 	error = VOP_RMDIR(dvp, vp, name);
+	if (!error)
+		vn_touch(dvp);
 	vn_unlock(vp);
 	vgone(vp);
 	vput(dvp);
@@ -558,6 +570,9 @@ sys_mknod(char *path, mode_t mode)
 		error = VOP_MKDIR(dvp, name, mode);
 	else
 		error = VOP_CREATE(dvp, name, mode);
+	if (!error)
+		vn_touch(dvp);
+	dcache_purge(path);
  out:
 	vput(dvp);
 	return error;
@@ -590,12 +605,14 @@ sys_rename(char *src, char *dest)
 		goto err1;
 	}
 	/* Is the source busy ? */
+	dcache_purge(src);
 	if (vcount(vp1) >= 2) {
 		error = EBUSY;
 		goto err1;
 	}
 	/* Check type of source & target */
 	error = namei(dest, &vp2);
+	dcache_purge(dest);
 	if (error == 0) {
 		/* target exists */
 		if (vp1->v_type == VDIR && vp2->v_type != VDIR) {
@@ -639,6 +656,10 @@ sys_rename(char *src, char *dest)
 		goto err4;
 	}
 	error = VOP_RENAME(dvp1, vp1, sname, dvp2, vp2, dname);
+	if (!error) {
+		vn_touch(vp1);
+		vn_touch(dvp2);
+	}
  err4:
 	vput(dvp2);
  err3:
@@ -669,6 +690,7 @@ sys_unlink(char *path)
 		goto out;
 	}
 	/* XXX: Need to allow unlink for opened file. */
+	dcache_purge(path);
 	if (vp->v_flags & VROOT || vcount(vp) >= 2) {
 		error = EBUSY;
 		goto out;
@@ -677,6 +699,8 @@ sys_unlink(char *path)
 		goto out;
 
 	error = VOP_REMOVE(dvp, vp, name);
+	if (!error)
+		vn_touch(dvp);
 
 	vn_unlock(vp);
 	vgone(vp);
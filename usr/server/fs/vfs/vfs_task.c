@@ -110,6 +110,7 @@ task_alloc(task_t task, struct task **pt)
 	t->t_taskid = task;
 	strlcpy(t->t_cwd, "/", sizeof(t->t_cwd));
 	mutex_init(&t->t_lock);
+	list_init(&t->t_pollsets);
 
 	TASK_LOCK();
 	list_insert(&task_table[TASKHASH(task)], &t->t_link);
@@ -35,6 +35,8 @@
 #include <sys/list.h>
 #include <sys/vnode.h>
 #include <sys/mount.h>
+#include <sys/poll.h>
+#include <sys/time.h>
 
 #include <limits.h>
 #include <unistd.h>
@@ -177,10 +179,12 @@ vget(mount_t mp, char *path)
 	}
 	vp->v_mount = mp;
 	vp->v_refcnt = 1;
+	vp->v_mtime = mp->m_mtime;
 	vp->v_op = mp->m_op->vfs_vnops;
 	strlcpy(vp->v_path, path, len);
 	mutex_init(&vp->v_lock);
 	vp->v_nrlocks = 0;
+	list_init(&vp->v_pollers);
 
 	/*
 	 * Request to allocate fs specific data for vnode.
@@ -348,6 +352,7 @@ vn_stat(vnode_t vp, struct stat *st)
 
 	st->st_ino = (ino_t)vp;
 	st->st_size = vp->v_size;
+	st->st_mtime = vp->v_mtime;
 	mode = vp->v_mode;
 	switch (vp->v_type) {
 	case VREG:
@@ -385,6 +390,24 @@ vn_stat(vnode_t vp, struct stat *st)
 	return 0;
 }
 
+/*
+ * Update the modification time of the vnode.
+ *
+ * The time is the seconds since boot. Since the file systems do
+ * not keep the time, a vnode which is created again gets the last
+ * modification time of its file system. So, st_mtime is never
+ * older than the actual modification.
+ */
+void
+vn_touch(vnode_t vp)
+{
+	struct timespec ts;
+
+	sys_uptime(&ts);
+	vp->v_mtime = (time_t)ts.ts_sec;
+	vp->v_mount->m_mtime = vp->v_mtime;
+}
+
 /*
  * Chceck permission on vnode pointer.
  */
@@ -415,6 +438,30 @@ vn_access(vnode_t vp, int flags)
 	return error;
 }
 
+/*
+ * Detect sequential read, and return the number of blocks to
+ * read ahead. @blkno and @nblks are the range of the logical
+ * blocks in the file for this read, and the block unit is up to
+ * the file system. The window is doubled while the file is read
+ * sequentially, and it is closed on random access.
+ */
+int
+vn_readahead(vnode_t vp, int blkno, int nblks)
+{
+
+	if (blkno == vp->v_ranext || blkno == vp->v_ranext - 1) {
+		if (vp->v_rawin == 0)
+			vp->v_rawin = nblks;
+		else
+			vp->v_rawin *= 2;
+		if (vp->v_rawin > VRA_MAXWIN)
+			vp->v_rawin = VRA_MAXWIN;
+	} else
+		vp->v_rawin = 0;
+	vp->v_ranext = blkno + nblks;
+	return vp->v_rawin;
+}
+
 #ifdef DEBUG_VFS
 /*
  * Dump all all vnode.
@@ -466,6 +513,16 @@ vop_einval(void)
 	return EINVAL;
 }
 
+/*
+ * Poll routine for the files which are always ready.
+ */
+int
+vop_seltrue(vnode_t vp, file_t fp, int events)
+{
+
+	return events & (POLLIN | POLLOUT);
+}
+
 /*
  * vnode_init() is called once (from vfs_init)
  * in initialization.
@@ -2,7 +2,8 @@
 #define LWIP_ARCH_CC_H
 
 #include <sys/types.h>
-#include <sys/errno.h>
+#include <errno.h>
+#include <sys/time.h>
 #include <assert.h>
 
 typedef uint32_t u32_t;
@@ -36,8 +37,12 @@ typedef vaddr_t mem_ptr_t;
 #define LWIP_PLATFORM_ASSERT(x) sys_panic(x)
 
 #ifndef BYTE_ORDER
+#ifdef __x86__
+#define BYTE_ORDER LITTLE_ENDIAN
+#else
 #define BYTE_ORDER BIG_ENDIAN
 #endif
+#endif
 
 #endif
 
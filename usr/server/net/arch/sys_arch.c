@@ -1,345 +1,314 @@
+/*
+ * lwIP system emulation layer on Prex
+ *
+ * Semaphores and mutexes are the kernel objects of Prex, and a
+ * mailbox is a ring of messages guarded by two semaphores.
+ */
+
+#include <sys/prex.h>
+#include <sys/sysinfo.h>
+#include <sys/param.h>
+
+#include <stdlib.h>
+#include <string.h>
+
 #include <lwip/sys.h>
 #include <arch/cc.h>
 
-#define debug 0
-
-#if 0
-#define NSEM		256
-#define NMBOX		128
-#define MBOXSLOTS	32
-
-struct sys_sem_entry {
-	int freed;
-	int gen;
-	union {
-		uint32_t v;
-		struct {
-			uint16_t counter;
-			uint16_t waiters;
-		};
-	};
-	LIST_ENTRY(sys_sem_entry) link;
+#define NTHREADS	16	/* max lwIP threads */
+#define MBOXSLOTS	64	/* max messages in mailbox */
+
+struct sys_mbox {
+	int		head;		/* next message to fetch */
+	int		tail;		/* next slot to post */
+	int		size;		/* number of slots */
+	mutex_t		lock;
+	sem_t		queued;		/* number of messages */
+	sem_t		free;		/* number of free slots */
+	void		*msg[MBOXSLOTS];
 };
-static struct sys_sem_entry sems[NSEM];
-static LIST_HEAD(sem_list, sys_sem_entry) sem_free;
-
-struct sys_mbox_entry {
-	int freed;
-	int head, nextq;
-	void *msg[MBOXSLOTS];
-	sys_sem_t queued_msg;
-	sys_sem_t free_msg;
-	LIST_ENTRY(sys_mbox_entry) link;
-};
-static struct sys_mbox_entry mboxes[NMBOX];
-static LIST_HEAD(mbox_list, sys_mbox_entry) mbox_free;
 
 struct sys_thread {
-	thread_id_t tid;
+	thread_t	t;
+	void		(*func)(void *);
+	void		*arg;
 	struct sys_timeouts tmo;
-	LIST_ENTRY(sys_thread) link;
 };
 
-enum { thread_hash_size = 257 };
-static LIST_HEAD(thread_list, sys_thread) threads[thread_hash_size];
-#endif
+static struct sys_thread threads[NTHREADS];
+static struct sys_timeouts main_tmo;	/* for the main thread */
+static mutex_t thread_lock = MUTEX_INITIALIZER;
+static mutex_t prot_lock = MUTEX_INITIALIZER;
+static int hz;
+
+/*
+ * Return the current time in msec.
+ */
+static u32_t
+sys_msec(void)
+{
+	u_long ticks;
+
+	sys_time(&ticks);
+	return (u32_t)((ticks / hz) * 1000 + (ticks % hz) * 1000 / hz);
+}
 
 void
 sys_init(void)
 {
-#if 0
-	int i = 0;
-	for (i = 0; i < NSEM; i++) {
-		sems[i].freed = 1;
-		LIST_INSERT_HEAD(&sem_free, &sems[i], link);
-	}
+	struct timerinfo info;
 
-	for (i = 0; i < NMBOX; i++) {
-		mboxes[i].freed = 1;
-		LIST_INSERT_HEAD(&mbox_free, &mboxes[i], link);
-	}
-#endif
+	sys_info(INFO_TIMER, &info);
+	hz = info.hz;
+	mutex_init(&thread_lock);
+	mutex_init(&prot_lock);
 }
 
 sys_mbox_t
 sys_mbox_new(int size)
 {
-#if 0
-	assert(size < MBOXSLOTS);
-	struct sys_mbox_entry *mbe = LIST_FIRST(&mbox_free);
-	if (!mbe) {
-		cprintf("lwip: sys_mbox_new: out of mailboxes\n");
+	struct sys_mbox *mb;
+
+	if (size <= 0 || size > MBOXSLOTS)
+		size = MBOXSLOTS;
+	if ((mb = malloc(sizeof(*mb))) == NULL)
+		return SYS_MBOX_NULL;
+	mb->head = mb->tail = 0;
+	mb->size = size;
+	mutex_init(&mb->lock);
+	if (sem_init(&mb->queued, 0) != 0) {
+		free(mb);
 		return SYS_MBOX_NULL;
 	}
-	LIST_REMOVE(mbe, link);
-	assert(mbe->freed);
-	mbe->freed = 0;
-
-	int i = mbe - &mboxes[0];
-	mbe->head = -1;
-	mbe->nextq = 0;
-	mbe->queued_msg = sys_sem_new(0);
-	mbe->free_msg = sys_sem_new(MBOXSLOTS);
-
-	if (mbe->queued_msg == SYS_SEM_NULL ||
-			mbe->free_msg == SYS_SEM_NULL)
-	{
-		sys_mbox_free(i);
-		cprintf("lwip: sys_mbox_new: can't get semaphore\n");
+	if (sem_init(&mb->free, (u_int)size) != 0) {
+		sem_destroy(&mb->queued);
+		free(mb);
 		return SYS_MBOX_NULL;
 	}
-	return i;
-#endif
-	return 0;
+	return mb;
 }
 
 void
 sys_mbox_free(sys_mbox_t mbox)
 {
-#if 0
-	assert(!mboxes[mbox].freed);
-	sys_sem_free(mboxes[mbox].queued_msg);
-	sys_sem_free(mboxes[mbox].free_msg);
-	LIST_INSERT_HEAD(&mbox_free, &mboxes[mbox], link);
-	mboxes[mbox].freed = 1;
-#endif
+
+	sem_destroy(&mbox->queued);
+	sem_destroy(&mbox->free);
+	mutex_destroy(&mbox->lock);
+	free(mbox);
+}
+
+static void
+mbox_put(sys_mbox_t mbox, void *msg)
+{
+
+	mutex_lock(&mbox->lock);
+	mbox->msg[mbox->tail] = msg;
+	mbox->tail = (mbox->tail + 1) % mbox->size;
+	mutex_unlock(&mbox->lock);
+	sem_post(&mbox->queued);
 }
 
 void
 sys_mbox_post(sys_mbox_t mbox, void *msg)
 {
-#if 0
-	assert(sys_mbox_trypost(mbox, msg) == ERR_OK);
-#endif
+
+	while (sem_wait(&mbox->free, 0) != 0)
+		;
+	mbox_put(mbox, msg);
 }
 
-err_t 
+err_t
 sys_mbox_trypost(sys_mbox_t mbox, void *msg)
 {
-#if 0
-	assert(!mboxes[mbox].freed);
 
-	sys_arch_sem_wait(mboxes[mbox].free_msg, 0);
-	if (mboxes[mbox].nextq == mboxes[mbox].head)
+	if (sem_trywait(&mbox->free) != 0)
 		return ERR_MEM;
-
-	int slot = mboxes[mbox].nextq;
-	mboxes[mbox].nextq = (slot + 1) % MBOXSLOTS;
-	mboxes[mbox].msg[slot] = msg;
-
-	if (mboxes[mbox].head == -1)
-		mboxes[mbox].head = slot;
-
-	sys_sem_signal(mboxes[mbox].queued_msg);
-#endif
-
+	mbox_put(mbox, msg);
 	return ERR_OK;
 }
 
 sys_sem_t
 sys_sem_new(u8_t count)
 {
-#if 0
-	struct sys_sem_entry *se = LIST_FIRST(&sem_free);
-	if (!se) {
-		cprintf("lwip: sys_sem_new: out of semaphores\n");
+	sem_t sem;
+
+	if (sem_init(&sem, count) != 0)
 		return SYS_SEM_NULL;
-	}
-	LIST_REMOVE(se, link);
-	assert(se->freed);
-	se->freed = 0;
-
-	se->counter = count;
-	se->gen++;
-	return se - &sems[0];
-#endif
-	return 0;
+	return sem;
 }
 
 void
 sys_sem_free(sys_sem_t sem)
 {
-#if 0
-	assert(!sems[sem].freed);
-	sems[sem].freed = 1;
-	sems[sem].gen++;
-	LIST_INSERT_HEAD(&sem_free, &sems[sem], link);
-#endif
+
+	sem_destroy(&sem);
 }
 
 void
 sys_sem_signal(sys_sem_t sem)
 {
-#if 0
-	assert(!sems[sem].freed);
-	sems[sem].counter++;
-	if (sems[sem].waiters) {
-		sems[sem].waiters = 0;
-		thread_wakeup(&sems[sem].v);
-	}
-#endif
+
+	sem_post(&sem);
 }
 
+/*
+ * Wait for the semaphore, and return the time waited in msec.
+ */
 u32_t
 sys_arch_sem_wait(sys_sem_t sem, u32_t tm_msec)
 {
-#if 0
-	assert(!sems[sem].freed);
-	u32_t waited = 0;
-
-	int gen = sems[sem].gen;
+	u32_t start, waited;
+	int error;
 
-	while (tm_msec == 0 || waited < tm_msec) {
-		if (sems[sem].counter > 0) {
-			sems[sem].counter--;
-			return waited;
-		} else if (tm_msec == SYS_ARCH_NOWAIT) {
+	if (tm_msec == SYS_ARCH_NOWAIT) {
+		if (sem_trywait(&sem) != 0)
 			return SYS_ARCH_TIMEOUT;
-		} else {
-			uint32_t a = sys_time_msec();
-			uint32_t sleep_until = tm_msec ? a + (tm_msec - waited) : ~0;
-			sems[sem].waiters = 1;
-			uint32_t cur_v = sems[sem].v;
-			lwip_core_unlock();
-			thread_wait(&sems[sem].v, cur_v, sleep_until);
-			lwip_core_lock();
-			if (gen != sems[sem].gen) {
-				cprintf("sys_arch_sem_wait: sem freed under waiter!\n");
-				return SYS_ARCH_TIMEOUT;
-			}
-			uint32_t b = sys_time_msec();
-			waited += (b - a);
-		}
+		return 0;
 	}
-
-	return SYS_ARCH_TIMEOUT;
-#endif
-	return 0;
+	start = sys_msec();
+	for (;;) {
+		waited = sys_msec() - start;
+		if (tm_msec != 0 && waited >= tm_msec)
+			return SYS_ARCH_TIMEOUT;
+		error = sem_wait(&sem, tm_msec ? tm_msec - waited : 0);
+		if (error == 0)
+			break;
+		if (error == ETIMEDOUT)
+			return SYS_ARCH_TIMEOUT;
+		/* interrupted by an exception: wait again */
+	}
+	waited = sys_msec() - start;
+	if (tm_msec != 0 && waited >= tm_msec)
+		waited = tm_msec - 1;
+	return waited;
 }
 
 u32_t
 sys_arch_mbox_fetch(sys_mbox_t mbox, void **msg, u32_t tm_msec)
 {
-#if 0
-	assert(!mboxes[mbox].freed);
+	u32_t waited;
+	void *m;
 
-	u32_t waited = sys_arch_sem_wait(mboxes[mbox].queued_msg, tm_msec);
+	waited = sys_arch_sem_wait(mbox->queued, tm_msec);
 	if (waited == SYS_ARCH_TIMEOUT)
 		return waited;
 
-	int slot = mboxes[mbox].head;
-	if (slot == -1)
-		panic("lwip: sys_arch_mbox_fetch: no message");
-	if (msg)
-		*msg = mboxes[mbox].msg[slot];
+	mutex_lock(&mbox->lock);
+	m = mbox->msg[mbox->head];
+	mbox->head = (mbox->head + 1) % mbox->size;
+	mutex_unlock(&mbox->lock);
+	sem_post(&mbox->free);
 
-	mboxes[mbox].head = (slot + 1) % MBOXSLOTS;
-	if (mboxes[mbox].head == mboxes[mbox].nextq)
-		mboxes[mbox].head = -1;
-
-	sys_sem_signal(mboxes[mbox].free_msg);
+	if (msg)
+		*msg = m;
 	return waited;
-#endif 
-	return 0;
 }
 
-u32_t 
+u32_t
 sys_arch_mbox_tryfetch(sys_mbox_t mbox, void **msg)
 {
-	return sys_arch_mbox_fetch(mbox, msg, SYS_ARCH_NOWAIT);
-}
+	u32_t waited;
 
-struct lwip_thread {
-	void (*func)(void *arg);
-	void *arg;
-};
-
-#if 0
-static void
-lwip_thread_entry(uint32_t arg)
-{
-	struct lwip_thread *lt = (struct lwip_thread *)arg;
-	lwip_core_lock();
-	lt->func(lt->arg);
-	lwip_core_unlock();
-	free(lt);
+	waited = sys_arch_mbox_fetch(mbox, msg, SYS_ARCH_NOWAIT);
+	if (waited == SYS_ARCH_TIMEOUT)
+		return SYS_MBOX_EMPTY;
+	return 0;
 }
-#endif
 
-sys_thread_t
-sys_thread_new(char *name, void (* thread)(void *arg), void *arg, 
-		int stacksize, int prio)
+static struct sys_thread *
+thread_lookup(thread_t t)
 {
-#if 0
-	struct lwip_thread *lt = malloc(sizeof(*lt));
-	if (lt == 0)
-		panic("sys_thread_new: cannot allocate thread struct");
-
-	if (stacksize > PGSIZE)
-		panic("large stack %d", stacksize);
+	int i;
 
-	lt->func = thread;
-	lt->arg = arg;
+	for (i = 0; i < NTHREADS; i++) {
+		if (threads[i].t == t)
+			return &threads[i];
+	}
+	return NULL;
+}
 
-	thread_id_t tid;
-	int r = thread_create(&tid, name, lwip_thread_entry, (uint32_t)lt);
+/*
+ * Entry point of lwIP threads. Prex does not pass an argument
+ * to a new thread, so it is found in the thread table.
+ */
+static void
+lwip_thread_entry(void)
+{
+	struct sys_thread *st;
 
-	if (r < 0)
-		panic("lwip: sys_thread_new: cannot create: %s\n", e2s(r));
+	mutex_lock(&thread_lock);
+	st = thread_lookup(thread_self());
+	mutex_unlock(&thread_lock);
 
-	return tid;
-#endif
-	return 0;
+	st->func(st->arg);
+	thread_terminate(thread_self());
 }
 
-#if 0
-static void
-timeout_cleanup(void)
+sys_thread_t
+sys_thread_new(char *name, void (* thread)(void *arg), void *arg,
+		int stacksize, int prio)
 {
-	lwip_core_lock();
-
-	thread_id_t tid = thread_id();
-	struct sys_thread *t;
-	LIST_FOREACH(t, &threads[tid % thread_hash_size], link)
-		if (t->tid == tid) {
-			free(t);
-			LIST_REMOVE(t, link);
-			goto done;
-		}
-
-	if (debug) cprintf("timeout_cleanup: bogus tid %ld\n", tid);
-done:
-	lwip_core_unlock();
+	struct sys_thread *st;
+	task_t self = task_self();
+	thread_t t;
+	void *stack, *sp;
+
+	if (stacksize < DFLSTKSZ)
+		stacksize = DFLSTKSZ;
+
+	mutex_lock(&thread_lock);
+	if ((st = thread_lookup(0)) == NULL)
+		sys_panic("lwip: too many threads");
+	if (thread_create(self, &t) != 0)
+		sys_panic("lwip: cannot create thread");
+	if (vm_allocate(self, &stack, (size_t)stacksize, 1) != 0)
+		sys_panic("lwip: cannot allocate stack");
+	sp = (void *)((u_long)stack + stacksize - sizeof(u_long) * 3);
+	thread_load(t, lwip_thread_entry, sp);
+	if (prio > 0)
+		thread_setpri(t, prio);
+
+	st->t = t;
+	st->func = thread;
+	st->arg = arg;
+	memset(&st->tmo, 0, sizeof(st->tmo));
+	mutex_unlock(&thread_lock);
+
+	thread_resume(t);
+	return t;
 }
-#endif
 
 struct sys_timeouts *
 sys_arch_timeouts(void)
 {
-#if 0
-	thread_id_t tid = thread_id();
-
-	struct sys_thread *t;
-	LIST_FOREACH(t, &threads[tid % thread_hash_size], link)
-		if (t->tid == tid)
-			goto out;
+	struct sys_thread *st;
+
+	mutex_lock(&thread_lock);
+	st = thread_lookup(thread_self());
+	mutex_unlock(&thread_lock);
+	if (st == NULL)
+		return &main_tmo;
+	return &st->tmo;
+}
 
-	t = malloc(sizeof(*t));
-	if (t == 0)
-		panic("sys_arch_timeouts: cannot malloc");
+/*
+ * Protection for the memory pools. The mutex of Prex can be
+ * locked recursively.
+ */
+sys_prot_t
+sys_arch_protect(void)
+{
 
-	int r = thread_onhalt(timeout_cleanup);
-	if (r < 0)
-		panic("thread_onhalt failed: %s", e2s(r));
+	mutex_lock(&prot_lock);
+	return 0;
+}
 
-	t->tid = tid;
-	memset(&t->tmo, 0, sizeof(t->tmo));
-	LIST_INSERT_HEAD(&threads[tid % thread_hash_size], t, link);
+void
+sys_arch_unprotect(sys_prot_t pval)
+{
 
-out:
-	return &t->tmo;
-#endif
-	return 0;
+	mutex_unlock(&prot_lock);
 }
 
 void
@@ -3,21 +3,20 @@
 
 #include <sys/types.h>
 
-typedef int sys_sem_t;
-typedef int sys_mbox_t;
-typedef int sys_thread_t;
+struct sys_mbox;
 
-#define SYS_MBOX_NULL   (-1)
-#define SYS_SEM_NULL    (-1)
+typedef sem_t sys_sem_t;
+typedef struct sys_mbox *sys_mbox_t;
+typedef thread_t sys_thread_t;
+typedef int sys_prot_t;
+
+#define SYS_MBOX_NULL   ((sys_mbox_t)0)
+#define SYS_SEM_NULL    ((sys_sem_t)0)
 
 void lwip_core_lock(void);
 void lwip_core_unlock(void);
 void lwip_core_init(void);
 
-#define SYS_ARCH_DECL_PROTECT(lev)
-#define SYS_ARCH_PROTECT(lev)
-#define SYS_ARCH_UNPROTECT(lev)
-
 #define SYS_ARCH_NOWAIT  0xfffffffe
 
 #endif
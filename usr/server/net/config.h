@@ -3,3 +3,17 @@
 #define DEF_NR_TXBUF	32
 
 #define DEF_NR_RXBUF	32
+
+/*
+ * Threads to process the socket requests. A request which waits
+ * for the network holds one of them until it completes.
+ */
+#define NR_NET_THREADS		8
+#define NET_THREAD_STACKSIZE	8192
+
+/*
+ * TCP sink to measure the receive throughput with iperf.
+ * Run "iperf -c <address> -p IPERF_PORT" on the host.
+ */
+/* #define CONFIG_IPERF */
+#define IPERF_PORT	5001
@@ -0,0 +1,112 @@
+/*
+ * TCP sink for iperf - receives data on a port, discards it and
+ * reports the throughput when the connection is closed.
+ */
+
+#include <sys/prex.h>
+#include <sys/sysinfo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <lwip/tcp.h>
+#include <lwip/tcpip.h>
+
+#include "config.h"
+#include "iperf.h"
+
+#ifdef CONFIG_IPERF
+
+struct iperf_conn {
+	u_long		start;		/* ticks at accept */
+	u_long		bytes;		/* bytes received */
+};
+
+static int iperf_port;
+
+static void
+iperf_report(struct iperf_conn *ic)
+{
+	struct timerinfo info;
+	u_long ticks, msec;
+
+	sys_info(INFO_TIMER, &info);
+	sys_time(&ticks);
+	msec = (ticks - ic->start) * 1000 / info.hz;
+	if (msec == 0)
+		msec = 1;
+	dprintf("iperf: %lu bytes in %lu msec, %lu Kbits/sec\n",
+		ic->bytes, msec, ic->bytes / msec * 8);
+}
+
+static err_t
+iperf_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+	struct iperf_conn *ic = arg;
+
+	if (p == NULL) {
+		/* closed by the peer */
+		iperf_report(ic);
+		free(ic);
+		tcp_arg(pcb, NULL);
+		tcp_recv(pcb, NULL);
+		tcp_close(pcb);
+		return ERR_OK;
+	}
+	ic->bytes += p->tot_len;
+	tcp_recved(pcb, p->tot_len);
+	pbuf_free(p);
+	return ERR_OK;
+}
+
+static void
+iperf_err(void *arg, err_t err)
+{
+
+	free(arg);
+}
+
+static err_t
+iperf_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+	struct iperf_conn *ic;
+
+	if ((ic = malloc(sizeof(*ic))) == NULL)
+		return ERR_MEM;
+	sys_time(&ic->start);
+	ic->bytes = 0;
+	tcp_arg(pcb, ic);
+	tcp_recv(pcb, iperf_recv);
+	tcp_err(pcb, iperf_err);
+	return ERR_OK;
+}
+
+/*
+ * The raw API is called in the tcpip thread.
+ */
+static void
+iperf_listen(void *arg)
+{
+	struct tcp_pcb *pcb;
+
+	if ((pcb = tcp_new()) == NULL)
+		return;
+	if (tcp_bind(pcb, IP_ADDR_ANY, (u16_t)iperf_port) != ERR_OK) {
+		tcp_close(pcb);
+		return;
+	}
+	if ((pcb = tcp_listen(pcb)) == NULL)
+		return;
+	tcp_accept(pcb, iperf_accept);
+	dprintf("iperf: listening on port %d\n", iperf_port);
+}
+
+void
+iperf_init(int port)
+{
+
+	iperf_port = port;
+	tcpip_callback(iperf_listen, NULL);
+}
+
+#endif /* CONFIG_IPERF */
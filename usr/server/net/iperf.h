@@ -0,0 +1,6 @@
+#ifndef _IPERF_H_
+#define _IPERF_H_
+
+void iperf_init(int port);
+
+#endif /* !_IPERF_H_ */
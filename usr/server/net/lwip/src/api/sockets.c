@@ -1121,6 +1121,7 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
       break;
     }
   }
+  LWIP_SOCKET_EVENT_HOOK(s);
 }
 
 /**
@@ -902,6 +902,15 @@
 #define PBUF_POOL_BUFSIZE               LWIP_MEM_ALIGN_SIZE(TCP_MSS+40+PBUF_LINK_HLEN)
 #endif
 
+/**
+ * LWIP_SUPPORT_CUSTOM_PBUF==1: Support for custom pbufs, whose memory
+ * is owned by the port. When the last reference is released, pbuf_free
+ * calls the free function of the pbuf instead of freeing the memory.
+ */
+#ifndef LWIP_SUPPORT_CUSTOM_PBUF
+#define LWIP_SUPPORT_CUSTOM_PBUF        0
+#endif
+
 /*
    ------------------------------------------------
    ---------- Network Interfaces options ----------
@@ -1218,6 +1227,15 @@
 #define LWIP_POSIX_SOCKETS_IO_NAMES     1
 #endif
 
+/**
+ * LWIP_SOCKET_EVENT_HOOK(s): Called after the events of socket s have
+ * changed, so that the port can wake up its own waiters. It is called
+ * from event_callback() without any semaphore of the socket layer held.
+ */
+#ifndef LWIP_SOCKET_EVENT_HOOK
+#define LWIP_SOCKET_EVENT_HOOK(s)
+#endif
+
 /**
  * LWIP_TCP_KEEPALIVE==1: Enable TCP_KEEPIDLE, TCP_KEEPINTVL and TCP_KEEPCNT
  * options processing. Note that TCP_KEEPIDLE and TCP_KEEPINTVL have to be set
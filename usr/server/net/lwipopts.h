@@ -2,6 +2,7 @@
 #define _PREX_LWIP_LWIPOPTS_H_
 
 #include <sys/prex.h>
+#include <sys/param.h>
 #include <sys/types.h>
 #include <stdio.h>
 #include <string.h>
@@ -12,8 +13,10 @@
 #define LWIP_STATS_DISPLAY	0
 #define LWIP_DHCP		1
 #define LWIP_COMPAT_SOCKETS	0
-#define LWIP_SOCKET		0
-/*#define SYS_LIGHTWEIGHT_PROT	1*/
+#define LWIP_SOCKET		1
+#define LWIP_TIMEVAL_PRIVATE	0
+#define LWIP_HAVE_LOOPIF	1
+#define SYS_LIGHTWEIGHT_PROT	1
 /*#define LWIP_PROVIDE_ERRNO	1*/
 
 /* Various tuning knobs, see:
@@ -38,6 +41,17 @@
 #define PBUF_POOL_SIZE		512
 #define PBUF_POOL_BUFSIZE	2000
 
+/* received frames are passed up in the dbufs of the driver */
+#define LWIP_SUPPORT_CUSTOM_PBUF	1
+
+/* the pollers of the clients are woken by sock_event() */
+void	sock_event(int);
+#define LWIP_SOCKET_EVENT_HOOK(s)	sock_event(s)
+
+#define TCPIP_THREAD_STACKSIZE	16384
+#define TCPIP_THREAD_PRIO	PRI_NET
+#define TCPIP_MBOX_SIZE		64
+
 #define TCP_MSS			1460
 #define TCP_WND			24000
 #define TCP_SND_BUF		(16 * TCP_MSS)
@@ -3,7 +3,7 @@
  * Network server - interface to lwIP stack
  */
 
-#define DEBUG_NET 1
+/* #define DEBUG_NET 1 */
 
 #ifdef DEBUG_NET
 #define DPRINTF(a) dprintf a
@@ -18,6 +18,7 @@
 #include <ipc/proc.h>
 #include <ipc/ipc.h>
 #include <ipc/exec.h>
+#include <ipc/net.h>
 #include <sys/list.h>
 
 #include <unistd.h>
@@ -32,8 +33,11 @@
 #include <lwip/stats.h>
 #include <lwip/netbuf.h>
 #include <netif/etharp.h>
+#include <netif/loopif.h>
 
 #include "pif.h"
+#include "iperf.h"
+#include "sock.h"
 
 /*
  * Message mapping
@@ -43,8 +47,38 @@ struct msg_map {
 	int	(*func)(struct msg *);
 };
 
+#define MSGMAP(code, fn) {code, (int (*)(struct msg *))fn}
+
 static const struct msg_map netmsg_map[] = {
-	{0,	0},
+	MSGMAP(NET_SOCKET,	sock_socket),
+	MSGMAP(NET_BIND,	sock_bind),
+	MSGMAP(NET_LISTEN,	sock_listen),
+	MSGMAP(NET_ACCEPT,	sock_accept),
+	MSGMAP(NET_CONNECT,	sock_connect),
+	MSGMAP(NET_SHUTDOWN,	sock_shutdown),
+	MSGMAP(NET_CLOSE,	sock_close),
+	MSGMAP(NET_SETSOCKOPT,	sock_setsockopt),
+	MSGMAP(NET_GETSOCKOPT,	sock_getsockopt),
+	MSGMAP(NET_GETSOCKNAME,	sock_getsockname),
+	MSGMAP(NET_GETPEERNAME,	sock_getpeername),
+	MSGMAP(NET_SEND,	sock_send),
+	MSGMAP(NET_RECV,	sock_recv),
+	MSGMAP(NET_BATCH,	sock_batch),
+	MSGMAP(NET_IOCTL,	sock_ioctl),
+	MSGMAP(NET_FCNTL,	sock_fcntl),
+	MSGMAP(NET_EXIT,	sock_exit),
+	MSGMAP(0,		0),
+};
+
+/*
+ * Buffer for the largest message.
+ */
+union netmsg {
+	struct msg		msg;
+	struct sock_msg		sock;
+	struct sockopt_msg	sockopt;
+	struct sockio_msg	sockio;
+	struct sockbatch_msg	batch;
 };
 
 struct net_state {
@@ -53,7 +87,10 @@ struct net_state {
 };
 
 static struct net_state ns;
+static struct netif loop_nif;
+static object_t netobj;
 
+#ifdef DEBUG_NET
 static char
 interface_type[][20] =
 {
@@ -65,6 +102,7 @@ interface_name(netif_type_t type)
 {
 	return interface_type[type];
 }
+#endif
 
 /*
  * Wait until specified server starts.
@@ -98,32 +136,74 @@ allocate_dbuf(struct pif *pif)
 {
 	int i;
 	dbuf_t dbuf;
-	list_init(&pif->tx_free_list);
-	list_init(&pif->rx_free_list);
-
-	/* allocate TX buffers */
-	for (i = 0; i < DEF_NR_TXBUF; i++)
-	{
-		vm_allocate(task_self(),
-			    (void *)&pif->tx_buf[i], PAGE_SIZE, 1);
-		dbuf = pif->tx_buf[i];
+
+	mutex_init(&pif->lock);
+	list_init(&pif->free_list);
+
+	/*
+	 * Allocate buffers. The first DEF_NR_TXBUF buffers are
+	 * kept for transmit, and the others are given to the
+	 * driver for receive.
+	 */
+	for (i = 0; i < NR_DBUFS; i++) {
+		if (vm_allocate(task_self(),
+				(void *)&pif->dbufs[i], PAGE_SIZE, 1))
+			sys_panic("net: cannot allocate dbuf");
+		dbuf = pif->dbufs[i];
 		dbuf->magic = DATAGRAM_HDR_MAGIC;
+		dbuf->data_start = (char *)dbuf + DBUF_DATA_OFFSET;
+		dbuf->data_length = 0;
 		list_init(&dbuf->link);
-		list_insert(&pif->tx_free_list, &dbuf->link);
+		if (i < DEF_NR_TXBUF)
+			list_insert(&pif->free_list, &dbuf->link);
 	}
 	pif->free_txbufs = DEF_NR_TXBUF;
+	pif->rx_held = 0;
+}
 
-	/* allocate RX buffers */
-	for (i = 0; i < DEF_NR_RXBUF; i++)
-	{
-		vm_allocate(task_self(),
-			    (void *)&pif->rx_buf[i], PAGE_SIZE, 1);
-		dbuf = pif->rx_buf[i];
-		dbuf->magic = DATAGRAM_HDR_MAGIC;
-		list_init(&dbuf->link);
-		list_insert(&pif->tx_free_list, &dbuf->link);
+/*
+ * Message loop of the worker threads. The requests which wait
+ * for the network are processed in parallel by the workers.
+ */
+static void
+net_worker(void *arg)
+{
+	union netmsg m;
+	const struct msg_map *map;
+	int error;
+
+	for (;;) {
+		/*
+		 * Wait for an incoming request.
+		 */
+		error = msg_receive(netobj, &m, sizeof(m));
+		if (error)
+			continue;
+
+		DPRINTF(("net: msg code=%x task=%x\n",
+			 m.msg.hdr.code, m.msg.hdr.task));
+
+		/* Check client's capability. */
+		if (task_chkcap(m.msg.hdr.task, CAP_NETWORK) != 0) {
+			map = NULL;
+			error = EPERM;
+		} else {
+			error = EINVAL;
+			map = &netmsg_map[0];
+			while (map->code != 0) {
+				if (map->code == m.msg.hdr.code) {
+					error = (*map->func)(&m.msg);
+					break;
+				}
+				map++;
+			}
+		}
+		/*
+		 * Reply to the client.
+		 */
+		m.msg.hdr.status = error;
+		msg_reply(netobj, &m, sizeof(m));
 	}
-	pif->free_rxbufs = DEF_NR_RXBUF;
 }
 
 int
@@ -131,8 +211,9 @@ main(int argc, char *argv[])
 {
 	device_t netc;
 	struct bind_msg bm;
-	object_t execobj, netobj;
-	int num_if, error, i;
+	object_t execobj;
+	struct ip_addr ipaddr, netmask, gateway;
+	int num_if = 0, error, i;
 
 	sys_log("Starting net server\n");
 
@@ -152,17 +233,29 @@ main(int argc, char *argv[])
 	strlcpy(bm.path, "/boot/net", sizeof(bm.path));
 	msg_send(execobj, &bm, sizeof(bm));
 
+	/* start lwIP and the tcpip thread */
+	sock_init();
+	tcpip_init(NULL, NULL);
+
 	/*
-	 * Connect to the network coordinator
+	 * The loopback interface is always available.
 	 */
-	if (device_open("netc", 0, &netc) != 0) {
-		/*
-		 * Bad config...
-		 */
-		sys_panic("net: cannot open net coordinator");
-	}
+	ipaddr.addr  = inet_addr("127.0.0.1");
+	netmask.addr = inet_addr("255.0.0.0");
+	gateway.addr = 0;
+	if (netif_add(&loop_nif, &ipaddr, &netmask, &gateway,
+		      NULL, loopif_init, tcpip_input) == NULL)
+		sys_panic("net: error in netif_add");
+	netif_set_default(&loop_nif);
+	netif_set_up(&loop_nif);
 
-	device_ioctl(netc, NETIO_QUERY_NR_IF, &num_if);
+	/*
+	 * Connect to the network coordinator
+	 */
+	if (device_open("netc", 0, &netc) != 0)
+		sys_log("net: no net coordinator, loopback only\n");
+	else
+		device_ioctl(netc, NETIO_QUERY_NR_IF, &num_if);
 	ns.num_if = num_if;
 	ns.pif = malloc(sizeof(struct pif) * num_if);
 
@@ -171,7 +264,6 @@ main(int argc, char *argv[])
 		char name[10];
 		struct net_if_caps caps;
 		struct pif *pif = &ns.pif[i];
-		struct ip_addr ipaddr, netmask, gateway;
 		ipaddr.addr  = inet_addr("10.0.2.15");
 		netmask.addr = inet_addr("255.255.255.0");
 		gateway.addr = inet_addr("10.0.2.2");	
@@ -181,60 +273,36 @@ main(int argc, char *argv[])
 		device_ioctl(pif->dev, NETIO_GET_IF_CAPS, &caps);
 		DPRINTF(("  %s: type %s, mtu %d\n", 
 			name, interface_name(caps.type), caps.mtu));
-		strncpy(pif->name, name, sizeof(name));
+		strlcpy(pif->name, name, sizeof(pif->name));
 		pif->mtu = caps.mtu;
 		pif->type = caps.type;
+		memcpy(pif->hwaddr, caps.hwaddr, sizeof(pif->hwaddr));
 
 		/* allocate buffer pool */
 		allocate_dbuf(pif);
 
 		if (0 == netif_add(&pif->nif, &ipaddr, &netmask, &gateway,
-				   pif, pif_init, ip_input))
-			panic("lwip_init: error in netif_add\n");
+				   pif, pif_init, tcpip_input))
+			sys_panic("net: error in netif_add");
+		if (i == 0)
+			netif_set_default(&pif->nif);
+		netif_set_up(&pif->nif);
 	}
 
+#ifdef CONFIG_IPERF
+	iperf_init(IPERF_PORT);
+#endif
+
 	error = object_create("!net", &netobj);
 	if (error)
 		sys_panic("fail to create object");
 
 	/*
-	 * Message loop
+	 * Start the workers. This thread serves as one of them.
 	 */
-	for (;;) {
-		/*
-		 * Wait for an incoming request.
-		 */
-		struct msg msg;
-		const struct msg_map *map;
-		error = msg_receive(netobj, &msg, sizeof(msg));
-		if (error)
-			continue;
-
-		DPRINTF(("net: msg code=%x task=%x\n",
-			 msg.hdr.code, msg.hdr.task));
-
-
-		/* Check client's capability. */
-		if (task_chkcap(msg.hdr.task, CAP_NETWORK) != 0) {
-			map = NULL;
-			error = EPERM;
-		} else {
-			error = EINVAL;
-			map = &netmsg_map[0];
-			while (map->code != 0) {
-				if (map->code == msg.hdr.code) {
-					error = (*map->func)(&msg);
-					break;
-				}
-				map++;
-			}
-		}
-		/*
-		 * Reply to the client.
-		 */
-		msg.hdr.status = error;
-		msg_reply(netobj, &msg, sizeof(msg));
-	}
-
+	for (i = 1; i < NR_NET_THREADS; i++)
+		sys_thread_new("net", net_worker, NULL,
+			       NET_THREAD_STACKSIZE, PRI_NET);
+	net_worker(NULL);
 	return 0;
 }
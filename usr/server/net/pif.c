@@ -41,12 +41,39 @@
 #include <netif/etharp.h>
 
 #include <sys/prex.h>
+#include <sys/param.h>
 #include <sys/ioctl.h>
 #include <sys/list.h>
 #include <sys/net.h>
 
 #include "pif.h"
 
+/*
+ * A received frame is passed to lwIP in its dbuf. The custom pbuf
+ * is placed in the free area of the dbuf, between the header and
+ * the frame, and the dbuf is given back to the driver when lwIP
+ * frees the pbuf.
+ */
+struct pif_dbuf {
+	struct pbuf_custom pc;
+	struct pif	*pif;
+};
+
+#define dbuf_to_pd(buf) \
+	((struct pif_dbuf *)((char *)(buf) + DBUF_HDR_SIZE))
+#define pd_to_dbuf(pd) \
+	((dbuf_t)((char *)(pd) - DBUF_HDR_SIZE))
+#define dbuf_data(buf) \
+	((char *)(buf) + DBUF_DATA_OFFSET)
+
+/*
+ * Frames are copied instead when lwIP holds this many rx
+ * buffers, so that the receive ring does not run dry.
+ */
+#define RX_COPY_THRESHOLD	(DEF_NR_RXBUF / 2)
+
+static void pif_rx_thread(void *arg);
+
 /**
  * In this function, the hardware should be initialized.
  * Called from ethernetif_init().
@@ -58,39 +85,95 @@ static void
 low_level_init(struct netif *netif)
 {
 	struct pif *pif = netif->state;
+	struct dbuf_batch batch;
+	int i;
 
 	/* set MAC hardware address length */
 	netif->hwaddr_len = ETHARP_HWADDR_LEN;
 
 	/* set MAC hardware address */
-	netif->hwaddr[0] = 0x52;
-	netif->hwaddr[1] = 0x54;
-	netif->hwaddr[2] = 0x00;
-	netif->hwaddr[3] = 0x12;
-	netif->hwaddr[4] = 0x34;
-	netif->hwaddr[5] = 0x56;
+	memcpy(netif->hwaddr, pif->hwaddr, ETHARP_HWADDR_LEN);
 
 	/* maximum transfer unit */
 	netif->mtu = pif->mtu;
 
 	/* device capabilities */
 	netif->flags = NETIF_FLAG_BROADCAST |
-		       NETIF_FLAG_ETHARP | 
+		       NETIF_FLAG_ETHARP |
 		       NETIF_FLAG_LINK_UP;
 
+	/* register all buffers to the driver */
+	batch.count = 0;
+	for (i = 0; i < NR_DBUFS; i++) {
+		batch.bufs[batch.count++] = pif->dbufs[i];
+		if (batch.count == NETIO_MAXBATCH || i == NR_DBUFS - 1) {
+			if (device_ioctl(pif->dev, NETIO_REG_BATCH, &batch))
+				sys_panic("net: cannot register dbuf");
+			batch.count = 0;
+		}
+	}
+
 	/* queue rx buffers */
-	while (pif->free_rxbufs) {
-		dbuf_t buf;
-		list_t n;
-		n = list_first(&pif->rx_free_list);
-		list_remove(n);
-		buf = list_entry(n, struct dbuf_user, link);
-		device_ioctl(pif->dev, NETIO_RX_QBUF, buf);
-		pif->free_rxbufs--;
+	batch.count = 0;
+	for (i = DEF_NR_TXBUF; i < NR_DBUFS; i++) {
+		batch.bufs[batch.count++] = pif->dbufs[i];
+		if (batch.count == NETIO_MAXBATCH || i == NR_DBUFS - 1) {
+			device_ioctl(pif->dev, NETIO_RX_QBATCH, &batch);
+			batch.count = 0;
+		}
 	}
 
 	/* bring up device */
-	/*device_ioctl(pif->dev, NETIO_START, NULL);*/
+	device_ioctl(pif->dev, NETIO_START, NULL);
+
+	sys_thread_new(pif->name, pif_rx_thread, pif, 0, PRI_NET);
+}
+
+/*
+ * Get a buffer for transmit. The buffers released by the driver
+ * after transmission are taken back in a batch.
+ */
+static dbuf_t
+pif_get_txbuf(struct pif *pif)
+{
+	struct dbuf_batch batch;
+	dbuf_t buf;
+	list_t n;
+	int i, retry;
+
+	mutex_lock(&pif->lock);
+	for (retry = 0; list_empty(&pif->free_list); retry++) {
+		mutex_unlock(&pif->lock);
+		if (retry >= 10)
+			return NULL;
+		batch.count = DEF_NR_TXBUF / 4;
+		if (device_ioctl(pif->dev, NETIO_TX_DQBATCH, &batch) != 0) {
+			thread_yield();
+			batch.count = 0;
+		}
+		mutex_lock(&pif->lock);
+		for (i = 0; i < batch.count; i++) {
+			list_insert(&pif->free_list, &batch.bufs[i]->link);
+			pif->free_txbufs++;
+		}
+	}
+	n = list_first(&pif->free_list);
+	list_remove(n);
+	pif->free_txbufs--;
+	mutex_unlock(&pif->lock);
+
+	buf = list_entry(n, struct dbuf_user, link);
+	return buf;
+}
+
+static void
+pif_put_txbuf(struct pif *pif, dbuf_t buf)
+{
+
+	mutex_lock(&pif->lock);
+	list_insert(&pif->free_list, &buf->link);
+	pif->free_txbufs++;
+	mutex_unlock(&pif->lock);
 }
 
 /**
@@ -112,66 +195,131 @@ low_level_init(struct netif *netif)
 static err_t
 low_level_output(struct netif *netif, struct pbuf *p)
 {
-	/*struct pif *pif = netif->state;*/
-	struct pbuf *q;
+	struct pif *pif = netif->state;
+	dbuf_t buf;
+	int retry;
+
+	if (p->tot_len > DBUF_DATA_SIZE) {
+		LINK_STATS_INC(link.lenerr);
+		return ERR_BUF;
+	}
+	if ((buf = pif_get_txbuf(pif)) == NULL) {
+		LINK_STATS_INC(link.memerr);
+		return ERR_MEM;
+	}
 
 #if ETH_PAD_SIZE
 	pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
 #endif
 
-	for(q = p; q != NULL; q = q->next) {
-		;
-	}
+	/*
+	 * lwIP builds the frame in a pbuf chain, and it is
+	 * gathered into the dbuf here.
+	 */
+	buf->data_start = dbuf_data(buf);
+	buf->data_length = pbuf_copy_partial(p, dbuf_data(buf),
+					     p->tot_len, 0);
 
 #if ETH_PAD_SIZE
 	pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
 #endif
 
+	/* wait for a free tx descriptor if the ring is full */
+	for (retry = 0; device_ioctl(pif->dev, NETIO_TX_QBUF, &buf) != 0;
+	     retry++) {
+		if (retry >= 10) {
+			pif_put_txbuf(pif, buf);
+			LINK_STATS_INC(link.drop);
+			return ERR_MEM;
+		}
+		thread_yield();
+	}
+
 	LINK_STATS_INC(link.xmit);
 
 	return ERR_OK;
 }
 
+/*
+ * Give rx buffers back to the driver.
+ */
+static void
+pif_requeue(struct pif *pif, struct dbuf_batch *batch)
+{
+
+	if (batch->count > 0)
+		device_ioctl(pif->dev, NETIO_RX_QBATCH, batch);
+	batch->count = 0;
+}
+
+/*
+ * Called by pbuf_free() when lwIP releases a received frame.
+ */
+static void
+pif_free_dbuf(struct pbuf *p)
+{
+	struct pif_dbuf *pd = (struct pif_dbuf *)p;
+	struct pif *pif = pd->pif;
+	dbuf_t buf = pd_to_dbuf(pd);
+
+	mutex_lock(&pif->lock);
+	pif->rx_held--;
+	mutex_unlock(&pif->lock);
+	device_ioctl(pif->dev, NETIO_RX_QBUF, &buf);
+}
+
 /**
  * Should allocate a pbuf and transfer the bytes of the incoming
  * packet from the interface into the pbuf.
  *
+ * The pbuf refers to the frame in the dbuf. It is copied to a
+ * pool pbuf only when lwIP holds too many rx buffers, and the dbuf
+ * is added to the requeue batch then.
+ *
  * @param netif the lwip network interface structure for this ethernetif
  * @return a pbuf filled with the received packet (including MAC header)
  *         NULL on memory error
  */
 static struct pbuf *
-low_level_input(struct netif *netif)
+low_level_input(struct netif *netif, dbuf_t buf, struct dbuf_batch *requeue)
 {
-	/*struct pif *pif = netif->state;*/
-	struct pbuf *p, *q;
-	u16_t len = 0;
-
-	/* Obtain the size of the packet and put it into the "len"
-	   variable. */
-
-#if ETH_PAD_SIZE
-	len += ETH_PAD_SIZE; /* allow room for Ethernet padding */
-#endif
-
-	/* We allocate a pbuf chain of pbufs from the pool. */
-	p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+	struct pif *pif = netif->state;
+	struct pif_dbuf *pd;
+	struct pbuf *p;
+	u16_t len;
+	int copy;
+
+	len = (u16_t)buf->data_length;
+
+	mutex_lock(&pif->lock);
+	copy = (pif->rx_held >= RX_COPY_THRESHOLD);
+	if (!copy)
+		pif->rx_held++;
+	mutex_unlock(&pif->lock);
+
+	if (copy) {
+		p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+		if (p != NULL)
+			pbuf_take(p, dbuf_data(buf), len);
+		requeue->bufs[requeue->count++] = buf;
+	} else {
+		pd = dbuf_to_pd(buf);
+		pd->pc.custom_free_function = pif_free_dbuf;
+		pd->pif = pif;
+		p = pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &pd->pc,
+					dbuf_data(buf), DBUF_DATA_SIZE);
+		if (p == NULL) {
+			mutex_lock(&pif->lock);
+			pif->rx_held--;
+			mutex_unlock(&pif->lock);
+			requeue->bufs[requeue->count++] = buf;
+		}
+	}
 
 	if (p != NULL) {
-
 #if ETH_PAD_SIZE
 		pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
 #endif
-
-		/* We iterate over the pbuf chain until we have read the entire
-		 * packet into the pbuf. */
-		for(q = p; q != NULL; q = q->next) {
-			;
-		}
-#if ETH_PAD_SIZE
-		pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
-#endif
-
 		LINK_STATS_INC(link.recv);
 	} else {
 		/* drop packet */
@@ -179,52 +327,40 @@ low_level_input(struct netif *netif)
 		LINK_STATS_INC(link.drop);
 	}
 
-	return p;  
+	return p;
 }
 
-/**
- * This function should be called when a packet is ready to be read
- * from the interface. It uses the function low_level_input() that
- * should handle the actual reception of bytes from the network
- * interface. Then the type of the received packet is determined and
- * the appropriate input function is called.
- *
- * @param netif the lwip network interface structure for this ethernetif
+/*
+ * Receive thread of the interface. It waits for the frames
+ * received by an interrupt, and passes them to the tcpip thread.
  */
-void
-pif_input(struct netif *netif)
+static void
+pif_rx_thread(void *arg)
 {
-	struct pif *pif;
-	struct eth_hdr *ethhdr;
+	struct pif *pif = arg;
+	struct netif *netif = &pif->nif;
+	struct dbuf_batch batch, requeue;
 	struct pbuf *p;
-
-	pif = netif->state;
-
-	/* move received packet into a new pbuf */
-	p = low_level_input(netif);
-	/* no packet could be read, silently ignore this */
-	if (p == NULL) return;
-	/* points to packet payload, which starts with an Ethernet header */
-	ethhdr = p->payload;
-
-	switch (htons(ethhdr->type)) {
-		/* IP or ARP packet? */
-		case ETHTYPE_IP:
-		case ETHTYPE_ARP:
+	int i;
+
+	requeue.count = 0;
+	for (;;) {
+		batch.count = NETIO_MAXBATCH;
+		if (device_ioctl(pif->dev, NETIO_RX_DQBATCH, &batch) != 0)
+			continue;
+
+		for (i = 0; i < batch.count; i++) {
+			p = low_level_input(netif, batch.bufs[i], &requeue);
+			if (p == NULL)
+				continue;
 			/* full packet send to tcpip_thread to process */
-			if (netif->input(p, netif) != ERR_OK)
-			{
+			if (netif->input(p, netif) != ERR_OK) {
 				LWIP_DEBUGF(NETIF_DEBUG,
 					    ("pif_input: IP input error\n"));
 				pbuf_free(p);
-				p = NULL;
 			}
-			break;
-
-		default:
-			pbuf_free(p);
-			p = NULL;
-			break;
+		}
+		pif_requeue(pif, &requeue);
 	}
 }
 
@@ -263,7 +399,7 @@ pif_init(struct netif *netif)
 			LINK_SPEED_OF_YOUR_NETIF_IN_BPS);
 #endif
 
-	strncpy(netif->name, pif->name, sizeof(pif->name));
+	memcpy(netif->name, pif->name, sizeof(netif->name));
 
 	/* We directly use etharp_output() here to save a function call.
 	 * You can instead declare your own function an call etharp_output()
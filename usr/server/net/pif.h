@@ -5,18 +5,20 @@
 struct netif;
 struct queue;
 
+#define NR_DBUFS	(DEF_NR_TXBUF + DEF_NR_RXBUF)
+
 struct pif {
 	char		name[10];
 	device_t	dev;
 	netif_type_t 	type;
 	struct netif 	nif;
 	uint16_t 	mtu;
-	dbuf_t		tx_buf[DEF_NR_TXBUF];
-	struct list	tx_free_list;
+	uint8_t		hwaddr[6];
+	dbuf_t		dbufs[NR_DBUFS];
+	mutex_t		lock;		/* lock for lists and counts */
+	struct list	free_list;	/* buffers for transmit */
 	int		free_txbufs;
-	dbuf_t		rx_buf[DEF_NR_RXBUF];
-	struct list	rx_free_list;
-	int		free_rxbufs;
+	int		rx_held;	/* rx buffers held by lwIP */
 };
 
 #define to_pif(netif) \
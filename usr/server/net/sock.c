@@ -0,0 +1,1217 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * sock.c - BSD socket interface for the client tasks.
+ *
+ * The requests are processed by the socket layer of lwIP. Each
+ * lwIP socket is recorded with its owner task here, and a task
+ * can only use its own sockets. The data is moved between lwIP
+ * and the buffers of the client without extra copy, by mapping
+ * them into our address space.
+ */
+
+#include <sys/prex.h>
+#include <sys/param.h>
+#include <sys/ioctl.h>
+#include <sys/fcntl.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/list.h>
+#include <netinet/in.h>
+#include <ipc/ipc.h>
+#include <ipc/net.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwipopts.h"
+#include "sock.h"
+
+#define NR_SOCKS	MEMP_NUM_NETCONN	/* same as lwIP */
+
+#if NR_SOCKS > NSOCKFD
+#error NR_SOCKS exceeds the socket descriptor range
+#endif
+#if NR_SOCKS > FD_SETSIZE
+#error FD_SETSIZE must cover NR_SOCKS for lwip_select()
+#endif
+
+struct sock {
+	task_t	owner;		/* owner task, or 0 if free */
+	int	type;		/* socket type */
+	int	nonblock;	/* true if non-blocking i/o */
+	int	shut;		/* shut down flags */
+	struct list pollers;	/* poll entries for this socket */
+};
+
+/* Flags for shut */
+#define SS_RDSHUT	0x01
+#define SS_WRSHUT	0x02
+
+static struct sock sock_table[NR_SOCKS];
+static mutex_t sock_lock = MUTEX_INITIALIZER;
+
+/*
+ * Look up the socket of the client task. Returns the socket
+ * number of lwIP, or -1 if the descriptor is not owned by it.
+ */
+static int
+sock_get(task_t task, int sd, struct sock **sop)
+{
+	int s = sd - SOCKFD_BASE;
+
+	if (s < 0 || s >= NR_SOCKS)
+		return -1;
+
+	mutex_lock(&sock_lock);
+	if (sock_table[s].owner != task) {
+		mutex_unlock(&sock_lock);
+		return -1;
+	}
+	mutex_unlock(&sock_lock);
+	if (sop != NULL)
+		*sop = &sock_table[s];
+	return s;
+}
+
+static void
+sock_register(int s, task_t task, int type)
+{
+	struct sock *so = &sock_table[s];
+
+	mutex_lock(&sock_lock);
+	so->owner = task;
+	so->type = type;
+	so->nonblock = 0;
+	so->shut = 0;
+	mutex_unlock(&sock_lock);
+}
+
+/*
+ * Close the socket. The entry is released first, since lwIP
+ * may give the same number to a new socket at once.
+ */
+static void sockpoll_close(int);
+
+static void
+sock_release(int s)
+{
+
+	mutex_lock(&sock_lock);
+	sock_table[s].owner = 0;
+	mutex_unlock(&sock_lock);
+	sockpoll_close(s);
+	lwip_close(s);
+}
+
+/*
+ * Get the error of the last operation. The global errno can
+ * not be used, since the requests are processed by multiple
+ * threads.
+ */
+static int
+sock_error(int s)
+{
+	int error = 0;
+	socklen_t len = sizeof(error);
+
+	if (lwip_getsockopt(s, SOL_SOCKET, SO_ERROR, &error, &len) != 0 ||
+	    error == 0)
+		return EIO;
+	return error;
+}
+
+/*
+ * Check if the socket can be read without blocking.
+ */
+static int
+sock_readable(int s)
+{
+	fd_set rset;
+	struct timeval tv;
+
+	FD_ZERO(&rset);
+	FD_SET(s, &rset);
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+	return lwip_select(s + 1, &rset, NULL, NULL, &tv) > 0;
+}
+
+/*
+ * Copy an array of the client.
+ */
+static int
+sock_copyin(task_t task, const void *uaddr, void *buf, size_t size)
+{
+	void *map;
+
+	if (size == 0)
+		return 0;
+	if (vm_map(task, (void *)uaddr, size, &map) != 0)
+		return EFAULT;
+	memcpy(buf, map, size);
+	vm_free(task_self(), map);
+	return 0;
+}
+
+/*
+ * Move data between the socket and the buffers of the client.
+ *
+ * Only the first transfer may wait, and the rest is done without
+ * blocking. So the request returns as soon as some data has been
+ * received, and the receive stops at a short read. A datagram is
+ * never split over the iovecs.
+ */
+static int
+sock_xfer(task_t task, int s, struct sock *so, int op,
+	  const struct iovec *iov, int iovcnt, int flags,
+	  struct sockaddr_in *addr, socklen_t *addrlen, size_t *result)
+{
+	size_t total = 0;
+	void *buf;
+	int i, n, error = 0;
+
+	if (op == SOP_SEND && (so->shut & SS_WRSHUT))
+		return EPIPE;
+	if (op == SOP_RECV && (so->shut & SS_RDSHUT)) {
+		*result = 0;
+		return 0;
+	}
+
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len == 0)
+			continue;
+		if (vm_map(task, iov[i].iov_base, iov[i].iov_len, &buf)) {
+			error = EFAULT;
+			break;
+		}
+		if (op == SOP_SEND) {
+			if (*addrlen > 0)
+				n = lwip_sendto(s, buf, iov[i].iov_len, flags,
+						(struct sockaddr *)addr,
+						*addrlen);
+			else
+				n = lwip_send(s, buf, iov[i].iov_len, flags);
+		} else {
+			n = lwip_recvfrom(s, buf, iov[i].iov_len, flags,
+					  (struct sockaddr *)addr, addrlen);
+		}
+		vm_free(task_self(), buf);
+
+		if (n < 0) {
+			error = sock_error(s);
+			break;
+		}
+		total += (size_t)n;
+		if (op == SOP_RECV &&
+		    ((size_t)n < iov[i].iov_len || so->type != SOCK_STREAM))
+			break;
+		flags |= MSG_DONTWAIT;
+	}
+	/* Return the data moved before the error. */
+	if (total > 0)
+		error = 0;
+	*result = total;
+	return error;
+}
+
+/*
+ * Accept up to count connections. The first one may wait for a
+ * connection, and the others are accepted only if they are
+ * already pending.
+ */
+static int
+sock_multiaccept(task_t task, int s, int flags, int *fds, int count,
+		 int *result)
+{
+	struct sockaddr_in sin;
+	socklen_t len;
+	int n, ns, error = 0;
+
+	for (n = 0; n < count; n++) {
+		if ((n > 0 || (flags & MSG_DONTWAIT)) && !sock_readable(s)) {
+			if (n == 0)
+				error = EWOULDBLOCK;
+			break;
+		}
+		len = sizeof(sin);
+		if ((ns = lwip_accept(s, (struct sockaddr *)&sin, &len)) < 0) {
+			if (n == 0)
+				error = sock_error(s);
+			break;
+		}
+		sock_register(ns, task, SOCK_STREAM);
+		fds[n] = SOCKFD_BASE + ns;
+	}
+	*result = n;
+	return error;
+}
+
+/*
+ * Poll the sockets of the client.
+ */
+static int
+sock_poll(task_t task, struct pollfd *pfd, int count, int timeout,
+	  int *result)
+{
+	fd_set rset, wset;
+	struct timeval tv, *tvp;
+	int i, s, maxfd = -1, nvalid = 0, n = 0;
+
+	FD_ZERO(&rset);
+	FD_ZERO(&wset);
+	for (i = 0; i < count; i++) {
+		pfd[i].revents = 0;
+		if (pfd[i].fd < 0)
+			continue;
+		if ((s = sock_get(task, pfd[i].fd, NULL)) < 0) {
+			pfd[i].revents = POLLNVAL;
+			nvalid++;
+			continue;
+		}
+		if (pfd[i].events & POLLIN)
+			FD_SET(s, &rset);
+		if (pfd[i].events & POLLOUT)
+			FD_SET(s, &wset);
+		maxfd = MAX(maxfd, s);
+	}
+
+	/* Do not wait if there is an invalid descriptor. */
+	if (nvalid > 0)
+		timeout = 0;
+	if (timeout < 0)
+		tvp = NULL;
+	else {
+		tv.tv_sec = timeout / 1000;
+		tv.tv_usec = (timeout % 1000) * 1000;
+		tvp = &tv;
+	}
+	if (maxfd >= 0 || tvp != NULL) {
+		if (lwip_select(maxfd + 1, &rset, &wset, NULL, tvp) < 0)
+			return EBADF;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (pfd[i].fd >= 0 && pfd[i].revents == 0) {
+			s = pfd[i].fd - SOCKFD_BASE;
+			if ((pfd[i].events & POLLIN) && FD_ISSET(s, &rset))
+				pfd[i].revents |= POLLIN;
+			if ((pfd[i].events & POLLOUT) && FD_ISSET(s, &wset))
+				pfd[i].revents |= POLLOUT;
+		}
+		if (pfd[i].revents != 0)
+			n++;
+	}
+	*result = n;
+	return 0;
+}
+
+/*
+ * Poll sets of the clients.
+ *
+ * A client which waits for the sockets passes its semaphore, and
+ * the sockets are kept in the poll set for the pair of the task
+ * and the semaphore. lwIP calls sock_event() when the events of a
+ * socket change, and we post the semaphore of each set which has
+ * the socket. The fs server posts the same semaphore for the files,
+ * so the client can wait for both servers at once.
+ *
+ * A poll set is rebuilt by every SOP_POLL, and it is released when
+ * any socket is ready. An epoll set is built by SOP_EPCTL, and its
+ * ready list holds the entries which may be ready, so that
+ * SOP_EPWAIT checks only them.
+ */
+struct pollset {
+	struct list	ps_link;	/* link to all sets */
+	task_t		ps_task;	/* owner task */
+	sem_t		ps_sem;		/* semaphore of client */
+	int		ps_epoll;	/* true if epoll set */
+	int		ps_posted;	/* true if posted since last scan */
+	struct list	ps_entries;	/* all entries */
+	struct list	ps_ready;	/* entries which may be ready */
+};
+
+struct pollent {
+	struct list	pe_link;	/* link to entries of set */
+	struct list	pe_slink;	/* link to pollers of socket */
+	struct list	pe_rlink;	/* link to ready list */
+	struct pollset	*pe_set;	/* poll set */
+	int		pe_sd;		/* socket descriptor */
+	int		pe_events;	/* requested events */
+	epoll_data_t	pe_data;	/* user data for epoll */
+	int		pe_onready;	/* true if on ready list */
+	int		pe_pending;	/* true if woken while checked */
+};
+
+static struct list pollsets = LIST_INIT(pollsets);
+
+/*
+ * pollset_lock serializes the changes of the sets, and it is held
+ * while the sockets are checked. poll_lock protects the socket
+ * lists, the ready lists and the posted flags, and it is the only
+ * lock taken by sock_event(). pollset_lock must be taken first.
+ */
+static mutex_t pollset_lock = MUTEX_INITIALIZER;
+static mutex_t poll_lock = MUTEX_INITIALIZER;
+
+/*
+ * Post the semaphore of the set, once until the next scan.
+ * Called with poll_lock held.
+ */
+static void
+poll_post(struct pollset *ps)
+{
+
+	if (!ps->ps_posted) {
+		ps->ps_posted = 1;
+		sem_post(&ps->ps_sem);
+	}
+}
+
+/*
+ * Notify an event of the entry to its set.
+ * Called with poll_lock held.
+ */
+static void
+poll_notify(struct pollent *pe)
+{
+	struct pollset *ps = pe->pe_set;
+
+	if (ps->ps_epoll) {
+		pe->pe_pending = 1;
+		if (!pe->pe_onready) {
+			list_insert(list_last(&ps->ps_ready), &pe->pe_rlink);
+			pe->pe_onready = 1;
+		}
+	}
+	poll_post(ps);
+}
+
+/*
+ * Called by lwIP when the events of the socket change.
+ */
+void
+sock_event(int s)
+{
+	struct list *head, *n;
+
+	if (s < 0 || s >= NR_SOCKS)
+		return;
+
+	head = &sock_table[s].pollers;
+	mutex_lock(&poll_lock);
+	for (n = list_first(head); n != head; n = list_next(n))
+		poll_notify(list_entry(n, struct pollent, pe_slink));
+	mutex_unlock(&poll_lock);
+}
+
+/*
+ * Add an entry for the socket of the task to the set. Returns
+ * NULL if the socket is not owned by the task, or no memory.
+ * Called with pollset_lock held.
+ */
+static struct pollent *
+pollent_alloc(struct pollset *ps, int sd, int events)
+{
+	struct pollent *pe;
+	int s;
+
+	if ((s = sock_get(ps->ps_task, sd, NULL)) < 0)
+		return NULL;
+	if ((pe = malloc_r(sizeof(struct pollent))) == NULL)
+		return NULL;
+	memset(pe, 0, sizeof(struct pollent));
+	pe->pe_set = ps;
+	pe->pe_sd = sd;
+	pe->pe_events = events;
+
+	mutex_lock(&poll_lock);
+	list_insert(&sock_table[s].pollers, &pe->pe_slink);
+	list_insert(list_last(&ps->ps_entries), &pe->pe_link);
+	mutex_unlock(&poll_lock);
+	return pe;
+}
+
+static void
+pollent_free(struct pollent *pe)
+{
+
+	mutex_lock(&poll_lock);
+	list_remove(&pe->pe_slink);
+	if (pe->pe_onready)
+		list_remove(&pe->pe_rlink);
+	list_remove(&pe->pe_link);
+	mutex_unlock(&poll_lock);
+	free_r(pe);
+}
+
+static struct pollset *
+pollset_lookup(task_t task, sem_t sem, int epoll)
+{
+	struct pollset *ps;
+	struct list *n;
+
+	for (n = list_first(&pollsets); n != &pollsets; n = list_next(n)) {
+		ps = list_entry(n, struct pollset, ps_link);
+		if (ps->ps_task == task && ps->ps_sem == sem &&
+		    ps->ps_epoll == epoll)
+			return ps;
+	}
+	return NULL;
+}
+
+static struct pollset *
+pollset_alloc(task_t task, sem_t sem, int epoll)
+{
+	struct pollset *ps;
+
+	if ((ps = malloc_r(sizeof(struct pollset))) == NULL)
+		return NULL;
+	memset(ps, 0, sizeof(struct pollset));
+	ps->ps_task = task;
+	ps->ps_sem = sem;
+	ps->ps_epoll = epoll;
+	list_init(&ps->ps_entries);
+	list_init(&ps->ps_ready);
+	list_insert(&pollsets, &ps->ps_link);
+	return ps;
+}
+
+static void
+pollset_clear(struct pollset *ps)
+{
+
+	while (!list_empty(&ps->ps_entries))
+		pollent_free(list_entry(list_first(&ps->ps_entries),
+					struct pollent, pe_link));
+}
+
+static void
+pollset_free(struct pollset *ps)
+{
+
+	pollset_clear(ps);
+	list_remove(&ps->ps_link);
+	free_r(ps);
+}
+
+/*
+ * Start a new scan of the set. The events after this point
+ * post the semaphore again.
+ */
+static void
+pollset_rescan(struct pollset *ps)
+{
+
+	mutex_lock(&poll_lock);
+	ps->ps_posted = 0;
+	mutex_unlock(&poll_lock);
+}
+
+/*
+ * The socket is being closed. The epoll sets forget it, and the
+ * poll sets are woken to report it.
+ */
+static void
+sockpoll_close(int s)
+{
+	struct list *head, *n, *next;
+	struct pollent *pe;
+
+	head = &sock_table[s].pollers;
+	mutex_lock(&pollset_lock);
+	for (n = list_first(head); n != head; n = next) {
+		next = list_next(n);
+		pe = list_entry(n, struct pollent, pe_slink);
+		if (pe->pe_set->ps_epoll)
+			pollent_free(pe);
+		else {
+			mutex_lock(&poll_lock);
+			poll_post(pe->pe_set);
+			mutex_unlock(&poll_lock);
+		}
+	}
+	mutex_unlock(&pollset_lock);
+}
+
+/*
+ * Release the poll sets of the task.
+ */
+static void
+sockpoll_cleanup(task_t task)
+{
+	struct list *n, *next;
+	struct pollset *ps;
+
+	mutex_lock(&pollset_lock);
+	for (n = list_first(&pollsets); n != &pollsets; n = next) {
+		next = list_next(n);
+		ps = list_entry(n, struct pollset, ps_link);
+		if (ps->ps_task == task)
+			pollset_free(ps);
+	}
+	mutex_unlock(&pollset_lock);
+}
+
+/*
+ * Poll the sockets without blocking, after they are registered
+ * to the poll set for sem. The set is released when any socket
+ * is ready, or count is 0.
+ */
+static int
+sockpoll_poll(task_t task, sem_t sem, struct pollfd *pfd, int count,
+	      int *result)
+{
+	struct pollset *ps;
+	int i, error;
+
+	*result = 0;
+	mutex_lock(&pollset_lock);
+	ps = pollset_lookup(task, sem, 0);
+	if (count == 0) {
+		if (ps != NULL)
+			pollset_free(ps);
+		mutex_unlock(&pollset_lock);
+		return 0;
+	}
+	if (ps == NULL && (ps = pollset_alloc(task, sem, 0)) == NULL) {
+		mutex_unlock(&pollset_lock);
+		return ENOMEM;
+	}
+	pollset_clear(ps);
+	pollset_rescan(ps);
+	for (i = 0; i < count; i++) {
+		if (pfd[i].fd >= 0)
+			pollent_alloc(ps, pfd[i].fd, pfd[i].events);
+	}
+	error = sock_poll(task, pfd, count, 0, result);
+	if (error || *result > 0)
+		pollset_free(ps);
+	mutex_unlock(&pollset_lock);
+	return error;
+}
+
+/*
+ * Change the interest list of the epoll set for sem. The set
+ * is released if op is 0.
+ */
+static int
+sockpoll_ctl(task_t task, sem_t sem, int op, int sd, int events,
+	     epoll_data_t data)
+{
+	struct pollset *ps;
+	struct pollent *pe = NULL;
+	struct list *n;
+	int error = 0;
+
+	mutex_lock(&pollset_lock);
+	ps = pollset_lookup(task, sem, 1);
+	if (op == 0) {
+		if (ps != NULL)
+			pollset_free(ps);
+		goto out;
+	}
+	if (sock_get(task, sd, NULL) < 0) {
+		error = EBADF;
+		goto out;
+	}
+	if (ps != NULL) {
+		for (n = list_first(&ps->ps_entries); n != &ps->ps_entries;
+		     n = list_next(n)) {
+			pe = list_entry(n, struct pollent, pe_link);
+			if (pe->pe_sd == sd)
+				break;
+		}
+		if (n == &ps->ps_entries)
+			pe = NULL;
+	}
+
+	events |= POLLERR | POLLHUP;
+	switch (op) {
+	case EPOLL_CTL_ADD:
+		if (pe != NULL) {
+			error = EEXIST;
+			goto out;
+		}
+		if (ps == NULL && (ps = pollset_alloc(task, sem, 1)) == NULL) {
+			error = ENOMEM;
+			goto out;
+		}
+		if ((pe = pollent_alloc(ps, sd, events)) == NULL) {
+			error = ENOMEM;
+			goto out;
+		}
+		break;
+	case EPOLL_CTL_MOD:
+		if (pe == NULL) {
+			error = ENOENT;
+			goto out;
+		}
+		pe->pe_events = events;
+		break;
+	case EPOLL_CTL_DEL:
+		if (pe == NULL)
+			error = ENOENT;
+		else
+			pollent_free(pe);
+		goto out;
+	default:
+		error = EINVAL;
+		goto out;
+	}
+	pe->pe_data = data;
+
+	/* Let the next wait check the new events. */
+	mutex_lock(&poll_lock);
+	poll_notify(pe);
+	mutex_unlock(&poll_lock);
+ out:
+	mutex_unlock(&pollset_lock);
+	return error;
+}
+
+/*
+ * Collect the ready events of the epoll set for sem.
+ *
+ * Only the entries on the ready list are checked. An entry stays
+ * there while it is ready, since the events are level triggered,
+ * and it is taken off when it is not ready anymore.
+ */
+static int
+sockpoll_wait(task_t task, sem_t sem, struct epoll_event *events,
+	      int maxevents, int *result)
+{
+	struct pollset *ps;
+	struct pollent *pe;
+	struct pollfd pfd;
+	struct list *n, *next;
+	int nready = 0, dummy;
+
+	mutex_lock(&pollset_lock);
+	if ((ps = pollset_lookup(task, sem, 1)) == NULL)
+		goto out;
+
+	pollset_rescan(ps);
+
+	mutex_lock(&poll_lock);
+	n = list_first(&ps->ps_ready);
+	mutex_unlock(&poll_lock);
+
+	while (n != &ps->ps_ready) {
+		pe = list_entry(n, struct pollent, pe_rlink);
+
+		mutex_lock(&poll_lock);
+		pe->pe_pending = 0;
+		mutex_unlock(&poll_lock);
+
+		pfd.fd = pe->pe_sd;
+		pfd.events = (short)pe->pe_events;
+		if (sock_poll(task, &pfd, 1, 0, &dummy) != 0)
+			pfd.revents = POLLNVAL;
+
+		mutex_lock(&poll_lock);
+		next = list_next(n);
+		if (pfd.revents == 0 && !pe->pe_pending) {
+			list_remove(&pe->pe_rlink);
+			pe->pe_onready = 0;
+		}
+		mutex_unlock(&poll_lock);
+
+		if (pfd.revents & POLLNVAL) {
+			/* The socket has been closed. */
+			pollent_free(pe);
+		} else if (pfd.revents != 0) {
+			events[nready].events = (uint32_t)pfd.revents;
+			events[nready].data = pe->pe_data;
+			if (++nready == maxevents) {
+				/*
+				 * Start the next wait from the entry
+				 * we could not check.
+				 */
+				mutex_lock(&poll_lock);
+				next = list_next(n);
+				if (next != &ps->ps_ready) {
+					list_remove(&ps->ps_ready);
+					list_insert(list_prev(next),
+						    &ps->ps_ready);
+				}
+				mutex_unlock(&poll_lock);
+				break;
+			}
+		}
+		n = next;
+	}
+ out:
+	mutex_unlock(&pollset_lock);
+	*result = nready;
+	return 0;
+}
+
+/*
+ * Do one operation of the batch request.
+ */
+static int
+sock_doop(task_t task, struct sockop *op)
+{
+	struct iovec iov[IOV_MAX];
+	struct pollfd pfd[NSOCKFD];
+	struct epoll_event ev[NSOCKFD];
+	int fds[SOP_MAX];
+	struct sock *so;
+	socklen_t addrlen = 0;
+	size_t size;
+	void *map;
+	int s, error;
+
+	op->so_result = 0;
+	switch (op->so_op) {
+	case SOP_SEND:
+	case SOP_RECV:
+		if ((s = sock_get(task, op->so_sd, &so)) < 0)
+			return EBADF;
+		if (op->so_count <= 0 || op->so_count > IOV_MAX)
+			return EINVAL;
+		error = sock_copyin(task, op->so_iov, iov,
+				    sizeof(struct iovec) * op->so_count);
+		if (error)
+			return error;
+		error = sock_xfer(task, s, so, op->so_op, iov, op->so_count,
+				  op->so_flags, NULL, &addrlen, &size);
+		op->so_result = (int)size;
+		return error;
+
+	case SOP_ACCEPT:
+		if ((s = sock_get(task, op->so_sd, NULL)) < 0)
+			return EBADF;
+		if (op->so_count <= 0 || op->so_count > SOP_MAX)
+			return EINVAL;
+		error = sock_multiaccept(task, s, op->so_flags, fds,
+					 op->so_count, &op->so_result);
+		if (op->so_result == 0)
+			return error;
+		size = sizeof(int) * op->so_result;
+		if (vm_map(task, op->so_fds, size, &map) != 0) {
+			/* The client can not get them. */
+			while (op->so_result > 0)
+				sock_release(fds[--op->so_result] -
+					     SOCKFD_BASE);
+			return EFAULT;
+		}
+		memcpy(map, fds, size);
+		vm_free(task_self(), map);
+		return error;
+
+	case SOP_POLL:
+		if (op->so_sem != 0 && op->so_count == 0)
+			return sockpoll_poll(task, op->so_sem, NULL, 0,
+					     &op->so_result);
+		if (op->so_count <= 0 || op->so_count > NSOCKFD)
+			return EINVAL;
+		size = sizeof(struct pollfd) * op->so_count;
+		if (vm_map(task, op->so_pfd, size, &map) != 0)
+			return EFAULT;
+		memcpy(pfd, map, size);
+		if (op->so_sem != 0)
+			error = sockpoll_poll(task, op->so_sem, pfd,
+					      op->so_count, &op->so_result);
+		else
+			error = sock_poll(task, pfd, op->so_count,
+					  op->so_timeout, &op->so_result);
+		memcpy(map, pfd, size);
+		vm_free(task_self(), map);
+		return error;
+
+	case SOP_EPCTL:
+		if (op->so_sem == 0)
+			return EINVAL;
+		return sockpoll_ctl(task, op->so_sem, op->so_flags,
+				    op->so_sd, op->so_count, op->so_data);
+
+	case SOP_EPWAIT:
+		if (op->so_sem == 0 || op->so_count <= 0 ||
+		    op->so_count > NSOCKFD)
+			return EINVAL;
+		sockpoll_wait(task, op->so_sem, ev, op->so_count,
+			      &op->so_result);
+		if (op->so_result == 0)
+			return 0;
+		size = sizeof(struct epoll_event) * op->so_result;
+		if (vm_map(task, op->so_ev, size, &map) != 0)
+			return EFAULT;
+		memcpy(map, ev, size);
+		vm_free(task_self(), map);
+		return 0;
+	}
+	return EINVAL;
+}
+
+int
+sock_socket(struct msg *m)
+{
+	struct sock_msg *msg = (struct sock_msg *)m;
+	int type = msg->data[1];
+	int s;
+
+	if (msg->data[0] != AF_INET)
+		return EAFNOSUPPORT;
+	if (type != SOCK_STREAM && type != SOCK_DGRAM && type != SOCK_RAW)
+		return EPROTOTYPE;
+	if (type == SOCK_RAW && task_chkcap(msg->hdr.task, CAP_RAWIO) != 0)
+		return EPERM;
+
+	if ((s = lwip_socket(AF_INET, type, msg->data[2])) < 0)
+		return ENFILE;
+	sock_register(s, msg->hdr.task, type);
+	msg->sd = SOCKFD_BASE + s;
+	return 0;
+}
+
+int
+sock_bind(struct msg *m)
+{
+	struct sock_msg *msg = (struct sock_msg *)m;
+	struct sockaddr_in sin;
+	int s;
+
+	if ((s = sock_get(msg->hdr.task, msg->sd, NULL)) < 0)
+		return EBADF;
+	if (msg->addrlen != sizeof(sin))
+		return EINVAL;
+	memcpy(&sin, msg->addr, sizeof(sin));
+	if (lwip_bind(s, (struct sockaddr *)&sin, sizeof(sin)) != 0)
+		return sock_error(s);
+	return 0;
+}
+
+int
+sock_listen(struct msg *m)
+{
+	struct sock_msg *msg = (struct sock_msg *)m;
+	int s;
+
+	if ((s = sock_get(msg->hdr.task, msg->sd, NULL)) < 0)
+		return EBADF;
+	if (lwip_listen(s, msg->data[0]) != 0)
+		return sock_error(s);
+	return 0;
+}
+
+int
+sock_accept(struct msg *m)
+{
+	struct sock_msg *msg = (struct sock_msg *)m;
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	int s, ns;
+
+	if ((s = sock_get(msg->hdr.task, msg->sd, NULL)) < 0)
+		return EBADF;
+	if ((ns = lwip_accept(s, (struct sockaddr *)&sin, &len)) < 0)
+		return sock_error(s);
+	sock_register(ns, msg->hdr.task, SOCK_STREAM);
+	msg->data[0] = SOCKFD_BASE + ns;
+	msg->addrlen = MIN(len, SOCK_MAXADDRLEN);
+	memcpy(msg->addr, &sin, msg->addrlen);
+	return 0;
+}
+
+int
+sock_connect(struct msg *m)
+{
+	struct sock_msg *msg = (struct sock_msg *)m;
+	struct sockaddr_in sin;
+	int s;
+
+	if ((s = sock_get(msg->hdr.task, msg->sd, NULL)) < 0)
+		return EBADF;
+	if (msg->addrlen != sizeof(sin))
+		return EINVAL;
+	memcpy(&sin, msg->addr, sizeof(sin));
+	if (lwip_connect(s, (struct sockaddr *)&sin, sizeof(sin)) != 0)
+		return sock_error(s);
+	return 0;
+}
+
+/*
+ * lwIP can not close one side of the connection. So the socket
+ * just refuses the further i/o, and the connection is closed
+ * by close().
+ */
+int
+sock_shutdown(struct msg *m)
+{
+	struct sock_msg *msg = (struct sock_msg *)m;
+	struct sock *so;
+
+	if (sock_get(msg->hdr.task, msg->sd, &so) < 0)
+		return EBADF;
+
+	switch (msg->data[0]) {
+	case SHUT_RD:
+		so->shut |= SS_RDSHUT;
+		break;
+	case SHUT_WR:
+		so->shut |= SS_WRSHUT;
+		break;
+	case SHUT_RDWR:
+		so->shut |= SS_RDSHUT | SS_WRSHUT;
+		break;
+	default:
+		return EINVAL;
+	}
+	return 0;
+}
+
+int
+sock_close(struct msg *msg)
+{
+	int s;
+
+	if ((s = sock_get(msg->hdr.task, msg->data[0], NULL)) < 0)
+		return EBADF;
+	sock_release(s);
+	return 0;
+}
+
+int
+sock_setsockopt(struct msg *m)
+{
+	struct sockopt_msg *msg = (struct sockopt_msg *)m;
+	int optval[SOCK_MAXOPTLEN / sizeof(int)];
+	int s;
+
+	if ((s = sock_get(msg->hdr.task, msg->sd, NULL)) < 0)
+		return EBADF;
+	if (msg->optlen > SOCK_MAXOPTLEN)
+		return EINVAL;
+	memcpy(optval, msg->optval, msg->optlen);
+	if (lwip_setsockopt(s, msg->level, msg->name, optval,
+			    msg->optlen) != 0)
+		return sock_error(s);
+	return 0;
+}
+
+int
+sock_getsockopt(struct msg *m)
+{
+	struct sockopt_msg *msg = (struct sockopt_msg *)m;
+	int optval[SOCK_MAXOPTLEN / sizeof(int)];
+	socklen_t len;
+	int s;
+
+	if ((s = sock_get(msg->hdr.task, msg->sd, NULL)) < 0)
+		return EBADF;
+	len = MIN(msg->optlen, SOCK_MAXOPTLEN);
+	if (lwip_getsockopt(s, msg->level, msg->name, optval, &len) != 0)
+		return sock_error(s);
+	msg->optlen = len;
+	memcpy(msg->optval, optval, len);
+	return 0;
+}
+
+int
+sock_getsockname(struct msg *m)
+{
+	struct sock_msg *msg = (struct sock_msg *)m;
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	int s;
+
+	if ((s = sock_get(msg->hdr.task, msg->sd, NULL)) < 0)
+		return EBADF;
+	if (lwip_getsockname(s, (struct sockaddr *)&sin, &len) != 0)
+		return sock_error(s);
+	msg->addrlen = MIN(len, SOCK_MAXADDRLEN);
+	memcpy(msg->addr, &sin, msg->addrlen);
+	return 0;
+}
+
+int
+sock_getpeername(struct msg *m)
+{
+	struct sock_msg *msg = (struct sock_msg *)m;
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	int s;
+
+	if ((s = sock_get(msg->hdr.task, msg->sd, NULL)) < 0)
+		return EBADF;
+	if (lwip_getpeername(s, (struct sockaddr *)&sin, &len) != 0)
+		return sock_error(s);
+	msg->addrlen = MIN(len, SOCK_MAXADDRLEN);
+	memcpy(msg->addr, &sin, msg->addrlen);
+	return 0;
+}
+
+int
+sock_send(struct msg *m)
+{
+	struct sockio_msg *msg = (struct sockio_msg *)m;
+	struct sockaddr_in sin;
+	struct sock *so;
+	socklen_t len;
+	int s;
+
+	msg->size = 0;
+	if ((s = sock_get(msg->hdr.task, msg->sd, &so)) < 0)
+		return EBADF;
+	if (msg->iovcnt < 0 || msg->iovcnt > IOV_MAX)
+		return EINVAL;
+	len = 0;
+	if (msg->addrlen > 0) {
+		if (msg->addrlen != sizeof(sin))
+			return EINVAL;
+		memcpy(&sin, msg->addr, sizeof(sin));
+		len = sizeof(sin);
+	}
+	return sock_xfer(msg->hdr.task, s, so, SOP_SEND, msg->iov,
+			 msg->iovcnt, msg->flags, &sin, &len, &msg->size);
+}
+
+int
+sock_recv(struct msg *m)
+{
+	struct sockio_msg *msg = (struct sockio_msg *)m;
+	struct sockaddr_in sin;
+	struct sock *so;
+	socklen_t len;
+	int s, error;
+
+	msg->size = 0;
+	if ((s = sock_get(msg->hdr.task, msg->sd, &so)) < 0)
+		return EBADF;
+	if (msg->iovcnt < 0 || msg->iovcnt > IOV_MAX)
+		return EINVAL;
+
+	/* The address is returned only for datagrams. */
+	len = (so->type == SOCK_STREAM) ? 0 : sizeof(sin);
+	error = sock_xfer(msg->hdr.task, s, so, SOP_RECV, msg->iov,
+			  msg->iovcnt, msg->flags, len ? &sin : NULL,
+			  len ? &len : NULL, &msg->size);
+	msg->addrlen = MIN(len, SOCK_MAXADDRLEN);
+	memcpy(msg->addr, &sin, msg->addrlen);
+	return error;
+}
+
+/*
+ * Process the operations in order by one request.
+ */
+int
+sock_batch(struct msg *m)
+{
+	struct sockbatch_msg *msg = (struct sockbatch_msg *)m;
+	int i;
+
+	if (msg->nops <= 0 || msg->nops > SOP_MAX)
+		return EINVAL;
+
+	for (i = 0; i < msg->nops; i++)
+		msg->ops[i].so_error = sock_doop(msg->hdr.task, &msg->ops[i]);
+	return 0;
+}
+
+int
+sock_ioctl(struct msg *msg)
+{
+	struct sock *so;
+	int s, arg;
+
+	if ((s = sock_get(msg->hdr.task, msg->data[0], &so)) < 0)
+		return EBADF;
+
+	arg = msg->data[2];
+	switch ((u_long)msg->data[1]) {
+	case FIONBIO:
+		if (lwip_ioctl(s, (long)FIONBIO, &arg) != 0)
+			return sock_error(s);
+		so->nonblock = arg ? 1 : 0;
+		break;
+	case FIONREAD:
+		if (lwip_ioctl(s, (long)FIONREAD, &arg) != 0)
+			return sock_error(s);
+		msg->data[2] = arg;
+		break;
+	default:
+		return EINVAL;
+	}
+	return 0;
+}
+
+int
+sock_fcntl(struct msg *msg)
+{
+	struct sock *so;
+	int s, arg;
+
+	if ((s = sock_get(msg->hdr.task, msg->data[0], &so)) < 0)
+		return EBADF;
+
+	switch (msg->data[1]) {
+	case F_GETFL:
+		msg->data[2] = O_RDWR | (so->nonblock ? O_NONBLOCK : 0);
+		break;
+	case F_SETFL:
+		arg = (msg->data[2] & O_NONBLOCK) ? 1 : 0;
+		if (lwip_ioctl(s, (long)FIONBIO, &arg) != 0)
+			return sock_error(s);
+		so->nonblock = arg;
+		msg->data[2] = 0;
+		break;
+	default:
+		return EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * Close all sockets of the terminated task.
+ */
+int
+sock_exit(struct msg *msg)
+{
+	int s;
+
+	sockpoll_cleanup(msg->hdr.task);
+	for (s = 0; s < NR_SOCKS; s++) {
+		if (sock_table[s].owner == msg->hdr.task)
+			sock_release(s);
+	}
+	return 0;
+}
+
+void
+sock_init(void)
+{
+	int s;
+
+	for (s = 0; s < NR_SOCKS; s++)
+		list_init(&sock_table[s].pollers);
+}
@@ -0,0 +1,51 @@
+#ifndef _SOCK_H_
+#define _SOCK_H_
+
+/*
+ * The socket layer of lwIP is called with the system definitions
+ * of the socket structures, which have the same layout. The
+ * header of lwIP can not be used here since it defines them again.
+ */
+struct sockaddr;
+struct timeval;
+
+int	lwip_accept(int, struct sockaddr *, socklen_t *);
+int	lwip_bind(int, const struct sockaddr *, socklen_t);
+int	lwip_close(int);
+int	lwip_connect(int, const struct sockaddr *, socklen_t);
+int	lwip_listen(int, int);
+int	lwip_recvfrom(int, void *, size_t, int, struct sockaddr *,
+		      socklen_t *);
+int	lwip_send(int, const void *, size_t, int);
+int	lwip_sendto(int, const void *, size_t, int, const struct sockaddr *,
+		    socklen_t);
+int	lwip_socket(int, int, int);
+int	lwip_select(int, fd_set *, fd_set *, fd_set *, struct timeval *);
+int	lwip_ioctl(int, long, void *);
+int	lwip_getsockname(int, struct sockaddr *, socklen_t *);
+int	lwip_getpeername(int, struct sockaddr *, socklen_t *);
+int	lwip_getsockopt(int, int, int, void *, socklen_t *);
+int	lwip_setsockopt(int, int, int, const void *, socklen_t);
+
+struct msg;
+
+int	sock_socket(struct msg *);
+int	sock_bind(struct msg *);
+int	sock_listen(struct msg *);
+int	sock_accept(struct msg *);
+int	sock_connect(struct msg *);
+int	sock_shutdown(struct msg *);
+int	sock_close(struct msg *);
+int	sock_setsockopt(struct msg *);
+int	sock_getsockopt(struct msg *);
+int	sock_getsockname(struct msg *);
+int	sock_getpeername(struct msg *);
+int	sock_send(struct msg *);
+int	sock_recv(struct msg *);
+int	sock_batch(struct msg *);
+int	sock_ioctl(struct msg *);
+int	sock_fcntl(struct msg *);
+int	sock_exit(struct msg *);
+void	sock_init(void);
+
+#endif /* !_SOCK_H_ */
@@ -0,0 +1,124 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * exec.c - exec benchmark
+ */
+
+#include <sys/prex.h>
+#include <sys/sysinfo.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NR_BENCH	100		/* number of exec in loop */
+#define NR_CHILD	20		/* number of concurrent children */
+
+static int hz;
+
+/*
+ * Run a program repeatedly, and report the time for one exec.
+ */
+static void
+exec_loop(void)
+{
+	u_long start, end;
+	pid_t pid;
+	int i, sts;
+
+	sys_time(&start);
+	for (i = 0; i < NR_BENCH; i++) {
+		pid = vfork();
+		if (pid == -1)
+			panic("fork failed");
+		if (pid == 0) {
+			execl("/bin/test", "test", NULL);
+			_exit(1);
+		}
+		while (wait(&sts) != pid)
+			;
+	}
+	sys_time(&end);
+	if (end == start)
+		end++;
+	printf("exec loop: %d msec for %d execs, %d usec/exec\n",
+	       (int)((end - start) * 1000 / hz), NR_BENCH,
+	       (int)((end - start) * 1000 / hz * 1000 / NR_BENCH));
+}
+
+/*
+ * Run the same program concurrently, and report the memory
+ * used by each instance. The text of the program should be
+ * shared by all instances.
+ */
+static void
+exec_concurrent(void)
+{
+	struct meminfo m0, m1;
+	pid_t pid;
+	int i, sts;
+
+	sys_info(INFO_MEMORY, &m0);
+	for (i = 0; i < NR_CHILD; i++) {
+		pid = vfork();
+		if (pid == -1)
+			panic("fork failed");
+		if (pid == 0) {
+			execl("/bin/sleep", "sleep", "2", NULL);
+			_exit(1);
+		}
+	}
+	timer_sleep(1000, 0);
+	sys_info(INFO_MEMORY, &m1);
+
+	printf("%d instances: %d KB used, %d KB/instance\n", NR_CHILD,
+	       (int)((m0.free - m1.free) / 1024),
+	       (int)((m0.free - m1.free) / 1024 / NR_CHILD));
+
+	for (i = 0; i < NR_CHILD; i++)
+		wait(&sts);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct timerinfo info;
+
+	printf("Exec benchmark\n");
+
+	sys_info(INFO_TIMER, &info);
+	if (info.hz == 0)
+		panic("can not get timer tick rate");
+	hz = info.hz;
+
+	exec_loop();
+	exec_concurrent();
+	return 0;
+}
@@ -37,17 +37,29 @@
 #include <sys/syslog.h>
 #include <sys/mount.h>
 #include <sys/fcntl.h>
+#include <sys/stat.h>
 
 #include <unistd.h>
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <dirent.h>
 
 #define IOBUFSZ	512
 #define READ_TARGET	"/boot/LICENSE"
 #define WRITE_TARGET	"/tmp/test"
 
+#define BENCH_BUFSZ	(64 * 1024)
+#define BENCH_FILESZ	(1024 * 1024)
+#define BENCH_LOOPS	4
+#define BENCH_SEEKS	2000
+#define BENCH_LOGSZ	(256 * 1024)
+#define BENCH_RECSZ	64
+#define BENCH_FILES	1000
+
 static	char iobuf[IOBUFSZ];
+static	char benchbuf[BENCH_BUFSZ];
 
 static void
 test_write(void)
@@ -80,6 +92,240 @@ cat_file(void)
 	close(fd);
 }
 
+/*
+ * Read the whole file sequentially, and report the throughput.
+ */
+static void
+read_loop(const char *path, size_t bufsz, const char *mode)
+{
+	struct timerinfo t0, t1;
+	u_long ticks, total;
+	int fd, i, rd;
+
+	total = 0;
+	sys_info(INFO_TIMER, &t0);
+	for (i = 0; i < BENCH_LOOPS; i++) {
+		if ((fd = open(path, O_RDONLY, 0)) < 0)
+			return;
+		while ((rd = read(fd, benchbuf, bufsz)) > 0)
+			total += (u_long)rd;
+		close(fd);
+	}
+	sys_info(INFO_TIMER, &t1);
+
+	ticks = t1.cputicks - t0.cputicks;
+	if (ticks == 0)
+		ticks = 1;
+	printf("%s: %2dKB read %s: %d KB/sec\n", path, (int)(bufsz / 1024),
+	       mode, (int)(total / 1024 * t1.hz / ticks));
+}
+
+/*
+ * Sequential read benchmark.
+ *
+ * Compare the read with the buffer mapped for each request,
+ * and the one with the I/O region registered to the server.
+ */
+static void
+test_readbench(const char *path)
+{
+	int fd, i;
+
+	if ((fd = open(path, O_CREAT|O_RDWR, 0)) < 0) {
+		printf("can not create %s\n", path);
+		return;
+	}
+	memset(benchbuf, 0x5a, BENCH_BUFSZ);
+	for (i = 0; i < BENCH_FILESZ / BENCH_BUFSZ; i++)
+		write(fd, benchbuf, BENCH_BUFSZ);
+	close(fd);
+
+	read_loop(path, 4096, "mapped");
+	read_loop(path, BENCH_BUFSZ, "mapped");
+
+	ioregion(benchbuf, BENCH_BUFSZ);
+	read_loop(path, 4096, "region");
+	read_loop(path, BENCH_BUFSZ, "region");
+	ioregion(NULL, 0);
+
+	unlink(path);
+}
+
+/*
+ * Copy benchmark.
+ *
+ * Copy a large file in BUFSIZ chunks as cp(1) does, so that
+ * the file system sees small sequential reads and writes.
+ */
+static void
+test_copybench(const char *src, const char *dst)
+{
+	struct timerinfo t0, t1;
+	u_long ticks, total;
+	int fd, fd2, i, rd;
+
+	if ((fd = open(src, O_CREAT|O_RDWR, 0)) < 0) {
+		printf("can not create %s\n", src);
+		return;
+	}
+	memset(benchbuf, 0xa5, BENCH_BUFSZ);
+	for (i = 0; i < BENCH_FILESZ / BENCH_BUFSZ; i++)
+		write(fd, benchbuf, BENCH_BUFSZ);
+	close(fd);
+	sync();
+
+	total = 0;
+	sys_info(INFO_TIMER, &t0);
+	if ((fd = open(src, O_RDONLY, 0)) < 0)
+		goto out;
+	if ((fd2 = open(dst, O_CREAT|O_WRONLY|O_TRUNC, 0)) < 0) {
+		close(fd);
+		goto out;
+	}
+	while ((rd = read(fd, benchbuf, BUFSIZ)) > 0) {
+		if (write(fd2, benchbuf, (size_t)rd) != rd)
+			break;
+		total += (u_long)rd;
+	}
+	close(fd2);
+	close(fd);
+	sync();
+	sys_info(INFO_TIMER, &t1);
+
+	ticks = t1.cputicks - t0.cputicks;
+	if (ticks == 0)
+		ticks = 1;
+	printf("%s: %dKB copied: %d KB/sec\n", dst, (int)(total / 1024),
+	       (int)(total / 1024 * t1.hz / ticks));
+ out:
+	unlink(dst);
+	unlink(src);
+}
+
+/*
+ * Print the rate of the operations since t0.
+ */
+static void
+print_rate(const char *name, int count, struct timerinfo *t0)
+{
+	struct timerinfo t1;
+	u_long ticks;
+
+	sys_info(INFO_TIMER, &t1);
+	ticks = t1.cputicks - t0->cputicks;
+	if (ticks == 0)
+		ticks = 1;
+	printf("%s: %d ops: %d ops/sec\n", name, count,
+	       (int)((u_long)count * t1.hz / ticks));
+}
+
+/*
+ * Random access and append benchmark.
+ *
+ * Read small records at random offsets in a large file, which
+ * needs the cluster lookup in the middle of the file. Then append
+ * small records to a log file, which grows the file one cluster
+ * at a time.
+ */
+static void
+test_seekbench(const char *path, const char *log)
+{
+	struct timerinfo t0;
+	int fd, i, n;
+	off_t off;
+
+	if ((fd = open(path, O_CREAT|O_RDWR, 0)) < 0) {
+		printf("can not create %s\n", path);
+		return;
+	}
+	memset(benchbuf, 0x3c, BENCH_BUFSZ);
+	for (i = 0; i < BENCH_FILESZ / BENCH_BUFSZ; i++)
+		write(fd, benchbuf, BENCH_BUFSZ);
+	sync();
+
+	srand(1);
+	sys_info(INFO_TIMER, &t0);
+	for (n = 0; n < BENCH_SEEKS; n++) {
+		off = (off_t)(rand() % (BENCH_FILESZ / IOBUFSZ)) * IOBUFSZ;
+		if (lseek(fd, off, SEEK_SET) != off ||
+		    read(fd, iobuf, IOBUFSZ) != IOBUFSZ)
+			break;
+	}
+	print_rate("random read", n, &t0);
+	close(fd);
+	unlink(path);
+
+	if ((fd = open(log, O_CREAT|O_WRONLY|O_APPEND, 0)) < 0) {
+		printf("can not create %s\n", log);
+		return;
+	}
+	sys_info(INFO_TIMER, &t0);
+	for (n = 0; n < BENCH_LOGSZ / BENCH_RECSZ; n++) {
+		if (write(fd, benchbuf, BENCH_RECSZ) != BENCH_RECSZ)
+			break;
+	}
+	close(fd);
+	sync();
+	print_rate("append", n, &t0);
+	unlink(log);
+}
+
+/*
+ * Directory benchmark.
+ *
+ * Create many files in one directory, then look up, list and
+ * remove them.
+ */
+static void
+test_dirbench(const char *dir)
+{
+	struct timerinfo t0;
+	struct stat st;
+	struct dirent *dp;
+	DIR *dirp;
+	char path[64];
+	int fd, n;
+
+	if (mkdir(dir, 0) < 0) {
+		printf("can not create %s\n", dir);
+		return;
+	}
+	sys_info(INFO_TIMER, &t0);
+	for (n = 0; n < BENCH_FILES; n++) {
+		sprintf(path, "%s/f%d", dir, n);
+		if ((fd = open(path, O_CREAT|O_WRONLY, 0)) < 0)
+			break;
+		close(fd);
+	}
+	print_rate("create", n, &t0);
+
+	sys_info(INFO_TIMER, &t0);
+	for (n = 0; n < BENCH_FILES; n++) {
+		sprintf(path, "%s/f%d", dir, n);
+		if (stat(path, &st) < 0)
+			break;
+	}
+	print_rate("lookup", n, &t0);
+
+	n = 0;
+	sys_info(INFO_TIMER, &t0);
+	if ((dirp = opendir(dir)) != NULL) {
+		while ((dp = readdir(dirp)) != NULL)
+			n++;
+		closedir(dirp);
+	}
+	print_rate("readdir", n, &t0);
+
+	sys_info(INFO_TIMER, &t0);
+	for (n = 0; n < BENCH_FILES; n++) {
+		sprintf(path, "%s/f%d", dir, n);
+		if (unlink(path) < 0)
+			break;
+	}
+	print_rate("remove", n, &t0);
+	rmdir(dir);
+}
+
 /*
  * Test invalid request
  */
@@ -168,6 +414,18 @@ main(int argc, char *argv[])
 
 	cat_file();		/* test read/write */
 
+	test_readbench("/tmp/bench");	/* ramfs */
+	test_seekbench("/tmp/rand", "/tmp/log");
+	test_dirbench("/tmp/dir");
+
+	mkdir("/fat", 0);
+	if (mount("/dev/fd0", "/fat", "fatfs", 0, NULL) == 0) {
+		test_readbench("/fat/bench");
+		test_copybench("/fat/src", "/fat/dst");
+		test_seekbench("/fat/rand", "/fat/log");
+		umount("/fat");
+	}
+
 	test_invalid();		/* test invalid request */
 
 	test_read();		/* test read loop */
@@ -36,6 +36,90 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define NR_BENCH	100		/* number of fork in benchmark */
+#define BENCH_HEAP	(1024 * 1024)	/* heap size touched by parent */
+
+static int hz;
+
+static void
+print_result(const char *name, u_long ticks, struct meminfo *m0,
+	     struct meminfo *m1)
+{
+
+	if (ticks == 0)
+		ticks = 1;
+	printf("%s: %d msec for %d forks, %d usec/fork\n", name,
+	       (int)(ticks * 1000 / hz), NR_BENCH,
+	       (int)(ticks * 1000 / hz * 1000 / NR_BENCH));
+	printf("  %d pages copied, %d copy-on-write faults\n",
+	       (int)(m1->cowcopies - m0->cowcopies),
+	       (int)(m1->cowfaults - m0->cowfaults));
+}
+
+/*
+ * Measure the cost of fork with a large heap. The child
+ * exits immediately, or runs exec, which is the common usage
+ * of fork. vfork() is a full fork on MMU systems. Since the
+ * writable pages are shared copy-on-write, fork should not
+ * copy the heap.
+ */
+static void
+fork_bench(void)
+{
+	struct timerinfo info;
+	struct meminfo m0, m1;
+	u_long start, end;
+	pid_t pid;
+	char *heap;
+	int i, sts;
+
+	printf("Fork benchmark\n");
+
+	sys_info(INFO_TIMER, &info);
+	if (info.hz == 0)
+		panic("can not get timer tick rate");
+	hz = info.hz;
+
+	if ((heap = malloc(BENCH_HEAP)) == NULL)
+		panic("out of memory");
+	memset(heap, 0xa5, BENCH_HEAP);
+
+	sys_info(INFO_MEMORY, &m0);
+	sys_time(&start);
+	for (i = 0; i < NR_BENCH; i++) {
+		pid = vfork();
+		if (pid == -1)
+			panic("fork failed");
+		if (pid == 0)
+			_exit(0);
+		while (wait(&sts) != pid)
+			;
+	}
+	sys_time(&end);
+	sys_info(INFO_MEMORY, &m1);
+	print_result("fork+exit", end - start, &m0, &m1);
+
+	sys_info(INFO_MEMORY, &m0);
+	sys_time(&start);
+	for (i = 0; i < NR_BENCH; i++) {
+		pid = vfork();
+		if (pid == -1)
+			panic("fork failed");
+		if (pid == 0) {
+			execl("/bin/test", "test", NULL);
+			_exit(1);
+		}
+		while (wait(&sts) != pid)
+			;
+	}
+	sys_time(&end);
+	sys_info(INFO_MEMORY, &m1);
+	print_result("fork+exec", end - start, &m0, &m1);
+
+	free(heap);
+}
 
 int
 main(int argc, char *argv[])
@@ -45,6 +129,8 @@ main(int argc, char *argv[])
 
 	printf("Test fork\n");
 
+	fork_bench();
+
 	for (;;) {
 		sys_log("fork\n");
 		pid = vfork();
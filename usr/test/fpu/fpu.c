@@ -0,0 +1,107 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * fpu.c - test FPU context switching
+ */
+
+#include <sys/prex.h>
+#include <stdio.h>
+
+#define NR_THREADS	4
+#define NR_LOOPS	20000
+#define STACK_SIZE	1024
+
+static char stack[NR_THREADS][STACK_SIZE];
+static thread_t threads[NR_THREADS];
+static volatile int done[NR_THREADS];
+static volatile int errors;
+
+/*
+ * Compute a sum which depends on the thread index. The thread
+ * yields in the loop, so other threads use the FPU meanwhile.
+ */
+static double
+compute(int idx, int yield)
+{
+	double sum = 0.0, x = (double)(idx + 1);
+	int i;
+
+	for (i = 1; i <= NR_LOOPS; i++) {
+		sum += x / (double)i;
+		if (yield && (i % 100) == 0)
+			thread_yield();
+	}
+	return sum;
+}
+
+static void
+fpu_thread(void)
+{
+	double expect, result;
+	int idx;
+
+	for (idx = 0; threads[idx] != thread_self(); idx++)
+		;
+	expect = compute(idx, 0);
+	result = compute(idx, 1);
+	if (result != expect)
+		errors++;
+	done[idx] = 1;
+	thread_terminate(thread_self());
+}
+
+int
+main(int argc, char *argv[])
+{
+	int i, n;
+
+	printf("FPU test program\n");
+
+	for (i = 0; i < NR_THREADS; i++) {
+		if (thread_create(task_self(), &threads[i]) != 0)
+			panic("thread_create is failed");
+		if (thread_load(threads[i], fpu_thread,
+				stack[i] + STACK_SIZE) != 0)
+			panic("thread_load is failed");
+	}
+	for (i = 0; i < NR_THREADS; i++) {
+		if (thread_resume(threads[i]) != 0)
+			panic("thread_resume is failed");
+	}
+	do {
+		timer_sleep(100, 0);
+		for (n = 0, i = 0; i < NR_THREADS; i++)
+			n += done[i];
+	} while (n < NR_THREADS);
+
+	printf("%d threads, %d errors\n", NR_THREADS, (int)errors);
+	printf("Test %s\n", errors ? "failed" : "succeeded");
+	return 0;
+}
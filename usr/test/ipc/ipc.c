@@ -36,13 +36,20 @@
 #include <stdio.h>
 #include <string.h>
 
+#define NR_BENCH	10000	/* number of messages for benchmark */
+#define NR_INFLIGHT	8	/* async messages in flight */
+#define PRI_BENCH	100	/* priority for benchmark threads */
+
 static char stack[1024];
+static char server_stack[1024];
 
 struct my_msg {
 	struct msg_header hdr;
 	char data[100];
 };
 
+static object_t bench_obj;
+
 /*
  * Run specified thread
  */
@@ -114,6 +121,102 @@ send_thread(void)
 	for (;;) ;
 }
 
+/*
+ * Server thread for benchmark
+ */
+static void
+bench_server(void)
+{
+	struct my_msg msg;
+
+	for (;;) {
+		if (msg_receive(bench_obj, &msg, sizeof(msg)) == 0)
+			msg_reply(bench_obj, &msg, sizeof(msg));
+	}
+}
+
+static void
+print_rate(const char *name, u_long ticks, int hz)
+{
+
+	if (ticks == 0)
+		ticks = 1;
+	printf("%s: %d msec for %d messages, %d msgs/sec\n", name,
+	       (int)(ticks * 1000 / hz), NR_BENCH,
+	       (int)(NR_BENCH * hz / ticks));
+}
+
+/*
+ * Compare the throughput of synchronous and asynchronous
+ * messages. The client and server run at same priority, so
+ * that the server can process all pending messages before
+ * the client runs again.
+ */
+static void
+ipc_bench(void)
+{
+	struct timerinfo info;
+	struct my_msg msg, amsg[NR_INFLIGHT];
+	thread_t t;
+	u_long start, end;
+	void *done;
+	int i, sent;
+
+	printf("IPC throughput benchmark\n");
+
+	sys_info(INFO_TIMER, &info);
+	if (info.hz == 0)
+		panic("can not get timer tick rate");
+
+	if (object_create(NULL, &bench_obj) != 0)
+		panic("failed to create object");
+
+	thread_setpri(thread_self(), PRI_BENCH);
+	if (thread_create(task_self(), &t) != 0)
+		panic("thread_create is failed");
+	if (thread_load(t, bench_server, server_stack + 1024) != 0)
+		panic("thread_load is failed");
+	if (thread_setpri(t, PRI_BENCH) != 0)
+		panic("thread_setpri is failed");
+	if (thread_resume(t) != 0)
+		panic("thread_resume is failed");
+
+	/*
+	 * Synchronous messages.
+	 */
+	sys_time(&start);
+	for (i = 0; i < NR_BENCH; i++) {
+		if (msg_send(bench_obj, &msg, sizeof(msg)) != 0)
+			panic("msg_send is failed");
+	}
+	sys_time(&end);
+	print_rate("sync ", end - start, info.hz);
+
+	/*
+	 * Asynchronous messages. Keep NR_INFLIGHT messages in
+	 * flight, and refill the window with completed messages.
+	 */
+	sys_time(&start);
+	for (sent = 0; sent < NR_INFLIGHT; sent++) {
+		if (msg_send_async(bench_obj, &amsg[sent], sizeof(msg)) != 0)
+			panic("msg_send_async is failed");
+	}
+	for (i = 0; i < NR_BENCH; i++) {
+		if (msg_poll(&done, 1) != 0)
+			panic("msg_poll is failed");
+		if (sent < NR_BENCH) {
+			if (msg_send_async(bench_obj, done, sizeof(msg)) != 0)
+				panic("msg_send_async is failed");
+			sent++;
+		}
+	}
+	sys_time(&end);
+	print_rate("async", end - start, info.hz);
+
+	thread_terminate(t);
+	object_destroy(bench_obj);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -180,6 +283,8 @@ main(int argc, char *argv[])
 	printf("%s\n", msg.data);
 	printf("%d\n", msg.hdr.code);
 
+	ipc_bench();
+
 	printf("Test completed...\n");
 	return 0;
 }
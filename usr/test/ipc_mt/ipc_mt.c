@@ -34,10 +34,18 @@
 #include <sys/prex.h>
 #include <ipc/ipc.h>
 #include <stdio.h>
+#include <errno.h>
 
 #define NR_THREADS	5
 
+#define NR_BENCH	10000	/* number of messages for benchmark */
+#define NR_BATCH	8	/* messages in flight and batch size */
+#define PRI_BENCH	100	/* priority for benchmark threads */
+
 static char stack[NR_THREADS][1024];
+static char server_stack[1024];
+
+static object_t bench_obj;
 
 /*
  * Run specified thread
@@ -105,6 +113,155 @@ receive_thread(void)
 	}
 }
 
+/*
+ * Benchmark server which receives one message at once.
+ */
+static void
+single_server(void)
+{
+	struct msg msg;
+
+	for (;;) {
+		if (msg_receive(bench_obj, &msg, sizeof(msg)) == 0)
+			msg_reply(bench_obj, &msg, sizeof(msg));
+	}
+}
+
+/*
+ * Benchmark server which receives all pending messages at once.
+ */
+static void
+batch_server(void)
+{
+	struct msg msg[NR_BATCH];
+	int count;
+
+	for (;;) {
+		count = NR_BATCH;
+		if (msg_receive_batch(bench_obj, msg, sizeof(struct msg),
+				      &count) == 0)
+			msg_reply_batch(bench_obj, msg, sizeof(struct msg),
+					count);
+	}
+}
+
+/*
+ * Send NR_BENCH asynchronous messages to the server
+ * and report the throughput.
+ */
+static void
+run_bench(const char *name, void (*server)(void), int hz)
+{
+	struct msg msg[NR_BATCH];
+	thread_t t;
+	u_long start, end;
+	void *done;
+	int i, sent;
+
+	if (object_create(NULL, &bench_obj) != 0)
+		panic("failed to create object");
+	if (thread_create(task_self(), &t) != 0)
+		panic("thread_create is failed");
+	if (thread_load(t, server, server_stack + 1024) != 0)
+		panic("thread_load is failed");
+	if (thread_setpri(t, PRI_BENCH) != 0)
+		panic("thread_setpri is failed");
+	if (thread_resume(t) != 0)
+		panic("thread_resume is failed");
+
+	sys_time(&start);
+	for (sent = 0; sent < NR_BATCH; sent++) {
+		if (msg_send_async(bench_obj, &msg[sent], sizeof(msg[0])) != 0)
+			panic("msg_send_async is failed");
+	}
+	for (i = 0; i < NR_BENCH; i++) {
+		if (msg_poll(&done, 1) != 0)
+			panic("msg_poll is failed");
+		if (sent < NR_BENCH) {
+			if (msg_send_async(bench_obj, done, sizeof(msg[0])) != 0)
+				panic("msg_send_async is failed");
+			sent++;
+		}
+	}
+	sys_time(&end);
+
+	thread_terminate(t);
+	object_destroy(bench_obj);
+
+	if (end == start)
+		end++;
+	printf("%s: %d msec for %d messages, %d msgs/sec\n", name,
+	       (int)((end - start) * 1000 / hz), NR_BENCH,
+	       (int)(NR_BENCH * hz / (end - start)));
+}
+
+#ifdef CONFIG_MMU
+/*
+ * A batch receive into an unmapped buffer must fail with
+ * EFAULT, and must leave the message in the queue.
+ */
+static void
+batch_fault_test(void)
+{
+	struct msg msg, rmsg[NR_BATCH];
+	void *bad, *done;
+	int count;
+
+	printf("Batch receive into a bad buffer\n");
+
+	if (object_create(NULL, &bench_obj) != 0)
+		panic("failed to create object");
+	if (vm_allocate(task_self(), &bad, sizeof(rmsg), 1) != 0)
+		panic("vm_allocate is failed");
+	vm_free(task_self(), bad);
+
+	if (msg_send_async(bench_obj, &msg, sizeof(msg)) != 0)
+		panic("msg_send_async is failed");
+
+	count = NR_BATCH;
+	if (msg_receive_batch(bench_obj, bad, sizeof(struct msg),
+			      &count) != EFAULT)
+		panic("msg_receive_batch did not fault");
+
+	count = NR_BATCH;
+	if (msg_receive_batch(bench_obj, rmsg, sizeof(struct msg),
+			      &count) != 0 || count != 1)
+		panic("message is lost");
+	msg_reply_batch(bench_obj, rmsg, sizeof(struct msg), count);
+
+	if (msg_poll(&done, 1) != 0 || done != &msg)
+		panic("msg_poll is failed");
+
+	object_destroy(bench_obj);
+	printf("ok\n");
+}
+#endif
+
+/*
+ * Compare the throughput of single receive and batched
+ * receive for asynchronous messages.
+ */
+static void
+ipc_bench(void)
+{
+	struct timerinfo info;
+	int pri;
+
+	printf("IPC throughput benchmark\n");
+
+	sys_info(INFO_TIMER, &info);
+	if (info.hz == 0)
+		panic("can not get timer tick rate");
+
+	thread_getpri(thread_self(), &pri);
+	thread_setpri(thread_self(), PRI_BENCH);
+
+	run_bench("single", single_server, info.hz);
+	run_bench("batch ", batch_server, info.hz);
+
+	thread_setpri(thread_self(), pri);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -113,6 +270,11 @@ main(int argc, char *argv[])
 
 	printf("IPC test for multi threads\n");
 
+#ifdef CONFIG_MMU
+	batch_fault_test();
+#endif
+	ipc_bench();
+
 	/*
 	 * Create an object.
 	 */
@@ -0,0 +1,118 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * lookup.c - path lookup benchmark.
+ *
+ * Call stat() many times on a nested path which exists, and on
+ * one which does not exist, as the PATH search of the shell does.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define LOOPS	10000
+#define DEPTH	4
+
+static char dir[DEPTH][64];
+static char file[128];
+static char nofile[128];
+
+static void
+bench(const char *name, const char *path, int expect)
+{
+	struct timeval t0, t1;
+	struct stat st;
+	long usec;
+	int i;
+
+	gettimeofday(&t0, NULL);
+	for (i = 0; i < LOOPS; i++) {
+		if ((stat(path, &st) == 0) != expect)
+			errx(1, "stat(%s): unexpected result", path);
+	}
+	gettimeofday(&t1, NULL);
+
+	usec = (t1.tv_sec - t0.tv_sec) * 1000000 +
+		(t1.tv_usec - t0.tv_usec);
+	printf("%s: %d stat calls in %ld msec (%ld usec/call)\n",
+	       name, LOOPS, usec / 1000, usec / LOOPS);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int fd, i;
+	pid_t pid = getpid();
+
+	sprintf(dir[0], "t%05d", pid);
+	for (i = 1; i < DEPTH; i++) {
+		strlcpy(dir[i], dir[i - 1], sizeof(dir[i]));
+		sprintf(file, "/d%d", i);
+		strlcat(dir[i], file, sizeof(dir[i]));
+	}
+	for (i = 0; i < DEPTH; i++) {
+		if (mkdir(dir[i], 0770) < 0)
+			err(1, "mkdir(%s)", dir[i]);
+	}
+	sprintf(file, "%s/file", dir[DEPTH - 1]);
+	sprintf(nofile, "%s/nofile", dir[DEPTH - 1]);
+	if ((fd = creat(file, 0660)) == -1)
+		err(1, "creat(%s)", file);
+	close(fd);
+
+	bench("exist", file, 1);
+	bench("not exist", nofile, 0);
+
+	/* The negative entry must be dropped by creat(). */
+	if ((fd = creat(nofile, 0660)) == -1)
+		err(1, "creat(%s)", nofile);
+	close(fd);
+	bench("created", nofile, 1);
+
+	/* The positive entry must be dropped by unlink(). */
+	if (unlink(nofile) == -1)
+		err(1, "unlink(%s)", nofile);
+	bench("removed", nofile, 0);
+
+	unlink(file);
+	for (i = DEPTH - 1; i >= 0; i--) {
+		if (rmdir(dir[i]) == -1)
+			err(1, "rmdir(%s)", dir[i]);
+	}
+	return 0;
+}
@@ -31,10 +31,14 @@
  * malloc.c - malloc test program.
  */
 
+#include <sys/prex.h>
+
 #include <stdlib.h>
 #include <stdio.h>
 
 #define NR_ALLOCS	30
+#define SPARSE_SIZE	(4 * 1024 * 1024)	/* size of sparse area */
+#define SPARSE_STEP	(16 * PAGE_SIZE)	/* touch every 16 pages */
 
 static void *ptr[NR_ALLOCS];
 
@@ -118,6 +122,44 @@ test_2(void)
 	printf("test_2 - done\n");
 }
 
+/*
+ * Allocate a large area and touch only a part of it. The
+ * pages are allocated on first access, so only the touched
+ * pages should be consumed.
+ */
+static void
+test_4(void)
+{
+	struct meminfo m0, m1, m2;
+	char *p;
+	size_t off;
+
+	printf("test_4 - start\n");
+
+	sys_info(INFO_MEMORY, &m0);
+	p = NULL;
+	if (vm_allocate(task_self(), (void **)&p, SPARSE_SIZE, 1)) {
+		printf("Error: vm_allocate() failed!\n");
+		return;
+	}
+	sys_info(INFO_MEMORY, &m1);
+	for (off = 0; off < SPARSE_SIZE; off += SPARSE_STEP) {
+		if (p[off] != 0)
+			printf("Error: page is not zero-filled!\n");
+		p[off] = '@';
+	}
+	sys_info(INFO_MEMORY, &m2);
+
+	printf("allocate %dK: used %dK, after touch %d pages: used %dK\n",
+	       SPARSE_SIZE / 1024, (int)(m0.free - m1.free) / 1024,
+	       SPARSE_SIZE / SPARSE_STEP, (int)(m0.free - m2.free) / 1024);
+	printf("%d pages filled on demand\n",
+	       (int)(m2.zerofills - m0.zerofills));
+	vm_free(task_self(), p);
+
+	printf("test_4 - done\n");
+}
+
 static void
 test_3(void)
 {
@@ -141,6 +183,7 @@ main(int argc, char *argv[])
 
 	test_1();
 	test_2();
+	test_4();
 	test_3();
 
 	return 0;
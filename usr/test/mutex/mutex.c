@@ -34,8 +34,102 @@
 #include <sys/prex.h>
 #include <stdio.h>
 
+#define NR_LOOPS	100000	/* lock count for uncontended case */
+#define NR_THREADS	4	/* threads for contended case */
+#define NR_CONTEND	2000	/* lock count per thread */
+#define STACK_SIZE	1024
+
 static mutex_t mtx_A = MUTEX_INITIALIZER;
 static mutex_t mtx_B, mtx_C;
+static mutex_t mtx_D = MUTEX_INITIALIZER;
+
+static char stack[NR_THREADS][STACK_SIZE];
+static volatile u_long counter;
+static volatile int nr_done;
+
+static u_long
+bench_ticks(u_long *hz)
+{
+	struct timerinfo info;
+
+	sys_info(INFO_TIMER, &info);
+	*hz = info.hz;
+	return info.cputicks;
+}
+
+static void
+report(const char *name, u_long count, u_long ticks, u_long hz)
+{
+
+	if (ticks == 0)
+		ticks = 1;
+	printf("%s: %d locks in %d msec, %d locks/sec\n", name,
+	       (int)count, (int)(ticks * 1000 / hz),
+	       (int)(count * hz / ticks));
+}
+
+/*
+ * Yield the CPU with the mutex locked, so that the other
+ * threads block on it.
+ */
+static void
+contend_thread(void)
+{
+	int i;
+
+	for (i = 0; i < NR_CONTEND; i++) {
+		mutex_lock(&mtx_D);
+		counter++;
+		thread_yield();
+		mutex_unlock(&mtx_D);
+	}
+	nr_done++;
+	thread_terminate(thread_self());
+}
+
+/*
+ * Lock benchmark.
+ *
+ * Measure the uncontended lock/unlock which is done in user
+ * space, and the contended one which needs the hand-off by
+ * the kernel.
+ */
+static void
+lock_bench(void)
+{
+	thread_t t;
+	u_long t0, t1, hz;
+	int i;
+
+	printf("Lock benchmark\n");
+
+	t0 = bench_ticks(&hz);
+	for (i = 0; i < NR_LOOPS; i++) {
+		mutex_lock(&mtx_D);
+		mutex_unlock(&mtx_D);
+	}
+	t1 = bench_ticks(&hz);
+	report("uncontended", NR_LOOPS, t1 - t0, hz);
+
+	counter = 0;
+	nr_done = 0;
+	t0 = bench_ticks(&hz);
+	for (i = 0; i < NR_THREADS; i++) {
+		if (thread_create(task_self(), &t) != 0)
+			panic("thread_create is failed");
+		if (thread_load(t, contend_thread,
+				stack[i] + STACK_SIZE) != 0)
+			panic("thread_load is failed");
+		if (thread_resume(t) != 0)
+			panic("thread_resume is failed");
+	}
+	while (nr_done < NR_THREADS)
+		timer_sleep(10, 0);
+	t1 = bench_ticks(&hz);
+	report("contended", counter, t1 - t0, hz);
+	if (counter != NR_THREADS * NR_CONTEND)
+		printf("Error: counter=%d\n", (int)counter);
+}
 
 int
 main(int argc, char *argv[])
@@ -101,6 +195,8 @@ main(int argc, char *argv[])
 	error = mutex_unlock(&mtx_A);
 	printf("11) Unlock mutex A: error=%d\n", error);
 
+	lock_bench();
+
 	printf("Test completed...\n");
 	return 0;
 }
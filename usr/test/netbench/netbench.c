@@ -0,0 +1,350 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * netbench.c - loopback echo benchmark for the socket interface.
+ *
+ * A thread runs an echo server with sockbatch(), and the main
+ * thread sends small requests to it over 127.0.0.1, one round trip
+ * per request at first, and then the requests of all connections
+ * in one batch. The latency is measured in clock ticks.
+ */
+
+#include <sys/prex.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#define PORT		7777
+#define MSGSZ		64	/* size of request */
+#define NCONN		8	/* connections for batch */
+#define NREQS		4000	/* requests for each test */
+
+static u_long lat[NREQS];	/* latency of each request */
+static int hz;
+static char server_stack[8192];
+
+static void
+echo_server(void)
+{
+	struct sockaddr_in sin;
+	struct pollfd pfd[NCONN + 1];
+	struct sockop ops[SOP_MAX];
+	struct iovec iov[NCONN];
+	static char buf[NCONN][MSGSZ];
+	int conn[NCONN], fds[NCONN], ready[NCONN];
+	int ls, nconn = 0, nops, nready, naccept, i, j, on = 1;
+
+	if ((ls = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		err(1, "socket");
+	setsockopt(ls, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_len = sizeof(sin);
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(PORT);
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(ls, (struct sockaddr *)&sin, sizeof(sin)) < 0)
+		err(1, "bind");
+	if (listen(ls, NCONN) < 0)
+		err(1, "listen");
+
+	for (;;) {
+		/*
+		 * Wait for the requests.
+		 */
+		pfd[0].fd = ls;
+		pfd[0].events = POLLIN;
+		for (i = 0; i < nconn; i++) {
+			pfd[i + 1].fd = conn[i];
+			pfd[i + 1].events = POLLIN;
+		}
+		ops[0].so_op = SOP_POLL;
+		ops[0].so_pfd = pfd;
+		ops[0].so_count = nconn + 1;
+		ops[0].so_timeout = -1;
+		ops[0].so_sem = 0;
+		if (sockbatch(ops, 1) < 0 || ops[0].so_error)
+			errx(1, "poll failed");
+
+		/*
+		 * Accept the new connections, and receive the
+		 * requests by one batch.
+		 */
+		nops = 0;
+		if ((pfd[0].revents & POLLIN) && nconn < NCONN) {
+			ops[nops].so_op = SOP_ACCEPT;
+			ops[nops].so_sd = ls;
+			ops[nops].so_flags = MSG_DONTWAIT;
+			ops[nops].so_fds = fds;
+			ops[nops].so_count = NCONN - nconn;
+			nops++;
+		}
+		nready = 0;
+		for (i = 0; i < nconn; i++) {
+			if ((pfd[i + 1].revents & POLLIN) == 0)
+				continue;
+			iov[i].iov_base = buf[i];
+			iov[i].iov_len = MSGSZ;
+			ops[nops].so_op = SOP_RECV;
+			ops[nops].so_sd = conn[i];
+			ops[nops].so_flags = MSG_DONTWAIT;
+			ops[nops].so_iov = &iov[i];
+			ops[nops].so_count = 1;
+			ready[nready++] = i;
+			nops++;
+		}
+		if (nops == 0)
+			continue;
+		if (sockbatch(ops, nops) < 0)
+			err(1, "sockbatch");
+		naccept = (ops[0].so_op == SOP_ACCEPT) ? ops[0].so_result : 0;
+
+		/*
+		 * Echo back the received data by one batch.
+		 */
+		j = nops - nready;
+		nops = 0;
+		for (i = 0; i < nready; i++, j++) {
+			if (ops[j].so_error == EWOULDBLOCK)
+				continue;
+			if (ops[j].so_error || ops[j].so_result == 0) {
+				close(conn[ready[i]]);
+				conn[ready[i]] = -1;
+				continue;
+			}
+			iov[ready[i]].iov_len = ops[j].so_result;
+			ops[nops].so_op = SOP_SEND;
+			ops[nops].so_sd = conn[ready[i]];
+			ops[nops].so_flags = 0;
+			ops[nops].so_iov = &iov[ready[i]];
+			ops[nops].so_count = 1;
+			nops++;
+		}
+		if (nops > 0 && sockbatch(ops, nops) < 0)
+			err(1, "sockbatch");
+
+		/* Add new connections, and remove closed ones. */
+		for (i = j = 0; i < nconn; i++) {
+			if (conn[i] >= 0)
+				conn[j++] = conn[i];
+		}
+		nconn = j;
+		for (i = 0; i < naccept; i++)
+			conn[nconn++] = fds[i];
+	}
+}
+
+static int
+connect_server(void)
+{
+	struct sockaddr_in sin;
+	int s, i;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_len = sizeof(sin);
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(PORT);
+	sin.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+	/* Wait for the server to listen. */
+	for (i = 0; i < 100; i++) {
+		if ((s = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+			err(1, "socket");
+		if (connect(s, (struct sockaddr *)&sin, sizeof(sin)) == 0)
+			return s;
+		close(s);
+		timer_sleep(10, 0);
+	}
+	err(1, "connect");
+	/* NOTREACHED */
+	return -1;
+}
+
+static void
+recv_all(int s, char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = recv(s, buf, len, 0)) <= 0)
+			errx(1, "recv failed");
+		buf += n;
+		len -= n;
+	}
+}
+
+static int
+cmp_lat(const void *a, const void *b)
+{
+	u_long x = *(const u_long *)a, y = *(const u_long *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void
+report(const char *name, u_long ticks)
+{
+	u_long p99;
+
+	if (ticks == 0)
+		ticks = 1;
+	qsort(lat, NREQS, sizeof(lat[0]), cmp_lat);
+	p99 = lat[NREQS * 99 / 100];
+	printf("%s: %d requests in %d msec, %d req/sec, p99 %d usec\n",
+	       name, NREQS, (int)(ticks * 1000 / hz),
+	       (int)((u_long)NREQS * hz / ticks),
+	       (int)(p99 * 1000000 / hz));
+}
+
+/*
+ * One round trip per request.
+ */
+static void
+bench_single(void)
+{
+	char buf[MSGSZ];
+	u_long start, end, t0, t1;
+	int s, i;
+
+	s = connect_server();
+	memset(buf, 'a', sizeof(buf));
+
+	sys_time(&start);
+	for (i = 0; i < NREQS; i++) {
+		sys_time(&t0);
+		if (send(s, buf, MSGSZ, 0) != MSGSZ)
+			err(1, "send");
+		recv_all(s, buf, MSGSZ);
+		sys_time(&t1);
+		lat[i] = t1 - t0;
+	}
+	sys_time(&end);
+	close(s);
+	report("single", end - start);
+}
+
+/*
+ * The requests of all connections are sent, and the replies
+ * are received by one sockbatch() call.
+ */
+static void
+bench_batch(void)
+{
+	struct sockop ops[NCONN * 2];
+	struct iovec txiov[NCONN], rxiov[NCONN];
+	static char txbuf[NCONN][MSGSZ], rxbuf[NCONN][MSGSZ];
+	u_long start, end, t0, t1;
+	int s[NCONN], i, j, n;
+
+	for (i = 0; i < NCONN; i++) {
+		s[i] = connect_server();
+		memset(txbuf[i], 'a' + i, MSGSZ);
+	}
+
+	sys_time(&start);
+	for (n = 0; n < NREQS; n += NCONN) {
+		for (i = 0; i < NCONN; i++) {
+			txiov[i].iov_base = txbuf[i];
+			txiov[i].iov_len = MSGSZ;
+			rxiov[i].iov_base = rxbuf[i];
+			rxiov[i].iov_len = MSGSZ;
+			ops[i].so_op = SOP_SEND;
+			ops[i].so_sd = s[i];
+			ops[i].so_flags = 0;
+			ops[i].so_iov = &txiov[i];
+			ops[i].so_count = 1;
+			ops[NCONN + i].so_op = SOP_RECV;
+			ops[NCONN + i].so_sd = s[i];
+			ops[NCONN + i].so_flags = 0;
+			ops[NCONN + i].so_iov = &rxiov[i];
+			ops[NCONN + i].so_count = 1;
+		}
+		sys_time(&t0);
+		if (sockbatch(ops, NCONN * 2) < 0)
+			err(1, "sockbatch");
+		for (i = 0; i < NCONN * 2; i++) {
+			if (ops[i].so_error)
+				errx(1, "operation %d: error %d", i,
+				     ops[i].so_error);
+		}
+		/* Get the rest of a short reply. */
+		for (i = 0; i < NCONN; i++) {
+			j = ops[NCONN + i].so_result;
+			if (j < MSGSZ)
+				recv_all(s[i], rxbuf[i] + j, MSGSZ - j);
+		}
+		sys_time(&t1);
+		for (i = 0; i < NCONN && n + i < NREQS; i++)
+			lat[n + i] = t1 - t0;
+	}
+	sys_time(&end);
+
+	for (i = 0; i < NCONN; i++) {
+		if (memcmp(txbuf[i], rxbuf[i], MSGSZ))
+			errx(1, "bad reply");
+		close(s[i]);
+	}
+	report("batch ", end - start);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct timerinfo info;
+	thread_t t;
+
+	printf("Loopback echo benchmark\n");
+
+	sys_info(INFO_TIMER, &info);
+	if (info.hz == 0)
+		errx(1, "can not get timer tick rate");
+	hz = info.hz;
+	printf("clock resolution: %d usec\n", 1000000 / hz);
+
+	if (thread_create(task_self(), &t) != 0 ||
+	    thread_load(t, echo_server,
+			server_stack + sizeof(server_stack)) != 0 ||
+	    thread_resume(t) != 0)
+		errx(1, "can not start server thread");
+
+	bench_single();
+	bench_batch();
+
+	/* The sockets of the server are closed at exit. */
+	thread_terminate(t);
+	return 0;
+}
@@ -36,6 +36,60 @@
 
 #include <stdio.h>
 
+#define NR_OBJECTS	24	/* number of objects for lookup test */
+
+static object_t objs[NR_OBJECTS];
+
+/*
+ * Create many named objects, and look up them.
+ */
+static void
+lookup_test(void)
+{
+	struct objinfo info;
+	object_t obj, priv[2];
+	char name[MAXOBJNAME];
+	int i, error;
+
+	for (i = 0; i < NR_OBJECTS; i++) {
+		sprintf(name, "test-%d", i);
+		error = object_create(name, &objs[i]);
+		if (error)
+			panic("Failed to create an object.\n");
+	}
+	for (i = 0; i < NR_OBJECTS; i++) {
+		sprintf(name, "test-%d", i);
+		error = object_lookup(name, &obj);
+		if (error || obj != objs[i])
+			panic("Failed to look up an object.\n");
+	}
+	error = object_lookup("test-none", &obj);
+	if (error == 0)
+		panic("Oops! We found non-existing object!");
+
+	/*
+	 * Private objects have no name, and can not be found.
+	 */
+	if (object_create(NULL, &priv[0]) || object_create(NULL, &priv[1]))
+		panic("Failed to create a private object.\n");
+	error = object_lookup("", &obj);
+	if (error == 0)
+		panic("Oops! We found a private object!");
+	object_destroy(priv[0]);
+	object_destroy(priv[1]);
+
+	for (i = 0; i < NR_OBJECTS; i++)
+		object_destroy(objs[i]);
+
+	if (sys_info(INFO_OBJECT, &info) == 0) {
+		printf("objects=%d named=%d buckets=%d resizes=%d\n",
+		       info.nobjects, info.nnamed, info.hashsize,
+		       info.resizes);
+		printf("lookups=%d hits=%d compares=%d\n",
+		       (int)info.lookups, (int)info.hits,
+		       (int)info.compares);
+	}
+}
 
 int
 main(int argc, char *argv[])
@@ -74,6 +128,8 @@ main(int argc, char *argv[])
 	if (error == 0)
 		panic("Oops! We could destroy a process object!");
 
+	lookup_test();
+
 	printf("test ok\n");
 	return 0;
 }
@@ -0,0 +1,309 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * poll.c - test poll(), select() and epoll over pipes.
+ */
+
+#include <sys/prex.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/poll.h>
+#include <sys/epoll.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define NPIPES		6	/* pipes for the epoll benchmark */
+#define NROUNDS		500	/* rounds of the epoll benchmark */
+
+static int hz;
+static int wakeup_fd;
+static char writer_stack[4096];
+
+static int
+msec(u_long ticks)
+{
+
+	return (int)(ticks * 1000 / hz);
+}
+
+static void
+test_timeout(void)
+{
+	struct pollfd pfd;
+	u_long start, end;
+	int fd[2], n;
+
+	if (pipe(fd) < 0)
+		err(1, "pipe");
+	pfd.fd = fd[0];
+	pfd.events = POLLIN;
+
+	sys_time(&start);
+	n = poll(&pfd, 1, 100);
+	sys_time(&end);
+	if (n != 0)
+		errx(1, "poll: returned %d for an empty pipe", n);
+	if (msec(end - start) < 100 - 1000 / hz)
+		errx(1, "poll: timed out in %d msec", msec(end - start));
+	printf("timeout: ok (%d msec)\n", msec(end - start));
+
+	close(fd[0]);
+	close(fd[1]);
+}
+
+static void
+test_ready(void)
+{
+	struct pollfd pfd[3];
+	char c = 'x';
+	int fd[2], n;
+
+	if (pipe(fd) < 0)
+		err(1, "pipe");
+	pfd[0].fd = fd[0];
+	pfd[0].events = POLLIN;
+	pfd[1].fd = fd[1];
+	pfd[1].events = POLLOUT;
+	pfd[2].fd = 13;			/* not opened */
+	pfd[2].events = POLLIN;
+
+	n = poll(pfd, 2, 0);
+	if (n != 1 || pfd[0].revents != 0 || pfd[1].revents != POLLOUT)
+		errx(1, "poll: bad events for an empty pipe");
+
+	write(fd[1], &c, 1);
+	n = poll(pfd, 3, INFTIM);
+	if (n != 3 || pfd[0].revents != POLLIN ||
+	    pfd[1].revents != POLLOUT || pfd[2].revents != POLLNVAL)
+		errx(1, "poll: bad events for a ready pipe");
+
+	read(fd[0], &c, 1);
+	close(fd[1]);
+	n = poll(pfd, 1, 0);
+	if (n != 1 || pfd[0].revents != POLLHUP)
+		errx(1, "poll: no hang up after close");
+	close(fd[0]);
+	printf("ready: ok\n");
+}
+
+static void
+test_select(void)
+{
+	struct timeval tv;
+	fd_set rfds, wfds;
+	char c = 'x';
+	int fd[2], n;
+
+	if (pipe(fd) < 0)
+		err(1, "pipe");
+	FD_ZERO(&rfds);
+	FD_ZERO(&wfds);
+	FD_SET(fd[0], &rfds);
+	FD_SET(fd[1], &wfds);
+	tv.tv_sec = 0;
+	tv.tv_usec = 10000;
+	n = select(fd[1] + 1, &rfds, &wfds, NULL, &tv);
+	if (n != 1 || FD_ISSET(fd[0], &rfds) || !FD_ISSET(fd[1], &wfds))
+		errx(1, "select: bad result for an empty pipe");
+
+	write(fd[1], &c, 1);
+	FD_SET(fd[0], &rfds);
+	n = select(fd[0] + 1, &rfds, NULL, NULL, NULL);
+	if (n != 1 || !FD_ISSET(fd[0], &rfds))
+		errx(1, "select: pipe is not readable");
+	close(fd[0]);
+	close(fd[1]);
+	printf("select: ok\n");
+}
+
+static void
+writer(void)
+{
+	char c = 'w';
+
+	timer_sleep(50, NULL);
+	write(wakeup_fd, &c, 1);
+	thread_terminate(thread_self());
+}
+
+static void
+test_wakeup(void)
+{
+	struct pollfd pfd;
+	thread_t t;
+	u_long start, end;
+	char c;
+	int fd[2];
+
+	if (pipe(fd) < 0)
+		err(1, "pipe");
+	wakeup_fd = fd[1];
+	if (thread_create(task_self(), &t) != 0 ||
+	    thread_load(t, writer,
+			writer_stack + sizeof(writer_stack)) != 0 ||
+	    thread_resume(t) != 0)
+		errx(1, "can not start writer thread");
+
+	pfd.fd = fd[0];
+	pfd.events = POLLIN;
+	sys_time(&start);
+	if (poll(&pfd, 1, 5000) != 1 || pfd.revents != POLLIN)
+		errx(1, "poll: not woken by the writer");
+	sys_time(&end);
+	read(fd[0], &c, 1);
+	close(fd[0]);
+	close(fd[1]);
+	printf("wakeup: ok (%d msec)\n", msec(end - start));
+}
+
+static void
+test_epoll(void)
+{
+	struct epoll_event ev, events[2];
+	char c = 'x';
+	int fd[2][2], ep, n;
+
+	if ((ep = epoll_create(2)) < 0)
+		err(1, "epoll_create");
+	if (pipe(fd[0]) < 0 || pipe(fd[1]) < 0)
+		err(1, "pipe");
+	ev.events = EPOLLIN;
+	ev.data.u32 = 0;
+	if (epoll_ctl(ep, EPOLL_CTL_ADD, fd[0][0], &ev) < 0)
+		err(1, "epoll_ctl");
+	ev.data.u32 = 1;
+	if (epoll_ctl(ep, EPOLL_CTL_ADD, fd[1][0], &ev) < 0)
+		err(1, "epoll_ctl");
+	if (epoll_ctl(ep, EPOLL_CTL_ADD, fd[1][0], &ev) == 0)
+		errx(1, "epoll_ctl: added twice");
+
+	if (epoll_wait(ep, events, 2, 10) != 0)
+		errx(1, "epoll_wait: empty pipes are ready");
+
+	/* Only the ready one is reported, and it stays ready. */
+	write(fd[1][1], &c, 1);
+	n = epoll_wait(ep, events, 2, INFTIM);
+	if (n != 1 || events[0].data.u32 != 1 ||
+	    events[0].events != EPOLLIN)
+		errx(1, "epoll_wait: bad events for a ready pipe");
+	if (epoll_wait(ep, events, 2, 0) != 1)
+		errx(1, "epoll_wait: not level triggered");
+	read(fd[1][0], &c, 1);
+	if (epoll_wait(ep, events, 2, 0) != 0)
+		errx(1, "epoll_wait: drained pipe is ready");
+
+	/* A closed descriptor leaves the set. */
+	write(fd[1][1], &c, 1);
+	close(fd[1][0]);
+	if (epoll_wait(ep, events, 2, 0) != 0)
+		errx(1, "epoll_wait: closed pipe is reported");
+	if (epoll_ctl(ep, EPOLL_CTL_DEL, fd[0][0], NULL) < 0)
+		err(1, "epoll_ctl");
+	if (epoll_ctl(ep, EPOLL_CTL_DEL, fd[0][0], NULL) == 0)
+		errx(1, "epoll_ctl: deleted twice");
+
+	close(fd[0][0]);
+	close(fd[0][1]);
+	close(fd[1][1]);
+	close(ep);
+	printf("epoll: ok\n");
+}
+
+static void
+bench_epoll(void)
+{
+	struct epoll_event ev, events[NPIPES];
+	u_long start, end;
+	char c = 'e';
+	int fds[NPIPES][2];
+	int ep, i, n, got, round, nevents = 0;
+
+	if ((ep = epoll_create(NPIPES)) < 0)
+		err(1, "epoll_create");
+	for (i = 0; i < NPIPES; i++) {
+		if (pipe(fds[i]) < 0)
+			err(1, "pipe");
+		ev.events = EPOLLIN;
+		ev.data.fd = fds[i][0];
+		if (epoll_ctl(ep, EPOLL_CTL_ADD, fds[i][0], &ev) < 0)
+			err(1, "epoll_ctl");
+	}
+
+	sys_time(&start);
+	for (round = 0; round < NROUNDS; round++) {
+		for (i = 0; i < NPIPES; i++)
+			write(fds[i][1], &c, 1);
+		for (got = 0; got < NPIPES; got += n) {
+			n = epoll_wait(ep, events, NPIPES, INFTIM);
+			if (n <= 0)
+				err(1, "epoll_wait");
+			for (i = 0; i < n; i++)
+				read(events[i].data.fd, &c, 1);
+		}
+		nevents += got;
+	}
+	sys_time(&end);
+
+	for (i = 0; i < NPIPES; i++) {
+		close(fds[i][0]);
+		close(fds[i][1]);
+	}
+	close(ep);
+	if (end == start)
+		end++;
+	printf("epoll: %d events over %d pipes in %d msec, %d events/sec\n",
+	       nevents, NPIPES, msec(end - start),
+	       (int)((u_long)nevents * hz / (end - start)));
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct timerinfo info;
+
+	printf("poll test program\n");
+
+	sys_info(INFO_TIMER, &info);
+	if (info.hz == 0)
+		errx(1, "can not get timer tick rate");
+	hz = info.hz;
+
+	test_timeout();
+	test_ready();
+	test_select();
+	test_wakeup();
+	test_epoll();
+	bench_epoll();
+	return 0;
+}
@@ -0,0 +1,255 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * string.c - Check and measure the string functions
+ */
+
+#include <sys/prex.h>
+#include <sys/time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAXSIZE		(64 * 1024)	/* largest size to measure */
+#define TOTAL		(1024 * 1024)	/* bytes processed per measure */
+#define CHECKSIZE	80		/* sizes checked byte by byte */
+
+static char buf1[MAXSIZE + 64];
+static char buf2[MAXSIZE + 64];
+static char ref[MAXSIZE + 64];
+
+static const size_t sizes[] = {
+	16, 64, 256, 1024, 4096, 16384, MAXSIZE
+};
+#define NSIZES	(sizeof(sizes) / sizeof(sizes[0]))
+
+/*
+ * Read the cycle counter, or the uptime in nsec on processors
+ * without one.
+ */
+static u_long
+cycles(void)
+{
+#if defined(__x86__)
+	u_long lo, hi;
+
+	__asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+	return lo;
+#else
+	struct timespec ts;
+
+	sys_uptime(&ts);
+	return (u_long)ts.ts_sec * 1000000000 + (u_long)ts.ts_nsec;
+#endif
+}
+
+static void
+fill(char *p, size_t len, int seed)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		p[i] = (char)(i * 7 + seed + 1);
+}
+
+static void
+fail(const char *func, size_t off1, size_t off2, size_t len)
+{
+
+	printf("%s failed: offset %d/%d length %d\n", func,
+	       (int)off1, (int)off2, (int)len);
+	exit(1);
+}
+
+/*
+ * Compare the results with a byte by byte operation for all
+ * alignments and small lengths, and for overlapping moves.
+ */
+static void
+check(void)
+{
+	size_t i, j, len, n;
+	int r;
+
+	for (i = 0; i < 8; i++) {
+		for (j = 0; j < 8; j++) {
+			for (len = 0; len < CHECKSIZE; len++) {
+				fill(buf1, sizeof(buf1), 0);
+				fill(buf2, sizeof(buf2), 1);
+				memcpy(ref, buf2, sizeof(ref));
+				for (n = 0; n < len; n++)
+					ref[j + n] = buf1[i + n];
+				if (memcpy(buf2 + j, buf1 + i, len) != buf2 + j ||
+				    memcmp(buf2, ref, sizeof(ref)) != 0)
+					fail("memcpy", i, j, len);
+
+				fill(buf2, sizeof(buf2), 1);
+				memcpy(ref, buf2, sizeof(ref));
+				for (n = 0; n < len; n++)
+					ref[j + n] = 0x5a;
+				if (memset(buf2 + j, 0x5a, len) != buf2 + j ||
+				    memcmp(buf2, ref, sizeof(ref)) != 0)
+					fail("memset", i, j, len);
+
+				/* Move in both directions within buf2 */
+				fill(buf2, sizeof(buf2), 1);
+				memcpy(ref, buf2, sizeof(ref));
+				for (n = 0; n < len; n++)
+					ref[j + 16 + n] = buf2[i + n];
+				memmove(buf2 + j + 16, buf2 + i, len);
+				if (memcmp(buf2, ref, sizeof(ref)) != 0)
+					fail("memmove up", i, j, len);
+
+				fill(buf2, sizeof(buf2), 1);
+				memcpy(ref, buf2, sizeof(ref));
+				for (n = 0; n < len; n++)
+					ref[i + n] = buf2[j + 16 + n];
+				memmove(buf2 + i, buf2 + j + 16, len);
+				if (memcmp(buf2, ref, sizeof(ref)) != 0)
+					fail("memmove down", i, j, len);
+
+				memcpy(buf2 + j, buf1 + i, len);
+				if (len > 0) {
+					buf2[j + len - 1]++;
+					r = memcmp(buf1 + i, buf2 + j, len);
+					if (r >= 0)
+						fail("memcmp", i, j, len);
+					buf2[j + len - 1]--;
+				}
+				if (memcmp(buf1 + i, buf2 + j, len) != 0)
+					fail("memcmp", i, j, len);
+
+				memset(buf1 + i, 'a', len);
+				buf1[i + len] = '\0';
+				if (strlen(buf1 + i) != len)
+					fail("strlen", i, j, len);
+				if (len > j) {
+					buf1[i + j] = 'b';
+					if (strchr(buf1 + i, 'b') != buf1 + i + j)
+						fail("strchr", i, j, len);
+				}
+				if (strchr(buf1 + i, 'c') != NULL ||
+				    strchr(buf1 + i, '\0') != buf1 + i + len)
+					fail("strchr", i, j, len);
+			}
+		}
+	}
+	/* Large move overlapping by one byte */
+	fill(buf2, sizeof(buf2), 1);
+	memcpy(ref, buf2, sizeof(ref));
+	memmove(ref + 1, buf2, MAXSIZE);
+	memmove(buf2 + 1, buf2, MAXSIZE);
+	if (memcmp(buf2, ref, sizeof(ref)) != 0)
+		fail("memmove", 0, 1, MAXSIZE);
+	printf("check: ok\n");
+}
+
+static void
+report(const char *func, size_t size, u_long nbytes, u_long t)
+{
+
+	if (t == 0)
+		t = 1;
+#if defined(__x86__)
+	printf("%-8s %6d bytes: %3d.%02d bytes/cycle\n", func, (int)size,
+	       (int)(nbytes / t), (int)(nbytes % t * 100 / t));
+#else
+	printf("%-8s %6d bytes: %6d bytes/usec\n", func, (int)size,
+	       (int)(nbytes / (t / 1000 + 1)));
+#endif
+}
+
+/*
+ * Measure each function over TOTAL bytes for each size.
+ */
+static void
+bench(void)
+{
+	size_t size;
+	u_long t0, n, loops;
+	u_int i;
+	volatile size_t sum = 0;
+
+	for (i = 0; i < NSIZES; i++) {
+		size = sizes[i];
+		loops = TOTAL / size;
+
+		fill(buf1, size, 0);
+		t0 = cycles();
+		for (n = 0; n < loops; n++)
+			memcpy(buf2, buf1, size);
+		report("memcpy", size, TOTAL, cycles() - t0);
+
+		t0 = cycles();
+		for (n = 0; n < loops; n++)
+			memcpy(buf2 + 1, buf1 + 2, size);
+		report("memcpy/u", size, TOTAL, cycles() - t0);
+
+		t0 = cycles();
+		for (n = 0; n < loops; n++)
+			memmove(buf2 + 8, buf2, size);
+		report("memmove", size, TOTAL, cycles() - t0);
+
+		t0 = cycles();
+		for (n = 0; n < loops; n++)
+			memset(buf2, (int)n, size);
+		report("memset", size, TOTAL, cycles() - t0);
+
+		memcpy(buf2, buf1, size);
+		t0 = cycles();
+		for (n = 0; n < loops; n++)
+			sum += memcmp(buf1, buf2, size);
+		report("memcmp", size, TOTAL, cycles() - t0);
+
+		memset(buf1, 'a', size - 1);
+		buf1[size - 1] = '\0';
+		t0 = cycles();
+		for (n = 0; n < loops; n++)
+			sum += strlen(buf1);
+		report("strlen", size, TOTAL, cycles() - t0);
+
+		t0 = cycles();
+		for (n = 0; n < loops; n++)
+			sum += (size_t)strchr(buf1, 'b');
+		report("strchr", size, TOTAL, cycles() - t0);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	printf("string test\n");
+	check();
+	bench();
+	printf("test completed\n");
+	return 0;
+}
@@ -32,13 +32,158 @@
  */
 
 #include <sys/prex.h>
+#include <sys/sysinfo.h>
+#include <sys/time.h>
 #include <stdio.h>
 
+#define NR_SHORT	64	/* threads with short timers */
+#define NR_LONG		32	/* threads with long timers */
+#define STORM_TIME	5000	/* benchmark time in msec */
+#define STACK_SIZE	1024
+
+static char stack[NR_SHORT + NR_LONG][STACK_SIZE];
+static thread_t threads[NR_SHORT + NR_LONG];
+static volatile u_long fired;
+
+/*
+ * Sleep with short timeout repeatedly.
+ */
+static void
+short_thread(void)
+{
+	u_long msec;
+
+	msec = (u_long)(thread_self() % 10) + 1;
+	for (;;) {
+		timer_sleep(msec, 0);
+		fired++;
+	}
+}
+
+/*
+ * Keep long timers in the upper wheels.
+ */
+static void
+long_thread(void)
+{
+
+	for (;;)
+		timer_sleep(60 * 1000, 0);
+}
+
+static void
+thread_run(int i, void (*start)(void))
+{
+
+	if (thread_create(task_self(), &threads[i]) != 0)
+		panic("thread_create is failed");
+	if (thread_load(threads[i], start, stack[i] + STACK_SIZE) != 0)
+		panic("thread_load is failed");
+	if (thread_resume(threads[i]) != 0)
+		panic("thread_resume is failed");
+}
+
+/*
+ * Timer storm benchmark.
+ *
+ * Many threads sleep with short timeouts while other timers
+ * are pending. Report the number of expired timers and the
+ * idle time. The idle time is reduced by the cost to handle
+ * the timers in the clock interrupt.
+ */
+static void
+timer_storm(void)
+{
+	struct timerinfo t0, t1;
+	u_long ticks, idle;
+	int i;
+
+	printf("Timer storm benchmark\n");
+
+	for (i = 0; i < NR_LONG; i++)
+		thread_run(NR_SHORT + i, long_thread);
+	for (i = 0; i < NR_SHORT; i++)
+		thread_run(i, short_thread);
+
+	sys_info(INFO_TIMER, &t0);
+	fired = 0;
+	timer_sleep(STORM_TIME, 0);
+	sys_info(INFO_TIMER, &t1);
+
+	for (i = 0; i < NR_SHORT + NR_LONG; i++)
+		thread_terminate(threads[i]);
+
+	ticks = t1.cputicks - t0.cputicks;
+	idle = t1.idleticks - t0.idleticks;
+	if (ticks == 0)
+		ticks = 1;
+	printf("%d timers fired in %d msec, %d timers/sec\n",
+	       (int)fired, (int)(ticks * 1000 / t1.hz),
+	       (int)(fired * t1.hz / ticks));
+	printf("%d active timers, %d cascaded, idle %d%%\n",
+	       (int)t1.ntimers, (int)(t1.cascades - t0.cascades),
+	       (int)(idle * 100 / ticks));
+}
+
+/*
+ * Return the interrupt count of the clock (IRQ 0).
+ */
+static u_int
+clock_count(void)
+{
+	struct irqinfo info;
+
+	info.cookie = 0;
+	while (sys_info(INFO_IRQ, &info) == 0) {
+		if (info.vector == 0)
+			return info.count;
+	}
+	return 0;
+}
+
+/*
+ * Check the clock interrupts while the system is idle, and
+ * the resolution of the uptime clock.
+ *
+ * With a tickless kernel, the clock interrupts during an
+ * idle sleep should be much less than the ticks.
+ */
+static void
+tickless_test(void)
+{
+	struct timespec ts0, ts1;
+	u_int c0, c1;
+	long nsec, min;
+	int i;
+
+	printf("Tickless test\n");
+
+	c0 = clock_count();
+	timer_sleep(1000, 0);
+	c1 = clock_count();
+	printf("%d clock interrupts in idle 1000 msec\n", (int)(c1 - c0));
+
+	min = 1000000000;
+	for (i = 0; i < 1000; i++) {
+		sys_uptime(&ts0);
+		sys_uptime(&ts1);
+		nsec = (ts1.ts_sec - ts0.ts_sec) * 1000000000 +
+		    ts1.ts_nsec - ts0.ts_nsec;
+		if (nsec > 0 && nsec < min)
+			min = nsec;
+	}
+	printf("uptime %d.%09d sec, resolution %d nsec\n",
+	       (int)ts1.ts_sec, (int)ts1.ts_nsec, (int)min);
+}
+
 int
 main(int argc, char *argv[])
 {
 	printf("Timer Test program\n");
 
+	timer_storm();
+	tickless_test();
+
 	printf("Sleep 5000 msec...\n");
 	timer_sleep(5000, 0);
 	printf("Wake!\n");
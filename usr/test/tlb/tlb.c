@@ -0,0 +1,109 @@
+/*-
+ * Copyright (c) 2011, Sheng-Yu Chiu
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of any co-contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * tlb.c - TLB pressure benchmark
+ */
+
+#include <sys/prex.h>
+#include <sys/param.h>
+#include <sys/sysinfo.h>
+#include <stdio.h>
+
+#define NR_PAGES	64		/* pages in the working set */
+#define BENCH_LOOPS	20000		/* map/unmap count */
+
+static volatile char *work;
+
+/*
+ * Touch all pages in the working set.
+ */
+static int
+touch_pages(void)
+{
+	int i, sum = 0;
+
+	for (i = 0; i < NR_PAGES; i++)
+		sum += work[i * PAGE_SIZE];
+	return sum;
+}
+
+/*
+ * Map and unmap one page in a loop while the working set is
+ * accessed. When the whole TLB is flushed at each mapping, all
+ * pages of the working set miss TLB in every loop.
+ */
+static void
+map_loop(size_t size)
+{
+	struct timerinfo t0, t1;
+	u_long ticks;
+	void *p;
+	int i;
+
+	sys_info(INFO_TIMER, &t0);
+	for (i = 0; i < BENCH_LOOPS; i++) {
+		if (vm_allocate(task_self(), &p, size, 1) != 0)
+			panic("vm_allocate is failed");
+		*(volatile char *)p = 1;
+		vm_free(task_self(), p);
+		touch_pages();
+	}
+	sys_info(INFO_TIMER, &t1);
+
+	ticks = t1.cputicks - t0.cputicks;
+	if (ticks == 0)
+		ticks = 1;
+	printf("map/unmap %3dKB: %d loops in %d msec, %d loops/sec\n",
+	       (int)(size / 1024), BENCH_LOOPS,
+	       (int)(ticks * 1000 / t1.hz),
+	       (int)((u_long)BENCH_LOOPS * t1.hz / ticks));
+}
+
+int
+main(int argc, char *argv[])
+{
+	void *p;
+	int i;
+
+	printf("TLB benchmark\n");
+
+	if (vm_allocate(task_self(), &p, NR_PAGES * PAGE_SIZE, 1) != 0)
+		panic("vm_allocate is failed");
+	work = p;
+	for (i = 0; i < NR_PAGES; i++)
+		work[i * PAGE_SIZE] = 0;
+
+	map_loop(PAGE_SIZE);
+	map_loop(PAGE_SIZE * 16);
+	map_loop(PAGE_SIZE * 64);
+
+	vm_free(task_self(), p);
+	return 0;
+}